@@ -1632,6 +1632,9 @@ static SANE_Bool force_a3 = SANE_FALSE;
 /* trust ADF-presence flag, even if ADF model is nonzero */
 static SANE_Bool skip_adf = SANE_FALSE;
 
+/* memory for the rear page of duplex scans, above it a file is used */
+static size_t duplex_rear_memory = 128 * 1024 * 1024;
+
 /* hardware resolutions to interpolate from */
 static const int  hw_res_list_c5[] =
   {
@@ -2688,47 +2691,81 @@ write_usb_cmd:
   } /* end cmd usb */
 }
 
-/* A bubble sort for the calibration. It only sorts the first third
- * and returns an average of the top 2/3 values. The input data is
- * 16bit big endian and the count is the count of the words - not
- * bytes! */
+/* Selection for the calibration: partially orders the count values so
+ * that the first k of them are the k smallest, in linear average time.
+ * Equal values are grouped, as calibration data has many of them. */
 
-static uint16_t
-bubble_sort (uint8_t* sort_data, size_t count)
+static void
+select_smallest (uint16_t* v, size_t count, size_t k)
 {
-  size_t i, j, limit, k;
-  double sum = 0.0;
+  size_t lo = 0, hi = count;
+  size_t i, lt, gt;
+  uint16_t pivot, t;
 
-  limit = count / 3;
+  if (k == 0 || k >= count)
+    return;
 
-  for (i = 0; i < limit; ++i)
+  while (hi - lo > 16)
     {
-      uint16_t ti = 0;
-      uint16_t tj = 0;
+      uint16_t a = v[lo], b = v[lo + (hi - lo) / 2], c = v[hi - 1];
 
-      for (j = (i + 1); j < count; ++j)
-	{
-	  ti = (uint16_t) get_double ((sort_data + i*2));
-	  tj = (uint16_t) get_double ((sort_data + j*2));
+      /* median of three */
+      if (a > b) { t = a; a = b; b = t; }
+      if (b > c) { b = c; }
+      pivot = (a > b) ? a : b;
 
-	  if (ti > tj) {
-	    set_double ((sort_data + i*2), tj);
-	    set_double ((sort_data + j*2), ti);
+      /* [lo, lt) < pivot, [lt, gt) == pivot, [gt, hi) > pivot */
+      lt = i = lo;
+      gt = hi;
+      while (i < gt)
+	{
+	  if (v[i] < pivot) {
+	    t = v[i]; v[i++] = v[lt]; v[lt++] = t;
+	  }
+	  else if (v[i] > pivot) {
+	    t = v[i]; v[i] = v[--gt]; v[gt] = t;
 	  }
+	  else
+	    ++i;
 	}
+
+      if (k < lt)
+	hi = lt;
+      else if (k > gt)
+	lo = gt;
+      else
+	return;
     }
 
-  for (k = 0, i = limit; i < count; ++i) {
-    sum += get_double ((sort_data + i*2));
-    ++ k;
-  }
+  /* few values left, sort them */
+  for (i = lo + 1; i < hi; ++i)
+    {
+      size_t j = i;
+      t = v[i];
+      for (; j > lo && v[j - 1] > t; --j)
+	v[j] = v[j - 1];
+      v[j] = t;
+    }
+}
 
-  /* DBG (7, "bubble_sort: %d values for average\n", k); */
+/* Returns the average of the top 2/3 values of a calibration column,
+ * without the lowest third. The values are reordered. */
 
-  if (k > 0) /* if avg to compute */
-    return (uint16_t) (sum /(double) k);
-  else
-    return (uint16_t) (sum); /* always zero? */
+static uint16_t
+average_top_values (uint16_t* v, size_t count)
+{
+  size_t i, limit = count / 3;
+  uint32_t sum = 0;
+
+  if (count == 0)
+    return 0;
+
+  select_smallest (v, count, limit);
+
+  for (i = limit; i < count; ++i)
+    sum += v[i];
+
+  return (uint16_t) (sum / (count - limit));
 }
 
 static SANE_Status
@@ -5412,23 +5449,31 @@ set_calib_data (Avision_Scanner* s, struct calibration_format* format,
    That is a = b[1] << 8 + b[0] in all system.
 
    We convert it to SCSI high-endian (big-endian) since we use it all
-   over the place anyway .... - Sorry for this mess. */
+   over the place anyway .... - Sorry for this mess.
+
+   The lines are read in blocks of columns, which are kept in native
+   endianness column by column for the selection. */
+
+#define SORT_BLOCK_COLUMNS 64
 
 static uint8_t*
 sort_and_average (struct calibration_format* format, uint8_t* data)
 {
-  const size_t elements_per_line = format->pixel_per_line * format->channels;
-  const size_t stride = format->bytes_per_channel * elements_per_line;
-  size_t i, line;
+  size_t elements_per_line, stride;
+  size_t i, j, line, block;
 
-  uint8_t *sort_data, *avg_data;
+  uint16_t *sort_data;
+  uint8_t *avg_data;
 
   DBG (1, "sort_and_average:\n");
 
   if (!format || !data)
     return NULL;
 
-  sort_data = malloc (format->lines * 2);
+  elements_per_line = format->pixel_per_line * format->channels;
+  stride = format->bytes_per_channel * elements_per_line;
+
+  sort_data = malloc (SORT_BLOCK_COLUMNS * format->lines * sizeof (uint16_t));
   if (!sort_data)
     return NULL;
 
@@ -5438,27 +5483,30 @@ sort_and_average (struct calibration_format* format, uint8_t* data)
     return NULL;
   }
 
-  /* for each pixel */
-  for (i = 0; i < elements_per_line; ++ i)
+  for (i = 0; i < elements_per_line; i += block)
     {
-      uint8_t* ptr1 = data + i * format->bytes_per_channel;
-      uint16_t temp;
+      block = elements_per_line - i;
+      if (block > SORT_BLOCK_COLUMNS)
+	block = SORT_BLOCK_COLUMNS;
 
-      /* copy all lines for pixel i into the linear array sort_data */
+      /* copy the lines of pixels i .. i + block - 1 into one column each */
       for (line = 0; line < format->lines; ++ line) {
-	uint8_t* ptr2 = ptr1 + line * stride; /* pixel */
+	uint8_t* ptr = data + line * stride + i * format->bytes_per_channel;
 
 	if (format->bytes_per_channel == 1)
-	  temp = 0xffff * *ptr2 / 255;
+	  for (j = 0; j < block; ++ j)
+	    sort_data[j * format->lines + line] = 0xffff * ptr[j] / 255;
 	else
-	  temp = get_double_le (ptr2);	  /* little-endian! */
-	set_double ((sort_data + line*2), temp); /* store big-endian */
-	/* DBG (7, "ReneR to sort: %x\n", temp); */
+	  for (j = 0; j < block; ++ j)	  /* little-endian! */
+	    sort_data[j * format->lines + line] =
+	      ptr[j * 2] | (ptr[j * 2 + 1] << 8);
       }
 
-      temp = bubble_sort (sort_data, format->lines);
-      /* DBG (7, "ReneR averaged: %x\n", temp); */
-      set_double ((avg_data + i*2), temp); /* store big-endian */
+      for (j = 0; j < block; ++ j) {
+	uint16_t temp = average_top_values (sort_data + j * format->lines,
+					    format->lines);
+	set_double ((avg_data + (i + j) * 2), temp); /* store big-endian */
+      }
     }
 
   free ((void *) sort_data);
@@ -7387,6 +7435,185 @@ init_options (Avision_Scanner* s)
   return SANE_STATUS_GOOD;
 }
 
+/* The rear page of duplex scans is stored between two runs of the
+   reader, in memory while it fits into duplex_rear_memory and in the
+   duplex rear file above that. Memory is only used with threads, as a
+   forked reader can not pass it on to the next one.
+
+   When reading it back the lines can be returned last to first, for
+   scanners flipping the page. */
+
+typedef struct rear_buffer
+{
+  Avision_Scanner* s;
+  FILE* fp;             /* rear file, or NULL while in memory */
+  size_t alloc;         /* bytes allocated for s->duplex_rear_data */
+  size_t pos;           /* bytes read back */
+  size_t size;          /* bytes to read back from the rear file */
+  size_t line_size;
+  SANE_Bool reading;    /* opened to read the stored page back */
+  SANE_Bool reverse;    /* read the lines last to first */
+} rear_buffer;
+
+static void
+rear_buffer_free_data (Avision_Scanner* s)
+{
+  free (s->duplex_rear_data);
+  s->duplex_rear_data = NULL;
+  s->duplex_rear_size = 0;
+  s->duplex_rear_in_memory = SANE_FALSE;
+}
+
+static SANE_Status
+rear_buffer_open_write (rear_buffer* rb, Avision_Scanner* s)
+{
+  memset (rb, 0, sizeof (*rb));
+  rb->s = s;
+  rear_buffer_free_data (s);
+
+  if (duplex_rear_memory > 0 && !sanei_thread_is_forked ()) {
+    DBG (3, "rear_buffer_open_write: keeping duplex rear data in memory.\n");
+    s->duplex_rear_in_memory = SANE_TRUE;
+    return SANE_STATUS_GOOD;
+  }
+
+  DBG (3, "reader_process: opening duplex rear file for writing.\n");
+  rb->fp = fopen (s->duplex_rear_fname, "w");
+  return rb->fp ? SANE_STATUS_GOOD : SANE_STATUS_IO_ERROR;
+}
+
+static SANE_Status
+rear_buffer_write (rear_buffer* rb, const uint8_t* data, size_t len)
+{
+  Avision_Scanner* s = rb->s;
+
+  if (!rb->fp && s->duplex_rear_size + len <= duplex_rear_memory)
+    {
+      if (s->duplex_rear_size + len > rb->alloc) {
+	size_t alloc = rb->alloc ? rb->alloc * 2 : 0x100000;
+	uint8_t* p;
+
+	while (alloc < s->duplex_rear_size + len)
+	  alloc *= 2;
+	if (alloc > duplex_rear_memory)
+	  alloc = duplex_rear_memory;
+	p = realloc (s->duplex_rear_data, alloc);
+	if (!p)
+	  goto spill;
+	s->duplex_rear_data = p;
+	rb->alloc = alloc;
+      }
+      memcpy (s->duplex_rear_data + s->duplex_rear_size, data, len);
+      s->duplex_rear_size += len;
+      return SANE_STATUS_GOOD;
+    }
+
+ spill:
+  if (!rb->fp)
+    {
+      DBG (3, "rear_buffer_write: %lu bytes over the memory budget, "
+	   "moving the rear data to the duplex rear file.\n",
+	   (u_long) (s->duplex_rear_size + len));
+      rb->fp = fopen (s->duplex_rear_fname, "w");
+      if (!rb->fp)
+	return SANE_STATUS_IO_ERROR;
+      if (s->duplex_rear_size > 0 &&
+	  fwrite (s->duplex_rear_data, s->duplex_rear_size, 1, rb->fp) != 1)
+	return SANE_STATUS_IO_ERROR;
+      rear_buffer_free_data (s);
+      rb->alloc = 0;
+    }
+  if (len > 0 && fwrite (data, len, 1, rb->fp) != 1)
+    return SANE_STATUS_IO_ERROR;
+  return SANE_STATUS_GOOD;
+}
+
+static SANE_Status
+rear_buffer_open_read (rear_buffer* rb, Avision_Scanner* s,
+		       SANE_Bool reverse, size_t line_size)
+{
+  long size;
+
+  memset (rb, 0, sizeof (*rb));
+  rb->s = s;
+  rb->reading = SANE_TRUE;
+  rb->reverse = reverse;
+  rb->line_size = line_size;
+
+  /* the page may be empty, the rear file then holds an older one */
+  if (s->duplex_rear_in_memory) {
+    DBG (3, "rear_buffer_open_read: reading duplex rear data from memory.\n");
+    rb->size = s->duplex_rear_size;
+    return SANE_STATUS_GOOD;
+  }
+
+  DBG (3, "reader_process: opening duplex rear file for reading.\n");
+  rb->fp = fopen (s->duplex_rear_fname, "r");
+  if (!rb->fp)
+    return SANE_STATUS_IO_ERROR;
+  if (fseek (rb->fp, 0, SEEK_END) != 0 || (size = ftell (rb->fp)) < 0) {
+    fclose (rb->fp);
+    rb->fp = NULL;
+    return SANE_STATUS_IO_ERROR;
+  }
+  rb->size = (size_t) size;
+  rewind (rb->fp);
+  return SANE_STATUS_GOOD;
+}
+
+/* Returns up to len bytes of the stored data, in line order or last line
+   first. */
+static size_t
+rear_buffer_read (rear_buffer* rb, uint8_t* dst, size_t len)
+{
+  size_t done = 0;
+
+  if (len > rb->size - rb->pos)
+    len = rb->size - rb->pos;
+
+  while (done < len)
+    {
+      size_t src = rb->pos, n = len - done, got;
+
+      if (rb->reverse) {
+	size_t lines = rb->size / rb->line_size;
+	size_t line = rb->pos / rb->line_size;
+	size_t offset = rb->pos % rb->line_size;
+
+	if (line >= lines)
+	  break;
+	src = (lines - 1 - line) * rb->line_size + offset;
+	if (n > rb->line_size - offset)
+	  n = rb->line_size - offset;
+      }
+
+      if (!rb->fp)
+	memcpy (dst + done, rb->s->duplex_rear_data + src, n);
+      else {
+	if ((rb->reverse || done == 0) &&
+	    fseek (rb->fp, (long) src, SEEK_SET) != 0)
+	  break;
+	got = fread (dst + done, 1, n, rb->fp);
+	if (got != n) {
+	  done += got;
+	  rb->pos += got;
+	  break;
+	}
+      }
+      done += n;
+      rb->pos += n;
+    }
+  return done;
+}
+
+static void
+rear_buffer_close (rear_buffer* rb)
+{
+  if (rb->fp)
+    fclose (rb->fp);
+  rb->fp = NULL;
+}
+
 /* This function is executed as a child process. The reason this is
    executed as a subprocess is because some (most?) generic SCSI
    interfaces block a SCSI request until it has completed. With a
@@ -7415,7 +7642,9 @@ reader_process (void *data)
 
   FILE* fp;
   FILE* fp_fd = 0; /* for ADF bottom offset truncating */
-  FILE* rear_fp = 0; /* used to store the deinterlaced rear data */
+  rear_buffer rear; /* used to store the deinterlaced rear data */
+  SANE_Bool rear_open = SANE_FALSE;
+  SANE_Bool flipped_rear; /* rear page of a page-flipping duplex scan */
   FILE* raw_fp = 0; /* used to write the RAW image data for debugging */
 
   /* the complex params */
@@ -7480,6 +7709,8 @@ reader_process (void *data)
 #endif
 
   gray_mode = color_mode_is_shaded (s->c_mode);
+  flipped_rear = (dev->hw->feature_type & AV_ADF_FLIPPING_DUPLEX) &&
+    s->source_mode == AV_ADF_DUPLEX && !(s->page % 2);
 
   if (s->avdimen.interlaced_duplex) {
     deinterlace = STRIPE;
@@ -7562,22 +7793,20 @@ reader_process (void *data)
     }
 
   /* setup file i/o for deinterlacing scans or if we are the back page with a flipping duplexer */
-  if (deinterlace != NONE ||
-     (dev->hw->feature_type & AV_ADF_FLIPPING_DUPLEX && s->source_mode == AV_ADF_DUPLEX && !(s->page % 2)))
+  if (deinterlace != NONE || flipped_rear)
     {
-      if (!s->duplex_rear_valid) { /* create new file for writing */
-	DBG (3, "reader_process: opening duplex rear file for writing.\n");
-	rear_fp = fopen (s->duplex_rear_fname, "w");
-      }
-      else { /* open saved rear data */
-	DBG (3, "reader_process: opening duplex rear file for reading.\n");
-	rear_fp = fopen (s->duplex_rear_fname, "r");
-      }
-      if (! rear_fp) {
+      if (!s->duplex_rear_valid) /* store new rear data */
+	status = rear_buffer_open_write (&rear, s);
+      else /* open saved rear data, a flipped page last line first */
+	status = rear_buffer_open_read (&rear, s, deinterlace == NONE,
+					(size_t) s->avdimen.hw_bytes_per_line);
+      if (status != SANE_STATUS_GOOD) {
 	fclose (fp);
-	fclose (fp_fd);
+	if (fp_fd)
+	  fclose (fp_fd);
 	return SANE_STATUS_IO_ERROR;
       }
+      rear_open = SANE_TRUE;
     }
 
   /* it takes quite a few lines to saturate the (USB) bus */
@@ -7755,7 +7984,7 @@ reader_process (void *data)
 	       (u_long) processed_bytes, (u_long) total_size);
 	  DBG (5, "reader_process: virtual this_read: %lu\n", (u_long) this_read);
 
-	  got = fread (stripe_data + stripe_fill, 1, this_read, rear_fp);
+	  got = rear_buffer_read (&rear, stripe_data + stripe_fill, this_read);
 	  stripe_fill += (unsigned int) got;
 	  processed_bytes += got;
 	  if (got != this_read)
@@ -7788,8 +8017,9 @@ reader_process (void *data)
 		   (deinterlace == HALF   && absline >= total_size / (size_t) s->avdimen.hw_bytes_per_line / 2) ||
 		   (deinterlace == LINE   && (absline & 0x1)) ) /* last bit equals % 2 */
 		{
-		  DBG (9, "reader_process: saving rear line %d to temporary file.\n", absline);
-		  fwrite (ptr, (size_t) s->avdimen.hw_bytes_per_line, 1, rear_fp);
+		  DBG (9, "reader_process: saving rear line %d.\n", absline);
+		  if (rear_buffer_write (&rear, ptr, (size_t) s->avdimen.hw_bytes_per_line) != SANE_STATUS_GOOD)
+		    exit_status = SANE_STATUS_IO_ERROR;
 		  if (deinterlace == LINE)
 		    memmove (ptr, ptr+s->avdimen.hw_bytes_per_line,
 			     (size_t) (stripe_data + stripe_fill - ptr - s->avdimen.hw_bytes_per_line));
@@ -7804,18 +8034,15 @@ reader_process (void *data)
 	  DBG (9, "reader_process: after deinterlacing: useful_bytes: %d, stripe_fill: %d\n",
 	       useful_bytes, stripe_fill);
 	}
-      if ((dev->hw->feature_type & AV_ADF_FLIPPING_DUPLEX) && s->source_mode == AV_ADF_DUPLEX && !(s->page % 2) && !s->duplex_rear_valid) {
-        /* Here we flip the image by writing the lines from the end of the file to the beginning. */
-	unsigned int absline = (unsigned int) ((processed_bytes - stripe_fill) / (size_t) s->avdimen.hw_bytes_per_line);
-	unsigned int abslines = absline + useful_bytes / (unsigned int) s->avdimen.hw_bytes_per_line;
-	uint8_t* ptr = stripe_data;
-	for ( ; absline < abslines; ++absline) {
-          fseek (rear_fp, ((0 - s->params.lines) - (SANE_Int) absline - 2) * s->avdimen.hw_bytes_per_line, SEEK_SET);
-          fwrite (ptr, (size_t) s->avdimen.hw_bytes_per_line, 1, rear_fp);
-          useful_bytes -= (unsigned int) s->avdimen.hw_bytes_per_line;
-          stripe_fill -= (unsigned int) s->avdimen.hw_bytes_per_line;
-          ptr += s->avdimen.hw_bytes_per_line;
-        }
+      if (flipped_rear && !s->duplex_rear_valid) {
+        /* Here we store the lines, they are read back last line first to
+           flip the image. */
+	unsigned int bytes = useful_bytes - useful_bytes % (unsigned int) s->avdimen.hw_bytes_per_line;
+
+	if (rear_buffer_write (&rear, stripe_data, bytes) != SANE_STATUS_GOOD)
+	  exit_status = SANE_STATUS_IO_ERROR;
+	useful_bytes -= bytes;
+	stripe_fill -= bytes;
 	DBG (9, "reader_process: after page flip: useful_bytes: %d, stripe_fill: %d\n",
 	       useful_bytes, stripe_fill);
       } else {
@@ -8268,8 +8495,12 @@ reader_process (void *data)
   } else {
     fclose (fp);
   }
-  if (rear_fp)
-    fclose (rear_fp);
+  if (rear_open) {
+    rear_buffer_close (&rear);
+    /* the stored rear page was scanned */
+    if (rear.reading)
+      rear_buffer_free_data (s);
+  }
 
   if (fp_fd)
     fclose(fp_fd);
@@ -8394,6 +8625,19 @@ sane_reload_devices (void)
 		     linenumber);
 		skip_adf = SANE_TRUE;
 	      }
+	      else if (strcmp (word, "duplex-memory") == 0) {
+		free (word);
+		word = NULL;
+		cp = sanei_config_get_string (cp, &word);
+		if (word && word[0] >= '0' && word[0] <= '9') {
+		  duplex_rear_memory = (size_t) strtoul (word, NULL, 10) * 1024 * 1024;
+		  DBG (3, "sane_reload_devices: config file line %d: duplex-memory %s MiB\n",
+		       linenumber, word);
+		}
+		else
+		  DBG (1, "sane_reload_devices: config file line %d: duplex-memory needs a size in MiB\n",
+		       linenumber);
+	      }
 	      else if (strcmp (word, "static-red-calib") == 0) {
 		DBG (3, "sane_reload_devices: config file line %d: static red calibration\n",
 		     linenumber);
@@ -8789,6 +9033,7 @@ sane_close (SANE_Handle handle)
     unlink (s->duplex_rear_fname);
     *(s->duplex_rear_fname) = 0;
   }
+  free (s->duplex_rear_data);
 
   free (handle);
 }
@@ -503,6 +503,9 @@ typedef struct Avision_Scanner
   /* Internal data for duplex scans */
   char duplex_rear_fname [PATH_MAX];
   SANE_Bool duplex_rear_valid;
+  SANE_Bool duplex_rear_in_memory; /* rear page kept in memory */
+  uint8_t* duplex_rear_data;	/* the page, NULL while empty */
+  size_t duplex_rear_size;	/* bytes of it */
 
   color_mode c_mode;
   source_mode source_mode;
@@ -359,6 +359,15 @@
          - add support for reading the total and roller counters
       v64 2022-11-18, CQ, MAN
          - add complete support for imprinters on X10C (#585)
+      v65 2026-10-18
+         - do software deskew and despeck as the image arrives,
+           instead of buffering the whole page first
+         - swskip fully buffers the image on its own
+      v66 2026-10-18
+         - check swskip blankness as the image arrives
+      v67 2026-10-18
+         - images without software processing stream through a ring
+           of two read blocks, instead of a buffer for the whole page
 
    SANE FLOW DIAGRAM
 
@@ -411,7 +420,7 @@
 #include "canon_dr.h"
 
 #define DEBUG 1
-#define BUILD 64
+#define BUILD 67
 
 /* values for SANE_DEBUG_CANON_DR env var:
  - errors           5
@@ -5457,8 +5466,8 @@ sane_start (SANE_Handle handle)
       goto errors;
     }
 
-    /* make large buffers to hold the images */
-    ret = image_buffers(s,1);
+    /* make buffers to hold or stream the images */
+    ret = image_buffers(s,2);
     if (ret != SANE_STATUS_GOOD) {
       DBG (5, "sane_start: ERROR: cannot load buffers\n");
       goto errors;
@@ -5588,6 +5597,17 @@ sane_start (SANE_Handle handle)
    * tell the user the size of the image. the sane
    * API has no way to inform the frontend of this,
    * so we block and buffer. yuck */
+
+  /* deskew, despeck and blank detection run on the image as it arrives,
+   * even if we also have to buffer all of it */
+  if(must_band_process(s)){
+    buffer_band_start(s,s->side);
+  }
+  else if(s->bands[s->side]){
+    sanei_magic_bandFinish(s->bands[s->side]);
+    s->bands[s->side] = NULL;
+  }
+
   if(must_fully_buffer(s)){
 
     /* get image */
@@ -5605,13 +5625,13 @@ sane_start (SANE_Handle handle)
     DBG (5, "sane_start: OK: done buffering\n");
 
     /* finished buffering, adjust image as required */
-    if(s->swdeskew){
+    if(s->swdeskew && !s->bands[s->side]){
       buffer_deskew(s,s->side);
     }
     if(s->swcrop){
       buffer_crop(s,s->side);
     }
-    if(s->swdespeck){
+    if(s->swdespeck && !s->bands[s->side]){
       buffer_despeck(s,s->side);
     }
     if(s->swskip){
@@ -5701,6 +5721,8 @@ clean_params (struct scanner *s)
 
 /*
  * frees/callocs buffers to hold the scan data
+ * setup 1 makes buffers for the whole images, setup 2 only for those
+ * that must_buffer_side(), the others get a ring of two read blocks
  */
 static SANE_Status
 image_buffers (struct scanner *s, int setup)
@@ -5712,16 +5734,42 @@ image_buffers (struct scanner *s, int setup)
 
   for(side=0;side<2;side++){
 
+    if (s->bands[side]) {
+      sanei_magic_bandFinish(s->bands[side]);
+      s->bands[side] = NULL;
+    }
+
     /* free current buffer */
     if (s->buffers[side]) {
       DBG (15, "image_buffers: free buffer %d.\n",side);
       free(s->buffers[side]);
       s->buffers[side] = NULL;
     }
+    s->buffer_len[side] = 0;
+    s->buffer_block[side] = 0;
 
     /* build new buffer if asked */
     if(s->i.bytes_tot[side] && setup){
-      s->buffers[side] = calloc (1,s->i.bytes_tot[side]);
+
+      int len = s->i.bytes_tot[side];
+      int block = s->buffer_size / s->s.Bpl * s->i.Bpl;
+
+      if(s->s.format == SANE_FRAME_JPEG){
+        block = s->buffer_size;
+      }
+
+      /* one block can arrive while the frontend reads the other */
+      if(setup > 1 && !must_buffer_side(s,side)
+        && block > 0 && 2 * block < len){
+        len = 2 * block;
+      }
+
+      DBG (15, "image_buffers: side %d, %d of %d bytes.\n",
+        side, len, s->i.bytes_tot[side]);
+
+      s->buffer_len[side] = len;
+      s->buffer_block[side] = block;
+      s->buffers[side] = calloc (1,len);
       if (!s->buffers[side]) {
         DBG (5, "image_buffers: Error, no buffer %d.\n",side);
         return SANE_STATUS_NO_MEM;
@@ -6007,7 +6055,8 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len, SANE_Int * len
   ){
 
     /* buffer both sides */
-    if(!s->s.eof[SIDE_FRONT] || !s->s.eof[SIDE_BACK]){
+    if((!s->s.eof[SIDE_FRONT] || !s->s.eof[SIDE_BACK])
+      && buffer_has_room(s,SIDE_FRONT) && buffer_has_room(s,SIDE_BACK)){
       ret = read_from_scanner_duplex(s, 0);
       if(ret){
         DBG(5,"sane_read: front returning %d\n",ret);
@@ -6023,7 +6072,7 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len, SANE_Int * len
 
   /* simplex or non-alternating duplex */
   else{
-    if(!s->s.eof[s->side]){
+    if(!s->s.eof[s->side] && buffer_has_room(s,s->side)){
       ret = read_from_scanner(s, s->side, 0);
       if(ret){
         DBG(5,"sane_read: side %d returning %d\n",s->side,ret);
@@ -6037,6 +6086,16 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len, SANE_Int * len
     }
   }
 
+  /* the background for a short image, as far as the ring has room */
+  if(s->s.eof[s->side] && s->i.bytes_sent[s->side] < s->i.bytes_tot[s->side]){
+    fill_image(s,s->side);
+  }
+
+  /* deskew and despeck the lines that have arrived */
+  if(s->bands[s->side]){
+    buffer_band(s,s->side);
+  }
+
   /* copy a block from buffer to frontend */
   ret = read_from_buffer(s,buf,max_len,len,s->side);
   if(ret)
@@ -6368,8 +6427,7 @@ copy_simplex(struct scanner *s, unsigned char * buf, int len, int side)
   /* jpeg data should not pass thru this function, so copy and bail out */
   if(s->s.format > SANE_FRAME_RGB){
     DBG (15, "copy_simplex: jpeg bulk copy\n");
-    memcpy(s->buffers[side]+s->i.bytes_sent[side], buf, len);
-    s->i.bytes_sent[side] += len;
+    buffer_put(s, side, buf, len);
     s->s.bytes_sent[side] += len;
     return ret;
   }
@@ -6756,8 +6814,7 @@ copy_line(struct scanner *s, unsigned char * buff, int side)
     && s->s.mode == s->i.mode
   ){
 
-    memcpy(s->buffers[side]+s->i.bytes_sent[side], buff, sbwidth);
-    s->i.bytes_sent[side] += sbwidth;
+    buffer_put(s, side, buff, sbwidth);
 
     DBG (20, "copy_line: finished smart\n");
     return ret;
@@ -6858,19 +6915,19 @@ copy_line(struct scanner *s, unsigned char * buff, int side)
   }
 
   /* change mode, store line in buffer */
+  /* gray and lineart are made in place, each byte from later ones */
   switch (s->i.mode) {
 
     case MODE_COLOR:
-      memcpy(s->buffers[side]+s->i.bytes_sent[side], line+(offset*3), ibwidth);
-      s->i.bytes_sent[side] += ibwidth;
+      buffer_put(s, side, line+(offset*3), ibwidth);
       break;
 
     case MODE_GRAYSCALE:
       for(i=0;i<ibwidth;i++){
         int source = (offset+i)*3;
-        s->buffers[side][s->i.bytes_sent[side]++]
-          = ((int)line[source] + line[source+1] + line[source+2])/3;
+        line[i] = ((int)line[source] + line[source+1] + line[source+2])/3;
       }
+      buffer_put(s, side, line, ibwidth);
       break;
 
     default:
@@ -6888,8 +6945,9 @@ copy_line(struct scanner *s, unsigned char * buff, int side)
           }
         }
 
-        s->buffers[side][s->i.bytes_sent[side]++] = curr;
+        line[i] = curr;
       }
+      buffer_put(s, side, line, ibwidth);
       break;
   }
 
@@ -6907,9 +6965,14 @@ read_from_buffer(struct scanner *s, SANE_Byte * buf, SANE_Int max_len,
   SANE_Status ret=SANE_STATUS_GOOD;
   int bytes = max_len;
   int remain = s->i.bytes_sent[side] - s->u.bytes_sent[side];
+  int pos, first;
 
   DBG (10, "read_from_buffer: start\n");
 
+  /* only send lines that deskew/despeck have finished */
+  if(s->bands[side])
+    remain = s->bytes_ready[side] - s->u.bytes_sent[side];
+
   /* figure out the max amount to transfer */
   if(bytes > remain)
     bytes = remain;
@@ -6925,8 +6988,14 @@ read_from_buffer(struct scanner *s, SANE_Byte * buf, SANE_Int max_len,
   DBG(15, "read_from_buffer: si:%d to:%d tx:%d bu:%d pa:%d\n", side,
     s->i.bytes_tot[side], s->u.bytes_sent[side], max_len, bytes);
 
-  /* copy to caller */
-  memcpy(buf,s->buffers[side]+s->u.bytes_sent[side],bytes);
+  /* copy to caller, the end of a ring and then its start */
+  pos = s->u.bytes_sent[side] % s->buffer_len[side];
+  first = s->buffer_len[side] - pos;
+  if(first > bytes)
+    first = bytes;
+
+  memcpy(buf,s->buffers[side]+pos,first);
+  memcpy(buf+first,s->buffers[side],bytes-first);
   s->u.bytes_sent[side] += bytes;
 
   DBG (10, "read_from_buffer: finished\n");
@@ -6934,7 +7003,51 @@ read_from_buffer(struct scanner *s, SANE_Byte * buf, SANE_Int max_len,
   return ret;
 }
 
+/* is there room in the buffer for the data of one more read? */
+static int
+buffer_has_room(struct scanner *s, int side)
+{
+  int used = s->i.bytes_sent[side] - s->u.bytes_sent[side];
+  int want = s->i.bytes_tot[side] - s->i.bytes_sent[side];
+
+  if(want > s->buffer_block[side]){
+    want = s->buffer_block[side];
+  }
+
+  return s->buffer_len[side] - used >= want;
+}
+
+/* add data to the image in the buffer, wrapping around in a ring */
+static void
+buffer_put(struct scanner *s, int side, unsigned char * buf, int len)
+{
+  int pos = s->i.bytes_sent[side] % s->buffer_len[side];
+  int first = s->buffer_len[side] - pos;
+
+  if(first > len)
+    first = len;
+
+  memcpy(s->buffers[side]+pos,buf,first);
+  memcpy(s->buffers[side],buf+first,len-first);
+  s->i.bytes_sent[side] += len;
+}
+
+static void
+buffer_fill(struct scanner *s, int side, unsigned char value, int len)
+{
+  int pos = s->i.bytes_sent[side] % s->buffer_len[side];
+  int first = s->buffer_len[side] - pos;
+
+  if(first > len)
+    first = len;
+
+  memset(s->buffers[side]+pos,value,first);
+  memset(s->buffers[side],value,len-first);
+  s->i.bytes_sent[side] += len;
+}
+
 /* fill remainder of buffer with background if scanner stops early */
+/* a ring gets as much as it has room for, sane_read calls again */
 static SANE_Status
 fill_image(struct scanner *s,int side)
 {
@@ -6942,6 +7055,12 @@ fill_image(struct scanner *s,int side)
 
   unsigned char bg_color = calc_bg_color(s);
   int fill_bytes = s->i.bytes_tot[side]-s->i.bytes_sent[side];
+  int room = s->buffer_len[side]
+    - (s->i.bytes_sent[side] - s->u.bytes_sent[side]);
+
+  if(fill_bytes > room){
+    fill_bytes = room;
+  }
 
   if(!fill_bytes){
     return ret;
@@ -6950,10 +7069,9 @@ fill_image(struct scanner *s,int side)
   DBG (15, "fill_image: side:%d bytes:%d bg_color:%02x\n", side, fill_bytes, bg_color);
 
   /* fill the rest with bg_color */
-  memset(s->buffers[side]+s->i.bytes_sent[side],bg_color,fill_bytes);
+  buffer_fill(s,side,bg_color,fill_bytes);
 
   /* pretend we got all the data from scanner */
-  s->i.bytes_sent[side] = s->i.bytes_tot[side];
   s->s.bytes_sent[side] = s->s.bytes_tot[side];
 
   return ret;
@@ -9066,6 +9184,120 @@ buffer_deskew(struct scanner *s, int side)
   return ret;
 }
 
+/* Set up deskew, despeck and blank detection of an image as it arrives,
+ * instead of after it is fully buffered. Same settings as
+ * buffer_deskew/buffer_despeck/buffer_isblank. */
+static SANE_Status
+buffer_band_start(struct scanner *s, int side)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  unsigned char bg_color = calc_bg_color(s);
+
+  DBG (10, "buffer_band_start: start\n");
+
+  sanei_magic_bandFinish(s->bands[side]);
+  s->bands[side] = NULL;
+  s->bytes_ready[side] = 0;
+
+  ret = sane_get_parameters((SANE_Handle) s, &s->s_params);
+  if(ret){
+    DBG (5, "buffer_band_start: bad params, bailing\n");
+    goto cleanup;
+  }
+
+  ret = sanei_magic_bandStart(&s->bands[side],
+    &s->s_params,s->u.dpi_x,s->u.dpi_y);
+  if(ret){
+    DBG (5, "buffer_band_start: bad start, bailing\n");
+    goto cleanup;
+  }
+
+  if(s->swdeskew){
+
+    /*only find skew on first image from a page, or if first image had error */
+    if(s->side == SIDE_FRONT || s->u.source == SOURCE_ADF_BACK || s->deskew_stat){
+
+      /* updated by buffer_band once the image is done */
+      s->deskew_stat = SANE_STATUS_UNSUPPORTED;
+      ret = sanei_magic_bandDeskew(s->bands[side],bg_color);
+    }
+    /* backside images can use a 'flipped' version of frontside data */
+    else{
+      s->deskew_slope *= -1;
+      s->deskew_vals[0] = s->s_params.pixels_per_line - s->deskew_vals[0];
+
+      ret = sanei_magic_bandRotate(s->bands[side],
+        s->deskew_vals[0],s->deskew_vals[1],s->deskew_slope,bg_color);
+    }
+
+    if(ret){
+      DBG (5, "buffer_band_start: bad deskew, bailing\n");
+      goto cleanup;
+    }
+  }
+
+  if(s->swdespeck){
+    ret = sanei_magic_bandDespeck(s->bands[side],s->swdespeck);
+    if(ret){
+      DBG (5, "buffer_band_start: bad despeck, bailing\n");
+      goto cleanup;
+    }
+  }
+
+  if(s->swskip){
+    ret = sanei_magic_bandBlank(s->bands[side],s->swskip);
+    if(ret){
+      DBG (5, "buffer_band_start: bad blank, bailing\n");
+      goto cleanup;
+    }
+  }
+
+  cleanup:
+  /* send the image unchanged */
+  if(ret){
+    sanei_magic_bandFinish(s->bands[side]);
+    s->bands[side] = NULL;
+    ret = SANE_STATUS_GOOD;
+  }
+
+  DBG (10, "buffer_band_start: finish\n");
+  return ret;
+}
+
+/* Deskew and despeck the lines that have arrived in the buffer,
+ * and mark the finished ones as ready to send */
+static SANE_Status
+buffer_band(struct scanner *s, int side)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  int lines = s->i.bytes_sent[side] / s->s_params.bytes_per_line;
+  int done = 0;
+
+  DBG (10, "buffer_band: start\n");
+
+  ret = sanei_magic_bandProcess(s->bands[side],s->buffers[side],lines,&done);
+  if(ret){
+    DBG (5, "buffer_band: bad process, bailing\n");
+    sanei_magic_bandFinish(s->bands[side]);
+    s->bands[side] = NULL;
+    ret = SANE_STATUS_GOOD;
+    goto cleanup;
+  }
+
+  s->bytes_ready[side] = done * s->s_params.bytes_per_line;
+
+  /* keep the skew for the backside */
+  if(done == s->s_params.lines && s->swdeskew && s->deskew_stat){
+    s->deskew_stat = sanei_magic_bandGetSkew(s->bands[side],
+      &s->deskew_vals[0],&s->deskew_vals[1],&s->deskew_slope);
+  }
+
+  cleanup:
+  DBG (10, "buffer_band: finish\n");
+  return ret;
+}
+
 /* Look in image for likely left/right/bottom paper edges, then crop
  * image to match. Does not attempt to rotate the image.
  * FIXME: should we do this before we binarize instead of after? */
@@ -9155,10 +9387,16 @@ buffer_isblank(struct scanner *s, int side)
 
   DBG (10, "buffer_isblank: start\n");
 
-  ret = sane_get_parameters((SANE_Handle) s, &s->s_params);
+  /* already checked as the image arrived */
+  if(s->bands[side]){
+    ret = sanei_magic_bandIsBlank(s->bands[side]);
+  }
+  else{
+    ret = sane_get_parameters((SANE_Handle) s, &s->s_params);
 
-  ret = sanei_magic_isBlank2(&s->s_params, s->buffers[side],
-    s->u.dpi_x, s->u.dpi_y, s->swskip);
+    ret = sanei_magic_isBlank2(&s->s_params, s->buffers[side],
+      s->u.dpi_x, s->u.dpi_y, s->swskip);
+  }
 
   if(ret == SANE_STATUS_NO_DOCS){
     DBG (5, "buffer_isblank: blank!\n");
@@ -9180,7 +9418,27 @@ must_fully_buffer(struct scanner *s)
 {
 
   if(
-    (s->swdeskew || s->swdespeck || s->swcrop)
+    (s->swcrop || s->swskip)
+    && s->s.format != SANE_FRAME_JPEG
+  ){
+    return 1;
+  }
+
+  return 0;
+}
+
+/* deskew, despeck and blank detection don't change the size of the
+ * image, so they are done in the buffer as the image arrives. Cropping
+ * has to wait for the whole image, so everything else waits too. */
+static int
+must_band_process(struct scanner *s)
+{
+  if(s->swcrop){
+    return 0;
+  }
+
+  if(
+    (s->swdeskew || s->swdespeck || s->swskip)
     && s->s.format != SANE_FRAME_JPEG
   ){
     return 1;
@@ -9189,6 +9447,27 @@ must_fully_buffer(struct scanner *s)
   return 0;
 }
 
+/* the whole image has to be kept for software processing, or because
+ * the scanner interlaces it with the front side, which is read first.
+ * all other images stream through a small ring. */
+static int
+must_buffer_side(struct scanner *s, int side)
+{
+  if(must_fully_buffer(s) || must_band_process(s)){
+    return 1;
+  }
+
+  if(side == SIDE_BACK
+    && (s->s.source == SOURCE_ADF_DUPLEX || s->s.source == SOURCE_CARD_DUPLEX)
+    && s->s.format <= SANE_FRAME_RGB
+    && s->duplex_interlace != DUPLEX_INTERLACE_NONE
+  ){
+    return 1;
+  }
+
+  return 0;
+}
+
 /* certain scanners require the mode of the
  * image to be changed in software. */
 static int
@@ -429,6 +429,16 @@ struct scanner
 
   unsigned char * buffers[2];
 
+  /* size of buffers: the whole image, or a ring that the image streams
+   * through, and the most that one read from the scanner adds to it */
+  int buffer_len[2];
+  int buffer_block[2];
+
+  /* deskew/despeck done as the image arrives, and the
+   * number of bytes in buffers which they have finished */
+  sanei_magic_band * bands[2];
+  int bytes_ready[2];
+
   /* --------------------------------------------------------------------- */
   /* values used by the command and data sending functions (scsi/usb)      */
   int fd;                      /* The scanner device file descriptor.      */
@@ -680,12 +690,16 @@ static SANE_Status fill_image(struct scanner *s,int side);
 
 static int must_downsample (struct scanner *s);
 static int must_fully_buffer (struct scanner *s);
+static int must_band_process (struct scanner *s);
+static int must_buffer_side (struct scanner *s, int side);
 static unsigned char calc_bg_color(struct scanner *s);
 
 static SANE_Status buffer_despeck(struct scanner *s, int side);
 static SANE_Status buffer_deskew(struct scanner *s, int side);
 static SANE_Status buffer_crop(struct scanner *s, int side);
 static int buffer_isblank(struct scanner *s, int side);
+static SANE_Status buffer_band_start(struct scanner *s, int side);
+static SANE_Status buffer_band(struct scanner *s, int side);
 
 static SANE_Status load_lut (unsigned char * lut, int in_bits, int out_bits,
   int out_min, int out_max, int slope, int offset);
@@ -693,6 +707,9 @@ static SANE_Status load_lut (unsigned char * lut, int in_bits, int out_bits,
 static SANE_Status read_from_buffer(struct scanner *s, SANE_Byte * buf, SANE_Int max_len, SANE_Int * len, int side);
 
 static SANE_Status image_buffers (struct scanner *s, int setup);
+static int buffer_has_room (struct scanner *s, int side);
+static void buffer_put (struct scanner *s, int side, unsigned char * buf, int len);
+static void buffer_fill (struct scanner *s, int side, unsigned char value, int len);
 static SANE_Status offset_buffers (struct scanner *s, int setup);
 static SANE_Status gain_buffers (struct scanner *s, int setup);
 
@@ -1196,6 +1196,7 @@ sane_open (SANE_String_Const full_name, SANE_Handle * meta_handle)
   dev_name = strchr (full_name, ':');
 
   int is_fakeusb = 0, is_fakeusbdev = 0, is_fakeusbout = 0;
+  int is_fakeusbstreamout = 0;
 
   if (dev_name)
     {
@@ -1205,6 +1206,9 @@ sane_open (SANE_String_Const full_name, SANE_Handle * meta_handle)
           dev_name - full_name == 10;
       is_fakeusbout = strncmp(full_name, "fakeusbout", dev_name - full_name) == 0 &&
           dev_name - full_name == 10;
+      is_fakeusbstreamout = strncmp(full_name, "fakeusbstreamout",
+                                    dev_name - full_name) == 0 &&
+          dev_name - full_name == 16;
     }
 
   if (is_fakeusb || is_fakeusbdev)
@@ -1224,7 +1228,7 @@ sane_open (SANE_String_Const full_name, SANE_Handle * meta_handle)
   else
     {
       char* fakeusbout_path = NULL;
-      if (is_fakeusbout)
+      if (is_fakeusbout || is_fakeusbstreamout)
       {
         ++dev_name; // skip colon
 
@@ -1261,6 +1265,14 @@ sane_open (SANE_String_Const full_name, SANE_Handle * meta_handle)
           if (status != SANE_STATUS_GOOD)
             return status;
         }
+      else if (is_fakeusbstreamout)
+        {
+          status = sanei_usb_testing_enable_stream_record(fakeusbout_path,
+                                                          be_name);
+          free(fakeusbout_path);
+          if (status != SANE_STATUS_GOOD)
+            return status;
+        }
     }
 
   if (!be_name)
@@ -31,6 +31,7 @@
 
 #include "epson2-io.h"
 #include "epson2-commands.h"
+#include "epson2_net.h"
 
 /*
  *       request identity
@@ -1668,6 +1669,10 @@ e2_start_ext_scan(Epson_Scanner * s)
 	s->ext_last_len = le32atoh(&buf[10]);
 
 	s->ext_counter = 0;
+	s->ext_received = 0;
+	s->ext_pending = SANE_FALSE;
+	s->ext_ready = SANE_FALSE;
+	s->ext_status = SANE_STATUS_GOOD;
 
 	DBG(5, " status         : 0x%02x\n", buf[1]);
 	DBG(5, " block size     : %u\n", (unsigned int) le32atoh(&buf[2]));
@@ -1683,6 +1688,16 @@ e2_start_ext_scan(Epson_Scanner * s)
 	if (s->ext_block_len == 0 && s->ext_last_len)
 		s->ext_block_len = s->ext_last_len;
 
+	/* network only: the buffer for the next block, sized for this scan,
+	 * a cancelled scan may have left a smaller one */
+	if (s->hw->connection == SANE_EPSON_NET) {
+		SANE_Byte *next = realloc(s->ext_next, s->ext_block_len + 1);
+
+		if (next == NULL)
+			return SANE_STATUS_NO_MEM;
+		s->ext_next = next;
+	}
+
 	return status;
 }
 
@@ -1693,6 +1708,8 @@ e2_scan_finish(Epson_Scanner * s)
 
 	free(s->buf);
 	s->buf = NULL;
+	free(s->ext_next);
+	s->ext_next = NULL;
 
 	if (s->hw->ADF && s->hw->use_extension && s->val[OPT_AUTO_EJECT].w)
 		if (e2_check_adf(s) == SANE_STATUS_NO_DOCS)
@@ -1735,6 +1752,163 @@ e2_copy_image_data(Epson_Scanner * s, SANE_Byte * data, SANE_Int max_length,
 	}
 }
 
+/* size of the image data in block n of an extended scan, counting from 1 */
+static size_t
+e2_ext_block_size(Epson_Scanner *s, SANE_Int n)
+{
+	if (n == s->ext_blocks && s->ext_last_len)
+		return s->ext_last_len;
+
+	return s->ext_block_len;
+}
+
+/*
+ * Receives the next block into ext_next. Once its status byte is checked,
+ * the block is acked right away, so the scanner sends the following one
+ * while the frontend still reads buf. If wait is not set, this returns as
+ * soon as no more data is available.
+ */
+static SANE_Status
+e2_ext_net_receive(Epson_Scanner *s, SANE_Bool wait)
+{
+	struct Epson_Device *dev = s->hw;
+	SANE_Status status;
+	SANE_Bool done;
+	size_t len = e2_ext_block_size(s, s->ext_received + 1);
+
+	if (!s->ext_pending) {
+		sanei_epson_net_read_start(s, s->ext_next, len + 1);
+		s->ext_pending = SANE_TRUE;
+	}
+
+	status = sanei_epson_net_read_pump(s, wait, &done);
+	if (status == SANE_STATUS_GOOD && !done)
+		return status;
+
+	s->ext_pending = SANE_FALSE;
+	s->ext_received++;
+
+	DBG(18, "%s: block %d/%d, size %lu, status: %d\n", __func__,
+		s->ext_received, s->ext_blocks, (unsigned long) len, status);
+
+	if (status != SANE_STATUS_GOOD) {
+		e2_cancel(s);
+		s->ext_received = s->ext_blocks;
+		return status;
+	}
+
+	if (e2_dev_model(dev, "GT-8200") || e2_dev_model(dev, "Perfection1650")) {
+		/* See http://bugs.debian.org/cgi-bin/bugreport.cgi?bug=597922#127 */
+		s->ext_next[len] &= 0xc0;
+	}
+
+	if (s->ext_next[len] & FSG_STATUS_CANCEL_REQ) {
+		DBG(0, "%s: cancel request received\n", __func__);
+		e2_cancel(s);
+		s->ext_received = s->ext_blocks;
+		return SANE_STATUS_CANCELLED;
+	}
+
+	if (s->ext_next[len] & (FSG_STATUS_FER | FSG_STATUS_NOT_READY)) {
+		s->ext_received = s->ext_blocks;
+		return SANE_STATUS_IO_ERROR;
+	}
+
+	s->ext_ready = SANE_TRUE;
+
+	/* ack every block except the last one */
+	if (s->ext_received < s->ext_blocks) {
+		if (s->canceling) {
+			e2_cancel(s);
+			s->ext_received = s->ext_blocks;
+			return SANE_STATUS_CANCELLED;
+		}
+
+		len = e2_ext_block_size(s, s->ext_received + 1);
+		sanei_epson_net_request(s, (const unsigned char *) S_ACK, 1,
+					len + 1, &status);
+	}
+
+	return status;
+}
+
+/*
+ * The scanner sends an acked block in any case, so it has to be received
+ * before the scan can be canceled.
+ */
+static SANE_Status
+e2_ext_net_cancel(Epson_Scanner *s)
+{
+	SANE_Bool done;
+
+	DBG(5, "%s: %d/%d blocks received\n", __func__,
+		s->ext_received, s->ext_blocks);
+
+	if (s->ext_received < s->ext_blocks) {
+		if (!s->ext_pending)
+			sanei_epson_net_read_start(s, s->ext_next,
+				e2_ext_block_size(s, s->ext_received + 1) + 1);
+
+		sanei_epson_net_read_pump(s, SANE_TRUE, &done);
+		s->ext_pending = SANE_FALSE;
+		s->ext_received++;
+
+		/* after the last block, there is nothing to cancel */
+		if (s->ext_received < s->ext_blocks)
+			e2_cancel(s);
+
+		s->ext_received = s->ext_blocks;
+	}
+
+	return SANE_STATUS_CANCELLED;
+}
+
+/* extended read over the network, with two buffers */
+static SANE_Status
+e2_ext_net_read(Epson_Scanner *s)
+{
+	SANE_Status status;
+	SANE_Byte *tmp;
+
+	if (s->canceling)
+		return e2_ext_net_cancel(s);
+
+	if (s->ptr == s->end) {
+
+		if (s->eof)
+			return SANE_STATUS_EOF;
+
+		/* report what went wrong while the previous block was read */
+		if (s->ext_status != SANE_STATUS_GOOD)
+			return s->ext_status;
+
+		while (!s->ext_ready) {
+			status = e2_ext_net_receive(s, SANE_TRUE);
+			if (status != SANE_STATUS_GOOD)
+				return status;
+		}
+
+		tmp = s->buf;
+		s->buf = s->ext_next;
+		s->ext_next = tmp;
+		s->ext_ready = SANE_FALSE;
+		s->ext_counter++;
+
+		if (s->ext_counter == s->ext_blocks)
+			s->eof = SANE_TRUE;
+
+		s->end = s->buf + e2_ext_block_size(s, s->ext_counter);
+		s->ptr = s->buf;
+	}
+
+	/* receive what has arrived of the next block */
+	if (!s->ext_ready && s->ext_received < s->ext_blocks
+	    && s->ext_status == SANE_STATUS_GOOD)
+		s->ext_status = e2_ext_net_receive(s, SANE_FALSE);
+
+	return SANE_STATUS_GOOD;
+}
+
 SANE_Status
 e2_ext_read(struct Epson_Scanner *s)
 {
@@ -1744,6 +1918,9 @@ e2_ext_read(struct Epson_Scanner *s)
 
 	DBG(18, "%s: begin\n", __func__);
 
+	if (dev->connection == SANE_EPSON_NET)
+		return e2_ext_net_read(s);
+
 	/* did we passed everything we read to sane? */
 	if (s->ptr == s->end) {
 
@@ -401,11 +401,27 @@ struct Epson_Scanner
 	unsigned char *netbuf, *netptr;
 	size_t netlen;
 
+	/* network reply received in the background */
+	unsigned char rx_header[12];
+	size_t rx_header_len;
+	unsigned char *rx_buf;
+	size_t rx_wanted;
+	size_t rx_size, rx_pos;
+
 	/* extended image data handshaking */
 	SANE_Int ext_block_len;
 	SANE_Int ext_last_len;
 	SANE_Int ext_blocks;
 	SANE_Int ext_counter;
+
+	/* network only: the next block is received into ext_next while
+	 * the frontend reads the current one from buf
+	 */
+	SANE_Byte *ext_next;
+	SANE_Int ext_received;		/* blocks received and checked */
+	SANE_Bool ext_pending;		/* ext_next is being received */
+	SANE_Bool ext_ready;		/* ext_next holds a checked block */
+	SANE_Status ext_status;		/* error while receiving ext_next */
 };
 
 typedef struct Epson_Scanner Epson_Scanner;
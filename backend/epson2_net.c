@@ -18,6 +18,9 @@
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
 
 #include "sane/sane.h"
 #include "sane/saneopts.h"
@@ -160,8 +163,8 @@ sanei_epson_net_read(Epson_Scanner *s, unsigned char *buf, ssize_t wanted,
 	return read;
 }
 
-size_t
-sanei_epson_net_write(Epson_Scanner *s, unsigned int cmd, const unsigned char *buf,
+static size_t
+sanei_epson_net_send(Epson_Scanner *s, unsigned int cmd, const unsigned char *buf,
 			size_t buf_size, size_t reply_len, SANE_Status *status)
 {
 	unsigned char *h1, *h2, *payload;
@@ -176,25 +179,6 @@ sanei_epson_net_write(Epson_Scanner *s, unsigned int cmd, const unsigned char *b
 	h2 = packet + 12;
 	payload = packet + 12 + 8;
 
-	if (reply_len) {
-		if (s->netbuf) {
-			DBG(23, "%s, freeing %p, %ld bytes unprocessed\n",
-				__func__, (void *) s->netbuf, (u_long) s->netlen);
-			free(s->netbuf);
-			s->netbuf = s->netptr = NULL;
-			s->netlen = 0;
-		}
-		s->netbuf = malloc(reply_len);
-		if (!s->netbuf) {
-			free(packet);
-			*status = SANE_STATUS_NO_MEM;
-			return 0;
-		}
-		s->netlen = reply_len;
-		DBG(24, "%s: allocated %lu bytes at %p\n", __func__,
-			(u_long) s->netlen, (void *) s->netbuf);
-	}
-
 	DBG(24, "%s: cmd = %04x, buf = %p, buf_size = %lu, reply_len = %lu\n",
 		__func__, cmd, (void *) buf, (u_long) buf_size, (u_long) reply_len);
 
@@ -238,6 +222,158 @@ sanei_epson_net_write(Epson_Scanner *s, unsigned int cmd, const unsigned char *b
 	return buf_size;
 }
 
+static void
+sanei_epson_net_free_buf(Epson_Scanner *s)
+{
+	if (s->netbuf) {
+		DBG(23, "%s, freeing %p, %ld bytes unprocessed\n",
+			__func__, (void *) s->netbuf, (u_long) s->netlen);
+		free(s->netbuf);
+		s->netbuf = s->netptr = NULL;
+		s->netlen = 0;
+	}
+}
+
+size_t
+sanei_epson_net_write(Epson_Scanner *s, unsigned int cmd, const unsigned char *buf,
+			size_t buf_size, size_t reply_len, SANE_Status *status)
+{
+	if (reply_len) {
+		sanei_epson_net_free_buf(s);
+		s->netbuf = malloc(reply_len);
+		if (!s->netbuf) {
+			*status = SANE_STATUS_NO_MEM;
+			return 0;
+		}
+		s->netlen = reply_len;
+		DBG(24, "%s: allocated %lu bytes at %p\n", __func__,
+			(u_long) s->netlen, (void *) s->netbuf);
+	}
+
+	return sanei_epson_net_send(s, cmd, buf, buf_size, reply_len, status);
+}
+
+/*
+ * Sends a command whose reply is received with sanei_epson_net_read_start()
+ * and sanei_epson_net_read_pump() instead of sanei_epson_net_read(), so no
+ * reply buffer is allocated.
+ */
+size_t
+sanei_epson_net_request(Epson_Scanner *s, const unsigned char *buf,
+			size_t buf_size, size_t reply_len, SANE_Status *status)
+{
+	sanei_epson_net_free_buf(s);
+	return sanei_epson_net_send(s, 0x2000, buf, buf_size, reply_len, status);
+}
+
+/*
+ * Prepares to receive the next reply straight into buf, which must hold
+ * wanted bytes. The reply is received by sanei_epson_net_read_pump(), so
+ * it can arrive while the caller does something else.
+ */
+void
+sanei_epson_net_read_start(Epson_Scanner *s, unsigned char *buf, size_t wanted)
+{
+	DBG(23, "%s: %lu bytes to %p\n", __func__, (u_long) wanted, (void *) buf);
+
+	sanei_epson_net_free_buf(s);
+
+	s->rx_buf = buf;
+	s->rx_wanted = wanted;
+	s->rx_header_len = 0;
+	s->rx_size = 0;
+	s->rx_pos = 0;
+}
+
+/*
+ * Receives what has arrived of the reply set up by
+ * sanei_epson_net_read_start(). If wait is set, it returns only when the
+ * whole reply is there, otherwise as soon as no more data is available.
+ * *done tells whether the reply is complete. A reply shorter than
+ * wanted is an I/O error, anything beyond wanted is discarded.
+ */
+SANE_Status
+sanei_epson_net_read_pump(Epson_Scanner *s, SANE_Bool wait, SANE_Bool *done)
+{
+	unsigned char discard[512];
+	fd_set readable;
+	struct timeval tv;
+	ssize_t n;
+	int ready;
+
+	*done = SANE_FALSE;
+
+	for (;;) {
+		if (s->rx_header_len == 12 && s->rx_pos == s->rx_size) {
+			*done = SANE_TRUE;
+
+			if (s->rx_size < s->rx_wanted) {
+				DBG(1, "%s: expected = %lu, got = %lu\n", __func__,
+					(u_long) s->rx_wanted, (u_long) s->rx_size);
+				return SANE_STATUS_IO_ERROR;
+			}
+			return SANE_STATUS_GOOD;
+		}
+
+		tv.tv_sec = wait ? 10 : 0;
+		tv.tv_usec = 0;
+
+		FD_ZERO(&readable);
+		FD_SET(s->fd, &readable);
+
+		ready = select(s->fd + 1, &readable, NULL, NULL, &tv);
+		if (ready == 0 && !wait)
+			return SANE_STATUS_GOOD;
+		if (ready <= 0) {
+			DBG(15, "%s: select failed: %d\n", __func__, ready);
+			return SANE_STATUS_IO_ERROR;
+		}
+
+		if (s->rx_header_len < 12) {
+			n = recv(s->fd, s->rx_header + s->rx_header_len,
+				12 - s->rx_header_len, 0);
+			if (n <= 0)
+				return SANE_STATUS_IO_ERROR;
+
+			s->rx_header_len += n;
+			if (s->rx_header_len < 12)
+				continue;
+
+			if (s->rx_header[0] != 'I' || s->rx_header[1] != 'S') {
+				DBG(1, "header mismatch: %02X %02x\n",
+					s->rx_header[0], s->rx_header[1]);
+				return SANE_STATUS_IO_ERROR;
+			}
+
+			s->rx_size = be32atoh(&s->rx_header[6]);
+
+			DBG(23, "%s: wanted = %lu, available = %lu\n", __func__,
+				(u_long) s->rx_wanted, (u_long) s->rx_size);
+		} else if (s->rx_pos < s->rx_wanted) {
+			size_t len = s->rx_size < s->rx_wanted ?
+				s->rx_size : s->rx_wanted;
+
+			n = recv(s->fd, s->rx_buf + s->rx_pos,
+				len - s->rx_pos, 0);
+			if (n <= 0)
+				return SANE_STATUS_IO_ERROR;
+
+			s->rx_pos += n;
+		} else {
+			size_t len = s->rx_size - s->rx_pos;
+
+			if (len > sizeof(discard))
+				len = sizeof(discard);
+
+			n = recv(s->fd, discard, len, 0);
+			if (n <= 0)
+				return SANE_STATUS_IO_ERROR;
+
+			s->rx_pos += n;
+		}
+	}
+}
+
 SANE_Status
 sanei_epson_net_lock(struct Epson_Scanner *s)
 {
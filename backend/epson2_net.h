@@ -9,6 +9,13 @@ extern ssize_t sanei_epson_net_read(struct Epson_Scanner *s, unsigned char *buf,
 extern size_t sanei_epson_net_write(struct Epson_Scanner *s, unsigned int cmd, const unsigned char *buf,
 				size_t buf_size, size_t reply_len,
 				SANE_Status *status);
+extern size_t sanei_epson_net_request(struct Epson_Scanner *s, const unsigned char *buf,
+				size_t buf_size, size_t reply_len,
+				SANE_Status *status);
+extern void sanei_epson_net_read_start(struct Epson_Scanner *s, unsigned char *buf,
+				size_t wanted);
+extern SANE_Status sanei_epson_net_read_pump(struct Epson_Scanner *s, SANE_Bool wait,
+				SANE_Bool *done);
 extern SANE_Status sanei_epson_net_lock(struct Epson_Scanner *s);
 extern SANE_Status sanei_epson_net_unlock(struct Epson_Scanner *s);
 
@@ -32,11 +32,22 @@ typedef struct my_error_mgr * my_error_ptr;
 
 METHODDEF(void) my_error_exit (j_common_ptr cinfo)
 {
+	my_error_ptr err = (my_error_ptr) cinfo->err;
 
 	char buffer[JMSG_LENGTH_MAX];
 	(*cinfo->err->format_message) (cinfo, buffer);
 
 	DBG(10,"Jpeg decode error [%s]", buffer);
+
+	longjmp(err->setjmp_buffer, 1);
+}
+
+METHODDEF(void) my_output_message (j_common_ptr cinfo)
+{
+	char buffer[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message) (cinfo, buffer);
+
+	DBG(10,"Jpeg decode warning [%s]", buffer);
 }
 
 LOCAL(struct jpeg_error_mgr *) jpeg_custom_error (struct my_error_mgr * err)
@@ -44,17 +55,52 @@ LOCAL(struct jpeg_error_mgr *) jpeg_custom_error (struct my_error_mgr * err)
 
 	struct jpeg_error_mgr* pRet  = jpeg_std_error(&(err->pub));
 	err->pub.error_exit = my_error_exit;
+	err->pub.output_message = my_output_message;
 
 	return pRet;
 }
 
-typedef struct
+/* ring buffer size for a side that is handed out while it is decoded */
+#define STREAM_RING_SIZE	(256 * 1024)
+#define STREAM_RING_MIN_LINES	16
+
+enum {
+	STREAM_HEADER,
+	STREAM_START,
+	STREAM_ROWS,
+	STREAM_PADDING,
+	STREAM_DONE
+};
+
+/*
+ * Decodes the image of one side while its compressed data arrives. The
+ * source manager suspends the decoder when it runs out of data, which
+ * keeps the bytes it still needs until more data is fed.
+ */
+struct eds_jpeg_stream
 {
-	struct jpeg_source_mgr pub;
-	JOCTET *buffer;
-	int length;
-}
-epsonds_src_mgr;
+	struct jpeg_source_mgr pub;	/* must be first */
+	struct jpeg_decompress_struct cinfo;
+	struct my_error_mgr err;
+
+	epsonds_scanner *s;
+	SANE_Bool whole_page;		/* keep the whole side in the ring */
+
+	JOCTET *data;			/* compressed data not decoded yet */
+	size_t alloc;
+	long skip;			/* bytes to skip in data still to come */
+	SANE_Int received;
+	SANE_Bool ended;		/* no more data will come */
+	SANE_Int height;		/* valid lines, 0 if not known */
+
+	int state;
+	SANE_Int rows;			/* lines written to the ring */
+	SANE_Int row_size;
+	JSAMPARRAY scanline;
+	SANE_Byte *row;
+};
+
+static const JOCTET fake_eoi[2] = { 0xFF, JPEG_EOI };
 
 METHODDEF(void)
 jpeg_init_source(j_decompress_ptr __sane_unused__ cinfo)
@@ -69,12 +115,17 @@ jpeg_term_source(j_decompress_ptr __sane_unused__ cinfo)
 METHODDEF(boolean)
 jpeg_fill_input_buffer(j_decompress_ptr cinfo)
 {
-	epsonds_src_mgr *src = (epsonds_src_mgr *)cinfo->src;
-	/* read from scanner if no data? */
+	eds_jpeg_stream *js = (eds_jpeg_stream *)cinfo->src;
+
+	/* suspend until more data is fed */
+	if (!js->ended)
+		return FALSE;
 
-	src->pub.next_input_byte = src->buffer;
-	src->pub.bytes_in_buffer = src->length;
-	DBG(18, "reading from ring buffer, %d left\n",  src->length);
+	/* the data ended early, let the decoder finish the image */
+	DBG(18, "%s: end of data\n", __func__);
+
+	js->pub.next_input_byte = fake_eoi;
+	js->pub.bytes_in_buffer = sizeof(fake_eoi);
 
 	return TRUE;
 }
@@ -82,154 +133,280 @@ jpeg_fill_input_buffer(j_decompress_ptr cinfo)
 METHODDEF (void)
 jpeg_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
 {
-	epsonds_src_mgr *src = (epsonds_src_mgr *)cinfo->src;
+	eds_jpeg_stream *js = (eds_jpeg_stream *)cinfo->src;
+
+	if (num_bytes <= 0)
+		return;
+
+	if (num_bytes > (long)js->pub.bytes_in_buffer) {
+		js->skip = num_bytes - (long)js->pub.bytes_in_buffer;
+		js->pub.next_input_byte += js->pub.bytes_in_buffer;
+		js->pub.bytes_in_buffer = 0;
+	} else {
+		js->pub.next_input_byte += (size_t) num_bytes;
+		js->pub.bytes_in_buffer -= (size_t) num_bytes;
+	}
+}
 
-	if (num_bytes > 0) {
+eds_jpeg_stream *
+eds_jpeg_stream_new(epsonds_scanner *s, SANE_Bool whole_page)
+{
+	/* volatile, js is still used after a longjmp */
+	eds_jpeg_stream * volatile js = calloc(1, sizeof(eds_jpeg_stream));
 
-		while (num_bytes > (long)src->pub.bytes_in_buffer) {
-			num_bytes -= (long)src->pub.bytes_in_buffer;
-			jpeg_fill_input_buffer(cinfo);
-		}
+	if (js == NULL)
+		return NULL;
 
-		src->pub.next_input_byte += (size_t) num_bytes;
-		src->pub.bytes_in_buffer -= (size_t) num_bytes;
+	js->s = s;
+	js->whole_page = whole_page;
+	js->state = STREAM_HEADER;
+
+	js->cinfo.err = jpeg_custom_error(&js->err);
+	if (setjmp(js->err.setjmp_buffer)) {
+		jpeg_destroy_decompress(&js->cinfo);
+		free(js);
+		return NULL;
 	}
+	jpeg_create_decompress(&js->cinfo);
+
+	js->pub.init_source = jpeg_init_source;
+	js->pub.fill_input_buffer = jpeg_fill_input_buffer;
+	js->pub.skip_input_data = jpeg_skip_input_data;
+	js->pub.resync_to_restart = jpeg_resync_to_restart;
+	js->pub.term_source = jpeg_term_source;
+	js->pub.bytes_in_buffer = 0;
+	js->pub.next_input_byte = NULL;
+	js->cinfo.src = &js->pub;
+
+	return js;
 }
 
+void
+eds_jpeg_stream_free(eds_jpeg_stream *js)
+{
+	if (js == NULL)
+		return;
+
+	jpeg_destroy_decompress(&js->cinfo);
+	free(js->row);
+	free(js->data);
+	free(js);
+}
 
-void eds_decode_jpeg(epsonds_scanner*s, SANE_Byte *data, SANE_Int size, ring_buffer* ringBuffer, SANE_Int isBackSide, SANE_Int needToConvertBW)
+SANE_Status
+eds_jpeg_stream_feed(eds_jpeg_stream *js, const SANE_Byte *data, SANE_Int size)
 {
-    struct jpeg_decompress_struct jpeg_cinfo;
-   	struct my_error_mgr jpeg_err;
+	size_t left = js->pub.bytes_in_buffer;
 
-    {
-        epsonds_src_mgr *src;
+	js->received += size;
 
-        jpeg_cinfo.err = jpeg_custom_error(&jpeg_err);
+	if (js->state == STREAM_PADDING || js->state == STREAM_DONE)
+		return SANE_STATUS_GOOD;
 
-        jpeg_create_decompress(&jpeg_cinfo);
+	if (js->skip) {
+		long n = js->skip < size ? js->skip : size;
 
-        jpeg_cinfo.src = (struct jpeg_source_mgr *)(*jpeg_cinfo.mem->alloc_small)((j_common_ptr)&jpeg_cinfo,
-                            JPOOL_PERMANENT, sizeof(epsonds_src_mgr));
+		js->skip -= n;
+		data += n;
+		size -= n;
+	}
 
-        memset(jpeg_cinfo.src, 0x00, sizeof(epsonds_src_mgr));
-;
-    	src = (epsonds_src_mgr *)jpeg_cinfo.src;
-        src->pub.init_source = jpeg_init_source;
-        src->pub.fill_input_buffer = jpeg_fill_input_buffer;
-        src->pub.skip_input_data = jpeg_skip_input_data;
-        src->pub.resync_to_restart = jpeg_resync_to_restart;
-        src->pub.term_source = jpeg_term_source;
-        src->pub.bytes_in_buffer = 0;
-        src->pub.next_input_byte = NULL;
-		src->buffer = (JOCTET*)data;
-		src->length = size;
-    }
-    {
-	    if (jpeg_read_header(&jpeg_cinfo, TRUE)) {
+	/* keep what the decoder still needs at the start of the buffer */
+	if (left && js->pub.next_input_byte != js->data)
+		memmove(js->data, js->pub.next_input_byte, left);
 
-		if (jpeg_start_decompress(&jpeg_cinfo)) {
+	if (left + size > js->alloc) {
+		size_t alloc = js->alloc * 2;
+		JOCTET *p;
 
-			DBG(10,"%s: w: %d, h: %d, components: %d\n",
-				__func__,
-				jpeg_cinfo.output_width, jpeg_cinfo.output_height,
-				jpeg_cinfo.output_components);
-		}
-        }
-    }
-    {
-		int sum = 0;
-        int bufSize = jpeg_cinfo.output_width * jpeg_cinfo.output_components;
-
-		int monoBufSize = (jpeg_cinfo.output_width + 7)/8;
-
-        JSAMPARRAY scanlines = (jpeg_cinfo.mem->alloc_sarray)((j_common_ptr)&jpeg_cinfo, JPOOL_IMAGE, bufSize, 1);
-        while (jpeg_cinfo.output_scanline < jpeg_cinfo.output_height) {
-            int l = jpeg_read_scanlines(&jpeg_cinfo, scanlines, 1);
-            if (l == 0) {
-                break;
-            }
-			sum += l;
-
-			if (needToConvertBW)
-			{
-				SANE_Byte* bytes = scanlines[0];
-
-				SANE_Int imgPos = 0;
-
-				for (int i = 0; i < monoBufSize; i++)
-				{
-					SANE_Byte outByte = 0;
-
-                    for(SANE_Int bitIndex = 0; bitIndex < 8 && imgPos < bufSize; bitIndex++) {
-						//DBG(10,"bytes[imgPos] = %d\n", bytes[imgPos]);
-
-                         if(bytes[imgPos] >= 110) {
-                               SANE_Byte bit = 7 - (bitIndex % 8);
-                               outByte     |= (1<< bit);
-                         }
-						 imgPos += 1;
-                  	 }
-						//DBG(10,"outByte = %d\n", outByte);
-					eds_ring_write(ringBuffer, &outByte, 1);
-				}
-			}
-			else
-			{
-				eds_ring_write(ringBuffer, scanlines[0], bufSize);
-			}
+		if (alloc < left + size)
+			alloc = left + size;
 
-			// decode until valida data
-			if (isBackSide)
-			{
-				if (sum >= s->height_back)
-				{
-					break;
-				}
-			}else
-			{
-				if (sum >= s->height_front)
-				{
-					break;
-				}
-			}
-        }
-		DBG(10,"decodded lines = %d\n", sum);
-
-		// abandon unncessary data
-		if ((JDIMENSION)sum < jpeg_cinfo.output_height)
-		{
-			// unncessary data
-			while(1)
-			{
-				int l = jpeg_read_scanlines(&jpeg_cinfo, scanlines, 1);
-				if (l == 0)
-				{
-					break;
-				}
+		p = realloc(js->data, alloc);
+		if (p == NULL)
+			return SANE_STATUS_NO_MEM;
+
+		js->data = p;
+		js->alloc = alloc;
+	}
+
+	memcpy(js->data + left, data, size);
+	js->pub.next_input_byte = js->data;
+	js->pub.bytes_in_buffer = left + size;
+
+	return SANE_STATUS_GOOD;
+}
+
+void
+eds_jpeg_stream_end(eds_jpeg_stream *js, SANE_Int height)
+{
+	DBG(10, "%s: %d bytes, height %d\n", __func__, js->received, height);
+
+	js->ended = SANE_TRUE;
+	js->height = height;
+}
+
+SANE_Bool
+eds_jpeg_stream_ended(eds_jpeg_stream *js)
+{
+	return js->ended;
+}
+
+/* prepares the ring buffer once the image size is known */
+static SANE_Status
+stream_start(eds_jpeg_stream *js, ring_buffer *ring)
+{
+	epsonds_scanner *s = js->s;
+	SANE_Int width = js->cinfo.output_width * js->cinfo.output_components;
+	SANE_Int lines;
+
+	DBG(10,"%s: w: %d, h: %d, components: %d\n",
+		__func__,
+		js->cinfo.output_width, js->cinfo.output_height,
+		js->cinfo.output_components);
+
+	if (s->needToConvertBW)
+		js->row_size = (js->cinfo.output_width + 7) / 8;
+	else
+		js->row_size = width;
+
+	js->scanline = (js->cinfo.mem->alloc_sarray)((j_common_ptr)&js->cinfo, JPOOL_IMAGE, width, 1);
+	js->row = malloc(js->row_size);
+	if (js->row == NULL)
+		return SANE_STATUS_NO_MEM;
+
+	if (js->whole_page) {
+		lines = js->cinfo.output_height;
+		if (lines < s->params.lines)
+			lines = s->params.lines;
+	} else {
+		lines = STREAM_RING_SIZE / js->row_size;
+		if (lines < STREAM_RING_MIN_LINES)
+			lines = STREAM_RING_MIN_LINES;
+	}
+
+	return eds_ring_init(ring, lines * js->row_size);
+}
+
+/* converts a decoded line to lineart */
+static void
+stream_convert_bw(eds_jpeg_stream *js)
+{
+	SANE_Byte *bytes = js->scanline[0];
+	SANE_Int bufSize = js->cinfo.output_width * js->cinfo.output_components;
+	SANE_Int imgPos = 0;
+
+	for (int i = 0; i < js->row_size; i++)
+	{
+		SANE_Byte outByte = 0;
+
+		for(SANE_Int bitIndex = 0; bitIndex < 8 && imgPos < bufSize; bitIndex++) {
+			if(bytes[imgPos] >= 110) {
+				SANE_Byte bit = 7 - (bitIndex % 8);
+				outByte     |= (1<< bit);
 			}
+			imgPos += 1;
+		}
+		js->row[i] = outByte;
+	}
+}
+
+/*
+ * Decodes as many lines into the ring as there are data and room for.
+ * Returns SANE_STATUS_EOF once the whole side, padding included, was
+ * written to the ring.
+ */
+SANE_Status
+eds_jpeg_stream_decode(eds_jpeg_stream *js, ring_buffer *ring)
+{
+	epsonds_scanner *s = js->s;
+	SANE_Status status;
+	SANE_Int lines;
+
+	if (setjmp(js->err.setjmp_buffer)) {
+		js->state = STREAM_DONE;
+		return SANE_STATUS_IO_ERROR;
+	}
+
+	if (js->state == STREAM_HEADER) {
+
+		/* no image on this side */
+		if (js->ended && js->received == 0) {
+			js->state = STREAM_DONE;
+			return SANE_STATUS_EOF;
+		}
+
+		if (jpeg_read_header(&js->cinfo, TRUE) == JPEG_SUSPENDED)
+			return SANE_STATUS_GOOD;
+
+		js->state = STREAM_START;
+	}
+
+	if (js->state == STREAM_START) {
+
+		if (!jpeg_start_decompress(&js->cinfo))
+			return SANE_STATUS_GOOD;
+
+		status = stream_start(js, ring);
+		if (status != SANE_STATUS_GOOD)
+			return status;
+
+		js->state = STREAM_ROWS;
+	}
+
+	while (js->state == STREAM_ROWS) {
+
+		/* decode until valid data, the height is known at the
+		 * end of the data only
+		 */
+		lines = js->cinfo.output_height;
+		if (js->height > 0 && js->height < lines)
+			lines = js->height;
+		if (s->val[OPT_ADF_CRP].w == 0 && s->params.lines < lines)
+			lines = s->params.lines;
+
+		if (js->rows >= lines) {
+			DBG(10,"decodded lines = %d\n", js->rows);
+			js->state = STREAM_PADDING;
+			break;
 		}
 
+		if (ring->size - ring->fill < js->row_size)
+			return SANE_STATUS_GOOD;
+
+		if (jpeg_read_scanlines(&js->cinfo, js->scanline, 1) == 0)
+			return SANE_STATUS_GOOD;
+
+		if (s->needToConvertBW) {
+			stream_convert_bw(js);
+			eds_ring_write(ring, js->row, js->row_size);
+		} else {
+			eds_ring_write(ring, js->scanline[0], js->row_size);
+		}
+		js->rows++;
+	}
+
+	if (js->state == STREAM_PADDING) {
+
 		// if not auto crop mode padding to lines
-		if (s->val[OPT_ADF_CRP].w == 0)
-		{
-			unsigned char* padding = malloc(s->params.bytes_per_line);
-			memset(padding, 255, s->params.bytes_per_line);
-			DBG(10,"padding data lines = %d to %d pa \n", sum,  s->params.lines);
-
-			while(sum < s->params.lines)
-			{
-				eds_ring_write(ringBuffer, padding, bufSize);
-				sum++;
-			}
+		if (s->val[OPT_ADF_CRP].w == 0) {
+
+			memset(js->row, 255, js->row_size);
+
+			while (js->rows < s->params.lines) {
 
-			free(padding);
-			padding = NULL;
+				if (ring->size - ring->fill < js->row_size)
+					return SANE_STATUS_GOOD;
+
+				eds_ring_write(ring, js->row, js->row_size);
+				js->rows++;
+			}
 		}
-    }
-    {
-        jpeg_finish_decompress(&jpeg_cinfo);
-        jpeg_destroy_decompress(&jpeg_cinfo);
-    }
-    return;
+
+		/* unnecessary data is not decoded */
+		jpeg_abort_decompress(&js->cinfo);
+		js->state = STREAM_DONE;
+	}
+
+	return SANE_STATUS_EOF;
 }
@@ -10,4 +10,11 @@
  * modify it under the terms of the GNU General Public License as
  * published by the Free Software Foundation, version 2.
  */
-void eds_decode_jpeg(epsonds_scanner*s, SANE_Byte *data, SANE_Int size, ring_buffer* ringBuffer, SANE_Int isBackSide, SANE_Int needToConvertBW);
+typedef struct eds_jpeg_stream eds_jpeg_stream;
+
+eds_jpeg_stream *eds_jpeg_stream_new(epsonds_scanner *s, SANE_Bool whole_page);
+void eds_jpeg_stream_free(eds_jpeg_stream *js);
+SANE_Status eds_jpeg_stream_feed(eds_jpeg_stream *js, const SANE_Byte *data, SANE_Int size);
+void eds_jpeg_stream_end(eds_jpeg_stream *js, SANE_Int height);
+SANE_Bool eds_jpeg_stream_ended(eds_jpeg_stream *js);
+SANE_Status eds_jpeg_stream_decode(eds_jpeg_stream *js, ring_buffer *ring);
@@ -1357,7 +1357,9 @@ max_string_size(const SANE_String_Const strings[])
 static SANE_Status attach_one_usb(SANE_String_Const devname);
 static SANE_Status attach_one_net(SANE_String_Const devname);
 static SANE_Status acquire_jpeg_data(epsonds_scanner* s);
-static SANE_Status acquire_and_decode_jpeg_data(epsonds_scanner* s);
+static SANE_Status start_jpeg_backside(epsonds_scanner* s);
+static SANE_Status decode_jpeg_data(epsonds_scanner* s);
+static void free_jpeg_data(epsonds_scanner* s);
 static SANE_Status acquire_raw_data(epsonds_scanner* s);
 
 static void
@@ -1398,6 +1400,7 @@ close_scanner(epsonds_scanner *s)
 
 free:
 
+	free_jpeg_data(s);
 	free(s->front.ring);
 	free(s->back.ring);
 	free(s->line_buffer);
@@ -2524,14 +2527,20 @@ static void swapPixel(SANE_Int  x1,
 }
 
 
+/* these models scan the backside upside down */
+static SANE_Bool
+backside_is_upside_down(epsonds_scanner *s)
+{
+	return strcmp(s->hw->sane.model, (char*)"DS-1630") == 0
+		|| strcmp(s->hw->sane.model, (char*)"DS-1610") == 0
+		|| strcmp(s->hw->sane.model, (char*)"DS-1660W") == 0;
+}
+
 void
 upside_down_backside_image(epsonds_scanner *s)
 {
 	// get all data from ring_buffer
-	if (eds_ring_avail(&s->back)  &&
-	    (strcmp(s->hw->sane.model, (char*)"DS-1630") == 0
-		 || strcmp(s->hw->sane.model, (char*)"DS-1610") == 0
-		 || strcmp(s->hw->sane.model, (char*)"DS-1660W") == 0))
+	if (eds_ring_avail(&s->back) && backside_is_upside_down(s))
 	{
 		SANE_Int bytesPerLine = s->params.bytes_per_line;
 		SANE_Int imageSize = bytesPerLine * s->height_back;
@@ -2599,12 +2608,13 @@ get_next_image(epsonds_scanner *s)
 
 		if (s->mode_jpeg)
 		{
-			status = acquire_and_decode_jpeg_data(s);
+			status = acquire_jpeg_data(s);
 		}else{
 			status = acquire_raw_data(s);
 		}
 		if (status != SANE_STATUS_GOOD)
 		{
+			free_jpeg_data(s);
 			eds_ring_flush(&s->front);
 			eds_ring_flush(&s->back);
 			eds_ring_destory(&s->front);
@@ -2614,6 +2624,18 @@ get_next_image(epsonds_scanner *s)
 
 		s->acquirePage = 1;
 	}
+	else if (s->acquirePage == 0 && s->current == &s->back && s->backJpeg)
+	{
+		status = start_jpeg_backside(s);
+		if (status != SANE_STATUS_GOOD)
+		{
+			free_jpeg_data(s);
+			eds_ring_flush(&s->back);
+			eds_ring_destory(&s->back);
+		}
+
+		s->acquirePage = 1;
+	}
 
 	return status;
 }
@@ -2835,13 +2857,13 @@ sane_start(SANE_Handle handle)
 
 	if ((s->pages % 2) == 1) {
 		s->current = &s->front;
-	} else if (eds_ring_avail(&s->back)) {
+	} else if (eds_ring_avail(&s->back) || s->backJpeg) {
 		DBG(5, "back side\n");
 		s->current = &s->back;
 	}
 
 	/* scan already in progress? (one pass adf) */
-	if (s->scanning  || eds_ring_avail(&s->back) > 0) {
+	if (s->scanning  || eds_ring_avail(&s->back) > 0 || s->backJpeg) {
 		DBG(5, " scan in progress, returning early\n");
 		return get_next_image(s);
 	}
@@ -3313,114 +3335,185 @@ end:
 	return status;
 }
 
-static SANE_Status acquire_jpeg_data(epsonds_scanner* s)
+static void
+free_jpeg_data(epsonds_scanner* s)
 {
+	eds_jpeg_stream_free(s->frontJpeg);
+	eds_jpeg_stream_free(s->backJpeg);
+	s->frontJpeg = NULL;
+	s->backJpeg = NULL;
+}
 
+/* receive the next block of JPEG data and hand it to its side */
+static SANE_Status
+acquire_jpeg_block(epsonds_scanner* s)
+{
 	SANE_Int read = 0;
+	SANE_Status status;
+	eds_jpeg_stream *js;
+
+	status = esci2_img(s, &read);
+	DBG(20, "acquire_jpeg_data read: %d, eof: %d, backside: %d, status: %d\n", read, s->eof, s->backside, status);
+
+	js = s->backside ? s->backJpeg : s->frontJpeg;
 
-	SANE_Int jpegBufSize = s->params.bytes_per_line * s->params.lines;
-	if (s->needToConvertBW)
+	if (read && js)
 	{
-		jpegBufSize = s->params.pixels_per_line * s->params.lines;
+		SANE_Status feed_status = eds_jpeg_stream_feed(js, s->buf, read);
+		if (feed_status != SANE_STATUS_GOOD)
+			return feed_status;
 	}
 
+	if (status == SANE_STATUS_EOF)
+	{
+		if (s->backside)
+		{
+			DBG(20, "eofBack\n");
+			s->backJpegEof = 1;
+			if (js)
+				eds_jpeg_stream_end(js, s->height_back);
+		}else{
+			DBG(20, "eofFront\n");
+			s->frontJpegEof = 1;
+			if (js)
+				eds_jpeg_stream_end(js, s->height_front);
+		}
+		return SANE_STATUS_GOOD;
+	}
 
-	s->frontJpegBuf = malloc(jpegBufSize);
-	s->backJpegBuf = malloc(jpegBufSize);
-	s->frontJpegBufLen  = 0;
-	s->backJpegBufLen = 0;
+	if (status == SANE_STATUS_CANCELLED)
+	{
+		// cancel cleanup
+		esci2_can(s);
+	}
 
-		// load all images, decode and fill buffer
-	SANE_Int status = SANE_STATUS_GOOD;
+	return status;
+}
 
-	int eofFront = 0;
-	int eofBack = 0;
+static SANE_Bool
+jpeg_data_acquired(epsonds_scanner* s)
+{
+	if (s->isDuplexScan)
+		return s->frontJpegEof && s->backJpegEof;
 
+	return s->frontJpegEof;
+}
 
-	status = eds_ring_init(&s->front, (s->params.bytes_per_line) * s->params.lines);
-	if (status != SANE_STATUS_GOOD) {
-				return status;
-	}
+/*
+ * Starts the JPEG decoding of a sheet. The image data is decoded while
+ * the frontend reads it, so the rings hold a few lines only and the
+ * backside waits compressed until its turn.
+ */
+static SANE_Status acquire_jpeg_data(epsonds_scanner* s)
+{
+	SANE_Status status = SANE_STATUS_GOOD;
 
-	status = eds_ring_init(&s->back, (s->params.bytes_per_line) * s->params.lines);
-	if (status != SANE_STATUS_GOOD) {
-			return status;
+	free_jpeg_data(s);
+	s->frontJpegEof = 0;
+	s->backJpegEof = 0;
+
+	s->frontJpeg = eds_jpeg_stream_new(s, SANE_FALSE);
+	if (s->frontJpeg == NULL)
+		return SANE_STATUS_NO_MEM;
+
+	if (s->isDuplexScan)
+	{
+		s->backJpeg = eds_jpeg_stream_new(s, backside_is_upside_down(s));
+		if (s->backJpeg == NULL)
+			return SANE_STATUS_NO_MEM;
 	}
 
-	while (1)
+	if (s->val[OPT_ADF_CRP].w)
 	{
-		status = esci2_img(s, &read);
-		DBG(20, "acquire_jpeg_data read: %d, eof: %d, backside: %d, status: %d\n", read, s->eof, s->backside, status);
-		if (read)
+		/* the size of the cropped pages is known at their end only,
+		 * so the whole sheet is received before the parameters are
+		 * handed out
+		 */
+		while (status == SANE_STATUS_GOOD && !jpeg_data_acquired(s))
+			status = acquire_jpeg_block(s);
+	}
+	else
+	{
+		/* wait for the image data, so that sane_start reports
+		 * an empty ADF or a paper jam
+		 */
+		while (status == SANE_STATUS_GOOD && !s->frontJpegEof && eds_ring_avail(&s->front) == 0)
 		{
-			if (s->backside)
-			{
-				SANE_Byte* backBuffer = s->backJpegBuf + s->backJpegBufLen;
-				memcpy(backBuffer, s->buf, read);
-				s->backJpegBufLen += read;
-			}else{
-				SANE_Byte* frontBuffer = s->frontJpegBuf +  s->frontJpegBufLen ;
-				memcpy(frontBuffer, s->buf, read);
-				s->frontJpegBufLen  += read;
-			}
+			status = acquire_jpeg_block(s);
+			if (status == SANE_STATUS_GOOD)
+				status = eds_jpeg_stream_decode(s->frontJpeg, &s->front);
 		}
-		if (status == SANE_STATUS_GOOD)
-		{
+		if (status == SANE_STATUS_EOF)
+			status = SANE_STATUS_GOOD;
+	}
 
-			DBG(20, "continue acquire image\n");
-			continue;
-		}
-		else if (status == SANE_STATUS_EOF)
-		{
-			if (s->backside)
-			{
-				DBG(20, "eofBack\n");
-				eofBack = 1;
-			}else{
-				DBG(20, "eofFront\n");
-				eofFront = 1;
-			}
-		}else if (status == SANE_STATUS_CANCELLED)
-		{
-				// cancel cleanup
-				esci2_can(s);
+	return status;
+}
 
-				free(s->frontJpegBuf);
-				free(s->backJpegBuf);
-				s->frontJpegBuf = NULL;
-				s->backJpegBuf = NULL;
-				return status;
-		}else{
-				// error occurs cleanup
-				free(s->frontJpegBuf);
-				free(s->backJpegBuf);
-				s->frontJpegBuf = NULL;
-				s->backJpegBuf = NULL;
-				return status;
+/*
+ * Decodes the current side into its ring, receiving more image data
+ * while the side needs it. Once the side is decoded, the rest of its
+ * data is received, so that the next page starts in step.
+ */
+static SANE_Status
+decode_jpeg_data(epsonds_scanner* s)
+{
+	eds_jpeg_stream **js = s->current == &s->back ? &s->backJpeg : &s->frontJpeg;
+	SANE_Int *eof = s->current == &s->back ? &s->backJpegEof : &s->frontJpegEof;
+	SANE_Status status;
+
+	while (*js)
+	{
+		status = eds_jpeg_stream_decode(*js, s->current);
+		if (status == SANE_STATUS_EOF)
+		{
+			eds_jpeg_stream_free(*js);
+			*js = NULL;
+			break;
 		}
+		if (status != SANE_STATUS_GOOD)
+			return status;
 
+		if (eds_ring_avail(s->current) > 0)
+			return SANE_STATUS_GOOD;
 
-		if (s->isDuplexScan)
-		{
-			DBG(20, "eofFront  = %d eofBack  = %d\n", eofFront, eofBack);
-				// acquire finish
-			if (eofFront && eofBack)
-			{
-				DBG(20, "eofFront && eofBack end\n");
-				break;
-			}
-		}else{
-			if (eofFront)
-			{
-				DBG(20, "eofFront end\n");
-				break;
-			}
-		 }
-	 }
+		/* the decoder needs more data */
+		if (jpeg_data_acquired(s))
+			return SANE_STATUS_IO_ERROR;
+
+		status = acquire_jpeg_block(s);
+		if (status != SANE_STATUS_GOOD)
+			return status;
+	}
+
+	while (!*eof)
+	{
+		status = acquire_jpeg_block(s);
+		if (status != SANE_STATUS_GOOD)
+			return status;
+	}
 
 	return SANE_STATUS_GOOD;
 }
 
+/* the backside of the upside down models is turned as a whole */
+static SANE_Status
+start_jpeg_backside(epsonds_scanner* s)
+{
+	SANE_Status status = SANE_STATUS_GOOD;
+
+	if (backside_is_upside_down(s))
+	{
+		while (status == SANE_STATUS_GOOD && s->backJpeg)
+			status = decode_jpeg_data(s);
+
+		if (status == SANE_STATUS_GOOD)
+			upside_down_backside_image(s);
+	}
+
+	return status;
+}
+
 static SANE_Status
 acquire_raw_data(epsonds_scanner* s)
 {
@@ -3537,40 +3630,6 @@ acquire_raw_data(epsonds_scanner* s)
 
 }
 
-static SANE_Status
-acquire_and_decode_jpeg_data(epsonds_scanner* s)
-{
-		SANE_Int status = acquire_jpeg_data(s);
-		if (status == SANE_STATUS_GOOD)
-		{
-			DBG(20, "** %s:  sane status = %d needToConvertBW = %d \n", __func__, status, s->needToConvertBW);
-
-			// process front page
-			if (s->frontJpegBufLen > 0)
-			{
-				eds_decode_jpeg(s, s->frontJpegBuf, s->frontJpegBufLen,  &s->front,0, s->needToConvertBW);
-				free(s->frontJpegBuf);
-				s->frontJpegBuf = NULL;
-			}
-			// process back page
-			if (s->backJpegBufLen > 0)
-			{
-				eds_decode_jpeg(s, s->backJpegBuf, s->backJpegBufLen,  &s->back, 1,  s->needToConvertBW);
-				free(s->backJpegBuf);
-				s->backJpegBuf = NULL;
-			}
-
-			if (s->isDuplexScan)
-			{
-				upside_down_backside_image(s);
-			}
-		}else{
-			DBG(20, "** %s:  sane finish status = %d\n", __func__, status);
-			return status;
-		}
-		return status;
-}
-
 int sumLength = 0;
 /* this moves data from our buffers to SANE */
 SANE_Status
@@ -3582,10 +3641,24 @@ sane_read(SANE_Handle handle, SANE_Byte *data, SANE_Int max_length, SANE_Int *le
 	if (s->canceling)
 	{
 		esci2_can(s);
+		free_jpeg_data(s);
 		*length = 0;
 		return SANE_STATUS_CANCELLED;
 	}
 
+	if (s->mode_jpeg)
+	{
+		SANE_Status status = decode_jpeg_data(s);
+		if (status != SANE_STATUS_GOOD)
+		{
+			free_jpeg_data(s);
+			eds_ring_flush(s->current);
+			eds_ring_destory(s->current);
+			*length = 0;
+			return status;
+		}
+	}
+
 	int available = eds_ring_avail(s->current);
 	/* anything in the buffer? pass it to the frontend */
 	if (available > 0) {
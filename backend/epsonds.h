@@ -196,8 +196,9 @@ struct epsonds_scanner
 	unsigned char *netbuf, *netptr;
 	size_t netlen;
 
-	SANE_Byte *frontJpegBuf, *backJpegBuf;
-	SANE_Int   frontJpegBufLen, backJpegBufLen;
+	/* JPEG data of the sides, decoded while the frontend reads them */
+	struct eds_jpeg_stream *frontJpeg, *backJpeg;
+	SANE_Int   frontJpegEof, backJpegEof;
 	SANE_Int   acquirePage;
 
 	SANE_Int   isflatbedScan;
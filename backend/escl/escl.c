@@ -101,6 +101,8 @@ typedef struct Handled {
     SANE_Bool write_scan_data;
     SANE_Bool decompress_scan_data;
     SANE_Bool end_read;
+    SANE_Bool stream;
+    int prefetch;
     SANE_Parameters ps;
 } escl_sane_t;
 
@@ -115,10 +117,36 @@ escl_free_device(ESCL_Device *current)
     free((void*)current->uuid);
     free((void*)current->unix_socket);
     curl_slist_free_all(current->hack);
+    if (current->share)
+        curl_share_cleanup(current->share);
     free(current);
     return NULL;
 }
 
+/**
+ * \fn static CURLSH *escl_share_new(void)
+ * \brief Function that creates the curl share of an opened device.
+ *        All requests of the device use it, so that the connections
+ *        (with libcurl >= 7.57.0), DNS entries and TLS sessions are kept
+ *        between them instead of connecting again for every status poll.
+ *
+ * \return the share, or NULL if it couldn't be created
+ */
+static CURLSH *
+escl_share_new(void)
+{
+    CURLSH *share = curl_share_init();
+
+    if (share == NULL)
+        return (NULL);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return (share);
+}
+
 
 #ifdef CURL_SSLVERSION_MAX_DEFAULT
 static int
@@ -179,6 +207,10 @@ escl_free_handler(escl_sane_t *handler)
     if (handler == NULL)
         return;
 
+    if (handler->scanner) {
+        escl_stream_close(handler->scanner);
+        escl_prefetch_free(handler->scanner);
+    }
     escl_free_device(handler->device);
     free(handler);
 }
@@ -515,6 +547,8 @@ attach_one_config(SANEI_Config __sane_unused__ *config, const char *line,
     static ESCL_Device *escl_device = NULL;
     if (*line == '#') return SANE_STATUS_GOOD;
     if (!strncmp(line, "pdfblacklist", 12)) return SANE_STATUS_GOOD;
+    if (!strncmp(line, "nostream", 8)) return SANE_STATUS_GOOD;
+    if (!strncmp(line, "prefetch", 8)) return SANE_STATUS_GOOD;
     if (strncmp(line, "device", 6) == 0) {
         char *name_str = NULL;
         char *opt_model = NULL;
@@ -1199,6 +1233,7 @@ _get_hack(SANE_String_Const name, ESCL_Device *device)
     {
       DBG (2, "_get_hack: couldn't access %s\n", ESCL_CONFIG_FILE);
       DBG (3, "_get_hack: exit\n");
+      return;
     }
 
   /* loop reading the configuration file, all line beginning by "option " are
@@ -1234,6 +1269,7 @@ _get_blacklist_pdf(void)
     {
       DBG (2, "_get_blacklit: couldn't access %s\n", ESCL_CONFIG_FILE);
       DBG (3, "_get_blacklist: exit\n");
+      return NULL;
     }
 
   /* loop reading the configuration file, all line beginning by "option " are
@@ -1254,6 +1290,56 @@ finish_:
 }
 
 
+/* 'nostream' in escl.conf: download and decode whole pages in sane_start() */
+static SANE_Bool
+_get_stream(void)
+{
+  FILE *fp;
+  SANE_Bool stream = SANE_TRUE;
+  SANE_Char line[PATH_MAX];
+
+  fp = sanei_config_open (ESCL_CONFIG_FILE);
+  if (!fp)
+    return stream;
+  while (sanei_config_read (line, PATH_MAX, fp))
+    {
+       if (!strncmp(line, "nostream", 8)) {
+          stream = SANE_FALSE;
+          break;
+       }
+    }
+  fclose(fp);
+  DBG (3, "_get_stream: %s\n", stream ? "yes" : "no");
+  return stream;
+}
+
+/* 'prefetch N' in escl.conf: download up to N pages of an ADF job ahead */
+static int
+_get_prefetch(void)
+{
+  FILE *fp;
+  int prefetch = 0;
+  SANE_Char line[PATH_MAX];
+
+  fp = sanei_config_open (ESCL_CONFIG_FILE);
+  if (!fp)
+    return prefetch;
+  while (sanei_config_read (line, PATH_MAX, fp))
+    {
+       if (!strncmp(line, "prefetch", 8)) {
+          prefetch = atoi(line + 8);
+          break;
+       }
+    }
+  fclose(fp);
+  if (prefetch < 0)
+    prefetch = 0;
+  else if (prefetch > ESCL_PREFETCH_MAX)
+    prefetch = ESCL_PREFETCH_MAX;
+  DBG (3, "_get_prefetch: %d\n", prefetch);
+  return prefetch;
+}
+
 /**
  * \fn SANE_Status sane_open(SANE_String_Const name, SANE_Handle *h)
  * \brief Function that establishes a connection with the device named by 'name',
@@ -1291,6 +1377,9 @@ sane_open(SANE_String_Const name, SANE_Handle *h)
         return (SANE_STATUS_NO_MEM);
     }
     handler->device = device;  // Handler owns device now.
+    device->share = escl_share_new();
+    if (device->share == NULL)
+        DBG (10, "No curl share, connections are not reused.\n");
     blacklist = _get_blacklist_pdf();
     handler->scanner = escl_capabilities(device, blacklist, &status);
     if (status != SANE_STATUS_GOOD) {
@@ -1298,6 +1387,8 @@ sane_open(SANE_String_Const name, SANE_Handle *h)
         return (status);
     }
     _get_hack(name, device);
+    handler->stream = _get_stream();
+    handler->prefetch = _get_prefetch();
 
     status = init_options(NULL, handler);
     if (status != SANE_STATUS_GOOD) {
@@ -1339,6 +1430,8 @@ sane_cancel(SANE_Handle h)
       fclose(handler->scanner->tmp);
       handler->scanner->tmp = NULL;
     }
+    escl_stream_close(handler->scanner);
+    escl_prefetch_free(handler->scanner);
     handler->scanner->work = SANE_FALSE;
     handler->cancel = SANE_TRUE;
     escl_scanner(handler->device, handler->scanner->scanJob, handler->result);
@@ -1552,6 +1645,8 @@ sane_start(SANE_Handle h)
     int w = 0;
     int he = 0;
     int bps = 0;
+    SANE_Bool stream = SANE_FALSE;
+    SANE_Bool prefetched = SANE_FALSE;
 
     if (handler->device == NULL) {
         DBG(1, "Missing handler device.\n");
@@ -1698,25 +1793,54 @@ sane_start(SANE_Handle h)
        handler->result = escl_newjob(handler->scanner, handler->device, &status);
        if (status != SANE_STATUS_GOOD)
           return (status);
+       escl_prefetch_free(handler->scanner);
+       if (handler->prefetch > 0 && handler->scanner->source != PLATEN)
+          handler->scanner->prefetch = escl_prefetch_new(handler->device,
+                                                         handler->scanner->scanJob,
+                                                         handler->result,
+                                                         handler->prefetch);
     }
     else
     {
-       SANE_Status job = SANE_STATUS_UNSUPPORTED;
-       SANE_Status st = escl_status(handler->device,
-                                       handler->scanner->source,
-                                       handler->result,
-                                       &job);
-       DBG(10, "eSCL : command returned status %s\n", sane_strstatus(st));
-       if (_go_next_page(st, job) != SANE_STATUS_GOOD)
+       // the page may already be here
+       status = escl_prefetch_next(handler->scanner);
+       if (status == SANE_STATUS_GOOD)
+          prefetched = SANE_TRUE;
+       else if (status != SANE_STATUS_NO_DOCS)
+          return (status);
+       else
        {
-         handler->scanner->work = SANE_FALSE;
-         return SANE_STATUS_NO_DOCS;
+          SANE_Status job = SANE_STATUS_UNSUPPORTED;
+          SANE_Status st = escl_status(handler->device,
+                                          handler->scanner->source,
+                                          handler->result,
+                                          &job);
+          DBG(10, "eSCL : command returned status %s\n", sane_strstatus(st));
+          if (_go_next_page(st, job) != SANE_STATUS_GOOD)
+          {
+            handler->scanner->work = SANE_FALSE;
+            escl_prefetch_free(handler->scanner);
+            return SANE_STATUS_NO_DOCS;
+          }
+          status = SANE_STATUS_GOOD;
        }
     }
-    status = escl_scan(handler->scanner, handler->device, handler->scanner->scanJob, handler->result);
+    // JPEG and PNG are decoded while sane_read() runs
+    stream = !prefetched && handler->stream &&
+        (!strcmp(handler->scanner->caps[handler->scanner->source].default_format, "image/jpeg") ||
+         !strcmp(handler->scanner->caps[handler->scanner->source].default_format, "image/png"));
+    if (prefetched)
+       DBG(10, "Prefetched page\n");
+    else if (stream)
+       status = escl_scan_stream(handler->scanner, handler->device, handler->scanner->scanJob,
+                                 handler->result, &w, &he, &bps);
+    else
+       status = escl_scan(handler->scanner, handler->device, handler->scanner->scanJob, handler->result);
     if (status != SANE_STATUS_GOOD)
        return (status);
-    if (!strcmp(handler->scanner->caps[handler->scanner->source].default_format, "image/jpeg"))
+    if (stream)
+       DBG(10, "Streaming image\n");
+    else if (!strcmp(handler->scanner->caps[handler->scanner->source].default_format, "image/jpeg"))
     {
        status = get_JPEG_data(handler->scanner, &w, &he, &bps);
     }
@@ -1748,6 +1872,8 @@ sane_start(SANE_Handle h)
     handler->ps.last_frame = SANE_TRUE;
     handler->ps.format = SANE_FRAME_RGB;
     handler->scanner->work = SANE_FALSE;
+    // download the next page while this one is read
+    escl_prefetch_pump(handler->scanner);
 //    DBG(10, "NEXT Frame [%s]\n", (handler->ps.last_frame ? "Non" : "Oui"));
     DBG(10, "Real Size Image [%dx%d|%dx%d]\n", 0, 0, w, he);
     return (status);
@@ -1811,11 +1937,24 @@ sane_read(SANE_Handle h, SANE_Byte *buf, SANE_Int maxlen, SANE_Int *len)
             return (status);
         handler->decompress_scan_data = SANE_TRUE;
     }
-    if (handler->scanner->img_data == NULL)
+    if (handler->scanner->img_data == NULL && handler->scanner->stream == NULL)
         return (SANE_STATUS_INVAL);
+    escl_prefetch_pump(handler->scanner);
     if (!handler->end_read) {
         readbyte = min((handler->scanner->img_size - handler->scanner->img_read), maxlen);
-        memcpy(buf, handler->scanner->img_data + handler->scanner->img_read, readbyte);
+        if (handler->scanner->stream) {
+            SANE_Int got = 0;
+            // rows are decoded while the scanner sends them
+            status = escl_stream_read(handler->scanner, buf, readbyte, &got);
+            if (status != SANE_STATUS_GOOD) {
+                *len = 0;
+                escl_stream_close(handler->scanner);
+                return (status);
+            }
+            readbyte = got;
+        }
+        else
+            memcpy(buf, handler->scanner->img_data + handler->scanner->img_read, readbyte);
         handler->scanner->img_read = handler->scanner->img_read + readbyte;
         *len = readbyte;
         if (handler->scanner->img_read == handler->scanner->img_size)
@@ -1833,15 +1972,20 @@ sane_read(SANE_Handle h, SANE_Byte *buf, SANE_Int maxlen, SANE_Int *len)
         *len = 0;
         free(handler->scanner->img_data);
         handler->scanner->img_data = NULL;
+        escl_stream_close(handler->scanner);
         if (handler->scanner->source != PLATEN) {
 	      SANE_Bool next_page = SANE_FALSE;
-          SANE_Status st = escl_status(handler->device,
-                                       handler->scanner->source,
-                                       handler->result,
-                                       &job);
-          DBG(10, "eSCL : command returned status %s\n", sane_strstatus(st));
-          if (_go_next_page(st, job) == SANE_STATUS_GOOD)
-	     next_page = SANE_TRUE;
+          if (escl_prefetch_pending(handler->scanner))
+             next_page = SANE_TRUE;
+          else {
+             SANE_Status st = escl_status(handler->device,
+                                          handler->scanner->source,
+                                          handler->result,
+                                          &job);
+             DBG(10, "eSCL : command returned status %s\n", sane_strstatus(st));
+             if (_go_next_page(st, job) == SANE_STATUS_GOOD)
+	        next_page = SANE_TRUE;
+          }
           handler->scanner->work = SANE_TRUE;
           handler->ps.last_frame = !next_page;
         }
@@ -1904,4 +2048,6 @@ escl_curl_url(CURL *handle, const ESCL_Device *device, SANE_String_Const path)
         curl_easy_setopt(handle, CURLOPT_UNIX_SOCKET_PATH,
                          device->unix_socket);
     }
+    if (device->share != NULL)
+        curl_easy_setopt(handle, CURLOPT_SHARE, device->share);
 }
@@ -103,6 +103,7 @@ typedef struct ESCL_Device {
     SANE_Bool https;
     struct curl_slist *hack;
     char     *unix_socket;
+    CURLSH   *share;
 } ESCL_Device;
 
 typedef struct capst
@@ -152,6 +153,12 @@ typedef struct support
     int step;
 } support_t;
 
+typedef struct escl_stream escl_stream_t;
+typedef struct escl_prefetch escl_prefetch_t;
+
+/* most pages of an ADF job downloaded ahead, see 'prefetch' in escl.conf */
+#define ESCL_PREFETCH_MAX 8
+
 typedef struct capabilities
 {
     caps_t caps[3];
@@ -159,6 +166,8 @@ typedef struct capabilities
     SANE_String_Const *Sources;
     int SourcesSize;
     FILE *tmp;
+    escl_stream_t *stream;
+    escl_prefetch_t *prefetch;
     char *scanJob;
     unsigned char *img_data;
     long img_size;
@@ -179,6 +188,41 @@ typedef struct capabilities
     int val_threshold;
 } capabilities_t;
 
+/* NextDocument being downloaded and decoded while sane_read() runs */
+struct escl_stream
+{
+    capabilities_t *scanner;
+    CURLM *multi;
+    CURL *curl;
+    int running;
+    CURLcode result;
+    SANE_Bool paused;
+    SANE_Bool ended;
+    SANE_Status status;
+
+    /* decoder, fed from the curl write callback */
+    void *decoder;
+    SANE_Status (*decode)(escl_stream_t *stream,
+                          const unsigned char *data,
+                          size_t len);
+    void (*close)(escl_stream_t *stream);
+
+    /* geometry, set by escl_stream_header() */
+    SANE_Bool have_header;
+    int x_off;
+    int y_off;
+    int width;
+    int height;
+    int row;
+    int lines;
+
+    /* decoded and cropped rows not read yet */
+    unsigned char *out;
+    size_t out_pos;
+    size_t out_len;
+    size_t out_size;
+};
+
 typedef struct {
     int                             XRes;
     int                             YRes;
@@ -246,6 +290,43 @@ SANE_Status escl_scan(capabilities_t *scanner,
                       char *scanJob,
                       char *result);
 
+SANE_Status escl_scan_stream(capabilities_t *scanner,
+                             const ESCL_Device *device,
+                             char *scanJob,
+                             char *result,
+                             int *width,
+                             int *height,
+                             int *bps);
+
+SANE_Status escl_stream_read(capabilities_t *scanner,
+                             unsigned char *buf,
+                             int maxlen,
+                             int *len);
+
+void escl_stream_close(capabilities_t *scanner);
+
+void escl_stream_header(escl_stream_t *stream,
+                        int x_off,
+                        int y_off,
+                        int width,
+                        int height);
+
+SANE_Status escl_stream_row(escl_stream_t *stream,
+                            const unsigned char *row);
+
+escl_prefetch_t *escl_prefetch_new(const ESCL_Device *device,
+                                   const char *scanJob,
+                                   const char *result,
+                                   int max);
+
+void escl_prefetch_pump(capabilities_t *scanner);
+
+SANE_Bool escl_prefetch_pending(capabilities_t *scanner);
+
+SANE_Status escl_prefetch_next(capabilities_t *scanner);
+
+void escl_prefetch_free(capabilities_t *scanner);
+
 void escl_scanner(const ESCL_Device *device,
                   char *scanJob,
                   char *result);
@@ -256,6 +337,14 @@ void escl_curl_url(CURL *handle,
                    const ESCL_Device *device,
                    SANE_String_Const path);
 
+void escl_crop_geometry(capabilities_t *scanner,
+                        int w,
+                        int h,
+                        int *x_off,
+                        int *y_off,
+                        int *width,
+                        int *height);
+
 unsigned char *escl_crop_surface(capabilities_t *scanner,
                                  unsigned char *surface,
                                  int w,
@@ -270,12 +359,16 @@ SANE_Status get_JPEG_data(capabilities_t *scanner,
                           int *height,
                           int *bps);
 
+SANE_Status escl_jpeg_stream(escl_stream_t *stream);
+
 // PNG
 SANE_Status get_PNG_data(capabilities_t *scanner,
                          int *width,
                          int *height,
                          int *bps);
 
+SANE_Status escl_png_stream(escl_stream_t *stream);
+
 // TIFF
 SANE_Status get_TIFF_data(capabilities_t *scanner,
                           int *width,
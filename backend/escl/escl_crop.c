@@ -28,42 +28,62 @@
 #include <stdlib.h>
 #include <string.h>
 
-unsigned char *
-escl_crop_surface(capabilities_t *scanner,
-               unsigned char *surface,
-	       int w,
-	       int h,
-	       int bps,
-	       int *width,
-	       int *height)
+/**
+ * \fn void escl_crop_geometry(capabilities_t *scanner, int w, int h, int *x_off, int *y_off, int *width, int *height)
+ * \brief Computes the part of a decoded w x h image that is kept, from the
+ *        scan area of the current source.
+ */
+void
+escl_crop_geometry(capabilities_t *scanner,
+                   int w,
+                   int h,
+                   int *x_off,
+                   int *y_off,
+                   int *width,
+                   int *height)
 {
     double ratio = 1.0;
-    int x_off = 0, x = 0;
-    int real_w = 0;
-    int y_off = 0, y = 0;
-    int real_h = 0;
-    unsigned char *surface_crop = NULL;
 
-    DBG( 1, "Escl Image Crop\n");
     ratio = (double)w / (double)scanner->caps[scanner->source].width;
     scanner->caps[scanner->source].width = w;
     if (scanner->caps[scanner->source].pos_x < 0)
        scanner->caps[scanner->source].pos_x = 0;
+    *x_off = 0;
     if (scanner->caps[scanner->source].pos_x &&
         (scanner->caps[scanner->source].width >
         scanner->caps[scanner->source].pos_x))
-       x_off = (int)((double)scanner->caps[scanner->source].pos_x * ratio);
-    real_w = scanner->caps[scanner->source].width - x_off;
+       *x_off = (int)((double)scanner->caps[scanner->source].pos_x * ratio);
+    *width = scanner->caps[scanner->source].width - *x_off;
 
     scanner->caps[scanner->source].height = h;
+    *y_off = 0;
     if (scanner->caps[scanner->source].pos_y &&
         (scanner->caps[scanner->source].height >
         scanner->caps[scanner->source].pos_y))
-       y_off = (int)((double)scanner->caps[scanner->source].pos_y * ratio);
-    real_h = scanner->caps[scanner->source].height - y_off;
+       *y_off = (int)((double)scanner->caps[scanner->source].pos_y * ratio);
+    *height = scanner->caps[scanner->source].height - *y_off;
 
     DBG( 1, "Escl Image Crop [%dx%d|%dx%d]\n", scanner->caps[scanner->source].pos_x, scanner->caps[scanner->source].pos_y,
 		    scanner->caps[scanner->source].width, scanner->caps[scanner->source].height);
+}
+
+unsigned char *
+escl_crop_surface(capabilities_t *scanner,
+               unsigned char *surface,
+	       int w,
+	       int h,
+	       int bps,
+	       int *width,
+	       int *height)
+{
+    int x_off = 0, x = 0;
+    int real_w = 0;
+    int y_off = 0, y = 0;
+    int real_h = 0;
+    unsigned char *surface_crop = NULL;
+
+    DBG( 1, "Escl Image Crop\n");
+    escl_crop_geometry(scanner, w, h, &x_off, &y_off, &real_w, &real_h);
 
     *width = real_w;
     *height = real_h;
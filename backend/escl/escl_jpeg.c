@@ -266,6 +266,220 @@ get_JPEG_data(capabilities_t *scanner, int *width, int *height, int *bps)
     scanner->tmp = NULL;
     return (SANE_STATUS_GOOD);
 }
+/* JPEG decoder of a streamed image, suspends when it runs out of data */
+typedef struct
+{
+    struct jpeg_decompress_struct cinfo;
+    struct my_error_mgr jerr;
+    struct jpeg_source_mgr src;
+    unsigned char *buffer;      /* data not consumed yet */
+    size_t size;
+    size_t alloc;
+    size_t skip;                /* bytes to skip in the next data */
+    int eof;
+    int state;
+    unsigned int rows;          /* decoded rows to read */
+    JSAMPROW row;
+} escl_jpeg_stream_t;
+
+enum {
+    JPEG_STREAM_HEADER = 0,
+    JPEG_STREAM_START,
+    JPEG_STREAM_ROWS,
+    JPEG_STREAM_DONE
+};
+
+static const JOCTET stream_eoi[2] = { 0xFF, JPEG_EOI };
+
+static boolean
+stream_fill_input_buffer(j_decompress_ptr cinfo)
+{
+    escl_jpeg_stream_t *jpeg = (escl_jpeg_stream_t *) cinfo->client_data;
+
+    if (!jpeg->eof)
+        return (FALSE);
+    /* same as a file that ends early */
+    jpeg->src.next_input_byte = stream_eoi;
+    jpeg->src.bytes_in_buffer = 2;
+    return (TRUE);
+}
+
+static void
+stream_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+    escl_jpeg_stream_t *jpeg = (escl_jpeg_stream_t *) cinfo->client_data;
+
+    if (num_bytes <= 0)
+        return;
+    if ((size_t) num_bytes > jpeg->src.bytes_in_buffer) {
+        jpeg->skip += (size_t) num_bytes - jpeg->src.bytes_in_buffer;
+        num_bytes = (long) jpeg->src.bytes_in_buffer;
+    }
+    jpeg->src.next_input_byte += (size_t) num_bytes;
+    jpeg->src.bytes_in_buffer -= (size_t) num_bytes;
+}
+
+/**
+ * \fn static SANE_Status escl_jpeg_stream_add(escl_jpeg_stream_t *jpeg, const unsigned char *data, size_t len)
+ * \brief Appends data to the bytes the decoder did not consume yet.
+ */
+static SANE_Status
+escl_jpeg_stream_add(escl_jpeg_stream_t *jpeg, const unsigned char *data, size_t len)
+{
+    size_t left = jpeg->src.bytes_in_buffer;
+
+    if (jpeg->skip) {
+        size_t n = jpeg->skip < len ? jpeg->skip : len;
+        jpeg->skip -= n;
+        data += n;
+        len -= n;
+    }
+    if (left && jpeg->src.next_input_byte != jpeg->buffer)
+        memmove(jpeg->buffer, jpeg->src.next_input_byte, left);
+    if (left + len > jpeg->alloc) {
+        size_t alloc = jpeg->alloc ? jpeg->alloc : INPUT_BUFFER_SIZE * 4;
+        unsigned char *buffer;
+
+        while (left + len > alloc)
+            alloc *= 2;
+        buffer = realloc(jpeg->buffer, alloc);
+        if (buffer == NULL)
+            return (SANE_STATUS_NO_MEM);
+        jpeg->buffer = buffer;
+        jpeg->alloc = alloc;
+    }
+    memcpy(jpeg->buffer + left, data, len);
+    jpeg->size = left + len;
+    jpeg->src.next_input_byte = jpeg->buffer;
+    jpeg->src.bytes_in_buffer = jpeg->size;
+    return (SANE_STATUS_GOOD);
+}
+
+/**
+ * \fn static SANE_Status escl_jpeg_stream_decode(escl_stream_t *stream, const unsigned char *data, size_t len)
+ * \brief Decodes as many rows as the data received so far allows.
+ *        'len' is 0 at the end of the image.
+ *
+ * \return SANE_STATUS_GOOD (if everything is OK, otherwise, SANE_STATUS_NO_MEM/SANE_STATUS_INVAL)
+ */
+static SANE_Status
+escl_jpeg_stream_decode(escl_stream_t *stream, const unsigned char *data, size_t len)
+{
+    escl_jpeg_stream_t *jpeg = (escl_jpeg_stream_t *) stream->decoder;
+    j_decompress_ptr cinfo = &jpeg->cinfo;
+    SANE_Status status = SANE_STATUS_GOOD;
+
+    if (len == 0)
+        jpeg->eof = 1;
+    else if (jpeg->state != JPEG_STREAM_DONE) {
+        status = escl_jpeg_stream_add(jpeg, data, len);
+        if (status != SANE_STATUS_GOOD)
+            return (status);
+    }
+    if (setjmp(jpeg->jerr.escape)) {
+        DBG( 1, "Escl Jpeg : Error reading jpeg\n");
+        return (SANE_STATUS_INVAL);
+    }
+    switch (jpeg->state) {
+    case JPEG_STREAM_HEADER: {
+        capabilities_t *scanner = stream->scanner;
+        int rw, rh, rx, ry;
+        double ratio;
+
+        if (jpeg_read_header(cinfo, TRUE) == JPEG_SUSPENDED)
+            return (SANE_STATUS_GOOD);
+        cinfo->out_color_space = JCS_RGB;
+        cinfo->quantize_colors = FALSE;
+        jpeg_calc_output_dimensions(cinfo);
+        /* same area as get_JPEG_data() */
+        ratio = (double)cinfo->output_width / (double)scanner->caps[scanner->source].width;
+        rw = (int)((double)scanner->caps[scanner->source].width * ratio);
+        rh = (int)((double)scanner->caps[scanner->source].height * ratio);
+        rx = (int)((double)scanner->caps[scanner->source].pos_x * ratio);
+        ry = (int)((double)scanner->caps[scanner->source].pos_y * ratio);
+        if (cinfo->output_width < (unsigned int)rw)
+            rw = cinfo->output_width;
+        if (rx < 0 || rx > rw)
+            rx = 0;
+        if (cinfo->output_height < (unsigned int)rh)
+            rh = cinfo->output_height;
+        if (ry < 0 || ry > rh)
+            ry = 0;
+        jpeg->rows = rh;
+        jpeg->row = malloc(cinfo->output_width * cinfo->output_components);
+        if (jpeg->row == NULL) {
+            DBG( 1, "Escl Jpeg : Memory allocation problem\n");
+            return (SANE_STATUS_NO_MEM);
+        }
+        escl_stream_header(stream, rx, ry, rw - rx, rh - ry);
+        jpeg->state = JPEG_STREAM_START;
+    }
+    /* fall through */
+    case JPEG_STREAM_START:
+        if (!jpeg_start_decompress(cinfo))
+            return (SANE_STATUS_GOOD);
+        jpeg->state = JPEG_STREAM_ROWS;
+    /* fall through */
+    case JPEG_STREAM_ROWS:
+        while (cinfo->output_scanline < jpeg->rows) {
+            if (jpeg_read_scanlines(cinfo, &jpeg->row, 1) == 0)
+                return (SANE_STATUS_GOOD);
+            status = escl_stream_row(stream, jpeg->row);
+            if (status != SANE_STATUS_GOOD)
+                return (status);
+        }
+        jpeg->state = JPEG_STREAM_DONE;
+        break;
+    default:
+        break;
+    }
+    return (SANE_STATUS_GOOD);
+}
+
+static void
+escl_jpeg_stream_close(escl_stream_t *stream)
+{
+    escl_jpeg_stream_t *jpeg = (escl_jpeg_stream_t *) stream->decoder;
+
+    if (jpeg == NULL)
+        return;
+    jpeg_destroy_decompress(&jpeg->cinfo);
+    free(jpeg->row);
+    free(jpeg->buffer);
+    free(jpeg);
+    stream->decoder = NULL;
+}
+
+/**
+ * \fn SANE_Status escl_jpeg_stream(escl_stream_t *stream)
+ * \brief Sets up 'stream' to decode a JPEG image while it is downloaded.
+ *
+ * \return SANE_STATUS_GOOD (if everything is OK, otherwise, SANE_STATUS_NO_MEM)
+ */
+SANE_Status
+escl_jpeg_stream(escl_stream_t *stream)
+{
+    escl_jpeg_stream_t *jpeg;
+
+    jpeg = (escl_jpeg_stream_t *) calloc(1, sizeof(escl_jpeg_stream_t));
+    if (jpeg == NULL)
+        return (SANE_STATUS_NO_MEM);
+    jpeg->cinfo.err = jpeg_std_error(&jpeg->jerr.errmgr);
+    jpeg->jerr.errmgr.error_exit = my_error_exit;
+    jpeg->jerr.errmgr.output_message = output_no_message;
+    jpeg_create_decompress(&jpeg->cinfo);
+    jpeg->cinfo.client_data = jpeg;
+    jpeg->src.init_source = init_source;
+    jpeg->src.fill_input_buffer = stream_fill_input_buffer;
+    jpeg->src.skip_input_data = stream_skip_input_data;
+    jpeg->src.resync_to_restart = jpeg_resync_to_restart;
+    jpeg->src.term_source = term_source;
+    jpeg->cinfo.src = &jpeg->src;
+    stream->decoder = jpeg;
+    stream->decode = escl_jpeg_stream_decode;
+    stream->close = escl_jpeg_stream_close;
+    return (SANE_STATUS_GOOD);
+}
 #else
 
 SANE_Status
@@ -277,4 +491,10 @@ get_JPEG_data(capabilities_t __sane_unused__ *scanner,
     return (SANE_STATUS_INVAL);
 }
 
+SANE_Status
+escl_jpeg_stream(escl_stream_t __sane_unused__ *stream)
+{
+    return (SANE_STATUS_INVAL);
+}
+
 #endif
@@ -182,6 +182,170 @@ close_file:
     scanner->tmp = NULL;
     return (status);
 }
+/* PNG decoder of a streamed image, fed with libpng's progressive reader */
+typedef struct
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    SANE_Status status;
+    int passes;
+    png_uint_32 height;
+    size_t rowbytes;
+    unsigned char *image;       /* whole image if interlaced */
+} escl_png_stream_t;
+
+static void
+stream_info_callback(png_structp png_ptr, png_infop info_ptr)
+{
+    escl_stream_t *stream = png_get_progressive_ptr(png_ptr);
+    escl_png_stream_t *png = (escl_png_stream_t *) stream->decoder;
+    png_uint_32 w = 0, h = 0;
+    int bit_depth, color_type;
+    int x_off, y_off, width, height;
+
+    bit_depth = png_get_bit_depth (png_ptr, info_ptr);
+    color_type = png_get_color_type (png_ptr, info_ptr);
+    // sane_read() returns 8 bit RGB
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+	png_set_palette_to_rgb (png_ptr);
+    else if (color_type == PNG_COLOR_TYPE_GRAY ||
+	     color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+	png_set_gray_to_rgb (png_ptr);
+    if (bit_depth == 16)
+	png_set_strip_16 (png_ptr);
+    else if (bit_depth < 8)
+	png_set_expand (png_ptr);
+    png_set_strip_alpha (png_ptr);
+    png->passes = png_set_interlace_handling (png_ptr);
+    png_read_update_info (png_ptr, info_ptr);
+    png_get_IHDR (png_ptr, info_ptr, &w, &h, &bit_depth, &color_type,
+		  NULL, NULL, NULL);
+    png->rowbytes = png_get_rowbytes (png_ptr, info_ptr);
+    png->height = h;
+    if (png->rowbytes != (size_t) w * 3) {
+	DBG( 1, "Escl Png : PNG format not supported.\n");
+	png->status = SANE_STATUS_INVAL;
+	png_error (png_ptr, "unsupported format");
+    }
+    if (png->passes > 1) {
+	png->image = calloc (h, png->rowbytes);
+	if (png->image == NULL) {
+	    DBG( 1, "Escl Png : texels Memory allocation problem\n");
+	    png->status = SANE_STATUS_NO_MEM;
+	    png_error (png_ptr, "out of memory");
+	}
+    }
+    escl_crop_geometry (stream->scanner, w, h, &x_off, &y_off, &width, &height);
+    escl_stream_header (stream, x_off, y_off, width, height);
+}
+
+static void
+stream_row_callback(png_structp png_ptr, png_bytep new_row,
+		    png_uint_32 row_num, int __sane_unused__ pass)
+{
+    escl_stream_t *stream = png_get_progressive_ptr(png_ptr);
+    escl_png_stream_t *png = (escl_png_stream_t *) stream->decoder;
+
+    if (new_row == NULL)
+	return;
+    // interlaced rows are complete at the end of the image only
+    if (png->passes > 1) {
+	png_progressive_combine_row (png_ptr,
+				     png->image + row_num * png->rowbytes,
+				     new_row);
+	return;
+    }
+    png->status = escl_stream_row (stream, new_row);
+    if (png->status != SANE_STATUS_GOOD)
+	png_error (png_ptr, "out of memory");
+}
+
+static void
+stream_end_callback(png_structp png_ptr, png_infop __sane_unused__ info_ptr)
+{
+    escl_stream_t *stream = png_get_progressive_ptr(png_ptr);
+    escl_png_stream_t *png = (escl_png_stream_t *) stream->decoder;
+    png_uint_32 i;
+
+    if (png->passes <= 1)
+	return;
+    for (i = 0; i < png->height; i++) {
+	png->status = escl_stream_row (stream, png->image + i * png->rowbytes);
+	if (png->status != SANE_STATUS_GOOD)
+	    png_error (png_ptr, "out of memory");
+    }
+}
+
+/**
+ * \fn static SANE_Status escl_png_stream_decode(escl_stream_t *stream, const unsigned char *data, size_t len)
+ * \brief Decodes as many rows as the data received so far allows.
+ *        'len' is 0 at the end of the image.
+ *
+ * \return SANE_STATUS_GOOD (if everything is OK, otherwise, SANE_STATUS_NO_MEM/SANE_STATUS_INVAL)
+ */
+static SANE_Status
+escl_png_stream_decode(escl_stream_t *stream, const unsigned char *data, size_t len)
+{
+    escl_png_stream_t *png = (escl_png_stream_t *) stream->decoder;
+
+    if (len == 0)
+	return (SANE_STATUS_GOOD);
+    if (setjmp (png_jmpbuf (png->png_ptr)))
+    {
+	DBG( 1, "Escl Png : PNG read error.\n");
+	if (png->status == SANE_STATUS_GOOD)
+	    png->status = SANE_STATUS_INVAL;
+	return (png->status);
+    }
+    png_process_data (png->png_ptr, png->info_ptr, (png_bytep) data, len);
+    return (SANE_STATUS_GOOD);
+}
+
+static void
+escl_png_stream_close(escl_stream_t *stream)
+{
+    escl_png_stream_t *png = (escl_png_stream_t *) stream->decoder;
+
+    if (png == NULL)
+	return;
+    png_destroy_read_struct (&png->png_ptr, &png->info_ptr, NULL);
+    free (png->image);
+    free (png);
+    stream->decoder = NULL;
+}
+
+/**
+ * \fn SANE_Status escl_png_stream(escl_stream_t *stream)
+ * \brief Sets up 'stream' to decode a PNG image while it is downloaded.
+ *        Unlike get_PNG_data(), rows are returned top down and without alpha.
+ *
+ * \return SANE_STATUS_GOOD (if everything is OK, otherwise, SANE_STATUS_NO_MEM)
+ */
+SANE_Status
+escl_png_stream(escl_stream_t *stream)
+{
+    escl_png_stream_t *png;
+
+    png = (escl_png_stream_t *) calloc (1, sizeof (escl_png_stream_t));
+    if (png == NULL)
+	return (SANE_STATUS_NO_MEM);
+    png->png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png->png_ptr)
+	png->info_ptr = png_create_info_struct (png->png_ptr);
+    if (!png->info_ptr)
+    {
+	DBG( 1, "Escl Png : PNG error create a png read struct\n");
+	png_destroy_read_struct (&png->png_ptr, NULL, NULL);
+	free (png);
+	return (SANE_STATUS_NO_MEM);
+    }
+    png_set_progressive_read_fn (png->png_ptr, stream, stream_info_callback,
+				 stream_row_callback, stream_end_callback);
+    stream->decoder = png;
+    stream->decode = escl_png_stream_decode;
+    stream->close = escl_png_stream_close;
+    return (SANE_STATUS_GOOD);
+}
 #else
 
 SANE_Status
@@ -193,4 +357,10 @@ get_PNG_data(capabilities_t __sane_unused__ *scanner,
     return (SANE_STATUS_INVAL);
 }
 
+SANE_Status
+escl_png_stream(escl_stream_t __sane_unused__ *stream)
+{
+    return (SANE_STATUS_INVAL);
+}
+
 #endif
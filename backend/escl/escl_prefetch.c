@@ -0,0 +1,296 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 Sane Developers.
+
+   This file is part of the SANE package.
+
+   SANE is free software; you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 3 of the License, or (at your
+   option) any later version.
+
+   SANE is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+   for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with sane; see the file COPYING.
+   If not, see <https://www.gnu.org/licenses/>.
+
+   This file implements a SANE backend for eSCL scanners.  */
+
+#define DEBUG_DECLARE_ONLY
+#include "../include/sane/config.h"
+
+#include "escl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/sane/sanei.h"
+
+/* a downloaded page, not decoded yet */
+typedef struct escl_page
+{
+    struct escl_page *next;
+    char *data;
+    size_t size;
+} escl_page_t;
+
+/* the next pages of an ADF job, downloaded while sane_read() runs */
+struct escl_prefetch
+{
+    const ESCL_Device *device;
+    char *path;
+    CURLM *multi;
+    CURL *curl;         /* page being downloaded, or NULL */
+    escl_page_t *page;  /* its data */
+    escl_page_t *pages; /* downloaded pages, oldest first */
+    int count;          /* pages downloaded and being downloaded */
+    int max;
+    SANE_Bool ended;    /* the scanner has no more pages */
+};
+
+static void
+free_page(escl_page_t *page)
+{
+    if (page == NULL)
+        return;
+    free(page->data);
+    free(page);
+}
+
+/**
+ * \fn static size_t page_callback(void *str, size_t size, size_t nmemb, void *userp)
+ * \brief Callback function that stores the page being prefetched in memory.
+ *
+ * \return the number of bytes stored, or 0 if there is no memory
+ */
+static size_t
+page_callback(void *str, size_t size, size_t nmemb, void *userp)
+{
+    escl_page_t *page = (escl_page_t *)userp;
+    size_t len = size * nmemb;
+    char *data = realloc(page->data, page->size + len);
+
+    if (data == NULL) {
+        DBG(1, "eSCL prefetch : Memory allocation problem\n");
+        return (0);
+    }
+    memcpy(data + page->size, str, len);
+    page->data = data;
+    page->size += len;
+    return (len);
+}
+
+/**
+ * \fn escl_prefetch_t *escl_prefetch_new(const ESCL_Device *device, const char *scanJob, const char *result, int max)
+ * \brief Function that prepares the prefetch of the pages of a new ADF job.
+ *        At most 'max' pages are kept in memory.
+ *
+ * \return the prefetch, or NULL if there is no memory
+ */
+escl_prefetch_t *
+escl_prefetch_new(const ESCL_Device *device, const char *scanJob,
+                  const char *result, int max)
+{
+    escl_prefetch_t *prefetch = NULL;
+    int len;
+
+    if (device == NULL || scanJob == NULL || result == NULL || max < 1)
+        return (NULL);
+    prefetch = (escl_prefetch_t *)calloc(1, sizeof(escl_prefetch_t));
+    if (prefetch == NULL)
+        return (NULL);
+    len = snprintf(NULL, 0, "/eSCL/%s%s/NextDocument", scanJob, result) + 1;
+    prefetch->path = (char *)malloc(len);
+    prefetch->multi = curl_multi_init();
+    if (prefetch->path == NULL || prefetch->multi == NULL) {
+        if (prefetch->multi)
+            curl_multi_cleanup(prefetch->multi);
+        free(prefetch->path);
+        free(prefetch);
+        return (NULL);
+    }
+    snprintf(prefetch->path, len, "/eSCL/%s%s/NextDocument", scanJob, result);
+    prefetch->device = device;
+    prefetch->max = max;
+    DBG(10, "eSCL prefetch : up to %d page(s) of %s\n", max, prefetch->path);
+    return (prefetch);
+}
+
+/**
+ * \fn static void escl_prefetch_done(escl_prefetch_t *prefetch, CURLcode res)
+ * \brief Queues the page that was being downloaded, or ends the prefetch
+ *        if the scanner didn't send one.
+ */
+static void
+escl_prefetch_done(escl_prefetch_t *prefetch, CURLcode res)
+{
+    escl_page_t **last = &prefetch->pages;
+    long code = 0;
+
+    curl_easy_getinfo(prefetch->curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_multi_remove_handle(prefetch->multi, prefetch->curl);
+    curl_easy_cleanup(prefetch->curl);
+    prefetch->curl = NULL;
+
+    if (res != CURLE_OK || code != 200 || prefetch->page->size == 0) {
+        DBG(10, "eSCL prefetch : No more pages (%s, HTTP %ld)\n",
+            curl_easy_strerror(res), code);
+        free_page(prefetch->page);
+        prefetch->page = NULL;
+        prefetch->count--;
+        prefetch->ended = SANE_TRUE;
+        return;
+    }
+    DBG(10, "eSCL prefetch : Page of %lu bytes\n",
+        (unsigned long)prefetch->page->size);
+    while (*last)
+        last = &(*last)->next;
+    *last = prefetch->page;
+    prefetch->page = NULL;
+}
+
+/**
+ * \fn static void escl_prefetch_run(escl_prefetch_t *prefetch, int timeout)
+ * \brief Starts the download of the next page if there is room for it, and
+ *        moves the download on, waiting up to 'timeout' ms for the scanner.
+ */
+static void
+escl_prefetch_run(escl_prefetch_t *prefetch, int timeout)
+{
+    CURLMsg *msg;
+    int running = 0, queued = 0;
+
+    if (prefetch->curl == NULL && !prefetch->ended &&
+        prefetch->count < prefetch->max) {
+        prefetch->page = (escl_page_t *)calloc(1, sizeof(escl_page_t));
+        prefetch->curl = curl_easy_init();
+        if (prefetch->page == NULL || prefetch->curl == NULL) {
+            free_page(prefetch->page);
+            prefetch->page = NULL;
+            if (prefetch->curl)
+                curl_easy_cleanup(prefetch->curl);
+            prefetch->curl = NULL;
+            prefetch->ended = SANE_TRUE;
+            return;
+        }
+        escl_curl_url(prefetch->curl, prefetch->device, prefetch->path);
+        curl_easy_setopt(prefetch->curl, CURLOPT_WRITEFUNCTION, page_callback);
+        curl_easy_setopt(prefetch->curl, CURLOPT_WRITEDATA, prefetch->page);
+        curl_easy_setopt(prefetch->curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(prefetch->curl, CURLOPT_MAXREDIRS, 3L);
+        curl_multi_add_handle(prefetch->multi, prefetch->curl);
+        prefetch->count++;
+    }
+    if (prefetch->curl == NULL)
+        return;
+    if (timeout > 0)
+        curl_multi_wait(prefetch->multi, NULL, 0, timeout, NULL);
+    curl_multi_perform(prefetch->multi, &running);
+    while ((msg = curl_multi_info_read(prefetch->multi, &queued)) != NULL) {
+        if (msg->msg == CURLMSG_DONE && msg->easy_handle == prefetch->curl)
+            escl_prefetch_done(prefetch, msg->data.result);
+    }
+}
+
+/**
+ * \fn void escl_prefetch_pump(capabilities_t *scanner)
+ * \brief Function that moves the prefetch on without waiting, called for
+ *        each sane_read(). Nothing is requested from the scanner while the
+ *        current page is still being downloaded.
+ */
+void
+escl_prefetch_pump(capabilities_t *scanner)
+{
+    if (scanner->prefetch == NULL)
+        return;
+    if (scanner->stream && !scanner->stream->ended)
+        return;
+    escl_prefetch_run(scanner->prefetch, 0);
+}
+
+/**
+ * \fn SANE_Bool escl_prefetch_pending(capabilities_t *scanner)
+ * \brief Function that tells if a next page was or is being prefetched.
+ *
+ * \return SANE_TRUE if escl_prefetch_next() can return a page without asking the scanner
+ */
+SANE_Bool
+escl_prefetch_pending(capabilities_t *scanner)
+{
+    if (scanner->prefetch == NULL)
+        return (SANE_FALSE);
+    return (scanner->prefetch->count > 0);
+}
+
+/**
+ * \fn SANE_Status escl_prefetch_next(capabilities_t *scanner)
+ * \brief Function that waits for the next prefetched page and puts it into
+ *        the temporary file, like 'escl_scan' does.
+ *
+ * \return SANE_STATUS_GOOD, or SANE_STATUS_NO_DOCS if no page was prefetched
+ *         (the page must then be requested from the scanner)
+ */
+SANE_Status
+escl_prefetch_next(capabilities_t *scanner)
+{
+    escl_prefetch_t *prefetch = scanner->prefetch;
+    escl_page_t *page;
+
+    if (prefetch == NULL)
+        return (SANE_STATUS_NO_DOCS);
+    while (prefetch->pages == NULL && prefetch->curl != NULL)
+        escl_prefetch_run(prefetch, 1000);
+    page = prefetch->pages;
+    if (page == NULL)
+        return (SANE_STATUS_NO_DOCS);
+    prefetch->pages = page->next;
+    prefetch->count--;
+
+    if (scanner->tmp)
+        fclose(scanner->tmp);
+    scanner->tmp = tmpfile();
+    if (scanner->tmp == NULL ||
+        fwrite(page->data, 1, page->size, scanner->tmp) != page->size) {
+        free_page(page);
+        return (SANE_STATUS_NO_MEM);
+    }
+    fseek(scanner->tmp, 0, SEEK_SET);
+    scanner->real_read = page->size;
+    free_page(page);
+
+    /* make room for the page after */
+    escl_prefetch_run(prefetch, 0);
+    return (SANE_STATUS_GOOD);
+}
+
+/**
+ * \fn void escl_prefetch_free(capabilities_t *scanner)
+ * \brief Function that stops the prefetch and drops the pages not read.
+ */
+void
+escl_prefetch_free(capabilities_t *scanner)
+{
+    escl_prefetch_t *prefetch = scanner->prefetch;
+    escl_page_t *page;
+
+    if (prefetch == NULL)
+        return;
+    if (prefetch->curl) {
+        curl_multi_remove_handle(prefetch->multi, prefetch->curl);
+        curl_easy_cleanup(prefetch->curl);
+    }
+    curl_multi_cleanup(prefetch->multi);
+    free_page(prefetch->page);
+    while ((page = prefetch->pages) != NULL) {
+        prefetch->pages = page->next;
+        free_page(page);
+    }
+    free(prefetch->path);
+    free(prefetch);
+    scanner->prefetch = NULL;
+}
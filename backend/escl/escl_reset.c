@@ -67,9 +67,10 @@ CURL_CALL:
         if (curl_easy_perform(curl_handle) == CURLE_OK) {
             curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &answer);
             i++;
-            if (i >= 15) return;
         }
         curl_easy_cleanup(curl_handle);
+        if (i >= 15)
+            return;
         if (SANE_STATUS_GOOD != escl_status(device,
                                             PLATEN,
                                             NULL,
@@ -106,3 +106,263 @@ cleanup:
     }
     return (status);
 }
+
+/* decoded rows buffered before the download is paused */
+#define ESCL_STREAM_BUFFER (1024 * 1024)
+
+/**
+ * \fn static size_t stream_callback(void *str, size_t size, size_t nmemb, void *userp)
+ * \brief Callback function that hands the image being downloaded to the decoder.
+ *        The download is paused while sane_read() has enough decoded rows.
+ *
+ * \return the number of bytes used, or CURL_WRITEFUNC_PAUSE
+ */
+static size_t
+stream_callback(void *str, size_t size, size_t nmemb, void *userp)
+{
+    capabilities_t *scanner = (capabilities_t *)userp;
+    escl_stream_t *stream = scanner->stream;
+    size_t len = size * nmemb;
+
+    if (stream->out_len - stream->out_pos >= ESCL_STREAM_BUFFER) {
+        stream->paused = SANE_TRUE;
+        return (CURL_WRITEFUNC_PAUSE);
+    }
+    scanner->real_read += len;
+    if (stream->status == SANE_STATUS_GOOD)
+        stream->status = stream->decode(stream, str, len);
+    if (stream->status != SANE_STATUS_GOOD)
+        return (0);
+    return (len);
+}
+
+/**
+ * \fn static void escl_stream_pump(escl_stream_t *stream)
+ * \brief Waits for more of the image, and decodes it.
+ */
+static void
+escl_stream_pump(escl_stream_t *stream)
+{
+    CURLMsg *msg;
+    int queued = 0;
+
+    if (stream->paused) {
+        stream->paused = SANE_FALSE;
+        curl_easy_pause(stream->curl, CURLPAUSE_CONT);
+    }
+    if (!stream->paused)
+        curl_multi_wait(stream->multi, NULL, 0, 1000, NULL);
+    curl_multi_perform(stream->multi, &stream->running);
+    while ((msg = curl_multi_info_read(stream->multi, &queued)) != NULL) {
+        if (msg->msg == CURLMSG_DONE)
+            stream->result = msg->data.result;
+    }
+    if (!stream->running && !stream->ended) {
+        stream->ended = SANE_TRUE;
+        if (stream->result != CURLE_OK)
+            DBG( 1, "Unable to scan: %s\n", curl_easy_strerror(stream->result));
+        else if (stream->status == SANE_STATUS_GOOD)
+            stream->status = stream->decode(stream, NULL, 0);
+    }
+}
+
+/**
+ * \fn void escl_stream_header(escl_stream_t *stream, int x_off, int y_off, int width, int height)
+ * \brief Called by the decoders once the image size is known, with the part
+ *        of the decoded rows to keep.
+ */
+void
+escl_stream_header(escl_stream_t *stream, int x_off, int y_off, int width, int height)
+{
+    DBG(10, "eSCL stream geometry [%dx%d|%dx%d]\n", x_off, y_off, width, height);
+    stream->x_off = x_off;
+    stream->y_off = y_off;
+    stream->width = width;
+    stream->height = height;
+    stream->have_header = SANE_TRUE;
+}
+
+/**
+ * \fn SANE_Status escl_stream_row(escl_stream_t *stream, const unsigned char *row)
+ * \brief Called by the decoders for each decoded RGB row, keeps the cropped part.
+ *
+ * \return SANE_STATUS_GOOD, or SANE_STATUS_NO_MEM
+ */
+SANE_Status
+escl_stream_row(escl_stream_t *stream, const unsigned char *row)
+{
+    size_t line = (size_t)stream->width * 3;
+    int y = stream->row++;
+
+    if (y < stream->y_off || stream->lines >= stream->height)
+        return (SANE_STATUS_GOOD);
+    if (stream->out_pos == stream->out_len) {
+        stream->out_pos = 0;
+        stream->out_len = 0;
+    }
+    if (stream->out_len + line > stream->out_size) {
+        size_t size = stream->out_size ? stream->out_size * 2 : line * 64;
+        unsigned char *out;
+
+        if (stream->out_pos) {
+            memmove(stream->out, stream->out + stream->out_pos,
+                    stream->out_len - stream->out_pos);
+            stream->out_len -= stream->out_pos;
+            stream->out_pos = 0;
+        }
+        while (stream->out_len + line > size)
+            size *= 2;
+        if (size != stream->out_size) {
+            out = realloc(stream->out, size);
+            if (out == NULL) {
+                DBG( 1, "eSCL stream : Memory allocation problem\n");
+                return (SANE_STATUS_NO_MEM);
+            }
+            stream->out = out;
+            stream->out_size = size;
+        }
+    }
+    memcpy(stream->out + stream->out_len, row + (size_t)stream->x_off * 3, line);
+    stream->out_len += line;
+    stream->lines++;
+    return (SANE_STATUS_GOOD);
+}
+
+/**
+ * \fn void escl_stream_close(capabilities_t *scanner)
+ * \brief Stops the download, if any, and frees the stream.
+ */
+void
+escl_stream_close(capabilities_t *scanner)
+{
+    escl_stream_t *stream = scanner->stream;
+
+    if (stream == NULL)
+        return;
+    if (stream->multi) {
+        if (stream->curl)
+            curl_multi_remove_handle(stream->multi, stream->curl);
+        curl_multi_cleanup(stream->multi);
+    }
+    if (stream->curl)
+        curl_easy_cleanup(stream->curl);
+    if (stream->close)
+        stream->close(stream);
+    free(stream->out);
+    free(stream);
+    scanner->stream = NULL;
+}
+
+/**
+ * \fn SANE_Status escl_scan_stream(capabilities_t *scanner, const ESCL_Device *device, char *scanJob, char *result, int *width, int *height, int *bps)
+ * \brief Like 'escl_scan', but only downloads the image until its size is known.
+ *        The rest is downloaded and decoded by 'escl_stream_read', so that
+ *        sane_read() returns the first rows while the scanner is still sending.
+ *        Only JPEG and PNG images can be streamed.
+ *
+ * \return status (if everything is OK, status = SANE_STATUS_GOOD, otherwise, SANE_STATUS_NO_MEM/SANE_STATUS_INVAL/SANE_STATUS_NO_DOCS)
+ */
+SANE_Status
+escl_scan_stream(capabilities_t *scanner, const ESCL_Device *device,
+                 char *scanJob, char *result, int *width, int *height, int *bps)
+{
+    const char *scan_jobs = "/eSCL/";
+    const char *scanner_start = "/NextDocument";
+    const char *format = scanner->caps[scanner->source].default_format;
+    char scan_cmd[PATH_MAX] = { 0 };
+    escl_stream_t *stream = NULL;
+    SANE_Status status = SANE_STATUS_GOOD;
+
+    if (device == NULL)
+        return (SANE_STATUS_NO_MEM);
+    escl_stream_close(scanner);
+    scanner->real_read = 0;
+    stream = (escl_stream_t *)calloc(1, sizeof(escl_stream_t));
+    if (stream == NULL)
+        return (SANE_STATUS_NO_MEM);
+    stream->scanner = scanner;
+    scanner->stream = stream;
+    if (!strcmp(format, "image/jpeg"))
+        status = escl_jpeg_stream(stream);
+    else
+        status = escl_png_stream(stream);
+    if (status != SANE_STATUS_GOOD)
+        goto fail;
+
+    stream->curl = curl_easy_init();
+    stream->multi = curl_multi_init();
+    if (stream->curl == NULL || stream->multi == NULL) {
+        status = SANE_STATUS_NO_MEM;
+        goto fail;
+    }
+    snprintf(scan_cmd, sizeof(scan_cmd), "%s%s%s%s",
+             scan_jobs, scanJob, result, scanner_start);
+    escl_curl_url(stream->curl, device, scan_cmd);
+    curl_easy_setopt(stream->curl, CURLOPT_WRITEFUNCTION, stream_callback);
+    curl_easy_setopt(stream->curl, CURLOPT_WRITEDATA, scanner);
+    curl_easy_setopt(stream->curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(stream->curl, CURLOPT_MAXREDIRS, 3L);
+    curl_multi_add_handle(stream->multi, stream->curl);
+    stream->running = 1;
+
+    while (!stream->have_header && stream->status == SANE_STATUS_GOOD &&
+           stream->running)
+        escl_stream_pump(stream);
+
+    DBG(10, "eSCL scan stream : [%s]\treal read (%ld)\n",
+        sane_strstatus(stream->status), scanner->real_read);
+    if (scanner->real_read == 0) {
+        status = SANE_STATUS_NO_DOCS;
+        goto fail;
+    }
+    if (!stream->have_header || stream->status != SANE_STATUS_GOOD) {
+        DBG( 1, "eSCL scan stream : No image header\n");
+        status = SANE_STATUS_INVAL;
+        goto fail;
+    }
+    *width = stream->width;
+    *height = stream->height;
+    *bps = 3;
+    scanner->img_size = (long)stream->width * stream->height * 3;
+    scanner->img_read = 0;
+    return (SANE_STATUS_GOOD);
+
+fail:
+    escl_stream_close(scanner);
+    return (status);
+}
+
+/**
+ * \fn SANE_Status escl_stream_read(capabilities_t *scanner, unsigned char *buf, int maxlen, int *len)
+ * \brief Returns the next decoded bytes of a streamed image, waiting for
+ *        the scanner if none are decoded yet.
+ *
+ * \return SANE_STATUS_GOOD, or SANE_STATUS_IO_ERROR if the image ended early
+ */
+SANE_Status
+escl_stream_read(capabilities_t *scanner, unsigned char *buf, int maxlen, int *len)
+{
+    escl_stream_t *stream = scanner->stream;
+    size_t count;
+
+    *len = 0;
+    if (stream == NULL)
+        return (SANE_STATUS_INVAL);
+    while (stream->out_pos == stream->out_len) {
+        if (stream->status != SANE_STATUS_GOOD)
+            return (stream->status);
+        if (stream->ended) {
+            DBG( 1, "eSCL stream : Image ended after %d of %d lines\n",
+                 stream->lines, stream->height);
+            return (SANE_STATUS_IO_ERROR);
+        }
+        escl_stream_pump(stream);
+    }
+    count = stream->out_len - stream->out_pos;
+    if (count > (size_t)maxlen)
+        count = maxlen;
+    memcpy(buf, stream->out + stream->out_pos, count);
+    stream->out_pos += count;
+    *len = (int)count;
+    return (SANE_STATUS_GOOD);
+}
@@ -616,6 +616,13 @@
       v139 2022-11-15, MAN
          - move updated window_gamma logic to set_window
          - use internal gamma table if possible (fixes #618)
+      v140 2026-10-18
+         - do software deskew and despeck as the image arrives,
+           instead of buffering the whole page first
+      v141 2026-10-18
+         - keep only unsent jpeg duplex data in the side buffers, and
+           grow the back buffer as compressed data arrives
+         - don't pass fully buffered jpeg images to sanei_magic
 
    SANE FLOW DIAGRAM
 
@@ -665,7 +672,7 @@
 #include "fujitsu.h"
 
 #define DEBUG 1
-#define BUILD 139
+#define BUILD 141
 
 /* values for SANE_DEBUG_FUJITSU env var:
  - errors           5
@@ -7158,7 +7165,8 @@ sane_start (SANE_Handle handle)
         s->buff_tot[SIDE_FRONT] = s->buffer_size;
 
         /* the front buffer is normally very small, but some scanners or
-         * option combinations can't handle it, so we make a big one */
+         * option combinations can't handle it, so we make a big one.
+         * deskew and despeck grow it as far as they need to */
         if(
           (s->s_mode == MODE_COLOR && s->color_interlace == COLOR_INTERLACE_3091)
           || must_fully_buffer(s)
@@ -7178,10 +7186,22 @@ sane_start (SANE_Handle handle)
         s->buff_tot[SIDE_BACK] = s->bytes_tot[SIDE_BACK];
 
         /* the back buffer is normally very large, but some scanners or
-         * option combinations don't need it, so we make a small one */
-        if(s->low_mem || s->source == SOURCE_ADF_BACK || s->source == SOURCE_CARD_BACK
+         * option combinations don't need it, so we make a small one.
+         * in low-mem mode, the back side is sent before deskew and
+         * despeck start on it, so they need all of it */
+        if((s->low_mem && !must_band_process(s))
+         || s->source == SOURCE_ADF_BACK || s->source == SOURCE_CARD_BACK
          || s->duplex_interlace == DUPLEX_INTERLACE_NONE)
           s->buff_tot[SIDE_BACK] = s->buffer_size;
+
+        /* interlaced jpeg is much smaller than the raw image, so
+         * read_from_JPEGduplex grows the back buffer as data arrives */
+        if(s->s_params.format == SANE_FRAME_JPEG
+         && s->jpeg_interlace == JPEG_INTERLACE_ALT
+         && (s->source == SOURCE_ADF_DUPLEX || s->source == SOURCE_CARD_DUPLEX)
+         && s->buff_tot[SIDE_BACK] > s->buffer_size){
+          s->buff_tot[SIDE_BACK] = s->buffer_size;
+        }
       }
       else{
         s->bytes_tot[SIDE_BACK] = 0;
@@ -7240,30 +7260,42 @@ sane_start (SANE_Handle handle)
       goto errors;
     }
 
-    /* finished buffering, adjust image as required */
-    if(s->swdeskew && (!s->hwdeskewcrop || s->req_driv_crop)){
-      buffer_deskew(s,s->side);
-    }
-    if(s->swcrop && (!s->hwdeskewcrop || s->req_driv_crop)){
-      buffer_crop(s,s->side);
-    }
-    if(s->swdespeck){
-      buffer_despeck(s,s->side);
-    }
-    if(s->swskip){
-      /* Skipping means throwing out this image.
-       * Pretend the user read the whole thing
-       * and call sane_start again.
-       * This assumes we are running in batch mode. */
-      if(buffer_isblank(s,s->side)){
-        s->bytes_tx[s->side] = s->bytes_rx[s->side];
-        s->eof_tx[s->side] = 1;
-        return sane_start(handle);
+    /* finished buffering, adjust image as required,
+     * jpeg is only here for hardware deskew */
+    if(s->s_params.format != SANE_FRAME_JPEG){
+      if(s->swdeskew && (!s->hwdeskewcrop || s->req_driv_crop)){
+        buffer_deskew(s,s->side);
+      }
+      if(s->swcrop && (!s->hwdeskewcrop || s->req_driv_crop)){
+        buffer_crop(s,s->side);
+      }
+      if(s->swdespeck){
+        buffer_despeck(s,s->side);
+      }
+      if(s->swskip){
+        /* Skipping means throwing out this image.
+         * Pretend the user read the whole thing
+         * and call sane_start again.
+         * This assumes we are running in batch mode. */
+        if(buffer_isblank(s,s->side)){
+          s->bytes_tx[s->side] = s->bytes_rx[s->side];
+          s->eof_tx[s->side] = 1;
+          return sane_start(handle);
+        }
       }
     }
 
   }
 
+  /* deskew and despeck the image as it arrives */
+  else if( must_band_process(s) ){
+    buffer_band_start(s,s->side);
+  }
+  else if( s->bands[s->side] ){
+    sanei_magic_bandFinish(s->bands[s->side]);
+    s->bands[s->side] = NULL;
+  }
+
   /* check if user cancelled during this start */
   ret = check_for_cancel(s);
 
@@ -7488,6 +7520,11 @@ setup_buffers (struct fujitsu *s)
 
   for(side=0;side<2;side++){
 
+    if (s->bands[side]) {
+      sanei_magic_bandFinish(s->bands[side]);
+      s->bands[side] = NULL;
+    }
+
     /* free old mem */
     if (s->buffers[side]) {
       DBG (15, "setup_buffers: free buffer %d.\n",side);
@@ -7510,6 +7547,60 @@ setup_buffers (struct fujitsu *s)
   return ret;
 }
 
+/*
+ * moves the bytes the frontend has not read yet
+ * to the start of the buffer of one side
+ */
+static void
+compact_buffer (struct fujitsu *s, int side)
+{
+  int remain = s->buff_rx[side] - s->buff_tx[side];
+
+  if(!s->buff_tx[side] || s->bands[side]){
+    return;
+  }
+
+  DBG (15, "compact_buffer: side %d, moving %d\n", side, remain);
+
+  memmove(s->buffers[side], s->buffers[side] + s->buff_tx[side], remain);
+  s->buff_rx[side] = remain;
+  s->buff_tx[side] = 0;
+}
+
+/*
+ * enlarges the buffer of one side so it has room for
+ * bytes more, but never beyond the size of the raw image
+ */
+static SANE_Status
+grow_buffer (struct fujitsu *s, int side, int bytes)
+{
+  unsigned char * buff;
+  int tot = s->buff_tot[side] ? s->buff_tot[side] : s->buffer_size;
+
+  while(tot - s->buff_rx[side] < bytes && tot < s->bytes_tot[side]){
+    tot *= 2;
+  }
+  if(tot > s->bytes_tot[side]){
+    tot = s->bytes_tot[side];
+  }
+  if(tot <= s->buff_tot[side]){
+    return SANE_STATUS_GOOD;
+  }
+
+  DBG (15, "grow_buffer: side %d, %d to %d\n", side, s->buff_tot[side], tot);
+
+  buff = realloc(s->buffers[side], tot);
+  if(!buff){
+    DBG (5, "grow_buffer: Error, no buffer %d.\n", side);
+    return SANE_STATUS_NO_MEM;
+  }
+
+  s->buffers[side] = buff;
+  s->buff_tot[side] = tot;
+
+  return SANE_STATUS_GOOD;
+}
+
 /*
  * This routine issues a SCSI SET WINDOW command to the scanner, using the
  * values currently in the scanner data structure.
@@ -8134,6 +8225,11 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len, SANE_Int * len
     }
   } /*end simplex*/
 
+  /* deskew and despeck the lines that have arrived */
+  if(s->bands[s->side]){
+    buffer_band(s,s->side);
+  }
+
   /* uncommon case, downsample and copy a block from buffer to frontend */
   if(must_downsample(s)){
     ret = downsample_from_buffer(s,buf,max_len,len,s->side);
@@ -8145,7 +8241,14 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len, SANE_Int * len
   }
 
   /*finished sending small buffer, reset it*/
-  if(s->buff_tx[s->side] == s->buff_rx[s->side]
+  if(s->bands[s->side]){
+    ret = buffer_band_compact(s,s->side);
+    if(ret){
+      DBG(5,"sane_read: band compact returning %d\n",ret);
+      return ret;
+    }
+  }
+  else if(s->buff_tx[s->side] == s->buff_rx[s->side]
     && s->buff_tot[s->side] < s->bytes_tot[s->side]
   ){
     DBG (15, "sane_read: reset buffers\n");
@@ -8222,6 +8325,21 @@ read_from_JPEGduplex(struct fujitsu *s)
       return ret;
     }
 
+    /* the frontend only needs the data it has not read yet, move
+     * that to the start of the buffers, so they can be kept small */
+    compact_buffer(s,SIDE_FRONT);
+    compact_buffer(s,SIDE_BACK);
+
+    /* the back is sent after the front, so it has to hold the whole
+     * compressed image, unless the frontend swaps sides in low-mem mode */
+    if(!s->eof_rx[SIDE_BACK] && !s->low_mem){
+      ret = grow_buffer(s,SIDE_BACK,bytes);
+      if(ret){
+        DBG(5,"read_from_JPEGduplex: cannot grow back buffer\n");
+        return ret;
+      }
+    }
+
     /* we don't know if the following read will give us front or back data
      * so we only get enough to fill whichever is smaller (and not yet done) */
     if(!s->eof_rx[SIDE_FRONT]){
@@ -8996,7 +9114,7 @@ read_from_buffer(struct fujitsu *s, SANE_Byte * buf,
 {
     SANE_Status ret=SANE_STATUS_GOOD;
     int bytes = max_len;
-    int remain = s->buff_rx[side] - s->buff_tx[side];
+    int remain = buffer_ready(s,side) - s->buff_tx[side];
 
     DBG (10, "read_from_buffer: start\n");
 
@@ -9044,7 +9162,7 @@ downsample_from_buffer(struct fujitsu *s, SANE_Byte * buf,
 
     if(s->s_mode == MODE_COLOR && s->u_mode == MODE_GRAYSCALE){
 
-      while(*len < max_len && s->buff_rx[side] - s->buff_tx[side] >= 3){
+      while(*len < max_len && buffer_ready(s,side) - s->buff_tx[side] >= 3){
 
         int gray = 0;
 
@@ -9081,7 +9199,7 @@ downsample_from_buffer(struct fujitsu *s, SANE_Byte * buf,
       /*FIXME: add dynamic threshold? */
       unsigned char thresh = (s->threshold ? s->threshold : 127);
 
-      while(*len < max_len && s->buff_rx[side] - s->buff_tx[side] >= 24){
+      while(*len < max_len && buffer_ready(s,side) - s->buff_tx[side] >= 24){
 
         int i;
         unsigned char out = 0;
@@ -9923,12 +10041,40 @@ wait_scanner(struct fujitsu *s)
 static int
 must_fully_buffer(struct fujitsu *s)
 {
+  /* hardware deskew will tell image size after transfer */
   if(s->hwdeskewcrop){
     return 1;
   }
 
+  /* the software functions can't work on compressed data,
+   * and the frontend gets the size of jpeg from its header */
+  if(s->s_params.format == SANE_FRAME_JPEG){
+    return 0;
+  }
+
+  if(s->swcrop || s->swskip){
+    return 1;
+  }
+
+  /* deskew and despeck need to know the image length */
+  if((s->swdeskew || s->swdespeck) && s->ald){
+    return 1;
+  }
+
+  return 0;
+}
+
+/* deskew and despeck don't change the size of the image,
+ * so they are done in the buffer as the image arrives. */
+static int
+must_band_process(struct fujitsu *s)
+{
+  if(must_fully_buffer(s)){
+    return 0;
+  }
+
   if(
-    (s->swdeskew || s->swdespeck || s->swcrop || s->swskip)
+    (s->swdeskew || s->swdespeck)
     && s->s_params.format != SANE_FRAME_JPEG
   ){
     return 1;
@@ -10170,8 +10316,6 @@ buffer_deskew(struct fujitsu *s, int side)
 {
   SANE_Status ret = SANE_STATUS_GOOD;
 
-  int bg_color = 0xd6;
-
   DBG (10, "buffer_deskew: start\n");
 
   /*only find skew on first image from a page, or if first image had error */
@@ -10194,18 +10338,8 @@ buffer_deskew(struct fujitsu *s, int side)
     s->deskew_vals[0] = s->s_params.pixels_per_line - s->deskew_vals[0];
   }
 
-  /* tweak the bg color based on scanner settings */
-  if(s->s_mode == MODE_HALFTONE || s->s_mode == MODE_LINEART){
-    if(s->bg_color == COLOR_BLACK || s->hwdeskewcrop || s->overscan)
-      bg_color = 0xff;
-    else
-      bg_color = 0;
-  }
-  else if(s->bg_color == COLOR_BLACK || s->hwdeskewcrop || s->overscan)
-    bg_color = 0;
-
   ret = sanei_magic_rotate(&s->s_params,s->buffers[side],
-    s->deskew_vals[0],s->deskew_vals[1],s->deskew_slope,bg_color);
+    s->deskew_vals[0],s->deskew_vals[1],s->deskew_slope,deskew_bg_color(s));
 
   if(ret){
     DBG(5,"buffer_deskew: rotate error: %d",ret);
@@ -10218,6 +10352,25 @@ buffer_deskew(struct fujitsu *s, int side)
   return ret;
 }
 
+/* replacement color for the corners exposed by deskew */
+static int
+deskew_bg_color(struct fujitsu *s)
+{
+  int bg_color = 0xd6;
+
+  /* tweak the bg color based on scanner settings */
+  if(s->s_mode == MODE_HALFTONE || s->s_mode == MODE_LINEART){
+    if(s->bg_color == COLOR_BLACK || s->hwdeskewcrop || s->overscan)
+      bg_color = 0xff;
+    else
+      bg_color = 0;
+  }
+  else if(s->bg_color == COLOR_BLACK || s->hwdeskewcrop || s->overscan)
+    bg_color = 0;
+
+  return bg_color;
+}
+
 /* Look in image for likely left/right/bottom paper edges, then crop image.
  * Does not attempt to rotate the image, that should be done first.
  * FIXME: should we do this before we binarize instead of after? */
@@ -10291,6 +10444,161 @@ buffer_despeck(struct fujitsu *s, int side)
   return ret;
 }
 
+/* Set up deskew and despeck of an image as it arrives, instead of after
+ * it is fully buffered. Same settings as buffer_deskew/buffer_despeck. */
+static SANE_Status
+buffer_band_start(struct fujitsu *s, int side)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  DBG (10, "buffer_band_start: start\n");
+
+  sanei_magic_bandFinish(s->bands[side]);
+  s->bands[side] = NULL;
+  s->buff_ready[side] = 0;
+  s->band_first[side] = 0;
+
+  ret = sanei_magic_bandStart(&s->bands[side],
+    &s->s_params,s->resolution_x,s->resolution_y);
+  if(ret){
+    DBG (5, "buffer_band_start: bad start, bailing\n");
+    goto cleanup;
+  }
+
+  if(s->swdeskew){
+
+    /*only find skew on first image from a page, or if first image had error */
+    if(s->side == SIDE_FRONT
+      || s->source == SOURCE_ADF_BACK || s->source == SOURCE_CARD_BACK
+      || s->deskew_stat){
+
+      /* updated by buffer_band once the image is done */
+      s->deskew_stat = SANE_STATUS_UNSUPPORTED;
+      ret = sanei_magic_bandDeskew(s->bands[side],deskew_bg_color(s));
+    }
+    /* backside images can use a 'flipped' version of frontside data */
+    else{
+      s->deskew_slope *= -1;
+      s->deskew_vals[0] = s->s_params.pixels_per_line - s->deskew_vals[0];
+
+      ret = sanei_magic_bandRotate(s->bands[side],
+        s->deskew_vals[0],s->deskew_vals[1],s->deskew_slope,
+        deskew_bg_color(s));
+    }
+
+    if(ret){
+      DBG (5, "buffer_band_start: bad deskew, bailing\n");
+      goto cleanup;
+    }
+  }
+
+  if(s->swdespeck){
+    ret = sanei_magic_bandDespeck(s->bands[side],s->swdespeck);
+    if(ret){
+      DBG (5, "buffer_band_start: bad despeck, bailing\n");
+      goto cleanup;
+    }
+  }
+
+  cleanup:
+  /* send the image unchanged */
+  if(ret){
+    sanei_magic_bandFinish(s->bands[side]);
+    s->bands[side] = NULL;
+    ret = SANE_STATUS_GOOD;
+  }
+
+  DBG (10, "buffer_band_start: finish\n");
+  return ret;
+}
+
+/* Deskew and despeck the lines that have arrived in the buffer,
+ * and mark the finished ones as ready to send */
+static SANE_Status
+buffer_band(struct fujitsu *s, int side)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  int first = s->band_first[side];
+  int lines = first + s->buff_rx[side] / s->s_params.bytes_per_line;
+  int done = 0;
+
+  DBG (10, "buffer_band: start\n");
+
+  ret = sanei_magic_bandProcessRows(s->bands[side],s->buffers[side],
+    first,lines,&done);
+  if(ret){
+    DBG (5, "buffer_band: bad process, bailing\n");
+    sanei_magic_bandFinish(s->bands[side]);
+    s->bands[side] = NULL;
+    ret = SANE_STATUS_GOOD;
+    goto cleanup;
+  }
+
+  s->buff_ready[side] = (done - first) * s->s_params.bytes_per_line;
+
+  /* image ended early, send the rest as it is */
+  if(s->eof_rx[side] && lines < s->s_params.lines){
+    s->buff_ready[side] = s->buff_rx[side];
+  }
+
+  /* keep the skew for the backside */
+  if(done == s->s_params.lines && s->swdeskew && s->deskew_stat){
+    s->deskew_stat = sanei_magic_bandGetSkew(s->bands[side],
+      &s->deskew_vals[0],&s->deskew_vals[1],&s->deskew_slope);
+  }
+
+  cleanup:
+  DBG (10, "buffer_band: finish %d\n", s->buff_ready[side]);
+  return ret;
+}
+
+/* Drop the lines that were sent and will not be read by the band
+ * again from a small buffer, and grow it if the band still needs
+ * too many lines to leave room for the next read */
+static SANE_Status
+buffer_band_compact(struct fujitsu *s, int side)
+{
+  int bwidth = s->s_params.bytes_per_line;
+  int drop = s->buff_tx[side];
+
+  if(s->buff_tot[side] >= s->bytes_tot[side]){
+    return SANE_STATUS_GOOD;
+  }
+
+  /* despeck reads the line above the finished ones */
+  if(drop > s->buff_ready[side] - bwidth){
+    drop = s->buff_ready[side] - bwidth;
+  }
+  drop -= drop % bwidth;
+
+  if(drop > 0){
+    DBG (15, "buffer_band_compact: side %d, dropping %d\n", side, drop);
+
+    memmove(s->buffers[side], s->buffers[side] + drop,
+      s->buff_rx[side] - drop);
+    s->buff_rx[side] -= drop;
+    s->buff_tx[side] -= drop;
+    s->buff_ready[side] -= drop;
+    s->band_first[side] += drop / bwidth;
+  }
+
+  if(s->buff_tot[side] - s->buff_rx[side] < s->buffer_size){
+    return grow_buffer(s,side,s->buffer_size);
+  }
+
+  return SANE_STATUS_GOOD;
+}
+
+/* bytes in the buffer that can be sent to the user */
+static int
+buffer_ready(struct fujitsu *s, int side)
+{
+  if(s->bands[side]){
+    return s->buff_ready[side];
+  }
+  return s->buff_rx[side];
+}
+
 /* Look if image has too few dark pixels.*/
 static int
 buffer_isblank(struct fujitsu *s, int side)
@@ -560,6 +560,13 @@ struct fujitsu
 
   unsigned char * buffers[2];
 
+  /* deskew/despeck done as the image arrives, the number of
+   * bytes in buffers which they have finished, and the image
+   * line at the start of buffers, as sent lines are dropped */
+  sanei_magic_band * bands[2];
+  int buff_ready[2];
+  int band_first[2];
+
   /* --------------------------------------------------------------------- */
   /*hardware feature bookkeeping*/
   int req_driv_crop;
@@ -815,6 +822,7 @@ static SANE_Status set_off_mode(struct fujitsu *s);
 
 static int must_downsample (struct fujitsu *s);
 static int must_fully_buffer (struct fujitsu *s);
+static int must_band_process (struct fujitsu *s);
 static int get_page_width (struct fujitsu *s);
 static int get_page_height (struct fujitsu *s);
 static int get_ipc_mode (struct fujitsu *s);
@@ -845,12 +853,19 @@ static SANE_Status read_from_buffer(struct fujitsu *s, SANE_Byte * buf, SANE_Int
 static SANE_Status downsample_from_buffer(struct fujitsu *s, SANE_Byte * buf, SANE_Int max_len, SANE_Int * len, int side);
 
 static SANE_Status setup_buffers (struct fujitsu *s);
+static void compact_buffer (struct fujitsu *s, int side);
+static SANE_Status grow_buffer (struct fujitsu *s, int side, int bytes);
 
 static SANE_Status get_hardware_status (struct fujitsu *s, SANE_Int option);
 
 static SANE_Status buffer_deskew(struct fujitsu *s, int side);
 static SANE_Status buffer_crop(struct fujitsu *s, int side);
 static SANE_Status buffer_despeck(struct fujitsu *s, int side);
+static SANE_Status buffer_band_start(struct fujitsu *s, int side);
+static SANE_Status buffer_band(struct fujitsu *s, int side);
+static SANE_Status buffer_band_compact(struct fujitsu *s, int side);
+static int buffer_ready(struct fujitsu *s, int side);
+static int deskew_bg_color(struct fujitsu *s);
 static int buffer_isblank(struct fujitsu *s, int side);
 
 static void hexdump (int level, char *comment, unsigned char *p, int l);
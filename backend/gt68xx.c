@@ -1924,7 +1924,7 @@ sane_start (SANE_Handle handle)
   GT68xx_Scan_Parameters scan_params;
   SANE_Status status;
   SANE_Int i, gamma_size;
-  unsigned int *buffer_pointers[3];
+  uint16_t *buffer_pointers[3];
   SANE_Bool document;
 
   DBG (5, "sane_start: start\n");
@@ -2073,6 +2073,15 @@ sane_start (SANE_Handle handle)
        SANE_UNFIX (scan_request.y0), SANE_UNFIX (scan_request.xs),
        SANE_UNFIX (scan_request.ys), scan_request.color ? "color" : "gray");
 
+  s->inflate_x = s->val[OPT_RESOLUTION].w / s->dev->model->optical_xdpi;
+  if (s->inflate_x > 1)
+    DBG (5, "sane_start: inflating x by factor %d\n", s->inflate_x);
+  else
+    s->inflate_x = 1;
+
+  s->lineart = (strcmp (s->val[OPT_MODE].s, SANE_VALUE_SCAN_MODE_LINEART) == 0)
+    ? SANE_TRUE : SANE_FALSE;
+
   s->line = 0;
   s->byte_count = s->reader->params.pixel_xs;
   s->total_bytes = 0;
@@ -2096,9 +2105,8 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len,
 {
   GT68xx_Scanner *s = handle;
   SANE_Status status;
-  static unsigned int *buffer_pointers[3];
+  static uint16_t *buffer_pointers[3];
   SANE_Int inflate_x;
-  SANE_Bool lineart;
   SANE_Int i, color, colors;
 
   if (!s)
@@ -2140,14 +2148,7 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len,
       return SANE_STATUS_EOF;
     }
 
-  inflate_x = s->val[OPT_RESOLUTION].w / s->dev->model->optical_xdpi;
-  if (inflate_x > 1)
-    DBG (5, "sane_read: inflating x by factor %d\n", inflate_x);
-  else
-    inflate_x = 1;
-
-  lineart = (strcmp (s->val[OPT_MODE].s, SANE_VALUE_SCAN_MODE_LINEART) == 0)
-    ? SANE_TRUE : SANE_FALSE;
+  inflate_x = s->inflate_x;
 
   if (s->reader->params.color)
     colors = 3;
@@ -2185,7 +2186,7 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len,
           /* mirror lines */
           if (s->dev->model->flags & GT68XX_FLAG_MIRROR_X)
             {
-              unsigned int swap;
+              uint16_t swap;
 
               for (color = 0; color < colors; color++)
                 {
@@ -2201,7 +2202,7 @@ sane_read (SANE_Handle handle, SANE_Byte * buf, SANE_Int max_len,
                 }
             }
         }
-      if (lineart)
+      if (s->lineart)
         {
           SANE_Int bit;
           SANE_Byte threshold = s->val[OPT_THRESHOLD].w;
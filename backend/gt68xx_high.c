@@ -80,6 +80,7 @@ gt68xx_calibrator_new (SANE_Int width,
 
   cal->k_white = NULL;
   cal->k_black = NULL;
+  cal->k_recip = NULL;
   cal->white_line = NULL;
   cal->black_line = NULL;
   cal->width = width;
@@ -92,10 +93,12 @@ gt68xx_calibrator_new (SANE_Int width,
 
   cal->k_white = (unsigned int *) malloc (width * sizeof (unsigned int));
   cal->k_black = (unsigned int *) malloc (width * sizeof (unsigned int));
+  cal->k_recip = (uint64_t *) malloc (width * sizeof (uint64_t));
   cal->white_line = (double *) malloc (width * sizeof (double));
   cal->black_line = (double *) malloc (width * sizeof (double));
 
-  if (!cal->k_white || !cal->k_black || !cal->white_line || !cal->black_line)
+  if (!cal->k_white || !cal->k_black || !cal->k_recip || !cal->white_line
+      || !cal->black_line)
     {
       DBG (5, "gt68xx_calibrator_new: no memory for calibration data\n");
       gt68xx_calibrator_free (cal);
@@ -106,6 +109,7 @@ gt68xx_calibrator_new (SANE_Int width,
     {
       cal->k_white[i] = 0;
       cal->k_black[i] = 0;
+      cal->k_recip[i] = 0;
       cal->white_line[i] = 0.0;
       cal->black_line[i] = 0.0;
     }
@@ -143,6 +147,12 @@ gt68xx_calibrator_free (GT68xx_Calibrator * cal)
       cal->k_black = NULL;
     }
 
+  if (cal->k_recip)
+    {
+      free (cal->k_recip);
+      cal->k_recip = NULL;
+    }
+
   if (cal->white_line)
     {
       free (cal->white_line);
@@ -162,7 +172,7 @@ gt68xx_calibrator_free (GT68xx_Calibrator * cal)
 }
 
 SANE_Status
-gt68xx_calibrator_add_white_line (GT68xx_Calibrator * cal, unsigned int *line)
+gt68xx_calibrator_add_white_line (GT68xx_Calibrator * cal, uint16_t *line)
 {
   SANE_Int i;
   SANE_Int width = cal->width;
@@ -207,7 +217,7 @@ gt68xx_calibrator_eval_white (GT68xx_Calibrator * cal, double factor)
 }
 
 SANE_Status
-gt68xx_calibrator_add_black_line (GT68xx_Calibrator * cal, unsigned int *line)
+gt68xx_calibrator_add_black_line (GT68xx_Calibrator * cal, uint16_t *line)
 {
   SANE_Int i;
   SANE_Int width = cal->width;
@@ -245,6 +255,28 @@ gt68xx_calibrator_eval_black (GT68xx_Calibrator * cal, double factor)
   return SANE_STATUS_GOOD;
 }
 
+/** Compute the scaling coefficients used by gt68xx_calibrator_process_line()
+ * from the white point vector, so that no division is needed per pixel.
+ *
+ * The coefficient is white_level / k_white rounded up, in 32.32 fixed point.
+ * As samples and white_level are below 2^16, the scaled values are the same
+ * as with the division.
+ */
+static void
+gt68xx_calibrator_set_recip (GT68xx_Calibrator * cal)
+{
+  int i;
+
+  for (i = 0; i < cal->width; ++i)
+    {
+      if (cal->k_white[i] > 0)
+	cal->k_recip[i] =
+	  ((uint64_t) cal->white_level << 32) / cal->k_white[i] + 1;
+      else
+	cal->k_recip[i] = 0;
+    }
+}
+
 SANE_Status
 gt68xx_calibrator_finish_setup (GT68xx_Calibrator * cal)
 {
@@ -278,25 +310,26 @@ gt68xx_calibrator_finish_setup (GT68xx_Calibrator * cal)
        ave_black, ave_diff);
 #endif /* TUNE_CALIBRATOR */
 
+  gt68xx_calibrator_set_recip (cal);
   return SANE_STATUS_GOOD;
 }
 
 SANE_Status
-gt68xx_calibrator_process_line (GT68xx_Calibrator * cal, unsigned int *line)
+gt68xx_calibrator_process_line (GT68xx_Calibrator * cal, uint16_t *line)
 {
   int i;
   int width = cal->width;
-  unsigned int white_level = cal->white_level;
 
   for (i = 0; i < width; ++i)
     {
       unsigned int src_value = line[i];
       unsigned int black = cal->k_black[i];
-      unsigned int value;
+      uint64_t value;
 
       if (src_value > black)
 	{
-	  value = (src_value - black) * white_level / cal->k_white[i];
+	  /* (src_value - black) * white_level / k_white[i] */
+	  value = ((uint64_t) (src_value - black) * cal->k_recip[i]) >> 32;
 	  if (value > 0xffff)
 	    {
 	      value = 0xffff;
@@ -314,7 +347,7 @@ gt68xx_calibrator_process_line (GT68xx_Calibrator * cal, unsigned int *line)
 #endif /* TUNE_CALIBRATOR */
 	}
 
-      line[i] = value;
+      line[i] = (uint16_t) value;
     }
 
   return SANE_STATUS_GOOD;
@@ -341,6 +374,7 @@ gt68xx_scanner_new (GT68xx_Device * dev, GT68xx_Scanner ** scanner_return)
   scanner->cal_r = NULL;
   scanner->cal_g = NULL;
   scanner->cal_b = NULL;
+  scanner->cal_mono = NULL;
 
   for(i=0;i<MAX_RESOLUTIONS;i++)
     {
@@ -358,6 +392,8 @@ gt68xx_scanner_new (GT68xx_Device * dev, GT68xx_Scanner ** scanner_return)
 static void
 gt68xx_scanner_free_calibrators (GT68xx_Scanner * scanner)
 {
+  scanner->cal_mono = NULL;
+
   if (scanner->cal_gray)
     {
       gt68xx_calibrator_free (scanner->cal_gray);
@@ -648,7 +684,7 @@ gt68xx_scanner_create_gray_calibrators (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_color_white_line (GT68xx_Scanner * scanner,
-					   unsigned int **buffer_pointers)
+					   uint16_t **buffer_pointers)
 {
 
   gt68xx_calibrator_add_white_line (scanner->cal_r, buffer_pointers[0]);
@@ -660,7 +696,7 @@ gt68xx_scanner_calibrate_color_white_line (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_gray_white_line (GT68xx_Scanner * scanner,
-					  unsigned int **buffer_pointers)
+					  uint16_t **buffer_pointers)
 {
   gt68xx_calibrator_add_white_line (scanner->cal_gray, buffer_pointers[0]);
   return SANE_STATUS_GOOD;
@@ -668,7 +704,7 @@ gt68xx_scanner_calibrate_gray_white_line (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_color_black_line (GT68xx_Scanner * scanner,
-					   unsigned int **buffer_pointers)
+					   uint16_t **buffer_pointers)
 {
   gt68xx_calibrator_add_black_line (scanner->cal_r, buffer_pointers[0]);
   gt68xx_calibrator_add_black_line (scanner->cal_g, buffer_pointers[1]);
@@ -679,7 +715,7 @@ gt68xx_scanner_calibrate_color_black_line (GT68xx_Scanner * scanner,
 
 static SANE_Status
 gt68xx_scanner_calibrate_gray_black_line (GT68xx_Scanner * scanner,
-					  unsigned int **buffer_pointers)
+					  uint16_t **buffer_pointers)
 {
   gt68xx_calibrator_add_black_line (scanner->cal_gray, buffer_pointers[0]);
   return SANE_STATUS_GOOD;
@@ -693,7 +729,7 @@ gt68xx_scanner_calibrate (GT68xx_Scanner * scanner,
   GT68xx_Scan_Parameters params;
   GT68xx_Scan_Request req;
   SANE_Int i;
-  unsigned int *buffer_pointers[3];
+  uint16_t *buffer_pointers[3];
   GT68xx_AFE_Parameters *afe = scanner->dev->afe;
   GT68xx_Exposure_Parameters *exposure = scanner->dev->exposure;
 
@@ -916,13 +952,28 @@ gt68xx_scanner_start_scan (GT68xx_Scanner * scanner,
   if (!scanner->dev->model->is_cis)
     sleep (2);
 
+  /* CIS scanners without a gray lamp scan gray with the lamp of one color,
+     so choose its calibrator once instead of for every line */
+  scanner->cal_mono = scanner->cal_gray;
+  if (scanner->dev->model->is_cis
+      && !(scanner->dev->model->flags & GT68XX_FLAG_CIS_LAMP))
+    {
+      if (strcmp (scanner->val[OPT_GRAY_MODE_COLOR].s, GT68XX_COLOR_BLUE) == 0)
+	scanner->cal_mono = scanner->cal_b;
+      else if (strcmp (scanner->val[OPT_GRAY_MODE_COLOR].s,
+		       GT68XX_COLOR_GREEN) == 0)
+	scanner->cal_mono = scanner->cal_g;
+      else
+	scanner->cal_mono = scanner->cal_r;
+    }
+
   return gt68xx_scanner_start_scan_extended (scanner, request, SA_SCAN,
 					     params);
 }
 
 SANE_Status
 gt68xx_scanner_read_line (GT68xx_Scanner * scanner,
-			  unsigned int **buffer_pointers)
+			  uint16_t **buffer_pointers)
 {
   SANE_Status status;
 
@@ -946,28 +997,8 @@ gt68xx_scanner_read_line (GT68xx_Scanner * scanner,
 	}
       else
 	{
-	  if (scanner->dev->model->is_cis && !(scanner->dev->model->flags & GT68XX_FLAG_CIS_LAMP))
-	    {
-	      if (strcmp
-		  (scanner->val[OPT_GRAY_MODE_COLOR].s,
-		   GT68XX_COLOR_BLUE) == 0)
-		gt68xx_calibrator_process_line (scanner->cal_b,
-						buffer_pointers[0]);
-	      else
-		if (strcmp
-		    (scanner->val[OPT_GRAY_MODE_COLOR].s,
-		     GT68XX_COLOR_GREEN) == 0)
-		gt68xx_calibrator_process_line (scanner->cal_g,
-						buffer_pointers[0]);
-	      else
-		gt68xx_calibrator_process_line (scanner->cal_r,
-						buffer_pointers[0]);
-	    }
-	  else
-	    {
-	      gt68xx_calibrator_process_line (scanner->cal_gray,
-					      buffer_pointers[0]);
-	    }
+	  gt68xx_calibrator_process_line (scanner->cal_mono,
+					  buffer_pointers[0]);
 	}
     }
 
@@ -1023,7 +1054,7 @@ struct GT68xx_Afe_Values
  * @param buffer scanned line
  */
 static void
-gt68xx_afe_ccd_calc (GT68xx_Afe_Values * values, unsigned int *buffer)
+gt68xx_afe_ccd_calc (GT68xx_Afe_Values * values, uint16_t *buffer)
 {
   SANE_Int start_black;
   SANE_Int end_black;
@@ -1092,7 +1123,7 @@ gt68xx_afe_ccd_calc (GT68xx_Afe_Values * values, unsigned int *buffer)
 static SANE_Bool
 gt68xx_afe_ccd_adjust_offset_gain (SANE_String_Const color_name,
 				   GT68xx_Afe_Values * values,
-				   unsigned int *buffer, SANE_Byte * offset,
+				   uint16_t *buffer, SANE_Byte * offset,
 				   SANE_Byte * pga, SANE_Byte * old_offset,
 				   SANE_Byte * old_pga)
 {
@@ -1192,7 +1223,7 @@ static SANE_Status
 gt68xx_wait_lamp_stable (GT68xx_Scanner * scanner,
 			 GT68xx_Scan_Parameters * params,
 			 GT68xx_Scan_Request *request,
-			 unsigned int *buffer_pointers[3],
+			 uint16_t *buffer_pointers[3],
 			 GT68xx_Afe_Values *values,
 			 SANE_Bool dont_move)
 {
@@ -1302,7 +1333,7 @@ gt68xx_afe_ccd_auto (GT68xx_Scanner * scanner,
   GT68xx_Scan_Request request;
   int i;
   GT68xx_Afe_Values values;
-  unsigned int *buffer_pointers[3];
+  uint16_t *buffer_pointers[3];
   GT68xx_AFE_Parameters *afe = scanner->dev->afe, old_afe;
   SANE_Bool gray_done = SANE_FALSE;
   SANE_Bool red_done = SANE_FALSE, green_done = SANE_FALSE, blue_done =
@@ -1490,7 +1521,7 @@ gt68xx_afe_ccd_auto (GT68xx_Scanner * scanner,
 
 static void
 gt68xx_afe_cis_calc_black (GT68xx_Afe_Values * values,
-			   unsigned int *black_buffer)
+			   uint16_t *black_buffer)
 {
   SANE_Int start_black;
   SANE_Int end_black;
@@ -1521,7 +1552,7 @@ gt68xx_afe_cis_calc_black (GT68xx_Afe_Values * values,
 
 static void
 gt68xx_afe_cis_calc_white (GT68xx_Afe_Values * values,
-			   unsigned int *white_buffer)
+			   uint16_t *white_buffer)
 {
   SANE_Int start_white;
   SANE_Int end_white;
@@ -1555,8 +1586,8 @@ gt68xx_afe_cis_calc_white (GT68xx_Afe_Values * values,
 static SANE_Bool
 gt68xx_afe_cis_adjust_gain_offset (SANE_String_Const color_name,
 				   GT68xx_Afe_Values * values,
-				   unsigned int *black_buffer,
-				   unsigned int *white_buffer,
+				   uint16_t *black_buffer,
+				   uint16_t *white_buffer,
 				   GT68xx_AFE_Parameters * afe,
 				   GT68xx_AFE_Parameters * old_afe)
 {
@@ -1683,7 +1714,7 @@ finish:
 static SANE_Bool
 gt68xx_afe_cis_adjust_exposure (SANE_String_Const color_name,
 				GT68xx_Afe_Values * values,
-				unsigned int *white_buffer, SANE_Int border,
+				uint16_t *white_buffer, SANE_Int border,
 				SANE_Int * exposure_time)
 {
   SANE_Int exposure_change = 0;
@@ -1719,12 +1750,12 @@ gt68xx_afe_cis_adjust_exposure (SANE_String_Const color_name,
 static SANE_Status
 gt68xx_afe_cis_read_lines (GT68xx_Afe_Values * values,
 			   GT68xx_Scanner * scanner, SANE_Bool lamp,
-			   SANE_Bool first, unsigned int *r_buffer,
-			   unsigned int *g_buffer, unsigned int *b_buffer)
+			   SANE_Bool first, uint16_t *r_buffer,
+			   uint16_t *g_buffer, uint16_t *b_buffer)
 {
   SANE_Status status;
   int line;
-  unsigned int *buffer_pointers[3];
+  uint16_t *buffer_pointers[3];
   GT68xx_Scan_Request request;
   GT68xx_Scan_Parameters params;
 
@@ -1814,11 +1845,11 @@ gt68xx_afe_cis_read_lines (GT68xx_Afe_Values * values,
 	    return status;
 	  }
 	memcpy (r_buffer + values->calwidth * line, buffer_pointers[0],
-		values->calwidth * sizeof (unsigned int));
+		values->calwidth * sizeof (uint16_t));
 	memcpy (g_buffer + values->calwidth * line, buffer_pointers[1],
-		values->calwidth * sizeof (unsigned int));
+		values->calwidth * sizeof (uint16_t));
 	memcpy (b_buffer + values->calwidth * line, buffer_pointers[2],
-		values->calwidth * sizeof (unsigned int));
+		values->calwidth * sizeof (uint16_t));
       }
 
   status = gt68xx_scanner_stop_scan (scanner);
@@ -1843,8 +1874,8 @@ gt68xx_afe_cis_auto (GT68xx_Scanner * scanner)
   GT68xx_Exposure_Parameters *exposure = scanner->dev->exposure;
   SANE_Int red_done, green_done, blue_done;
   SANE_Bool first = SANE_TRUE;
-  unsigned int *r_gbuffer = 0, *g_gbuffer = 0, *b_gbuffer = 0;
-  unsigned int *r_obuffer = 0, *g_obuffer = 0, *b_obuffer = 0;
+  uint16_t *r_gbuffer = 0, *g_gbuffer = 0, *b_gbuffer = 0;
+  uint16_t *r_obuffer = 0, *g_obuffer = 0, *b_obuffer = 0;
 
   DBG (5, "gt68xx_afe_cis_auto: start\n");
 
@@ -1863,17 +1894,17 @@ gt68xx_afe_cis_auto (GT68xx_Scanner * scanner)
 				  r_gbuffer, g_gbuffer, b_gbuffer));
 
   r_gbuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (uint16_t));
   g_gbuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (uint16_t));
   b_gbuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (uint16_t));
   r_obuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (uint16_t));
   g_obuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (uint16_t));
   b_obuffer =
-    malloc (values.calwidth * values.callines * sizeof (unsigned int));
+    malloc (values.calwidth * values.callines * sizeof (uint16_t));
   if (!r_gbuffer || !g_gbuffer || !b_gbuffer || !r_obuffer || !g_obuffer
       || !b_obuffer)
     return SANE_STATUS_NO_MEM;
@@ -2008,6 +2039,7 @@ gt68xx_calibrator_create_copy (GT68xx_Calibrator ** calibrator,
       (*calibrator)->white_line[i]=reference->white_line[i+offset];
       (*calibrator)->black_line[i]=reference->black_line[i+offset];
     }
+  gt68xx_calibrator_set_recip (*calibrator);
 
   return status;
 }
@@ -2048,7 +2080,7 @@ gt68xx_sheetfed_scanner_calibrate (GT68xx_Scanner * scanner)
   GT68xx_Scan_Request request;
   GT68xx_Scan_Parameters params;
   int count, i, x, y, white;
-  unsigned int *buffer_pointers[3];
+  uint16_t *buffer_pointers[3];
 #ifdef DEBUG_CALIBRATION
   FILE *fcal;
   char title[50];
@@ -55,6 +55,7 @@ struct GT68xx_Calibrator
 {
   unsigned int *k_white;	/**< White point vector */
   unsigned int *k_black;	/**< Black point vector */
+  uint64_t *k_recip;		/**< white_level / k_white, 32.32 fixed point */
 
   double *white_line;		/**< White average */
   double *black_line;		/**< Black average */
@@ -120,7 +121,7 @@ static SANE_Status gt68xx_calibrator_free (GT68xx_Calibrator * cal);
  */
 static SANE_Status
 gt68xx_calibrator_add_white_line (GT68xx_Calibrator * cal,
-				  unsigned int *line);
+				  uint16_t *line);
 
 /** Calculate the white point for the calibrator.
  *
@@ -150,7 +151,7 @@ gt68xx_calibrator_eval_white (GT68xx_Calibrator * cal, double factor);
  */
 static SANE_Status
 gt68xx_calibrator_add_black_line (GT68xx_Calibrator * cal,
-				  unsigned int *line);
+				  uint16_t *line);
 
 /** Calculate the black point for the calibrator.
  *
@@ -191,7 +192,7 @@ static SANE_Status gt68xx_calibrator_finish_setup (GT68xx_Calibrator * cal);
  * - #SANE_STATUS_GOOD - the image line was processed successfully.
  */
 static SANE_Status
-gt68xx_calibrator_process_line (GT68xx_Calibrator * cal, unsigned int *line);
+gt68xx_calibrator_process_line (GT68xx_Calibrator * cal, uint16_t *line);
 
 /** List of SANE options
  */
@@ -253,6 +254,7 @@ struct GT68xx_Scanner
   GT68xx_Calibrator *cal_r;	    /**< Calibrator for the red channel */
   GT68xx_Calibrator *cal_g;	    /**< Calibrator for the green channel */
   GT68xx_Calibrator *cal_b;	    /**< Calibrator for the blue channel */
+  GT68xx_Calibrator *cal_mono;	    /**< Calibrator used for gray scans */
 
   /* SANE data */
   SANE_Bool scanning;			   /**< We are currently scanning */
@@ -263,6 +265,8 @@ struct GT68xx_Scanner
   SANE_Int total_bytes;			   /**< Bytes already transmitted */
   SANE_Int byte_count;			   /**< Bytes transmitted in this line */
   SANE_Bool calib;			   /**< Apply calibration data */
+  SANE_Bool lineart;			   /**< Lineart scan */
+  SANE_Int inflate_x;			   /**< Horizontal pixel repetition */
   SANE_Bool auto_afe;			   /**< Use automatic gain/offset */
   SANE_Bool first_scan;			   /**< Is this the first scan? */
   struct timeval lamp_on_time;		   /**< Time when the lamp was turned on */
@@ -337,7 +341,7 @@ gt68xx_scanner_start_scan (GT68xx_Scanner * scanner,
  */
 static SANE_Status
 gt68xx_scanner_read_line (GT68xx_Scanner * scanner,
-			  unsigned int **buffer_pointers);
+			  uint16_t **buffer_pointers);
 
 /** Stop scanning the image.
  *
@@ -43,6 +43,10 @@
 #include "gt68xx_mid.h"
 #include "gt68xx_low.c"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /** @file
  * @brief Image data unpacking.
  */
@@ -67,7 +71,7 @@ gt68xx_delay_buffer_init (GT68xx_Delay_Buffer * delay,
       return SANE_STATUS_INVAL;
     }
 
-  bytes_per_line = pixels_per_line * sizeof (unsigned int);
+  bytes_per_line = pixels_per_line * sizeof (uint16_t);
 
   delay->line_count = line_count = delay_count + 1;
   delay->read_index = 0;
@@ -84,7 +88,7 @@ gt68xx_delay_buffer_init (GT68xx_Delay_Buffer * delay,
     delay->mem_block[i] = i % 256;
 
   delay->lines =
-    (unsigned int **) malloc (sizeof (unsigned int *) * line_count);
+    (uint16_t **) malloc (sizeof (uint16_t *) * line_count);
   if (!delay->lines)
     {
       free (delay->mem_block);
@@ -95,7 +99,7 @@ gt68xx_delay_buffer_init (GT68xx_Delay_Buffer * delay,
 
   for (i = 0; i < line_count; ++i)
     delay->lines[i] =
-      (unsigned int *) (delay->mem_block + i * bytes_per_line);
+      (uint16_t *) (delay->mem_block + i * bytes_per_line);
 
   return SANE_STATUS_GOOD;
 }
@@ -135,94 +139,138 @@ gt68xx_delay_buffer_done (GT68xx_Delay_Buffer * delay)
 
 
 static inline void
-unpack_8_mono (SANE_Byte * src, unsigned int *dst, SANE_Int pixels_per_line)
+unpack_8_mono (SANE_Byte * src, uint16_t * dst, SANE_Int pixels_per_line)
 {
   for (; pixels_per_line > 0; ++src, ++dst, --pixels_per_line)
     {
-      *dst = (((unsigned int) *src) << 8) | *src;
+      *dst = (uint16_t) ((*src << 8) | *src);
     }
 }
 
 static inline void
-unpack_8_rgb (SANE_Byte * src, unsigned int *dst, SANE_Int pixels_per_line)
+unpack_8_rgb (SANE_Byte * src, uint16_t * dst, SANE_Int pixels_per_line)
 {
   for (; pixels_per_line > 0; src += 3, ++dst, --pixels_per_line)
     {
-      *dst = (((unsigned int) *src) << 8) | *src;
+      *dst = (uint16_t) ((*src << 8) | *src);
     }
 }
 
 /* 12-bit routines use the fact that pixels_per_line is aligned */
 
+/* Two 12-bit samples are packed into 3 bytes: the first one is in src[0]
+ * and the low nibble of src[1], the second one in the high nibble of src[1]
+ * and src[2].  They are scaled to 16 bit by repeating the high bits.
+ */
+#define UNPACK_12_FIRST(src) \
+  ((uint16_t) (((src)[1] & 0x0f) << 12 | (src)[0] << 4 | ((src)[1] & 0x0f)))
+#define UNPACK_12_SECOND(src) \
+  ((uint16_t) ((src)[2] << 8 | ((src)[1] & 0xf0) | (src)[2] >> 4))
+
+#ifdef __SSE2__
+/* Unpack 8 pixels from the 12 bytes at src; 16 bytes must be readable. */
+static inline __m128i
+unpack_12_le_sse2 (const SANE_Byte * src)
+{
+  __m128i x, d, w;
+
+  /* 32-bit words starting at bytes 0, 3, 6 and 9, each holding 2 samples */
+  x = _mm_loadu_si128 ((const __m128i *) src);
+  d = _mm_unpacklo_epi64 (_mm_unpacklo_epi32 (x, _mm_srli_si128 (x, 3)),
+			  _mm_unpacklo_epi32 (_mm_srli_si128 (x, 6),
+					      _mm_srli_si128 (x, 9)));
+  w = _mm_or_si128 (_mm_and_si128 (d, _mm_set1_epi32 (0x00000fff)),
+		    _mm_and_si128 (_mm_slli_epi32 (d, 4),
+				   _mm_set1_epi32 (0x0fff0000)));
+  return _mm_or_si128 (_mm_slli_epi16 (w, 4), _mm_srli_epi16 (w, 8));
+}
+#endif
+
 static inline void
-unpack_12_le_mono (SANE_Byte * src, unsigned int *dst,
+unpack_12_le_mono (SANE_Byte * src, uint16_t * dst,
 		   SANE_Int pixels_per_line)
 {
+#ifdef __SSE2__
+  /* 12 pixels are 18 bytes, enough to load 16 bytes for the first 8 */
+  for (; pixels_per_line >= 12; src += 12, dst += 8, pixels_per_line -= 8)
+    _mm_storeu_si128 ((__m128i *) dst, unpack_12_le_sse2 (src));
+#endif
   for (; pixels_per_line > 0; src += 3, dst += 2, pixels_per_line -= 2)
     {
-      dst[0] = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		| (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      dst[1] = ((((unsigned int) src[2]) << 8)
-		| (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+      dst[0] = UNPACK_12_FIRST (src);
+      dst[1] = UNPACK_12_SECOND (src);
     }
 }
 
 static inline void
 unpack_12_le_rgb (SANE_Byte * src,
-		  unsigned int *dst1,
-		  unsigned int *dst2,
-		  unsigned int *dst3, SANE_Int pixels_per_line)
+		  uint16_t * dst1,
+		  uint16_t * dst2,
+		  uint16_t * dst3, SANE_Int pixels_per_line)
 {
+#ifdef __SSE2__
+  uint16_t tmp[24];
+  int i;
+
+  /* unpack 8 pixels of all colors at once, then split the colors */
+  for (; pixels_per_line >= 12; src += 36, pixels_per_line -= 8)
+    {
+      _mm_storeu_si128 ((__m128i *) tmp, unpack_12_le_sse2 (src));
+      _mm_storeu_si128 ((__m128i *) (tmp + 8), unpack_12_le_sse2 (src + 12));
+      _mm_storeu_si128 ((__m128i *) (tmp + 16),
+			unpack_12_le_sse2 (src + 24));
+      for (i = 0; i < 24; i += 3)
+	{
+	  *dst1++ = tmp[i];
+	  *dst2++ = tmp[i + 1];
+	  *dst3++ = tmp[i + 2];
+	}
+    }
+#endif
   for (; pixels_per_line > 0; pixels_per_line -= 2)
     {
-      *dst1++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      *dst2++ = ((((unsigned int) src[2]) << 8)
-		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+      *dst1++ = UNPACK_12_FIRST (src);
+      *dst2++ = UNPACK_12_SECOND (src);
       src += 3;
 
-      *dst3++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      *dst1++ = ((((unsigned int) src[2]) << 8)
-		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+      *dst3++ = UNPACK_12_FIRST (src);
+      *dst1++ = UNPACK_12_SECOND (src);
       src += 3;
 
-      *dst2++ = ((((unsigned int) (src[1] & 0x0f)) << 12)
-		 | (((unsigned int) src[0]) << 4) | (src[1] & 0x0f));
-      *dst3++ = ((((unsigned int) src[2]) << 8)
-		 | (src[1] & 0xf0) | (((unsigned int) src[2]) >> 0x04));
+      *dst2++ = UNPACK_12_FIRST (src);
+      *dst3++ = UNPACK_12_SECOND (src);
       src += 3;
     }
 }
 
 static inline void
-unpack_16_le_mono (SANE_Byte * src, unsigned int *dst,
+unpack_16_le_mono (SANE_Byte * src, uint16_t * dst,
 		   SANE_Int pixels_per_line)
 {
   for (; pixels_per_line > 0; src += 2, dst++, --pixels_per_line)
     {
-      *dst = (((unsigned int) src[1]) << 8) | src[0];
+      *dst = (uint16_t) (src[1] << 8 | src[0]);
     }
 }
 
 static inline void
-unpack_16_le_rgb (SANE_Byte * src, unsigned int *dst,
+unpack_16_le_rgb (SANE_Byte * src, uint16_t * dst,
 		  SANE_Int pixels_per_line)
 {
   for (; pixels_per_line > 0; src += 6, ++dst, --pixels_per_line)
     {
-      *dst = (((unsigned int) src[1]) << 8) | src[0];
+      *dst = (uint16_t) (src[1] << 8 | src[0]);
     }
 }
 
 
 static SANE_Status
 line_read_gray_8 (GT68xx_Line_Reader * reader,
-		  unsigned int **buffer_pointers_return)
+		  uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  uint16_t *buffer;
 
   size = reader->params.scan_bpl;
 
@@ -237,11 +285,11 @@ line_read_gray_8 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_double_8 (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return)
+			 uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  uint16_t *buffer;
   int i;
 
   size = reader->params.scan_bpl;
@@ -263,11 +311,11 @@ line_read_gray_double_8 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_12 (GT68xx_Line_Reader * reader,
-		   unsigned int **buffer_pointers_return)
+		   uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  uint16_t *buffer;
 
   size = reader->params.scan_bpl;
   RIE (gt68xx_device_read (reader->dev, reader->pixel_buffer, &size));
@@ -281,11 +329,11 @@ line_read_gray_12 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_double_12 (GT68xx_Line_Reader * reader,
-			  unsigned int **buffer_pointers_return)
+			  uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  uint16_t *buffer;
   int i;
 
   size = reader->params.scan_bpl;
@@ -307,11 +355,11 @@ line_read_gray_double_12 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_16 (GT68xx_Line_Reader * reader,
-		   unsigned int **buffer_pointers_return)
+		   uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  uint16_t *buffer;
 
   size = reader->params.scan_bpl;
   RIE (gt68xx_device_read (reader->dev, reader->pixel_buffer, &size));
@@ -325,11 +373,11 @@ line_read_gray_16 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_gray_double_16 (GT68xx_Line_Reader * reader,
-			  unsigned int **buffer_pointers_return)
+			  uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
-  unsigned int *buffer;
+  uint16_t *buffer;
   int i;
 
   size = reader->params.scan_bpl;
@@ -352,7 +400,7 @@ line_read_gray_double_16 (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_8_line_mode (GT68xx_Line_Reader * reader,
-			   unsigned int **buffer_pointers_return)
+			   uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -386,7 +434,7 @@ line_read_rgb_8_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_double_8_line_mode (GT68xx_Line_Reader * reader,
-				  unsigned int **buffer_pointers_return)
+				  uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -432,7 +480,7 @@ line_read_rgb_double_8_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_8_line_mode (GT68xx_Line_Reader * reader,
-			   unsigned int **buffer_pointers_return)
+			   uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -465,7 +513,7 @@ line_read_bgr_8_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_12_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -501,7 +549,7 @@ line_read_rgb_12_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_double_12_line_mode (GT68xx_Line_Reader * reader,
-				   unsigned int **buffer_pointers_return)
+				   uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -550,7 +598,7 @@ line_read_rgb_double_12_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_16_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -586,7 +634,7 @@ line_read_rgb_16_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_double_16_line_mode (GT68xx_Line_Reader * reader,
-				   unsigned int **buffer_pointers_return)
+				   uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -635,7 +683,7 @@ line_read_rgb_double_16_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_12_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -671,7 +719,7 @@ line_read_bgr_12_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_16_line_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -707,7 +755,7 @@ line_read_bgr_16_line_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_8_pixel_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -741,7 +789,7 @@ line_read_rgb_8_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_12_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -769,7 +817,7 @@ line_read_rgb_12_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_rgb_16_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -805,7 +853,7 @@ line_read_rgb_16_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_8_pixel_mode (GT68xx_Line_Reader * reader,
-			    unsigned int **buffer_pointers_return)
+			    uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -839,7 +887,7 @@ line_read_bgr_8_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_12_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -867,7 +915,7 @@ line_read_bgr_12_pixel_mode (GT68xx_Line_Reader * reader,
 
 static SANE_Status
 line_read_bgr_16_pixel_mode (GT68xx_Line_Reader * reader,
-			     unsigned int **buffer_pointers_return)
+			     uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
   size_t size;
@@ -1184,7 +1232,7 @@ gt68xx_line_reader_free (GT68xx_Line_Reader * reader)
 
 SANE_Status
 gt68xx_line_reader_read (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return)
+			 uint16_t **buffer_pointers_return)
 {
   SANE_Status status;
 
@@ -57,7 +57,7 @@ struct GT68xx_Delay_Buffer
   SANE_Int line_count;
   SANE_Int read_index;
   SANE_Int write_index;
-  unsigned int **lines;
+  uint16_t **lines;
   SANE_Byte *mem_block;
 };
 
@@ -66,7 +66,7 @@ struct GT68xx_Delay_Buffer
  *
  * This object handles reading the image data from the scanner line by line and
  * converting it to internal format.  Internally each image sample is
- * represented as <code>unsigned int</code> value, scaled to 16-bit range
+ * represented as packed <code>uint16_t</code> value, scaled to 16-bit range
  * (0-65535).  For color images the data for each primary color is stored as
  * separate lines.
  */
@@ -94,7 +94,7 @@ struct GT68xx_Line_Reader
   SANE_Bool delays_initialized;
 
     SANE_Status (*read) (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return);
+			 uint16_t **buffer_pointers_return);
 };
 
 /**
@@ -145,7 +145,7 @@ static SANE_Status gt68xx_line_reader_free (GT68xx_Line_Reader * reader);
  */
 static SANE_Status
 gt68xx_line_reader_read (GT68xx_Line_Reader * reader,
-			 unsigned int **buffer_pointers_return);
+			 uint16_t **buffer_pointers_return);
 
 #endif /* not GT68XX_MID_H */
 
@@ -92,6 +92,7 @@
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#include <sys/uio.h>
 #ifdef HAVE_PWD_H
 #include <pwd.h>
 #endif
@@ -1380,34 +1381,30 @@ bjnp_send_read_request (int devno)
       errno = terrno;
       return -1;
     }
+  device[devno].read_requests++;
   return 0;
 }
 
 static SANE_Status
-bjnp_recv_header (int devno, size_t *payload_size )
+bjnp_recv_data (int devno, SANE_Byte * buffer, size_t start_pos, size_t * len);
+
+static SANE_Status
+bjnp_wait_tcp (int devno, const char *caller)
 {
 /*
- * This function receives the response header to bjnp commands.
- * devno device number
- * size: return value for data size returned by scanner
+ * This function waits for TCP data from the scanner.
  * Returns:
- * SANE_STATUS_IO_ERROR when any IO error occurs
- * SANE_STATUS_GOOD in case no errors were encountered
+ * SANE_STATUS_IO_ERROR when select fails or times out
+ * SANE_STATUS_GOOD when data can be received
  */
-  struct BJNP_command resp_buf;
   fd_set input;
   struct timeval timeout;
-  int recv_bytes;
   int terrno;
   int result;
   int fd;
   int attempt;
 
-  PDBG (bjnp_dbg
-	(LOG_DEBUG, "bjnp_recv_header: receiving response header\n") );
   fd = device[devno].tcp_socket;
-
-  *payload_size = 0;
   attempt = 0;
   do
     {
@@ -1425,8 +1422,8 @@ bjnp_recv_header (int devno, size_t *payload_size )
     {
       terrno = errno;
       PDBG (bjnp_dbg (LOG_CRIT,
-		       "bjnp_recv_header: ERROR - could not read response header (select): %s!\n",
-		       strerror (terrno)));
+		       "%s: ERROR - could not read response (select): %s!\n",
+		       caller, strerror (terrno)));
       errno = terrno;
       return SANE_STATUS_IO_ERROR;
     }
@@ -1434,35 +1431,226 @@ bjnp_recv_header (int devno, size_t *payload_size )
     {
       terrno = errno;
       PDBG (bjnp_dbg (LOG_CRIT,
-		"bjnp_recv_header: ERROR - could not read response header (select timed out after %d ms)!\n",
-		device[devno].bjnp_ip_timeout ) );
+		"%s: ERROR - could not read response (select timed out after %d ms)!\n",
+		caller, device[devno].bjnp_ip_timeout ) );
       errno = terrno;
       return SANE_STATUS_IO_ERROR;
     }
+  return SANE_STATUS_GOOD;
+}
 
-  /* get response header */
+static void
+bjnp_set_stale_read_requests (int devno)
+{
+/*
+ * The read requests in flight will not be answered before the next
+ * command, if at all. Remember their serials, so late answers to them
+ * can be recognized. When there are too many, the oldest is forgotten.
+ */
+  uint16_t serial;
 
-  if ((recv_bytes =
-       recv (fd, (char *) &resp_buf,
-	     sizeof (struct BJNP_command),
-	     0)) != sizeof (struct BJNP_command))
+  serial = (uint16_t) (device[devno].serial - device[devno].read_requests + 1);
+  for (; device[devno].read_requests > 0; device[devno].read_requests--)
     {
-      terrno = errno;
-      if (recv_bytes == 0)
-        {
-          PDBG (bjnp_dbg (LOG_CRIT,
-          		"bjnp_recv_header: ERROR - (recv) Scanner closed the TCP-connection!\n"));
-        } else {
-          PDBG (bjnp_dbg (LOG_CRIT,
-	      	       "bjnp_recv_header: ERROR - (recv) could not read response header, received %d bytes!\n",
-		       recv_bytes));
-          PDBG (bjnp_dbg
-	  		(LOG_CRIT, "bjnp_recv_header: ERROR - (recv) error: %s!\n",
-	     		strerror (terrno)));
-        }
-      errno = terrno;
+      if (device[devno].stale_read_requests == BJNP_STALE_REQUESTS_MAX)
+	{
+	  memmove (device[devno].stale_serials, device[devno].stale_serials + 1,
+		   (BJNP_STALE_REQUESTS_MAX - 1) * sizeof (uint16_t));
+	  device[devno].stale_read_requests--;
+	}
+      device[devno].stale_serials[device[devno].stale_read_requests++] = serial++;
+    }
+}
+
+static void
+bjnp_clear_stale_read_requests (int devno)
+{
+  device[devno].read_requests = 0;
+  device[devno].stale_read_requests = 0;
+  free (device[devno].late_data);
+  device[devno].late_data = NULL;
+  device[devno].late_data_len = 0;
+  device[devno].late_data_pos = 0;
+  device[devno].late_last_block = 0;
+}
+
+static int
+bjnp_find_stale_read_request (int devno, uint16_t serial)
+{
+  int i;
+
+  for (i = 0; i < device[devno].stale_read_requests; i++)
+    {
+      if (device[devno].stale_serials[i] == serial)
+	return i;
+    }
+  return -1;
+}
+
+static SANE_Status
+bjnp_recv_late_data (int devno, size_t size)
+{
+/*
+ * Keep the payload of a late answer to a read request, that arrived
+ * while waiting for the response to a command. It is the start of the
+ * data for the next read.
+ */
+  SANE_Byte *data;
+  size_t n;
+
+  data = realloc (device[devno].late_data, device[devno].late_data_len + size);
+  if (data == NULL)
+    {
+      PDBG (bjnp_dbg (LOG_CRIT,
+		       "bjnp_recv_late_data: ERROR - out of memory for %ld bytes\n",
+		       (long) (device[devno].late_data_len + size)));
       return SANE_STATUS_IO_ERROR;
     }
+  device[devno].late_data = data;
+  while (size > 0)
+    {
+      n = size;
+      if ((bjnp_recv_data (devno, data, device[devno].late_data_len, &n) !=
+	   SANE_STATUS_GOOD) || (n == 0))
+	return SANE_STATUS_IO_ERROR;
+      device[devno].late_data_len += n;
+      size -= n;
+    }
+  return SANE_STATUS_GOOD;
+}
+
+static SANE_Status
+bjnp_recv_header_data (int devno, size_t *payload_size, SANE_Byte * buffer,
+                       size_t * len)
+{
+/*
+ * This function receives the response header to bjnp commands.
+ * If buffer is not NULL, up to *len bytes of the payload are received
+ * into it by the same readv(), and *len is set to the number of payload
+ * bytes received.
+ * Late answers to stale read requests are returned when reading data
+ * (buffer is not NULL), else their payload is kept for the next read.
+ * devno device number
+ * size: return value for data size returned by scanner
+ * Returns:
+ * SANE_STATUS_IO_ERROR when any IO error occurs
+ * SANE_STATUS_GOOD in case no errors were encountered
+ */
+  struct BJNP_command resp_buf;
+  struct iovec iov[2];
+  ssize_t recv_bytes;
+  size_t hdr_bytes;
+  size_t data_bytes;
+  size_t late_size;
+  uint16_t expected;
+  uint16_t seq_no;
+  int iov_count;
+  int stale;
+  int late;
+  int terrno;
+  int fd;
+
+  PDBG (bjnp_dbg
+	(LOG_DEBUG, "bjnp_recv_header: receiving response header\n") );
+  fd = device[devno].tcp_socket;
+
+  /* with read requests in flight, the oldest one is answered first */
+
+  expected = (uint16_t) device[devno].serial;
+  if (device[devno].read_requests > 0)
+    expected = expected - device[devno].read_requests + 1;
+
+  /* payload data is not received with the header while late answers may
+     be waiting, as the payload could then contain the next header */
+
+  iov_count = 1;
+  if ((buffer != NULL) && (*len > 0) && (device[devno].stale_read_requests == 0))
+    iov_count = 2;
+
+  *payload_size = 0;
+  late = 0;
+  for (;;)
+    {
+      if (bjnp_wait_tcp (devno, "bjnp_recv_header") != SANE_STATUS_GOOD)
+	return SANE_STATUS_IO_ERROR;
+
+      /* get response header, and payload data if there is room for it */
+
+      iov[0].iov_base = &resp_buf;
+      iov[0].iov_len = sizeof (struct BJNP_command);
+      if (iov_count == 2)
+	{
+	  iov[1].iov_base = buffer;
+	  iov[1].iov_len = MIN (*len, SSIZE_MAX - sizeof (struct BJNP_command));
+	}
+      recv_bytes = readv (fd, iov, iov_count);
+
+      /* the header may be split over TCP segments */
+
+      hdr_bytes = (recv_bytes > 0) ? MIN ((size_t) recv_bytes, sizeof (struct BJNP_command)) : 0;
+      data_bytes = (recv_bytes > 0) ? (size_t) recv_bytes - hdr_bytes : 0;
+      while ((recv_bytes > 0) && (hdr_bytes < sizeof (struct BJNP_command)))
+	{
+	  if (bjnp_wait_tcp (devno, "bjnp_recv_header") != SANE_STATUS_GOOD)
+	    return SANE_STATUS_IO_ERROR;
+	  recv_bytes = recv (fd, (char *) &resp_buf + hdr_bytes,
+			     sizeof (struct BJNP_command) - hdr_bytes, 0);
+	  if (recv_bytes > 0)
+	    hdr_bytes += recv_bytes;
+	}
+
+      if (recv_bytes <= 0)
+	{
+	  terrno = errno;
+	  if (recv_bytes == 0)
+	    {
+	      PDBG (bjnp_dbg (LOG_CRIT,
+			"bjnp_recv_header: ERROR - (recv) Scanner closed the TCP-connection!\n"));
+	    } else {
+	      PDBG (bjnp_dbg (LOG_CRIT,
+		       "bjnp_recv_header: ERROR - (recv) could not read response header, received %ld bytes!\n",
+		       (long) hdr_bytes));
+	      PDBG (bjnp_dbg
+			(LOG_CRIT, "bjnp_recv_header: ERROR - (recv) error: %s!\n",
+			strerror (terrno)));
+	    }
+	  errno = terrno;
+	  return SANE_STATUS_IO_ERROR;
+	}
+
+      seq_no = ntohs (resp_buf.seq_no);
+      if ((resp_buf.cmd_code != CMD_TCP_REQ) || (seq_no == expected) ||
+	  ((stale = bjnp_find_stale_read_request (devno, seq_no)) < 0))
+	break;
+
+      /* late answer to a stale read request. Answers come in order, so */
+      /* the stale requests sent before it will not be answered anymore */
+
+      device[devno].stale_read_requests -= stale + 1;
+      memmove (device[devno].stale_serials,
+	       device[devno].stale_serials + stale + 1,
+	       device[devno].stale_read_requests * sizeof (uint16_t));
+      late_size = ntohl (resp_buf.payload_len);
+      PDBG (bjnp_dbg
+	    (LOG_INFO,
+	     "bjnp_recv_header: Late response with serial %d (%ld bytes)\n",
+	     (int) seq_no, (long) late_size));
+
+      /* an answer without data tells nothing */
+
+      if (late_size == 0)
+	continue;
+      device[devno].blocksize = MAX (device[devno].blocksize, late_size);
+      if (buffer != NULL)
+	{
+	  late = 1;
+	  break;
+	}
+      if (bjnp_recv_late_data (devno, late_size) != SANE_STATUS_GOOD)
+	return SANE_STATUS_IO_ERROR;
+      if (late_size < device[devno].blocksize)
+	device[devno].late_last_block = 1;
+    }
 
   if (resp_buf.cmd_code != device[devno].last_cmd)
     {
@@ -1473,15 +1661,25 @@ bjnp_recv_header (int devno, size_t *payload_size )
       return SANE_STATUS_IO_ERROR;
     }
 
-  if (ntohs (resp_buf.seq_no) != (uint16_t) device[devno].serial)
+  if (!late && ((uint16_t) ntohs (resp_buf.seq_no) != expected))
     {
       PDBG (bjnp_dbg
 	    (LOG_CRIT,
 	     "bjnp_recv_header: ERROR - Received response has serial %d, expected %d\n",
-	     (int) ntohs (resp_buf.seq_no), (int) device[devno].serial));
+	     (int) ntohs (resp_buf.seq_no), (int) expected));
       return SANE_STATUS_IO_ERROR;
     }
 
+  /* the oldest read request in flight is answered, so the stale ones, */
+  /* sent before it, will not be answered anymore */
+
+  if (!late && (resp_buf.cmd_code == CMD_TCP_REQ) &&
+      (device[devno].read_requests > 0))
+    {
+      device[devno].read_requests--;
+      device[devno].stale_read_requests = 0;
+    }
+
   /* got response header back, retrieve length of payload */
 
 
@@ -1491,9 +1689,30 @@ bjnp_recv_header (int devno, size_t *payload_size )
 	 *payload_size) );
   PDBG (bjnp_hexdump
 	(LOG_DEBUG2, (char *) &resp_buf, sizeof (struct BJNP_command)));
+
+  if (data_bytes > *payload_size)
+    {
+      PDBG (bjnp_dbg
+	    (LOG_CRIT,
+	     "bjnp_recv_header: ERROR - Received %ld bytes beyond the payload!\n",
+	     (long) (data_bytes - *payload_size)));
+      return SANE_STATUS_IO_ERROR;
+    }
+  if (buffer != NULL)
+    {
+      PDBG (bjnp_dbg (LOG_DEBUG2, "bjnp_recv_header: Received %ld bytes of payload with the header\n",
+		       (long) data_bytes));
+      *len = data_bytes;
+    }
   return SANE_STATUS_GOOD;
 }
 
+static SANE_Status
+bjnp_recv_header (int devno, size_t *payload_size )
+{
+  return bjnp_recv_header_data (devno, payload_size, NULL, NULL);
+}
+
 static int
 bjnp_init_device_structure(int dn, bjnp_sockaddr_t *sa, bjnp_protocol_defs_t *protocol_defs, int ip_timeout)
 {
@@ -1524,6 +1743,12 @@ bjnp_init_device_structure(int dn, bjnp_sockaddr_t *sa, bjnp_protocol_defs_t *pr
   device[dn].last_cmd = 0;
   device[dn].blocksize = BJNP_BLOCKSIZE_START;
   device[dn].last_block = 0;
+  device[dn].read_requests = 0;
+  device[dn].stale_read_requests = 0;
+  device[dn].late_data = NULL;
+  device[dn].late_data_len = 0;
+  device[dn].late_data_pos = 0;
+  device[dn].late_last_block = 0;
   /* fill mac_address */
 
   if (bjnp_get_scanner_mac_address(dn, device[dn].mac_address) != 0 )
@@ -1545,6 +1770,7 @@ bjnp_free_device_structure( int dn)
     free (device[dn].addr );
     device[dn].addr = NULL;
     }
+  bjnp_clear_stale_read_requests (dn);
   device[dn].open = 0;
 }
 
@@ -1690,6 +1916,13 @@ bjnp_open_tcp (int devno)
   val = 1;
   setsockopt (sock, IPPROTO_TCP, TCP_NODELAY, &val, sizeof (val));
 
+  /*
+   * Leave room for the answers to the read requests sent ahead
+   */
+
+  val = BJNP_TCP_RCVBUF;
+  setsockopt (sock, SOL_SOCKET, SO_RCVBUF, &val, sizeof (val));
+
 /*
  * Close this socket when starting another process...
  */
@@ -1702,6 +1935,7 @@ bjnp_open_tcp (int devno)
           (sock, &(addr->addr), sa_size(device[devno].addr)) == 0)
 	    {
               device[devno].tcp_socket = sock;
+              bjnp_clear_stale_read_requests (devno);
               PDBG( bjnp_dbg(LOG_INFO, "bjnp_open_tcp: created socket %d\n", sock));
               return 0;
 	    }
@@ -1723,6 +1957,7 @@ static void bjnp_close_tcp(int devno)
       bjnp_finish_job (devno);
       close (device[devno].tcp_socket);
       device[devno].tcp_socket = -1;
+      bjnp_clear_stale_read_requests (devno);
     }
   else
     {
@@ -2408,6 +2643,7 @@ sanei_bjnp_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
   size_t read_size;
   size_t read_size_max;
   size_t requested;
+  int read_ahead = 0;
 
   PDBG (bjnp_dbg
 	(LOG_INFO, "bjnp_read_bulk(dn=%d, bufferptr=%lx, 0x%lx = %ld)\n", dn,
@@ -2421,7 +2657,9 @@ sanei_bjnp_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 	 (unsigned long) device[dn].scanner_data_left,
 	 (unsigned long) device[dn].scanner_data_left ) );
 
-  while ( (recvd < requested) && !( device[dn].last_block && (device[dn].scanner_data_left == 0)) )
+  while ( (recvd < requested) &&
+          !( device[dn].last_block && (device[dn].scanner_data_left == 0) &&
+             (device[dn].late_data_pos == device[dn].late_data_len)) )
     {
       PDBG (bjnp_dbg
 	    (LOG_DEBUG,
@@ -2429,6 +2667,26 @@ sanei_bjnp_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 	     (unsigned long) recvd, (unsigned long) recvd,
 	     (unsigned long) requested, (unsigned long)requested ));
 
+      /* First hand out data of late answers, received with the last command */
+
+      if (device[dn].late_data_pos < device[dn].late_data_len)
+        {
+          read_size = MIN (device[dn].late_data_len - device[dn].late_data_pos,
+                           requested - recvd);
+          memcpy (buffer + recvd, device[dn].late_data + device[dn].late_data_pos,
+                  read_size);
+          device[dn].late_data_pos += read_size;
+          recvd = recvd + read_size;
+          if (device[dn].late_data_pos == device[dn].late_data_len)
+            {
+              free (device[dn].late_data);
+              device[dn].late_data = NULL;
+              device[dn].late_data_len = 0;
+              device[dn].late_data_pos = 0;
+            }
+          continue;
+        }
+
       /* Check first if there is data in flight from the scanner */
 
       if (device[dn].scanner_data_left == 0)
@@ -2439,16 +2697,39 @@ sanei_bjnp_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
                           "bjnp_read_bulk: No (more) scanner data available, requesting more( blocksize = %ld = %lx\n",
                           (long int) device[dn].blocksize, (long int) device[dn].blocksize ));
 
-          if ((error = bjnp_send_read_request (dn)) != SANE_STATUS_GOOD)
+          if ((device[dn].read_requests == 0) &&
+              ((error = bjnp_send_read_request (dn)) != SANE_STATUS_GOOD))
             {
               *size = recvd;
               return SANE_STATUS_IO_ERROR;
             }
-          if ( ( error = bjnp_recv_header (dn, &(device[dn].scanner_data_left) )  ) != SANE_STATUS_GOOD)
+
+          /* after a full block, keep read requests in flight for the data the */
+          /* backend still wants, so the scanner sends the next blocks while */
+          /* we receive this one. Only ask for blocks beyond the ones in flight */
+          /* when more than a block is still wanted after them, as requests */
+          /* beyond the end of the data go stale */
+
+          while (read_ahead && (device[dn].read_requests < BJNP_READ_REQUESTS_MAX) &&
+                 ((device[dn].read_requests + 1) * device[dn].blocksize < requested - recvd))
+            {
+              if ((error = bjnp_send_read_request (dn)) != SANE_STATUS_GOOD)
+                {
+                  *size = recvd;
+                  return SANE_STATUS_IO_ERROR;
+                }
+            }
+
+          /* receive the header and as much of the block as fits in the buffer */
+
+          read_size = MIN (device[dn].blocksize, requested - recvd);
+          if ( ( error = bjnp_recv_header_data (dn, &(device[dn].scanner_data_left),
+                                                buffer + recvd, &read_size) ) != SANE_STATUS_GOOD)
             {
               *size = recvd;
               return SANE_STATUS_IO_ERROR;
             }
+
           /* correct blocksize if applicable */
 
           device[dn].blocksize = MAX (device[dn].blocksize, device[dn].scanner_data_left);
@@ -2460,7 +2741,17 @@ sanei_bjnp_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
               /* this block is shorter than blocksize, so after this block we are done */
 
               device[dn].last_block = 1;
+
+              /* so the read requests sent ahead will not be answered */
+
+              bjnp_set_stale_read_requests (dn);
             }
+          else
+            read_ahead = 1;
+
+          device[dn].scanner_data_left = device[dn].scanner_data_left - read_size;
+          recvd = recvd + read_size;
+          continue;
         }
 
       PDBG (bjnp_dbg (LOG_DEBUG, "bjnp_read_bulk: In flight: 0x%lx = %ld bytes available\n",
@@ -2524,6 +2815,23 @@ sanei_bjnp_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
   uint32_t buf;
   size_t payload_size;
 
+  /* read requests still in flight will not be answered anymore */
+
+  if (device[dn].read_requests > 0)
+    {
+      PDBG (bjnp_dbg (LOG_DEBUG, "sanei_bjnp_write_bulk: %d read request(s) not answered\n",
+		       device[dn].read_requests));
+      bjnp_set_stale_read_requests (dn);
+    }
+
+  /* data of late answers not read yet belongs to the previous command */
+
+  free (device[dn].late_data);
+  device[dn].late_data = NULL;
+  device[dn].late_data_len = 0;
+  device[dn].late_data_pos = 0;
+  device[dn].late_last_block = 0;
+
   /* Write received data to scanner */
 
   sent = bjnp_write (dn, buffer, *size);
@@ -2567,9 +2875,11 @@ sanei_bjnp_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
 	     (unsigned long) recvd, (unsigned long) *size));
       return SANE_STATUS_IO_ERROR;
     }
-  /* we can expect data from the scanner */
+  /* we can expect data from the scanner, unless late answers to stale */
+  /* read requests already brought all of it */
 
-  device[dn].last_block = 0;
+  device[dn].last_block = device[dn].late_last_block;
+  device[dn].late_last_block = 0;
 
   return SANE_STATUS_GOOD;
 }
@@ -76,6 +76,9 @@
 #define BJNP_NO_DEVICES 16		/* max number of open devices */
 #define BJNP_SCAN_BUF_MAX 65536		/* size of scanner data intermediate buffer */
 #define BJNP_BLOCKSIZE_START 512	/* startsize for last block detection */
+#define BJNP_READ_REQUESTS_MAX 4	/* max read requests sent ahead */
+#define BJNP_STALE_REQUESTS_MAX 16	/* max unanswered earlier read requests */
+#define BJNP_TCP_RCVBUF 1048576		/* TCP receive buffer for image data */
 
 /* timers */
 #define BJNP_BROADCAST_INTERVAL 10 	/* ms between broadcasts */
@@ -367,6 +370,14 @@ typedef struct device_s
   size_t blocksize;		/* size of (TCP) blocks returned by the scanner */
   size_t scanner_data_left;	/* TCP data left from last read request */
   char last_block;		/* last TCP read command was shorter than blocksize */
+  int read_requests;		/* TCP read requests not answered yet */
+  int stale_read_requests;	/* read requests sent beyond the last block */
+  uint16_t stale_serials[BJNP_STALE_REQUESTS_MAX];
+				/* their serials, oldest first */
+  SANE_Byte *late_data;		/* payload of late answers to them, received */
+  size_t late_data_len;		/* while waiting for a command response */
+  size_t late_data_pos;		/* bytes of it handed out */
+  char late_last_block;		/* late data ends with a short block */
 
   /* device information */
   char mac_address[BJNP_HOST_MAX];
@@ -51,6 +51,9 @@
 
 #include <sys/time.h>		/* gettimeofday(4.3BSD) */
 #include <unistd.h>		/* usleep */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #if defined(HAVE_LIBXML2)
 # include <libxml/parser.h>
@@ -506,6 +509,229 @@ pixma_binarize_line(pixma_scan_param_t * sp, uint8_t * dst, uint8_t * src, unsig
   return dst;
 }
 
+/* under some conditions some scanners have sub images in one line
+ * e.g. doubled image (n = 2, m = w / 2):
+ * line before reordering: px1 px3 px5 px7 px2 px4 px6 px8
+ * line after reordering:  px1 px2 px3 px4 px5 px6 px7 px8
+ *
+ * Pixel i goes to n * (i % m) + i / m, so the line is transposed from
+ * n sub images of m pixels. Walking the sub images avoids a division
+ * per pixel, and a constant pixel size lets the compiler inline the copy.
+ */
+#define REORDER_PIXELS(C)                                               \
+  for (q = 0; q * m < w; q++)                                           \
+    {                                                                   \
+      const uint8_t *src = sptr + (C) * q * m;                          \
+      uint8_t *dst = linebuf + (C) * q;                                 \
+      unsigned r, rn = (w - q * m < m) ? w - q * m : m;                 \
+                                                                        \
+      for (r = 0; r < rn; r++, src += (C), dst += (C) * n)              \
+        memcpy (dst, src, (C));                                         \
+    }
+
+void
+pixma_reorder_pixels (uint8_t * linebuf, uint8_t * sptr, unsigned c,
+                      unsigned n, unsigned m, unsigned w, unsigned line_size)
+{
+  unsigned q;
+
+  if (m == 0)
+    return;
+  switch (c)
+    {
+    case 1:
+      REORDER_PIXELS (1);
+      break;
+    case 2:
+      REORDER_PIXELS (2);
+      break;
+    case 3:
+      REORDER_PIXELS (3);
+      break;
+    case 6:
+      REORDER_PIXELS (6);
+      break;
+    default:
+      REORDER_PIXELS (c);
+      break;
+    }
+  memcpy (sptr, linebuf, line_size);
+}
+
+/* sums of scale lines kept on the stack by pixma_shrink_image() */
+#define SHRINK_SUMS 1536
+
+/* add up scale lines, stride bytes apart, into sums */
+static void
+shrink_sum_lines (uint16_t * sums, const uint8_t * src, unsigned len,
+                  unsigned stride, unsigned scale)
+{
+  unsigned k = 0, l;
+
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128 ();
+
+  for (; k + 16 <= len; k += 16)
+    {
+      __m128i lo = zero, hi = zero;
+
+      for (l = 0; l < scale; l++)
+        {
+          __m128i v = _mm_loadu_si128 ((const __m128i *) (src + k + l * stride));
+
+          lo = _mm_add_epi16 (lo, _mm_unpacklo_epi8 (v, zero));
+          hi = _mm_add_epi16 (hi, _mm_unpackhi_epi8 (v, zero));
+        }
+      _mm_storeu_si128 ((__m128i *) (sums + k), lo);
+      _mm_storeu_si128 ((__m128i *) (sums + k + 8), hi);
+    }
+#endif
+  for (; k < len; k++)
+    {
+      uint16_t sum = 0;
+
+      for (l = 0; l < scale; l++)
+        sum += src[k + l * stride];
+      sums[k] = sum;
+    }
+}
+
+/* add up scale neighbours of each channel and divide by scale * scale:
+ * sum * recip >> 24 is exact for sums up to 255 * scale * scale when
+ * scale <= 16 */
+static void
+shrink_sum_pixels (uint8_t * dst, const uint16_t * sums, unsigned w,
+                   unsigned scale, unsigned c, uint32_t recip)
+{
+  unsigned i = 0, ic, k;
+
+  if (c == 1 && (scale == 2 || scale == 4))
+    {
+#ifdef __SSE2__
+      __m128i ones = _mm_set1_epi16 (1);
+      __m128i zero = _mm_setzero_si128 ();
+
+      for (; i + 8 <= w; i += 8, sums += 8 * scale, dst += 8)
+        {
+          /* pairwise sums as 32 bit, packed back to 16 bit */
+          __m128i a = _mm_madd_epi16 (_mm_loadu_si128 ((const __m128i *) sums), ones);
+          __m128i b = _mm_madd_epi16 (_mm_loadu_si128 ((const __m128i *) (sums + 8)), ones);
+          __m128i v = _mm_packs_epi32 (a, b);
+
+          if (scale == 4)
+            {
+              __m128i w2 = _mm_packs_epi32 (
+                _mm_madd_epi16 (_mm_loadu_si128 ((const __m128i *) (sums + 16)), ones),
+                _mm_madd_epi16 (_mm_loadu_si128 ((const __m128i *) (sums + 24)), ones));
+
+              v = _mm_packs_epi32 (_mm_madd_epi16 (v, ones),
+                                   _mm_madd_epi16 (w2, ones));
+              v = _mm_srli_epi16 (v, 4);
+            }
+          else
+            v = _mm_srli_epi16 (v, 2);
+          _mm_storel_epi64 ((__m128i *) dst, _mm_packus_epi16 (v, zero));
+        }
+#endif
+      for (; i < w; i++, sums += scale)
+        {
+          unsigned sum = 0;
+
+          for (k = 0; k < scale; k++)
+            sum += sums[k];
+          *dst++ = (scale == 2) ? sum >> 2 : sum >> 4;
+        }
+    }
+  else if (c == 3 && scale == 2)
+    {
+      for (; i < w; i++, sums += 6, dst += 3)
+        {
+          dst[0] = (sums[0] + sums[3]) >> 2;
+          dst[1] = (sums[1] + sums[4]) >> 2;
+          dst[2] = (sums[2] + sums[5]) >> 2;
+        }
+    }
+  else if (c == 3 && scale == 4)
+    {
+      for (; i < w; i++, sums += 12, dst += 3)
+        {
+          dst[0] = (sums[0] + sums[3] + sums[6] + sums[9]) >> 4;
+          dst[1] = (sums[1] + sums[4] + sums[7] + sums[10]) >> 4;
+          dst[2] = (sums[2] + sums[5] + sums[8] + sums[11]) >> 4;
+        }
+    }
+  else
+    {
+      for (; i < w; i++, sums += c * scale)
+        for (ic = 0; ic < c; ic++)
+          {
+            uint32_t sum = 0;
+
+            for (k = 0; k < scale; k++)
+              sum += sums[ic + c * k];
+            *dst++ = (sum * recip) >> 24;
+          }
+    }
+}
+
+/* the scanned image must be shrunk by factor "scale"
+ * the image can be formatted as rgb (c=3) or gray (c=1)
+ * we need to crop the left side (xs)
+ * we ignore more pixels inside scanned line (wx), behind needed line (w)
+ *
+ * example (scale=2):
+ * line | pixel[0] | pixel[1] | ... | pixel[w-1]
+ * ---------
+ *  0   |  rgbrgb  |  rgbrgb  | ... |  rgbrgb
+ * wx*c |  rgbrgb  |  rgbrgb  | ... |  rgbrgb
+ *
+ * The scale lines are added up first, a piece of the line at a time,
+ * then the neighbouring pixels.
+ */
+uint8_t *
+pixma_shrink_image (uint8_t * dptr, uint8_t * sptr, unsigned xs, unsigned w,
+                    unsigned wx, unsigned scale, unsigned c)
+{
+  uint16_t sums[SHRINK_SUMS];
+  uint32_t recip;
+  unsigned chunk, i, n;
+
+  /* crop left side */
+  sptr += c * xs;
+
+  if (scale == 0 || scale > 16 || c * scale > SHRINK_SUMS)
+    {
+      /* the sums may overflow 16 bit like they always did */
+      for (i = 0; i < w; i++, sptr += c * scale)
+        {
+          unsigned ic, l, k;
+
+          for (ic = 0; ic < c; ic++)
+            {
+              uint16_t pixel = 0;
+
+              for (l = 0; l < scale; l++)
+                for (k = 0; k < scale; k++)
+                  pixel += sptr[ic + c * k + wx * c * l];
+              *dptr++ = scale ? pixel / (scale * scale) : 0;
+            }
+        }
+      return dptr;
+    }
+
+  recip = ((1 << 24) + scale * scale - 1) / (scale * scale);
+  chunk = SHRINK_SUMS / (c * scale);
+  for (i = 0; i < w; i += n)
+    {
+      n = (w - i < chunk) ? w - i : chunk;
+      shrink_sum_lines (sums, sptr, n * c * scale, wx * c, scale);
+      shrink_sum_pixels (dptr, sums, n, scale, c, recip);
+      sptr += n * c * scale;
+      dptr += n * c;
+    }
+  return dptr;
+}
+
 /**
    This code was taken from the genesys backend
    Function to build a lookup table (LUT), often
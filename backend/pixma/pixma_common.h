@@ -192,6 +192,12 @@ void pixma_get_time (time_t * sec, uint32_t * usec);
 uint8_t * pixma_r_to_ir (uint8_t * gptr, uint8_t * sptr, unsigned w, unsigned c);
 uint8_t * pixma_rgb_to_gray (uint8_t * gptr, uint8_t * sptr, unsigned w, unsigned c);
 uint8_t * pixma_binarize_line(pixma_scan_param_t *, uint8_t * dst, uint8_t * src, unsigned width, unsigned c);
+void pixma_reorder_pixels (uint8_t * linebuf, uint8_t * sptr, unsigned c,
+                           unsigned n, unsigned m, unsigned w,
+                           unsigned line_size);
+uint8_t * pixma_shrink_image (uint8_t * dptr, uint8_t * sptr, unsigned xs,
+                              unsigned w, unsigned wx, unsigned scale,
+                              unsigned c);
 /**@}*/
 
 /** \name Command related functions */
@@ -1418,23 +1418,6 @@ shift_colorsCS9000_4800 (uint8_t * dptr, uint8_t * sptr, unsigned w,
   return dptr;
 }
 
-/* under some conditions some scanners have sub images in one line */
-/* e.g. doubled image, line size = 8				   */
-/* line before reordering: px1 px3 px5 px7 px2 px4 px6 px8         */
-/* line after reordering:  px1 px2 px3 px4 px5 px6 px7 px8         */
-static void reorder_pixels (uint8_t * linebuf, uint8_t * sptr, unsigned c,
-                            unsigned n, unsigned m, unsigned w,
-                            unsigned line_size)
-{
-  unsigned i;
-
-  for (i = 0; i < w; i++)
-  { /* process complete line */
-    memcpy (linebuf + c * (n * (i % m) + i / m), sptr + c * i, c);
-  }
-  memcpy (sptr, linebuf, line_size);
-}
-
 /* special reorder matrix for mp960 */
 static void mp960_reorder_pixels (uint8_t * linebuf, uint8_t * sptr, unsigned c,
                                       unsigned n, unsigned m, unsigned w,
@@ -1753,7 +1736,7 @@ static unsigned post_process_image_data (pixma_t * s, pixma_imagebuf_t * ib)
             && !((s->cfg->pid == CS9000F_PID || s->cfg->pid == CS9000F_MII_PID) && (s->param->xdpi == 9600)))
         { /* for both flatbed & TPU */
           /* PDBG (pixma_dbg (4, "*post_process_image_data***** reordering pixels normal n = %i  *****\n", n)); */
-          reorder_pixels (mp->linebuf, sptr, c, n, m, s->param->wx, line_size);
+          pixma_reorder_pixels (mp->linebuf, sptr, c, n, m, s->param->wx, line_size);
         }
 
         if ((s->cfg->pid == CS9000F_PID || s->cfg->pid == CS9000F_MII_PID) && (s->param->xdpi == 9600))
@@ -86,12 +86,14 @@
 #define pixma_print_supported_devices sanei_pixma_print_supported_devices
 #define pixma_read_image sanei_pixma_read_image
 #define pixma_read sanei_pixma_read
+#define pixma_reorder_pixels sanei_pixma_reorder_pixels
 #define pixma_reset_device sanei_pixma_reset_device
 #define pixma_scan sanei_pixma_scan
 #define pixma_set_be16 sanei_pixma_set_be16
 #define pixma_set_be32 sanei_pixma_set_be32
 #define pixma_set_debug_level sanei_pixma_set_debug_level
 #define pixma_set_interrupt_mode sanei_pixma_set_interrupt_mode
+#define pixma_shrink_image sanei_pixma_shrink_image
 #define pixma_sleep sanei_pixma_sleep
 #define pixma_strerror sanei_pixma_strerror
 #define pixma_sum_bytes sanei_pixma_sum_bytes
@@ -1054,6 +1054,7 @@ usbDev_stopScan( Plustek_Device *dev )
 	usb_ScanEnd( dev );
 
 	dev->scanning.dwFlag = 0;
+	usb_FreeScaleMap( &dev->scanning );
 
 	if( NULL != dev->scanning.pScanBuffer ) {
 
@@ -1345,7 +1346,8 @@ usbDev_Prepare( Plustek_Device *dev, SANE_Byte *buf )
 		}
 
 		/* set a function to process the RAW data... */
-		usb_GetImageProc( dev );
+		if( usb_GetImageProc( dev ) != 0 )
+			return _E_ALLOC;
 
 		if( scan->sParam.bSource == SOURCE_ADF )
 			scan->dwFlag |= SCANFLAG_StillModule;
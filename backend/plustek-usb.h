@@ -631,6 +631,11 @@ typedef struct ScanDef
 
 	/** Image processing routine according to the scan mode  */
 	void (*pfnProcess)(struct Plustek_Device*);
+	/** averaging done before pfnProcess, may be NULL */
+	void (*pfnAverage)(struct Plustek_Device*);
+
+	u_long* pScaleMap;        /**< source pixel of each user pixel */
+	u_long  dwSampleStep;     /**< bytes between the pixels of a channel */
 
 	u_long* pScanBuffer;      /**< our scan buffer */
 
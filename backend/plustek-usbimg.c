@@ -33,6 +33,9 @@
  * - 0.51 - added usb_ColorDuplicateGray16_2(), usb_ColorScaleGray16_2()
  *          usb_BWScaleFromColor_2() and usb_BWDuplicateFromColor_2()
  * - 0.52 - cleanup
+ * - 0.53 - replaced the copy and scaling functions by a table of a few
+ *          generic kernels and precomputed scaler index maps
+ *        - fixed the output pointer in ReverseBits()
  * .
  * <hr>
  * This file is part of the SANE package.
@@ -73,6 +76,10 @@
  * <hr>
  */
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define _SCALER  1000
 
 static u_char   bShift, Shift;
@@ -133,7 +140,7 @@ static void ReverseBits( int b, u_char **pTar, int *iByte, int *iWeightSum,
 			if(b & bit)
 				*iByte |= 1;
 			if(*iByte >= 0x100)	{
-				**pTar++ = (u_char)*iByte;
+				*(*pTar)++ = (u_char)*iByte;
 				*iByte = 1;
 			}
 		}
@@ -149,7 +156,7 @@ static void ReverseBits( int b, u_char **pTar, int *iByte, int *iWeightSum,
 					*iByte |= 1;
 				if(*iByte >= 0x100)
 				{
-					**pTar++ = (u_char)*iByte;
+					*(*pTar)++ = (u_char)*iByte;
 					*iByte = 1;
 				}
 			}
@@ -337,1081 +344,382 @@ static int usb_GetScaler( ScanDef *scan )
 	return (int)(1.0/ratio * _SCALER);
 }
 
-/******************************* the copy functions **************************/
+/****************************** the pixel kernels ****************************/
 
-/** do a simple memcopy from scan-buffer to user buffer
+/* The pixel functions below are built from a few kernels, which copy one
+ * channel of a line. They take the source pixels in order, or as given by
+ * the index map of the scaler, and write the destination pixels forward or
+ * backward with the given distance (-1 or -3 for the mirrored ADF images).
  */
-static void usb_ColorDuplicate8( Plustek_Device *dev )
-{
-	int      next;
-	u_long   dw, pixels;
-	ScanDef *scan = &dev->scanning;
-
-	usb_AverageColorByte( dev );
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
 
-	for( dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next ) {
-
-		scan->UserBuf.pb_rgb[pixels].Red   = scan->Red.pcb[dw].a_bColor[0];
-		scan->UserBuf.pb_rgb[pixels].Green = scan->Green.pcb[dw].a_bColor[0];
-		scan->UserBuf.pb_rgb[pixels].Blue  = scan->Blue.pcb[dw].a_bColor[0];
-	}
-}
-
-/** reorder from rgb line to rgb pixel (CIS scanner)
+/** copy 8 bit samples
  */
-static void usb_ColorDuplicate8_2( Plustek_Device *dev )
+static void usb_CopyBytes( u_char *dest, long next, const u_char *src,
+                           u_long step, const u_long *map, u_long pixels )
 {
-	int      next;
-	u_long   dw, pixels;
-	ScanDef *scan = &dev->scanning;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next  = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
+	u_long dw;
 
-	for( dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next ) {
-
-		scan->UserBuf.pb_rgb[pixels].Red   = (u_char)scan->Red.pb[dw];
-		scan->UserBuf.pb_rgb[pixels].Green = (u_char)scan->Green.pb[dw];
-		scan->UserBuf.pb_rgb[pixels].Blue  = (u_char)scan->Blue.pb[dw];
-	}
-}
+	if( map ) {
+		for( dw = 0; dw < pixels; dw++ )
+			dest[(long)dw * next] = src[map[dw] * step];
 
-/**
- */
-static void usb_ColorDuplicate16( Plustek_Device *dev )
-{
-	int       next;
-	u_char    ls;
-	u_long    dw, pixels;
-	ScanDef  *scan = &dev->scanning;
-	SANE_Bool swap = usb_HostSwap();
+	} else if( next == 1 && step == 1 ) {
+		memcpy( dest, src, pixels );
 
-	usb_AverageColorWord( dev );
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
 	} else {
-		next  = 1;
-		pixels = 0;
-	}
-
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
-	for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-
-		if( swap ) {
-			scan->UserBuf.pw_rgb[pixels].Red =
-			                  _HILO2WORD(scan->Red.pcw[dw].HiLo[0]) >> ls;
-			scan->UserBuf.pw_rgb[pixels].Green =
-			                  _HILO2WORD(scan->Green.pcw[dw].HiLo[0]) >> ls;
-			scan->UserBuf.pw_rgb[pixels].Blue =
-			                  _HILO2WORD(scan->Blue.pcw[dw].HiLo[0]) >> ls;
-		} else {
-			scan->UserBuf.pw_rgb[pixels].Red  = scan->Red.pw[dw]   >> ls;
-			scan->UserBuf.pw_rgb[pixels].Green= scan->Green.pw[dw] >> ls;
-			scan->UserBuf.pw_rgb[pixels].Blue = scan->Blue.pw[dw]  >> ls;
-		}
+		for( dw = 0; dw < pixels; dw++ )
+			dest[(long)dw * next] = src[dw * step];
 	}
 }
 
-/**
+/** copy 16 bit samples, which the scanner sends big-endian, to host order
  */
-static void usb_ColorDuplicate16_2( Plustek_Device *dev )
+static void usb_CopyWords( u_short *dest, long next, const u_char *src,
+                           u_long step, const u_long *map, u_long pixels,
+                           u_char ls )
 {
-	int       next;
-	u_char    ls;
-	HiLoDef   tmp;
-	u_long    dw, pixels;
-	ScanDef  *scan = &dev->scanning;
-	SANE_Bool swap = usb_HostSwap();
-
-	usb_AverageColorWord( dev );
+	u_long        dw = 0;
+	const u_char *p;
 
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
+	if( map ) {
+		for( ; dw < pixels; dw++ ) {
+			p = src + map[dw] * step;
+			dest[(long)dw * next] = (u_short)(((u_short)p[0] * 256U + p[1]) >> ls);
+		}
+		return;
 	}
 
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
+#ifdef __SSE2__
+	if( next == 1 && step == 2 ) {
 
-	for( dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+		__m128i shift = _mm_cvtsi32_si128( ls );
 
-		if( swap ) {
-			tmp = *((HiLoDef*)&scan->Red.pw[dw]);
-			scan->UserBuf.pw_rgb[pixels].Red = _HILO2WORD(tmp) >> ls;
+		for( ; dw + 8 <= pixels; dw += 8 ) {
 
-			tmp = *((HiLoDef*)&scan->Green.pw[dw]);
-			scan->UserBuf.pw_rgb[pixels].Green = _HILO2WORD(tmp) >> ls;
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + dw * 2));
 
-			tmp = *((HiLoDef*)&scan->Blue.pw[dw]);
-			scan->UserBuf.pw_rgb[pixels].Blue = _HILO2WORD(tmp) >> ls;
-
-		} else {
-
-			scan->UserBuf.pw_rgb[pixels].Red   = scan->Red.pw[dw]   >> ls;
-			scan->UserBuf.pw_rgb[pixels].Green = scan->Green.pw[dw] >> ls;
-			scan->UserBuf.pw_rgb[pixels].Blue  = scan->Blue.pw[dw]  >> ls;
+			v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ));
+			_mm_storeu_si128((__m128i*)(dest + dw), _mm_srl_epi16( v, shift ));
 		}
 	}
-}
-
-/**
- */
-static void usb_ColorDuplicatePseudo16( Plustek_Device *dev )
-{
-	int      next;
-	u_short  wR, wG, wB;
-	u_long   dw, pixels;
-	ScanDef *scan = &dev->scanning;
-
-	usb_AverageColorByte( dev );
-
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	wR = (u_short)scan->Red.pcb[0].a_bColor[0];
-	wG = (u_short)scan->Green.pcb[0].a_bColor[0];
-	wB = (u_short)scan->Blue.pcb[0].a_bColor[0];
-
-	for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-
-		scan->UserBuf.pw_rgb[pixels].Red   =
-		                        (wR + scan->Red.pcb[dw].a_bColor[0]) << bShift;
-		scan->UserBuf.pw_rgb[pixels].Green =
-		                      (wG + scan->Green.pcb[dw].a_bColor[0]) << bShift;
-		scan->UserBuf.pw_rgb[pixels].Blue  =
-		                       (wB + scan->Blue.pcb[dw].a_bColor[0]) << bShift;
-
-		wR = (u_short)scan->Red.pcb[dw].a_bColor[0];
-		wG = (u_short)scan->Green.pcb[dw].a_bColor[0];
-		wB = (u_short)scan->Blue.pcb[dw].a_bColor[0];
+#endif
+	for( ; dw < pixels; dw++ ) {
+		p = src + dw * step;
+		dest[(long)dw * next] = (u_short)(((u_short)p[0] * 256U + p[1]) >> ls);
 	}
 }
 
-/**
+/** merge the three channels of 8 bit samples into RGB pixels
  */
-static void usb_ColorDuplicateGray( Plustek_Device *dev )
+static void usb_MergeBytes( u_char *dest, long next, u_char *const src[3],
+                            u_long step, const u_long *map, u_long pixels )
 {
-	int      next;
-	u_long   dw, pixels;
-	ScanDef *scan = &dev->scanning;
+	u_long        dw, i;
+	const u_char *r = src[0], *g = src[1], *b = src[2];
 
-	usb_AverageColorByte( dev );
-
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	switch(scan->fGrayFromColor) {
-
-	case 1:
-		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-			scan->UserBuf.pb[pixels] = scan->Red.pcb[dw].a_bColor[0];
-		break;
-	case 2:
-		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-			scan->UserBuf.pb[pixels] = scan->Green.pcb[dw].a_bColor[0];
-		break;
-	case 3:
-		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-			scan->UserBuf.pb[pixels] = scan->Blue.pcb[dw].a_bColor[0];
-		break;
+	for( dw = 0; dw < pixels; dw++, dest += next ) {
+		i = (map ? map[dw] : dw) * step;
+		dest[0] = r[i];
+		dest[1] = g[i];
+		dest[2] = b[i];
 	}
 }
 
-/**
+/** merge the three channels of 16 bit samples into RGB pixels in host order
  */
-static void usb_ColorDuplicateGray_2( Plustek_Device *dev )
+static void usb_MergeWords( u_short *dest, long next, u_char *const src[3],
+                            u_long step, const u_long *map, u_long pixels,
+                            u_char ls )
 {
-	int      next;
-	u_long   dw, pixels;
-	ScanDef *scan = &dev->scanning;
+	u_long        dw = 0, i;
+	const u_char *r = src[0], *g = src[1], *b = src[2];
 
-	usb_AverageColorByte( dev );
+#ifdef __SSE2__
+	/* swap eight pixels of each plane at once, then interleave them */
+	if( !map && next == 3 && step == 2 ) {
 
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	switch(scan->fGrayFromColor)
-	{
-	case 1:
-		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-			scan->UserBuf.pb[pixels] = scan->Red.pb[dw];
-		break;
-	case 3:
-		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-			scan->UserBuf.pb[pixels] = scan->Blue.pb[dw];
-		break;
-	default:
-		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-			scan->UserBuf.pb[pixels] = scan->Green.pb[dw];
-		break;
-	}
-}
+		__m128i shift = _mm_cvtsi32_si128( ls );
+		u_short tmp[3][8];
+		int     c, k;
 
-/**
- */
-static void usb_ColorDuplicateGray16( Plustek_Device *dev )
-{
-	int       next;
-	u_char    ls;
-	u_long    dw, pixels;
-	ScanDef  *scan = &dev->scanning;
-	SANE_Bool swap = usb_HostSwap();
+		for( ; dw + 8 <= pixels; dw += 8, dest += 24 ) {
 
-	usb_AverageColorWord( dev );
+			for( c = 0; c < 3; c++ ) {
+				__m128i v = _mm_loadu_si128((const __m128i*)(src[c] + dw * 2));
 
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
-	switch(scan->fGrayFromColor) {
-
-	case 1:
-		if( swap ) {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-				scan->UserBuf.pw[pixels] =
-				                   _HILO2WORD(scan->Red.pcw[dw].HiLo[0]) >> ls;
-		} else {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-				scan->UserBuf.pw[pixels] = scan->Red.pw[dw] >> ls;
-		}
-		break;
-	case 2:
-		if( swap ) {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-				scan->UserBuf.pw[pixels] =
-				                 _HILO2WORD(scan->Green.pcw[dw].HiLo[0]) >> ls;
-		} else {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-				scan->UserBuf.pw[pixels] = scan->Green.pw[dw] >> ls;
-		}
-		break;
-	case 3:
-		if( swap ) {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-				scan->UserBuf.pw[pixels] =
-				                   _HILO2WORD(scan->Blue.pcw[dw].HiLo[0]) >> ls;
-		} else {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
-				scan->UserBuf.pw[pixels] = scan->Blue.pw[dw] >> ls;
-		}
-		break;
-	}
-}
-
-/**
- */
-static void usb_ColorDuplicateGray16_2( Plustek_Device *dev )
-{
-	int       next;
-	u_char    ls;
-	u_long    dw, pixels;
-	HiLoDef   tmp;
-	ScanDef  *scan = &dev->scanning;
-	SANE_Bool swap = usb_HostSwap();
-
-	usb_AverageColorWord( dev );
-
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
-	switch(scan->fGrayFromColor) {
-	case 1:
-		if( swap ) {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-				tmp = *((HiLoDef*)&scan->Red.pw[dw]);
-				scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
-			}
-		} else {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-				scan->UserBuf.pw[pixels] = scan->Red.pw[dw] >> ls;
+				v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ));
+				_mm_storeu_si128((__m128i*)tmp[c], _mm_srl_epi16( v, shift ));
 			}
-		}
-		break;
-	case 2:
-		if( swap ) {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-				tmp = *((HiLoDef*)&scan->Green.pw[dw]);
-				scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
-			}
-		} else {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-				scan->UserBuf.pw[pixels] = scan->Green.pw[dw] >> ls;
+			for( k = 0; k < 8; k++ ) {
+				dest[k * 3]     = tmp[0][k];
+				dest[k * 3 + 1] = tmp[1][k];
+				dest[k * 3 + 2] = tmp[2][k];
 			}
 		}
-		break;
-	case 3:
-		if( swap ) {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-				tmp = *((HiLoDef*)&scan->Blue.pw[dw]);
-				scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
-			}
-		} else {
-			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
-				scan->UserBuf.pw[pixels] = scan->Blue.pw[dw] >> ls;
-			}
-		}
-		break;
-	}
-}
-
-/**
- */
-static void usb_GrayDuplicate8( Plustek_Device *dev )
-{
-	u_char  *dest, *src;
-	u_long   pixels;
-	ScanDef *scan = &dev->scanning;
-
-	usb_AverageGrayByte( dev );
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-
-		pixels = scan->sParam.Size.dwPixels;
-		src    = scan->Green.pb;
-		dest   = scan->UserBuf.pb + pixels - 1;
-
-		for(; pixels; pixels--, src++, dest--)
-			*dest = *src;
-	} else {
-		memcpy( scan->UserBuf.pb, scan->Green.pb, scan->sParam.Size.dwBytes );
-	}
-}
-
-/**
- */
-static void usb_GrayDuplicate16( Plustek_Device *dev )
-{
-	int       next;
-	u_char    ls;
-	u_short  *dest;
-	u_long    pixels;
-	HiLoDef  *pwm;
-	ScanDef  *scan = &dev->scanning;
-	SANE_Bool swap = usb_HostSwap();
-
-	usb_AverageGrayWord( dev );
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next = -1;
-		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
-	} else {
-		next = 1;
-		dest = scan->UserBuf.pw;
-	}
-
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
-	pwm = scan->Green.philo;
-	for( pixels=scan->sParam.Size.dwPixels; pixels--; pwm++, dest += next ) {
-		if( swap )
-			*dest = (_PHILO2WORD(pwm)) >> ls;
-		else
-			*dest = (_PLOHI2WORD(pwm)) >> ls;
-	}
-}
-
-/**
- */
-static void usb_GrayDuplicatePseudo16( Plustek_Device *dev )
-{
-	u_char  *src;
-	int      next;
-	u_short  g;
-	u_short *dest;
-	u_long   pixels;
-	ScanDef *scan = &dev->scanning;
-
-	usb_AverageGrayByte( dev );
-
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		next = -1;
-		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
-	} else {
-		next = 1;
-		dest = scan->UserBuf.pw;
 	}
-
-	src = scan->Green.pb;
-	g = (u_short)*src;
-
-	for( pixels=scan->sParam.Size.dwPixels; pixels--; src++, dest += next ) {
-
-		*dest = (g + *src) << bShift;
-		g = (u_short)*src;
-	}
-}
-
-/** copy binary data to the user buffer
- */
-static void usb_BWDuplicate( Plustek_Device *dev )
-{
-	ScanDef *scan = &dev->scanning;
-
-	if(scan->sParam.bSource == SOURCE_ADF)
-	{
-		usb_ReverseBitStream( scan->Green.pb, scan->UserBuf.pb,
-		                      scan->sParam.Size.dwValidPixels,
-		                      scan->dwBytesLine, 0, 0, 1 );
-	} else {
-		memcpy( scan->UserBuf.pb, scan->Green.pb, scan->sParam.Size.dwBytes );
+#endif
+	for( ; dw < pixels; dw++, dest += next ) {
+		i = (map ? map[dw] : dw) * step;
+		dest[0] = (u_short)(((u_short)r[i] * 256U + r[i + 1]) >> ls);
+		dest[1] = (u_short)(((u_short)g[i] * 256U + g[i + 1]) >> ls);
+		dest[2] = (u_short)(((u_short)b[i] * 256U + b[i + 1]) >> ls);
 	}
 }
 
-/** generate binary data from one of the three color inputs according to the
- *  value in fGrayFromColor (CCD version)
+/** make 16 bit samples from 8 bit ones, by adding each source pixel to its
+ *  predecessor
  */
-static void usb_BWDuplicateFromColor( Plustek_Device *dev )
+static void usb_CopyPseudoWords( u_short *dest, long next, const u_char *src,
+                                 u_long step, const u_long *map, u_long pixels )
 {
-	int           next;
-	u_char        d, s, *dest;
-	u_short       j;
-	u_long        pixels;
-	ColorByteDef *src;
-	ScanDef      *scan = &dev->scanning;
+	u_long dw, i;
 
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
-		next = -1;
-	} else {
-		dest = scan->UserBuf.pb;
-		next = 1;
-	}
-
-	switch(scan->fGrayFromColor) {
-		case 1:  src = scan->Red.pcb;   break;
-		case 3:  src = scan->Blue.pcb;  break;
-		default: src = scan->Green.pcb; break;
-	}
-
-	d = j = 0;
-	for( pixels = scan->sParam.Size.dwPixels; pixels; pixels--, src++ ) {
-
-		s = src->a_bColor[0];
-		if( s != 0 )
-			d |= BitTable[j];
-		j++;
-		if( j == 8 ) {
-			*dest = d;
-			dest += next;
-
-			d = j = 0;
+	if( map ) {
+		for( dw = 0; dw < pixels; dw++ ) {
+			i = map[dw];
+			dest[(long)dw * next] =
+			        (u_short)((src[(i ? i - 1 : 0) * step] + src[i * step]) << bShift);
 		}
+
+	} else if( pixels ) {
+		dest[0] = (u_short)((src[0] + src[0]) << bShift);
+		for( dw = 1; dw < pixels; dw++ )
+			dest[(long)dw * next] =
+			        (u_short)((src[(dw - 1) * step] + src[dw * step]) << bShift);
 	}
 }
 
-/** generate binary data from one of the three color inputs according to the
- *  value in fGrayFromColor (CIS version)
+/** pack 8 bit samples into one bit per pixel, set for all non-zero samples,
+ *  only whole bytes are written
  */
-static void usb_BWDuplicateFromColor_2( Plustek_Device *dev )
+static void usb_PackBits( u_char *dest, long next, const u_char *src,
+                          u_long step, const u_long *map, u_long pixels )
 {
-	int      next;
-	u_char   d, *dest, *src;
-	u_short  j;
-	u_long   pixels;
-	ScanDef *scan = &dev->scanning;
+	u_char d = 0;
+	u_long dw, j = 0;
 
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
-		next = -1;
-	} else {
-		dest = scan->UserBuf.pb;
-		next = 1;
-	}
-
-	switch(scan->fGrayFromColor) {
-		case 1:  src = scan->Red.pb;   break;
-		case 3:  src = scan->Blue.pb;  break;
-		default: src = scan->Green.pb; break;
-	}
-
-	d = j = 0;
-	for( pixels = scan->sParam.Size.dwPixels; pixels; pixels--, src++ ) {
+	for( dw = 0; dw < pixels; dw++ ) {
 
-		if( *src != 0 )
+		if( src[(map ? map[dw] : dw) * step] != 0 )
 			d |= BitTable[j];
-		j++;
-		if( j == 8 ) {
+		if( ++j == 8 ) {
 			*dest = d;
 			dest += next;
-
 			d = j = 0;
 		}
 	}
 }
 
-/************************** the scaling functions ****************************/
-
-/**
+/** build the index map of the DDA scaler: the source pixel of each user
+ *  pixel, in the order they are written
  */
-static void usb_ColorScaleGray( Plustek_Device *dev )
+static SANE_Bool usb_BuildScaleMap( ScanDef *scan )
 {
-	int           izoom, ddax, next;
-	u_long        dw, pixels;
-	ColorByteDef *src;
-	ScanDef      *scan = &dev->scanning;
-
-	usb_AverageColorByte( dev );
+	int    izoom, ddax;
+	u_long dw, bitsput, pixels = scan->sParam.Size.dwPixels;
 
-	dw = scan->sParam.Size.dwPixels;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	switch(scan->fGrayFromColor) {
-		case 1:  src = scan->Red.pcb;   break;
-		case 3:  src = scan->Blue.pcb;  break;
-		default: src = scan->Green.pcb; break;
-	}
+	scan->pScaleMap = (u_long*)malloc((pixels ? pixels : 1) * sizeof(u_long));
+	if( NULL == scan->pScaleMap )
+		return SANE_FALSE;
 
 	izoom = usb_GetScaler( scan );
 
-	for( ddax = 0; dw; src++ ) {
+	for( dw = 0, bitsput = 0, ddax = 0; dw < pixels; bitsput++ ) {
 
 		ddax -= _SCALER;
-		while((ddax < 0) && (dw > 0)) {
 
-			scan->UserBuf.pb[pixels] = src->a_bColor[0];
+		while((ddax < 0) && (dw < pixels)) {
 
-			pixels += next;
-			ddax   += izoom;
-			dw--;
+			scan->pScaleMap[dw++] = bitsput;
+			ddax += izoom;
 		}
 	}
+	return SANE_TRUE;
 }
 
-/**
+/** returns the distance between the user pixels written one after the
+ *  other, and the index of the first one
  */
-static void usb_ColorScaleGray_2( Plustek_Device *dev )
+static long usb_GetDirection( ScanDef *scan, u_long *first )
 {
-	u_char  *src;
-	int      izoom, ddax, next;
-	u_long   dw, pixels;
-	ScanDef *scan = &dev->scanning;
-
-	usb_AverageColorByte( dev );
-
-	dw = scan->sParam.Size.dwPixels;
-
 	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	switch(scan->fGrayFromColor) {
-		case 1:  src = scan->Red.pb;   break;
-		case 3:  src = scan->Blue.pb;  break;
-		default: src = scan->Green.pb; break;
-	}
-
-	izoom = usb_GetScaler( scan );
-
-	for( ddax = 0; dw; src++ ) {
-
-		ddax -= _SCALER;
-		while((ddax < 0) && (dw > 0)) {
-
-			scan->UserBuf.pb[pixels] = *src;
-
-			pixels += next;
-			ddax   += izoom;
-			dw--;
-		}
+		*first = scan->sParam.Size.dwPixels - 1;
+		return -1;
 	}
+	*first = 0;
+	return 1;
 }
 
-/**
+/** the channel to use for gray and black/white modes
  */
-static void usb_ColorScaleGray16( Plustek_Device *dev )
+static u_char *usb_GetGrayChannel( ScanDef *scan )
 {
-	u_char    ls;
-	int       izoom, ddax, next;
-	u_long    dw, pixels, bitsput;
-	SANE_Bool swap = usb_HostSwap();
-	ScanDef  *scan = &dev->scanning;
-
-	usb_AverageColorByte( dev );
-
-	dw = scan->sParam.Size.dwPixels;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	izoom = usb_GetScaler( scan );
-
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
 	switch( scan->fGrayFromColor ) {
-
-	case 1:
-		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-			ddax -= _SCALER;
-
-			while((ddax < 0) && (dw > 0)) {
-				if( swap ) {
-					scan->UserBuf.pw[pixels] =
-					        _HILO2WORD(scan->Red.pcw[bitsput].HiLo[0]) >> ls;
-				} else {
-					scan->UserBuf.pw[pixels] = scan->Red.pw[bitsput] >> ls;
-				}
-				pixels += next;
-				ddax   += izoom;
-				dw--;
-			}
-		}
-		break;
-
-	case 2:
-		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-			ddax -= _SCALER;
-
-			while((ddax < 0) && (dw > 0)) {
-				if( swap ) {
-					scan->UserBuf.pw[pixels] =
-					      _HILO2WORD(scan->Green.pcw[bitsput].HiLo[0]) >> ls;
-				} else {
-					scan->UserBuf.pw[pixels] = scan->Green.pw[bitsput] >> ls;
-				}
-				pixels += next;
-				ddax   += izoom;
-				dw--;
-			}
-		}
-		break;
-
-	case 3:
-		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-			ddax -= _SCALER;
-
-			while((ddax < 0) && (dw > 0)) {
-				if( swap ) {
-					scan->UserBuf.pw[pixels] =
-					       _HILO2WORD(scan->Blue.pcw[bitsput].HiLo[0]) >> ls;
-				} else {
-					scan->UserBuf.pw[pixels] = scan->Blue.pw[bitsput] >> ls;
-				}
-				pixels += next;
-				ddax   += izoom;
-				dw--;
-			}
-		}
-		break;
+		case 1:  return scan->Red.pb;
+		case 3:  return scan->Blue.pb;
+		default: return scan->Green.pb;
 	}
 }
 
-/**
+/******************************* the pixel functions *************************/
+
+/** 8 bit color
  */
-static void usb_ColorScaleGray16_2( Plustek_Device *dev )
+static void usb_ColorCopy8( Plustek_Device *dev )
 {
-	u_char    ls;
-	int       izoom, ddax, next;
-	u_long    dw, pixels, bitsput;
-	HiLoDef   tmp;
-	SANE_Bool swap = usb_HostSwap();
-	ScanDef  *scan = &dev->scanning;
-
-	usb_AverageColorByte( dev );
-
-	dw = scan->sParam.Size.dwPixels;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	izoom = usb_GetScaler( scan );
-
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
-	switch( scan->fGrayFromColor ) {
-
-	case 1:
-		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-			ddax -= _SCALER;
-
-			while((ddax < 0) && (dw > 0)) {
-				if( swap ) {
-					tmp = *((HiLoDef*)&scan->Red.pw[bitsput]);
-					scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
-				} else {
-					scan->UserBuf.pw[pixels] = scan->Red.pw[dw] >> ls;
-				}
-				pixels += next;
-				ddax   += izoom;
-				dw--;
-			}
-		}
-		break;
-
-	case 2:
-		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-			ddax -= _SCALER;
+	u_long   first;
+	long     next;
+	u_char  *dest;
+	ScanDef *scan = &dev->scanning;
+	u_char  *src[3];
 
-			while((ddax < 0) && (dw > 0)) {
-				if( swap ) {
-					tmp = *((HiLoDef*)&scan->Green.pw[bitsput]);
-					scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
-				} else {
-					scan->UserBuf.pw[pixels] = scan->Green.pw[bitsput] >> ls;
-				}
-				pixels += next;
-				ddax   += izoom;
-				dw--;
-			}
-		}
-		break;
+	src[0] = scan->Red.pb;
+	src[1] = scan->Green.pb;
+	src[2] = scan->Blue.pb;
 
-	case 3:
-		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+	if( scan->pfnAverage )
+		scan->pfnAverage( dev );
 
-			ddax -= _SCALER;
+	next = usb_GetDirection( scan, &first ) * 3;
+	dest = &scan->UserBuf.pb_rgb[first].Red;
 
-			while((ddax < 0) && (dw > 0)) {
-				if( swap ) {
-					tmp = *((HiLoDef*)&scan->Blue.pw[bitsput]);
-					scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
-				} else {
-					scan->UserBuf.pw[pixels] = scan->Blue.pw[bitsput] >> ls;
-				}
-				pixels += next;
-				ddax   += izoom;
-				dw--;
-			}
-		}
-		break;
-	}
+	usb_MergeBytes( dest, next, src, scan->dwSampleStep,
+	                scan->pScaleMap, scan->sParam.Size.dwPixels );
 }
 
-/** here we copy and scale from scanner world to user world...
+/** 16 bit color
  */
-static void usb_ColorScale8( Plustek_Device *dev )
+static void usb_ColorCopy16( Plustek_Device *dev )
 {
-	int      izoom, ddax, next;
-	u_long   dw, pixels, bitsput;
-    ScanDef *scan = &dev->scanning;
-
-	usb_AverageColorByte( dev );
-
-	dw = scan->sParam.Size.dwPixels;
+	u_char   ls;
+	u_long   first;
+	long     next;
+	u_short *dest;
+	ScanDef *scan = &dev->scanning;
+	u_char  *src[3];
 
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
+	src[0] = scan->Red.pb;
+	src[1] = scan->Green.pb;
+	src[2] = scan->Blue.pb;
 
-	izoom = usb_GetScaler( scan );
+	if( scan->pfnAverage )
+		scan->pfnAverage( dev );
 
-	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+	ls   = (scan->dwFlag & SCANFLAG_RightAlign) ? Shift : 0;
+	next = usb_GetDirection( scan, &first ) * 3;
+	dest = &scan->UserBuf.pw_rgb[first].Red;
 
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (dw > 0)) {
-
-			scan->UserBuf.pb_rgb[pixels].Red =
-			                            scan->Red.pcb[bitsput].a_bColor[0];
-			scan->UserBuf.pb_rgb[pixels].Green =
-			                            scan->Green.pcb[bitsput].a_bColor[0];
-			scan->UserBuf.pb_rgb[pixels].Blue =
-			                            scan->Blue.pcb[bitsput].a_bColor[0];
-			pixels += next;
-			ddax   += izoom;
-			dw--;
-		}
-	}
+	usb_MergeWords( dest, next, src, scan->dwSampleStep,
+	                scan->pScaleMap, scan->sParam.Size.dwPixels, ls );
 }
 
-static void usb_ColorScale8_2( Plustek_Device *dev )
+/** 16 bit color from 8 bit data
+ */
+static void usb_ColorCopyPseudo16( Plustek_Device *dev )
 {
-	int      izoom, ddax, next;
-	u_long   dw, pixels, bitsput;
+	u_long   first;
+	long     next;
+	u_short *dest;
 	ScanDef *scan = &dev->scanning;
 
-	dw = scan->sParam.Size.dwPixels;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	izoom = usb_GetScaler( scan );
-
-	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (dw > 0)) {
+	if( scan->pfnAverage )
+		scan->pfnAverage( dev );
 
-			scan->UserBuf.pb_rgb[pixels].Red   = scan->Red.pb[bitsput];
-			scan->UserBuf.pb_rgb[pixels].Green = scan->Green.pb[bitsput];
-			scan->UserBuf.pb_rgb[pixels].Blue  = scan->Blue.pb[bitsput];
+	next = usb_GetDirection( scan, &first ) * 3;
+	dest = &scan->UserBuf.pw_rgb[first].Red;
 
-			pixels += next;
-			ddax   += izoom;
-			dw--;
-		}
-	}
+	usb_CopyPseudoWords( dest, next, scan->Red.pb, scan->dwSampleStep,
+	                     scan->pScaleMap, scan->sParam.Size.dwPixels );
+	usb_CopyPseudoWords( dest + 1, next, scan->Green.pb, scan->dwSampleStep,
+	                     scan->pScaleMap, scan->sParam.Size.dwPixels );
+	usb_CopyPseudoWords( dest + 2, next, scan->Blue.pb, scan->dwSampleStep,
+	                     scan->pScaleMap, scan->sParam.Size.dwPixels );
 }
 
-/**
+/** 8 bit gray, from gray data or one channel of color data
  */
-static void usb_ColorScale16( Plustek_Device *dev )
+static void usb_GrayCopy8( Plustek_Device *dev )
 {
-	u_char    ls;
-	int       izoom, ddax, next;
-	u_long    dw, pixels, bitsput;
-	SANE_Bool swap = usb_HostSwap();
-	ScanDef  *scan = &dev->scanning;
-
-	usb_AverageColorWord( dev );
-
-	dw = scan->sParam.Size.dwPixels;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	izoom = usb_GetScaler( scan );
-
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
-	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (dw > 0)) {
-
-			if( swap ) {
-
-				scan->UserBuf.pw_rgb[pixels].Red =
-				          _HILO2WORD(scan->Red.pcw[bitsput].HiLo[0]) >> ls;
-
-				scan->UserBuf.pw_rgb[pixels].Green =
-					      _HILO2WORD(scan->Green.pcw[bitsput].HiLo[0]) >> ls;
-
-				scan->UserBuf.pw_rgb[pixels].Blue =
-					      _HILO2WORD(scan->Blue.pcw[bitsput].HiLo[0]) >> ls;
+	u_long   first;
+	long     next;
+	ScanDef *scan = &dev->scanning;
 
-			} else {
+	if( scan->pfnAverage )
+		scan->pfnAverage( dev );
 
-				scan->UserBuf.pw_rgb[pixels].Red   = scan->Red.pw[bitsput]>>ls;
-				scan->UserBuf.pw_rgb[pixels].Green = scan->Green.pw[bitsput] >> ls;
-				scan->UserBuf.pw_rgb[pixels].Blue  = scan->Blue.pw[bitsput] >> ls;
-			}
-			pixels += next;
-			ddax   += izoom;
-			dw--;
-		}
-	}
+	next = usb_GetDirection( scan, &first );
+	usb_CopyBytes( scan->UserBuf.pb + first, next, usb_GetGrayChannel(scan),
+	               scan->dwSampleStep, scan->pScaleMap,
+	               scan->sParam.Size.dwPixels );
 }
 
-/**
+/** 16 bit gray, from gray data or one channel of color data
  */
-static void usb_ColorScale16_2( Plustek_Device *dev )
+static void usb_GrayCopy16( Plustek_Device *dev )
 {
-	u_char     ls;
-	HiLoDef    tmp;
-	int        izoom, ddax, next;
-	u_long     dw, pixels, bitsput;
-	SANE_Bool  swap = usb_HostSwap();
-	ScanDef   *scan = &dev->scanning;
-
-	usb_AverageColorWord( dev );
-
-	dw = scan->sParam.Size.dwPixels;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
-	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	izoom = usb_GetScaler( scan );
-
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
-
-	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (dw > 0)) {
-
-			if( swap ) {
+	u_char   ls;
+	u_long   first;
+	long     next;
+	ScanDef *scan = &dev->scanning;
 
-				tmp = *((HiLoDef*)&scan->Red.pw[bitsput]);
-				scan->UserBuf.pw_rgb[pixels].Red = _HILO2WORD(tmp) >> ls;
+	if( scan->pfnAverage )
+		scan->pfnAverage( dev );
 
-				tmp = *((HiLoDef*)&scan->Green.pw[bitsput]);
-				scan->UserBuf.pw_rgb[pixels].Green = _HILO2WORD(tmp) >> ls;
+	ls   = (scan->dwFlag & SCANFLAG_RightAlign) ? Shift : 0;
+	next = usb_GetDirection( scan, &first );
+	usb_CopyWords( scan->UserBuf.pw + first, next, usb_GetGrayChannel(scan),
+	               scan->dwSampleStep, scan->pScaleMap,
+	               scan->sParam.Size.dwPixels, ls );
+}
 
-				tmp = *((HiLoDef*)&scan->Blue.pw[bitsput]);
-				scan->UserBuf.pw_rgb[pixels].Blue = _HILO2WORD(tmp) >> ls;
+/** 16 bit gray from 8 bit gray data
+ */
+static void usb_GrayCopyPseudo16( Plustek_Device *dev )
+{
+	u_long   first;
+	long     next;
+	ScanDef *scan = &dev->scanning;
 
-			} else {
+	if( scan->pfnAverage )
+		scan->pfnAverage( dev );
 
-				scan->UserBuf.pw_rgb[pixels].Red   = scan->Red.pw[bitsput] >> ls;
-				scan->UserBuf.pw_rgb[pixels].Green = scan->Green.pw[bitsput] >> ls;
-				scan->UserBuf.pw_rgb[pixels].Blue  = scan->Blue.pw[bitsput] >> ls;
-			}
-			pixels += next;
-			ddax   += izoom;
-			dw--;
-		}
-	}
+	next = usb_GetDirection( scan, &first );
+	usb_CopyPseudoWords( scan->UserBuf.pw + first, next,
+	                     usb_GetGrayChannel(scan), scan->dwSampleStep,
+	                     scan->pScaleMap, scan->sParam.Size.dwPixels );
 }
 
-/**
+/** generate binary data from one of the three color inputs according to the
+ *  value in fGrayFromColor
  */
-static void usb_ColorScalePseudo16( Plustek_Device *dev )
+static void usb_BWCopyFromColor( Plustek_Device *dev )
 {
-	int      izoom, ddax, next;
-	u_short  wR, wG, wB;
-	u_long   dw, pixels, bitsput;
+	u_long   first;
+	long     next;
 	ScanDef *scan = &dev->scanning;
 
-	usb_AverageColorByte( dev );
+	/* for the ADF, the bytes are written backward from the index of the
+	 * last pixel
+	 */
+	next = usb_GetDirection( scan, &first );
+	usb_PackBits( scan->UserBuf.pb + first, next, usb_GetGrayChannel(scan),
+	              scan->dwSampleStep, scan->pScaleMap,
+	              scan->sParam.Size.dwPixels );
+}
 
-	dw = scan->sParam.Size.dwPixels;
+/** copy binary data to the user buffer
+ */
+static void usb_BWDuplicate( Plustek_Device *dev )
+{
+	ScanDef *scan = &dev->scanning;
 
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next   = -1;
-		pixels = scan->sParam.Size.dwPixels - 1;
+	if(scan->sParam.bSource == SOURCE_ADF)
+	{
+		usb_ReverseBitStream( scan->Green.pb, scan->UserBuf.pb,
+		                      scan->sParam.Size.dwValidPixels,
+		                      scan->dwBytesLine, 0, 0, 1 );
 	} else {
-		next   = 1;
-		pixels = 0;
-	}
-
-	izoom = usb_GetScaler( scan );
-
-	wR = (u_short)scan->Red.pcb[0].a_bColor[0];
-	wG = (u_short)scan->Green.pcb[0].a_bColor[1];
-	wB = (u_short)scan->Blue.pcb[0].a_bColor[2];
-
-	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
-
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (dw > 0)) {
-
-			scan->UserBuf.pw_rgb[pixels].Red =
-				(wR + scan->Red.pcb[bitsput].a_bColor[0]) << bShift;
-
-			scan->UserBuf.pw_rgb[pixels].Green =
-				(wG + scan->Green.pcb[bitsput].a_bColor[0]) << bShift;
-
-			scan->UserBuf.pw_rgb[pixels].Blue =
-				(wB + scan->Blue.pcb[bitsput].a_bColor[0]) << bShift;
-
-			pixels += next;
-			ddax   += izoom;
-			dw--;
-		}
-
-		wR = (u_short)scan->Red.pcb[bitsput].a_bColor[0];
-		wG = (u_short)scan->Green.pcb[bitsput].a_bColor[0];
-		wB = (u_short)scan->Blue.pcb[bitsput].a_bColor[0];
+		memcpy( scan->UserBuf.pb, scan->Green.pb, scan->sParam.Size.dwBytes );
 	}
 }
 
@@ -1462,400 +770,182 @@ static void usb_BWScale( Plustek_Device *dev )
 	}
 }
 
-/**
- */
-static void usb_BWScaleFromColor( Plustek_Device *dev )
-{
-	u_char        d, s, *dest;
-	u_short       j;
-	u_long        pixels;
-	int           izoom, ddax, next;
-	ColorByteDef *src;
-	ScanDef      *scan = &dev->scanning;
-
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
-		next = -1;
-	} else {
-		dest = scan->UserBuf.pb;
-		next = 1;
-	}
-
-	/* setup the source buffer */
-	switch(scan->fGrayFromColor) {
-	case 1:  src = scan->Red.pcb;   break;
-	case 3:  src = scan->Blue.pcb;  break;
-	default: src = scan->Green.pcb; break;
-	}
-
-	izoom = usb_GetScaler( scan );
-	ddax  = 0;
-
-	d = j = 0;
-	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
-
-		ddax -= _SCALER;
+/******************************* the selection *******************************/
 
-		while((ddax < 0) && (pixels > 0)) {
-
-			s = src->a_bColor[0];
-			if( s != 0 )
-				d |= BitTable[j];
-			j++;
-			if( j == 8 ) {
-				*dest = d;
-				dest += next;
-				d = j = 0;
-			}
-			ddax   += izoom;
-			pixels--;
-		}
-	}
-}
-
-/**
+/** kinds of pixel processing, according to the scan mode
  */
-static void usb_BWScaleFromColor_2( Plustek_Device *dev )
-{
-	u_char        d, *dest, *src;
-	u_short       j;
-	u_long        pixels;
-	int           izoom, ddax, next;
-	ScanDef      *scan = &dev->scanning;
-
-	if (scan->sParam.bSource == SOURCE_ADF) {
-		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
-		next = -1;
-	} else {
-		dest = scan->UserBuf.pb;
-		next = 1;
-	}
-
-	/* setup the source buffer */
-	switch(scan->fGrayFromColor) {
-	case 1:  src = scan->Red.pb;   break;
-	case 3:  src = scan->Blue.pb;  break;
-	default: src = scan->Green.pb; break;
-	}
-
-	izoom = usb_GetScaler( scan );
-	ddax  = 0;
-
-	d = j = 0;
-	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
-
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (pixels > 0)) {
+enum {
+	_IP_COLOR8 = 0,
+	_IP_COLOR16,
+	_IP_COLOR_PSEUDO16,
+	_IP_GRAY_FROM_COLOR8,
+	_IP_GRAY_FROM_COLOR16,
+	_IP_BW_FROM_COLOR,
+	_IP_GRAY8,
+	_IP_GRAY16,
+	_IP_GRAY_PSEUDO16,
+	_IP_BW
+};
 
-			if( *src != 0 )
-				d |= BitTable[j];
-			j++;
-			if( j == 8 ) {
-				*dest = d;
-				dest += next;
-				d = j = 0;
-			}
-			ddax   += izoom;
-			pixels--;
-		}
-	}
-}
+/** the pixel function, averaging and source pixel distance of each kind of
+ *  processing, for CCD (interleaved) and CIS (planar) data
+ */
+typedef struct {
+	int         kind;
+	int         cis;      /**< 1: CIS only, 0: CCD only, -1: both      */
+	SANE_Bool   scaled;
+	u_long      step;     /**< bytes between two pixels of a channel  */
+	void      (*pfnAverage)(Plustek_Device*);
+	void      (*pfnProcess)(Plustek_Device*);
+	const char *name;
+} ImageProcDef;
+
+static const ImageProcDef ImageProcs[] = {
+
+	/* pixel copy */
+	{ _IP_COLOR8,            0, SANE_FALSE, 3, usb_AverageColorByte,
+	  usb_ColorCopy8,        "ColorDuplicate8"        },
+	{ _IP_COLOR8,            1, SANE_FALSE, 1, NULL,
+	  usb_ColorCopy8,        "ColorDuplicate8_2"      },
+	{ _IP_COLOR16,           0, SANE_FALSE, 6, usb_AverageColorWord,
+	  usb_ColorCopy16,       "ColorDuplicate16"       },
+	{ _IP_COLOR16,           1, SANE_FALSE, 2, usb_AverageColorWord,
+	  usb_ColorCopy16,       "ColorDuplicate16_2"     },
+	{ _IP_COLOR_PSEUDO16,   -1, SANE_FALSE, 3, usb_AverageColorByte,
+	  usb_ColorCopyPseudo16, "ColorDuplicatePseudo16" },
+	{ _IP_GRAY_FROM_COLOR8,  0, SANE_FALSE, 3, usb_AverageColorByte,
+	  usb_GrayCopy8,         "ColorDuplicateGray"     },
+	{ _IP_GRAY_FROM_COLOR8,  1, SANE_FALSE, 1, usb_AverageColorByte,
+	  usb_GrayCopy8,         "ColorDuplicateGray_2"   },
+	{ _IP_GRAY_FROM_COLOR16, 0, SANE_FALSE, 6, usb_AverageColorWord,
+	  usb_GrayCopy16,        "ColorDuplicateGray16"   },
+	{ _IP_GRAY_FROM_COLOR16, 1, SANE_FALSE, 2, usb_AverageColorWord,
+	  usb_GrayCopy16,        "ColorDuplicateGray16_2" },
+	{ _IP_BW_FROM_COLOR,     0, SANE_FALSE, 3, NULL,
+	  usb_BWCopyFromColor,   "BWDuplicateFromColor"   },
+	{ _IP_BW_FROM_COLOR,     1, SANE_FALSE, 1, NULL,
+	  usb_BWCopyFromColor,   "BWDuplicateFromColor_2" },
+	{ _IP_GRAY8,            -1, SANE_FALSE, 1, usb_AverageGrayByte,
+	  usb_GrayCopy8,         "GrayDuplicate8"         },
+	{ _IP_GRAY16,           -1, SANE_FALSE, 2, usb_AverageGrayWord,
+	  usb_GrayCopy16,        "GrayDuplicate16"        },
+	{ _IP_GRAY_PSEUDO16,    -1, SANE_FALSE, 1, usb_AverageGrayByte,
+	  usb_GrayCopyPseudo16,  "GrayDuplicatePseudo16"  },
+	{ _IP_BW,               -1, SANE_FALSE, 0, NULL,
+	  usb_BWDuplicate,       "BWDuplicate"            },
+
+	/* pixel scaling */
+	{ _IP_COLOR8,            0, SANE_TRUE,  3, usb_AverageColorByte,
+	  usb_ColorCopy8,        "ColorScale8"            },
+	{ _IP_COLOR8,            1, SANE_TRUE,  1, NULL,
+	  usb_ColorCopy8,        "ColorScale8_2"          },
+	{ _IP_COLOR16,           0, SANE_TRUE,  6, usb_AverageColorWord,
+	  usb_ColorCopy16,       "ColorScale16"           },
+	{ _IP_COLOR16,           1, SANE_TRUE,  2, usb_AverageColorWord,
+	  usb_ColorCopy16,       "ColorScale16_2"         },
+	{ _IP_COLOR_PSEUDO16,   -1, SANE_TRUE,  3, usb_AverageColorByte,
+	  usb_ColorCopyPseudo16, "ColorScalePseudo16"     },
+	{ _IP_GRAY_FROM_COLOR8,  0, SANE_TRUE,  3, usb_AverageColorByte,
+	  usb_GrayCopy8,         "ColorScaleGray"         },
+	{ _IP_GRAY_FROM_COLOR8,  1, SANE_TRUE,  1, usb_AverageColorByte,
+	  usb_GrayCopy8,         "ColorScaleGray_2"       },
+	{ _IP_GRAY_FROM_COLOR16, 0, SANE_TRUE,  6, usb_AverageColorByte,
+	  usb_GrayCopy16,        "ColorScaleGray16"       },
+	{ _IP_GRAY_FROM_COLOR16, 1, SANE_TRUE,  2, usb_AverageColorByte,
+	  usb_GrayCopy16,        "ColorScaleGray16_2"     },
+	{ _IP_BW_FROM_COLOR,     0, SANE_TRUE,  3, NULL,
+	  usb_BWCopyFromColor,   "BWScaleFromColor"       },
+	{ _IP_BW_FROM_COLOR,     1, SANE_TRUE,  1, NULL,
+	  usb_BWCopyFromColor,   "BWScaleFromColor_2"     },
+	{ _IP_GRAY8,            -1, SANE_TRUE,  1, usb_AverageGrayByte,
+	  usb_GrayCopy8,         "GrayScale8"             },
+	{ _IP_GRAY16,           -1, SANE_TRUE,  2, usb_AverageGrayWord,
+	  usb_GrayCopy16,        "GrayScale16"            },
+	{ _IP_GRAY_PSEUDO16,    -1, SANE_TRUE,  1, usb_AverageGrayByte,
+	  usb_GrayCopyPseudo16,  "GrayScalePseudo16"      },
+	{ _IP_BW,               -1, SANE_TRUE,  0, NULL,
+	  usb_BWScale,           "BWScale"                }
+};
 
 /**
  */
-static void usb_GrayScale8( Plustek_Device *dev )
+static void usb_FreeScaleMap( ScanDef *scan )
 {
-	u_char  *dest, *src;
-	int      izoom, ddax, next;
-	u_long   pixels;
-	ScanDef *scan = &dev->scanning;
-
-	usb_AverageGrayByte( dev );
-
-	src = scan->Green.pb;
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
-		next = -1;
-	} else {
-		dest = scan->UserBuf.pb;
-		next = 1;
-	}
-
-	izoom = usb_GetScaler( scan );
-	ddax  = 0;
-
-	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
-
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (pixels > 0)) {
-
-			*dest = *src;
-			dest += next;
-			ddax   += izoom;
-			pixels--;
-		}
+	if( NULL != scan->pScaleMap ) {
+		free( scan->pScaleMap );
+		scan->pScaleMap = NULL;
 	}
 }
 
-/**
+/** function to select the appropriate pixel copy function
  */
-static void usb_GrayScale16( Plustek_Device *dev )
+static int usb_GetImageProc( Plustek_Device *dev )
 {
-	u_char    ls;
-	int       izoom, ddax, next;
-	u_short  *dest;
-	u_long    pixels;
-	HiLoDef  *pwm;
-	ScanDef  *scan = &dev->scanning;
-	SANE_Bool swap = usb_HostSwap();
-
-	usb_AverageGrayWord( dev);
+	int                 kind, cis;
+	SANE_Bool           scaled;
+	u_long              i;
+	const ImageProcDef *ip = NULL;
+	ScanDef            *scan = &dev->scanning;
+	DCapsDef           *sc   = &dev->usbDev.Caps;
+	HWDef              *hw   = &dev->usbDev.HwSetting;
 
-	pwm  = scan->Green.philo;
-	wSum = scan->sParam.PhyDpi.x;
-
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next = -1;
-		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
-	} else {
-		next = 1;
-		dest = scan->UserBuf.pw;
-	}
-
-	izoom = usb_GetScaler( scan );
-	ddax  = 0;
-
-	if( scan->dwFlag & SCANFLAG_RightAlign )
-		ls = Shift;
-	else
-		ls = 0;
+	bShift = 0;
 
-	for( pixels = scan->sParam.Size.dwPixels; pixels; pwm++ ) {
+	switch( scan->sParam.bDataType ) {
 
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (pixels > 0)) {
+		case SCANDATATYPE_Color:
+			if( scan->sParam.bBitDepth > 8 ) {
+				if( scan->fGrayFromColor )
+					kind = _IP_GRAY_FROM_COLOR16;
+				else
+					kind = _IP_COLOR16;
+			} else if( scan->dwFlag & SCANFLAG_Pseudo48 ) {
+				kind = _IP_COLOR_PSEUDO16;
+			} else if( scan->fGrayFromColor > 7 ) {
+				kind = _IP_BW_FROM_COLOR;
+			} else if( scan->fGrayFromColor ) {
+				kind = _IP_GRAY_FROM_COLOR8;
+			} else {
+				kind = _IP_COLOR8;
+			}
+			break;
 
-			if( swap )
-				*dest = _PHILO2WORD(pwm) >> ls;
+		case SCANDATATYPE_Gray:
+			if( scan->sParam.bBitDepth > 8 )
+				kind = _IP_GRAY16;
+			else if( scan->dwFlag & SCANFLAG_Pseudo48 )
+				kind = _IP_GRAY_PSEUDO16;
 			else
-				*dest = _PLOHI2WORD(pwm) >> ls;
-
-			dest += next;
-			ddax += izoom;
-			pixels--;
-		}
-	}
-}
-
-/**
- */
-static void usb_GrayScalePseudo16( Plustek_Device *dev )
-{
-	u_char  *src;
-	int      izoom, ddax, next;
-	u_short *dest, g;
-	u_long   pixels;
-	ScanDef *scan = &dev->scanning;
-
-	usb_AverageGrayByte( dev );
+				kind = _IP_GRAY8;
+			break;
 
-	if( scan->sParam.bSource == SOURCE_ADF ) {
-		next = -1;
-		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
-	} else {
-		next = 1;
-		dest = scan->UserBuf.pw;
+		default:
+			kind = _IP_BW;
+			break;
 	}
 
-	src = scan->Green.pb;
-	g   = (u_short)*src;
-
-	izoom = usb_GetScaler( scan );
-	ddax  = 0;
+	scaled = (scan->sParam.UserDpi.x != scan->sParam.PhyDpi.x);
+	cis    = usb_IsCISDevice(dev) ? 1 : 0;
 
-	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
+	for( i = 0; i < sizeof(ImageProcs)/sizeof(ImageProcs[0]); i++ ) {
 
-		ddax -= _SCALER;
-
-		while((ddax < 0) && (pixels > 0)) {
-
-			*dest = (g + *src) << bShift;
-			dest += next;
-			ddax += izoom;
-			pixels--;
+		if( ImageProcs[i].kind == kind && ImageProcs[i].scaled == scaled &&
+		   (ImageProcs[i].cis == -1 || ImageProcs[i].cis == cis)) {
+			ip = &ImageProcs[i];
+			break;
 		}
-		g = (u_short)*src;
 	}
-}
 
-/** function to select the appropriate pixel copy function
- */
-static void usb_GetImageProc( Plustek_Device *dev )
-{
-    ScanDef  *scan = &dev->scanning;
-	DCapsDef *sc   = &dev->usbDev.Caps;
-	HWDef    *hw   = &dev->usbDev.HwSetting;
-
-	bShift = 0;
-
-	if( scan->sParam.UserDpi.x != scan->sParam.PhyDpi.x ) {
-
-		/* Pixel scaling... */
-		switch( scan->sParam.bDataType ) {
-
-			case SCANDATATYPE_Color:
-				if (scan->sParam.bBitDepth > 8) {
-
-					if( usb_IsCISDevice(dev)){
-						scan->pfnProcess = usb_ColorScale16_2;
-						DBG( _DBG_INFO, "ImageProc is: ColorScale16_2\n" );
-					} else {
-						scan->pfnProcess = usb_ColorScale16;
-						DBG( _DBG_INFO, "ImageProc is: ColorScale16\n" );
-					}
-					if (scan->fGrayFromColor) {
-						if( usb_IsCISDevice(dev)){
-							scan->pfnProcess = usb_ColorScaleGray16_2;
-							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray16_2\n" );
-						} else {
-							scan->pfnProcess = usb_ColorScaleGray16;
-							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray16\n" );
-						}
-					}
-				} else if (scan->dwFlag & SCANFLAG_Pseudo48) {
-					scan->pfnProcess = usb_ColorScalePseudo16;
-					DBG( _DBG_INFO, "ImageProc is: ColorScalePseudo16\n" );
-
-				} else if (scan->fGrayFromColor) {
-
-					if( usb_IsCISDevice(dev)){
-						if (scan->fGrayFromColor > 7 ) {
-							scan->pfnProcess = usb_BWScaleFromColor_2;
-							DBG( _DBG_INFO, "ImageProc is: BWScaleFromColor_2\n" );
-						} else {
-							scan->pfnProcess = usb_ColorScaleGray_2;
-							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray_2\n" );
-						}
-					} else {
-						if (scan->fGrayFromColor > 7 ) {
-							scan->pfnProcess = usb_BWScaleFromColor;
-							DBG( _DBG_INFO, "ImageProc is: BWScaleFromColor\n" );
-						} else {
-							scan->pfnProcess = usb_ColorScaleGray;
-							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray\n" );
-						}
-					}
-				} else {
-
-					if( usb_IsCISDevice(dev)){
-						scan->pfnProcess = usb_ColorScale8_2;
-						DBG( _DBG_INFO, "ImageProc is: ColorScale8_2\n" );
-					} else {
-						scan->pfnProcess = usb_ColorScale8;
-						DBG( _DBG_INFO, "ImageProc is: ColorScale8\n" );
-					}
-				}
-				break;
-
-			case SCANDATATYPE_Gray:
-				if (scan->sParam.bBitDepth > 8) {
-					scan->pfnProcess = usb_GrayScale16;
-					DBG( _DBG_INFO, "ImageProc is: GrayScale16\n" );
-				} else {
-
-					if (scan->dwFlag & SCANFLAG_Pseudo48) {
-						scan->pfnProcess = usb_GrayScalePseudo16;
-						DBG( _DBG_INFO, "ImageProc is: GrayScalePseudo16\n" );
-					} else {
-						scan->pfnProcess = usb_GrayScale8;
-						DBG( _DBG_INFO, "ImageProc is: GrayScale8\n" );
-					}
-				}
-				break;
-
-			default:
-				scan->pfnProcess = usb_BWScale;
-				DBG( _DBG_INFO, "ImageProc is: BWScale\n" );
-				break;
-		}
-
-	} else {
+	scan->pfnProcess   = ip->pfnProcess;
+	scan->pfnAverage   = ip->pfnAverage;
+	scan->dwSampleStep = ip->step;
+	DBG( _DBG_INFO, "ImageProc is: %s\n", ip->name );
 
-		/* Pixel copy */
-		switch( scan->sParam.bDataType ) {
-
-			case SCANDATATYPE_Color:
-				if (scan->sParam.bBitDepth > 8) {
-					if( usb_IsCISDevice(dev)){
-						scan->pfnProcess = usb_ColorDuplicate16_2;
-						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate16_2\n" );
-					} else {
-						scan->pfnProcess = usb_ColorDuplicate16;
-						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate16\n" );
-					}
-					if (scan->fGrayFromColor) {
-						if( usb_IsCISDevice(dev)){
-							scan->pfnProcess = usb_ColorDuplicateGray16_2;
-							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray16_2\n" );
-						} else {
-							scan->pfnProcess = usb_ColorDuplicateGray16;
-							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray16\n" );
-						}
-					}
-				} else if (scan->dwFlag & SCANFLAG_Pseudo48) {
-					scan->pfnProcess = usb_ColorDuplicatePseudo16;
-					DBG( _DBG_INFO, "ImageProc is: ColorDuplicatePseudo16\n" );
-				} else if (scan->fGrayFromColor) {
-					if( usb_IsCISDevice(dev)){
-						if (scan->fGrayFromColor > 7 ) {
-							scan->pfnProcess = usb_BWDuplicateFromColor_2;
-							DBG( _DBG_INFO, "ImageProc is: BWDuplicateFromColor_2\n" );
-						} else {
-							scan->pfnProcess = usb_ColorDuplicateGray_2;
-							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray_2\n" );
-						}
-					} else {
-						if (scan->fGrayFromColor > 7 ) {
-							scan->pfnProcess = usb_BWDuplicateFromColor;
-							DBG( _DBG_INFO, "ImageProc is: BWDuplicateFromColor\n" );
-						} else {
-							scan->pfnProcess = usb_ColorDuplicateGray;
-							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray\n" );
-						}
-					}
-				} else {
-					if( usb_IsCISDevice(dev)){
-						scan->pfnProcess = usb_ColorDuplicate8_2;
-						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate8_2\n" );
-					} else {
-						scan->pfnProcess = usb_ColorDuplicate8;
-						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate8\n" );
-					}
-				}
-				break;
-
-			case SCANDATATYPE_Gray:
-				if (scan->sParam.bBitDepth > 8) {
-					scan->pfnProcess = usb_GrayDuplicate16;
-					DBG( _DBG_INFO, "ImageProc is: GrayDuplicate16\n" );
-				} else {
-					if (scan->dwFlag & SCANFLAG_Pseudo48) {
-						scan->pfnProcess = usb_GrayDuplicatePseudo16;
-						DBG( _DBG_INFO, "ImageProc is: GrayDuplicatePseudo16\n" );
-					} else {
-						scan->pfnProcess = usb_GrayDuplicate8;
-						DBG( _DBG_INFO, "ImageProc is: GrayDuplicate8\n" );
-					}
-				}
-				break;
-
-			default:
-				scan->pfnProcess = usb_BWDuplicate;
-				DBG( _DBG_INFO, "ImageProc is: BWDuplicate\n" );
-				break;
+	usb_FreeScaleMap( scan );
+	if( scaled && kind != _IP_BW ) {
+		if( !usb_BuildScaleMap( scan )) {
+			DBG( _DBG_ERROR, "Can't allocate the scaler map\n" );
+			return _E_ALLOC;
 		}
 	}
 
@@ -1886,6 +976,7 @@ static void usb_GetImageProc( Plustek_Device *dev )
 		Shift = 2;
 		Mask  = 0xFFFC;
 	}
+	return 0;
 }
 
 /**
@@ -157,7 +157,7 @@
 #include "../include/sane/sanei.h"
 #include "../include/sane/saneopts.h"
 
-#define BACKEND_VERSION "0.52-12"
+#define BACKEND_VERSION "0.52-13"
 
 #define BACKEND_NAME    plustek
 #include "../include/sane/sanei_access.h"
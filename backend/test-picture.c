@@ -59,7 +59,7 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
   if (test_device->val[opt_invert_endianess].w)
     is_little_endian ^= 1;
 
-  DBG (2, "(child) init_picture_buffer test_device=%p, buffer=%p, "
+  DBG (2, "init_picture_buffer test_device=%p, buffer=%p, "
        "buffer_size=%p\n",(void*)test_device,(void*)buffer,(void*)buffer_size);
 
   if (strcmp (test_device->val[opt_test_picture].s, "Solid black") == 0
@@ -74,7 +74,7 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
 
@@ -83,7 +83,7 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
 
       if (strcmp (test_device->val[opt_test_picture].s, "Solid black") == 0)
 	{
-	  DBG (3, "(child) init_picture_buffer: drawing solid black test "
+	  DBG (3, "init_picture_buffer: drawing solid black test "
 	       "picture %zu bytes\n", b_size);
 	  if (test_device->params.format == SANE_FRAME_GRAY
 	      && test_device->params.depth == 1)
@@ -93,7 +93,7 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
 	}
       else
 	{
-	  DBG (3, "(child) init_picture_buffer: drawing solid white test "
+	  DBG (3, "init_picture_buffer: drawing solid white test "
 	       "picture %zu bytes\n", b_size);
 	  if (test_device->params.format == SANE_FRAME_GRAY
 	      && test_device->params.depth == 1)
@@ -123,12 +123,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing grid test picture "
+      DBG (3, "init_picture_buffer: drawing grid test picture "
 	   "%zu bytes, %d bpl, %d ppl, %d lines\n", b_size, bpl, ppl, lines);
 
       for (line_count = 0; line_count < lines; line_count++)
@@ -223,12 +223,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing b/w test picture "
+      DBG (3, "init_picture_buffer: drawing b/w test picture "
 	   "%zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 255, b_size);
       for (line_count = 0; line_count < lines; line_count++)
@@ -264,12 +264,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing 8 bit gray test picture "
+      DBG (3, "init_picture_buffer: drawing 8 bit gray test picture "
 	   "%zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
       for (line_count = 0; line_count < lines; line_count++)
@@ -313,12 +313,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing 16 bit gray test picture "
+      DBG (3, "init_picture_buffer: drawing 16 bit gray test picture "
 	   "%zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
       for (line_count = 0; line_count < lines; line_count++)
@@ -374,12 +374,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing color lineart test "
+      DBG (3, "init_picture_buffer: drawing color lineart test "
 	   "picture %zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
 
@@ -441,12 +441,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing color lineart three-pass "
+      DBG (3, "init_picture_buffer: drawing color lineart three-pass "
 	   "test picture %zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
 
@@ -509,12 +509,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing 8 bit color test picture "
+      DBG (3, "init_picture_buffer: drawing 8 bit color test picture "
 	   "%zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
       for (line_count = 0; line_count < lines; line_count++)
@@ -589,12 +589,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing 8 bit color three-pass "
+      DBG (3, "init_picture_buffer: drawing 8 bit color three-pass "
 	   "test picture %zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
       for (line_count = 0; line_count < lines; line_count++)
@@ -655,13 +655,13 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
       DBG (3,
-	   "(child) init_picture_buffer: drawing 16 bit color test picture "
+	   "init_picture_buffer: drawing 16 bit color test picture "
 	   "%zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
       for (line_count = 0; line_count < lines; line_count++)
@@ -761,12 +761,12 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
       b = malloc (b_size);
       if (!b)
 	{
-	  DBG (1, "(child) init_picture_buffer: couldn't malloc buffer\n");
+	  DBG (1, "init_picture_buffer: couldn't malloc buffer\n");
 	  return SANE_STATUS_NO_MEM;
 	}
       if (buffer)
 	*buffer = b;
-      DBG (3, "(child) init_picture_buffer: drawing 16 bit color three-pass "
+      DBG (3, "init_picture_buffer: drawing 16 bit color three-pass "
 	   "test picture %zu bytes, %d bpl, %d lines\n", b_size, bpl, lines);
       memset (b, 0x55, b_size);
       for (line_count = 0; line_count < lines; line_count++)
@@ -840,7 +840,7 @@ init_picture_buffer (Test_Device * test_device, SANE_Byte ** buffer,
     }
   else				/* Huh? */
     {
-      DBG (1, "(child) init_picture_buffer: unknown mode\n");
+      DBG (1, "init_picture_buffer: unknown mode\n");
       return SANE_STATUS_INVAL;
     }
 
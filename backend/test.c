@@ -47,16 +47,23 @@
 
 #include "../include/sane/config.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include "../include/_stdint.h"
 
 #include "../include/sane/sane.h"
@@ -64,6 +71,7 @@
 #include "../include/sane/saneopts.h"
 #include "../include/sane/sanei_config.h"
 #include "../include/sane/sanei_thread.h"
+#include "../include/sane/sanei_ring.h"
 
 #define BACKEND_NAME	test
 #include "../include/sane/sanei_backend.h"
@@ -108,6 +116,24 @@ static SANE_Range read_delay_duration_range = {
   1000
 };
 
+static SANE_Range timing_bandwidth_range = {
+  0,
+  1024 * 1024,			/* 1 GB/s */
+  1
+};
+
+static SANE_Range timing_duration_range = {
+  0,
+  60 * 1000,			/* 1 minute */
+  1
+};
+
+static SANE_Range timing_stall_interval_range = {
+  0,
+  1024 * 1024,			/* 1 GB */
+  1
+};
+
 static SANE_Range int_constraint_range = {
   4,
   192,
@@ -233,6 +259,25 @@ static SANE_String_Const source_list[] = {
   0
 };
 
+static SANE_String_Const timing_profile_list[] = {
+  SANE_I18N ("None"), SANE_I18N ("Flatbed"), SANE_I18N ("Sheet-fed"),
+  SANE_I18N ("Network sheet-fed"), SANE_I18N ("Custom"),
+  0
+};
+
+/* values of the timing options for each entry of timing_profile_list
+   before "Custom": bandwidth (KB/s), warm-up (ms), stall interval (KB),
+   stall duration (ms), page gap (ms) and variable length */
+static const SANE_Word timing_profiles[][6] = {
+  {0, 0, 0, 0, 0, SANE_FALSE},
+  {4 * 1024, 3000, 0, 0, 2000, SANE_FALSE},
+  {24 * 1024, 1000, 4 * 1024, 40, 400, SANE_TRUE},
+  {2 * 1024, 1500, 512, 120, 800, SANE_TRUE}
+};
+
+#define NUM_TIMING_PROFILES \
+  (sizeof (timing_profiles) / sizeof (timing_profiles[0]))
+
 static double random_factor;	/* use for fuzzyness of parameters */
 
 /* initial values. Initial string values are set in sane_init() */
@@ -260,7 +305,15 @@ static SANE_Word init_ppl_loss = 0;
 static SANE_Bool init_non_blocking = SANE_FALSE;
 static SANE_Bool init_select_fd = SANE_FALSE;
 static SANE_Bool init_enable_test_options = SANE_FALSE;
+static SANE_String init_timing_profile = NULL;
+static SANE_Word init_timing_bandwidth = 0;
+static SANE_Word init_timing_warm_up = 0;
+static SANE_Word init_timing_stall_interval = 0;
+static SANE_Word init_timing_stall_duration = 0;
+static SANE_Word init_timing_page_gap = 0;
+static SANE_Bool init_timing_variable_length = SANE_FALSE;
 static SANE_String init_string = NULL;
+static SANE_String picture_cache_dir = NULL;
 static SANE_String init_string_constraint_string_list = NULL;
 static SANE_String init_string_constraint_long_string_list = NULL;
 
@@ -337,6 +390,9 @@ cleanup_options (Test_Device * test_device)
   free(test_device->val[opt_read_status_code].s);
   test_device->val[opt_read_status_code].s = NULL;
 
+  free(test_device->val[opt_timing_profile].s);
+  test_device->val[opt_timing_profile].s = NULL;
+
   free(test_device->val[opt_string].s);
   test_device->val[opt_string].s = NULL;
 
@@ -349,6 +405,45 @@ cleanup_options (Test_Device * test_device)
   test_device->options_initialized = SANE_FALSE;
 }
 
+/* load the values of the selected timing profile into the timing options,
+   which can only be changed with the "Custom" profile */
+static void
+load_timing_profile (Test_Device * test_device)
+{
+  SANE_Word option_number;
+  size_t profile;
+
+  for (profile = 0; profile < NUM_TIMING_PROFILES; profile++)
+    if (strcmp (test_device->val[opt_timing_profile].s,
+		timing_profile_list[profile]) == 0)
+      break;
+
+  for (option_number = opt_timing_bandwidth;
+       option_number <= opt_timing_variable_length; option_number++)
+    {
+      if (profile == NUM_TIMING_PROFILES)
+	{
+	  test_device->opt[option_number].cap &= ~SANE_CAP_INACTIVE;
+	  continue;
+	}
+      test_device->opt[option_number].cap |= SANE_CAP_INACTIVE;
+      test_device->val[option_number].w =
+	timing_profiles[profile][option_number - opt_timing_bandwidth];
+    }
+  DBG (3, "load_timing_profile: profile `%s'\n",
+       test_device->val[opt_timing_profile].s);
+}
+
+/* ADF pages have a random length that is only known at their end */
+static SANE_Bool
+variable_length (Test_Device * test_device)
+{
+  return test_device->val[opt_timing_variable_length].w == SANE_TRUE
+    && test_device->val[opt_hand_scanner].w == SANE_FALSE
+    && strcmp (test_device->val[opt_scan_source].s,
+	       "Automatic Document Feeder") == 0;
+}
+
 static SANE_Status
 init_options (Test_Device * test_device)
 {
@@ -712,6 +807,131 @@ init_options (Test_Device * test_device)
   od->constraint.string_list = 0;
   test_device->val[opt_print_options].w = 0;
 
+  /* opt_timing_group */
+  od = &test_device->opt[opt_timing_group];
+  od->name = "";
+  od->title = SANE_I18N ("Performance simulation");
+  od->desc = "";
+  od->type = SANE_TYPE_GROUP;
+  od->unit = SANE_UNIT_NONE;
+  od->size = 0;
+  od->cap = 0;
+  od->constraint_type = SANE_CONSTRAINT_NONE;
+  od->constraint.range = 0;
+  test_device->val[opt_timing_group].w = 0;
+
+  /* opt_timing_profile */
+  od = &test_device->opt[opt_timing_profile];
+  od->name = "timing-profile";
+  od->title = SANE_I18N ("Timing profile");
+  od->desc = SANE_I18N ("Deliver the image data with the timing of a "
+			"real scanner. \"Custom\" uses the values of the "
+			"other performance simulation options.");
+  od->type = SANE_TYPE_STRING;
+  od->unit = SANE_UNIT_NONE;
+  od->size = (SANE_Int) max_string_size (timing_profile_list);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_STRING_LIST;
+  od->constraint.string_list = timing_profile_list;
+  test_device->val[opt_timing_profile].s = malloc ((size_t) od->size);
+  if (!test_device->val[opt_timing_profile].s)
+    goto fail;
+  if (sanei_check_value (od, init_timing_profile) == SANE_STATUS_GOOD)
+    strcpy (test_device->val[opt_timing_profile].s, init_timing_profile);
+  else
+    {
+      DBG (1, "init_options: unknown timing profile `%s'\n",
+	   init_timing_profile);
+      strcpy (test_device->val[opt_timing_profile].s, "None");
+    }
+
+  /* opt_timing_bandwidth */
+  od = &test_device->opt[opt_timing_bandwidth];
+  od->name = "timing-bandwidth";
+  od->title = SANE_I18N ("Bandwidth");
+  od->desc = SANE_I18N ("The most image data the scanner delivers per "
+			"second, in KB. 0 means no limit.");
+  od->type = SANE_TYPE_INT;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_RANGE;
+  od->constraint.range = &timing_bandwidth_range;
+  test_device->val[opt_timing_bandwidth].w = init_timing_bandwidth;
+
+  /* opt_timing_warm_up */
+  od = &test_device->opt[opt_timing_warm_up];
+  od->name = "timing-warm-up";
+  od->title = SANE_I18N ("Warm-up time");
+  od->desc = SANE_I18N ("How long the first page of a batch takes before "
+			"its data starts to arrive, in milliseconds.");
+  od->type = SANE_TYPE_INT;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_RANGE;
+  od->constraint.range = &timing_duration_range;
+  test_device->val[opt_timing_warm_up].w = init_timing_warm_up;
+
+  /* opt_timing_stall_interval */
+  od = &test_device->opt[opt_timing_stall_interval];
+  od->name = "timing-stall-interval";
+  od->title = SANE_I18N ("Stall interval");
+  od->desc = SANE_I18N ("The scanner stalls each time it has delivered "
+			"this many KB of a page. 0 means no stalls.");
+  od->type = SANE_TYPE_INT;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_RANGE;
+  od->constraint.range = &timing_stall_interval_range;
+  test_device->val[opt_timing_stall_interval].w = init_timing_stall_interval;
+
+  /* opt_timing_stall_duration */
+  od = &test_device->opt[opt_timing_stall_duration];
+  od->name = "timing-stall-duration";
+  od->title = SANE_I18N ("Stall duration");
+  od->desc = SANE_I18N ("How long each stall lasts, in milliseconds.");
+  od->type = SANE_TYPE_INT;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_RANGE;
+  od->constraint.range = &timing_duration_range;
+  test_device->val[opt_timing_stall_duration].w = init_timing_stall_duration;
+
+  /* opt_timing_page_gap */
+  od = &test_device->opt[opt_timing_page_gap];
+  od->name = "timing-page-gap";
+  od->title = SANE_I18N ("Page gap");
+  od->desc = SANE_I18N ("How long the following pages of a batch take "
+			"before their data starts to arrive, in "
+			"milliseconds.");
+  od->type = SANE_TYPE_INT;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_RANGE;
+  od->constraint.range = &timing_duration_range;
+  test_device->val[opt_timing_page_gap].w = init_timing_page_gap;
+
+  /* opt_timing_variable_length */
+  od = &test_device->opt[opt_timing_variable_length];
+  od->name = "timing-variable-length";
+  od->title = SANE_I18N ("Variable page length");
+  od->desc = SANE_I18N ("Pages from the document feeder are shorter than "
+			"the scan area by a random amount, and their length "
+			"is unknown until the end of the page.");
+  od->type = SANE_TYPE_BOOL;
+  od->unit = SANE_UNIT_NONE;
+  od->size = sizeof (SANE_Word);
+  od->cap = SANE_CAP_SOFT_DETECT | SANE_CAP_SOFT_SELECT;
+  od->constraint_type = SANE_CONSTRAINT_NONE;
+  od->constraint.range = 0;
+  test_device->val[opt_timing_variable_length].w = init_timing_variable_length;
+
+  load_timing_profile (test_device);
+
   /* opt_geometry_group */
   od = &test_device->opt[opt_geometry_group];
   od->name = "";
@@ -1268,6 +1488,10 @@ cleanup_initial_string_values ()
   init_test_picture = NULL;
   free (init_read_status_code);
   init_read_status_code = NULL;
+  free (init_timing_profile);
+  init_timing_profile = NULL;
+  free (picture_cache_dir);
+  picture_cache_dir = NULL;
   free (init_string);
   init_string = NULL;
   free (init_string_constraint_string_list);
@@ -1276,12 +1500,248 @@ cleanup_initial_string_values ()
   init_string_constraint_long_string_list = NULL;
 }
 
+/* The test pictures are drawn once for each set of parameters and kept
+   by the device, so a scan only has to copy them. With the
+   "picture-cache" directory of test.conf, they are also stored in files
+   there and mapped from them, by this and later sessions. */
+
+static void
+picture_key (Test_Device * test_device, SANE_Char * key, size_t size)
+{
+  SANE_Bool is_little_endian = little_endian ();
+  SANE_Char *cp;
+
+  if (test_device->val[opt_invert_endianess].w)
+    is_little_endian ^= 1;
+
+  snprintf (key, size, "%s-%d-%d-%dx%d-%d-%s",
+	    test_device->val[opt_test_picture].s,
+	    test_device->params.format, test_device->params.depth,
+	    test_device->pixels_per_line, test_device->bytes_per_line,
+	    test_device->val[opt_resolution].w, is_little_endian ? "le" : "be");
+
+  /* the key is also the name of the cache file */
+  for (cp = key; *cp; cp++)
+    if (!isalnum ((unsigned char) *cp) && *cp != '-')
+      *cp = '_';
+}
+
+static void
+free_picture (Test_Picture * picture)
+{
+  if (!picture->data)
+    return;
+#ifdef HAVE_MMAP
+  if (picture->mapped)
+    munmap (picture->data, picture->size);
+  else
+#endif
+    free (picture->data);
+  picture->data = NULL;
+  picture->size = 0;
+  picture->mapped = SANE_FALSE;
+}
+
+static void
+free_pictures (Test_Device * test_device)
+{
+  int i;
+
+  for (i = 0; i < PICTURE_CACHE_ENTRIES; i++)
+    free_picture (&test_device->pictures[i]);
+  test_device->picture = NULL;
+}
+
+#ifdef HAVE_MMAP
+static SANE_Bool
+map_picture_file (Test_Picture * picture, SANE_String_Const path)
+{
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return SANE_FALSE;
+  if (fstat (fd, &st) < 0 || st.st_size <= 0)
+    {
+      close (fd);
+      return SANE_FALSE;
+    }
+  data = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      DBG (1, "map_picture_file: can't map %s (%s)\n", path,
+	   strerror (errno));
+      return SANE_FALSE;
+    }
+  picture->data = data;
+  picture->size = (size_t) st.st_size;
+  picture->mapped = SANE_TRUE;
+  DBG (3, "map_picture_file: mapped %zu bytes of %s\n", picture->size, path);
+  return SANE_TRUE;
+}
+
+static SANE_Bool
+write_picture_file (Test_Picture * picture, SANE_String_Const path)
+{
+  SANE_Char tmp[PATH_MAX];
+  size_t written = 0;
+  ssize_t n;
+  int fd;
+
+  /* others may map the file as soon as it has its name */
+  if ((size_t) snprintf (tmp, sizeof (tmp), "%s.XXXXXX", path)
+      >= sizeof (tmp))
+    return SANE_FALSE;
+  fd = mkstemp (tmp);
+  if (fd < 0)
+    {
+      DBG (1, "write_picture_file: can't create %s (%s)\n", tmp,
+	   strerror (errno));
+      return SANE_FALSE;
+    }
+  while (written < picture->size)
+    {
+      n = write (fd, picture->data + written, picture->size - written);
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+      written += (size_t) n;
+    }
+  if (close (fd) < 0 || written < picture->size || rename (tmp, path) < 0)
+    {
+      DBG (1, "write_picture_file: can't write %s (%s)\n", path,
+	   strerror (errno));
+      unlink (tmp);
+      return SANE_FALSE;
+    }
+  return SANE_TRUE;
+}
+#endif
+
+static SANE_Status
+draw_picture (Test_Device * test_device, Test_Picture * picture)
+{
+  SANE_Status status;
+#ifdef HAVE_MMAP
+  SANE_Char path[PATH_MAX];
+
+  if (picture_cache_dir)
+    {
+      snprintf (path, sizeof (path), "%s/test-%s.pic", picture_cache_dir,
+		picture->key);
+      if (map_picture_file (picture, path))
+	return SANE_STATUS_GOOD;
+    }
+#endif
+
+  status = init_picture_buffer (test_device, &picture->data, &picture->size);
+  if (status != SANE_STATUS_GOOD)
+    {
+      picture->data = NULL;
+      return status;
+    }
+
+#ifdef HAVE_MMAP
+  if (picture_cache_dir && write_picture_file (picture, path))
+    {
+      Test_Picture drawn = *picture;
+
+      if (map_picture_file (picture, path))
+	free (drawn.data);
+      else
+	*picture = drawn;
+    }
+#endif
+  return SANE_STATUS_GOOD;
+}
+
+/* make test_device->picture the picture for the current parameters */
+static SANE_Status
+get_picture (Test_Device * test_device)
+{
+  SANE_Char key[sizeof (test_device->pictures[0].key)];
+  Test_Picture *picture, *oldest = NULL;
+  SANE_Status status;
+  int i;
+
+  picture_key (test_device, key, sizeof (key));
+  test_device->picture_uses++;
+  for (i = 0; i < PICTURE_CACHE_ENTRIES; i++)
+    {
+      picture = &test_device->pictures[i];
+      if (picture->data && strcmp (picture->key, key) == 0)
+	{
+	  DBG (3, "get_picture: reusing picture %s\n", key);
+	  picture->last_used = test_device->picture_uses;
+	  test_device->picture = picture;
+	  return SANE_STATUS_GOOD;
+	}
+      if (!oldest || (oldest->data && (!picture->data
+				       || picture->last_used
+				       < oldest->last_used)))
+	oldest = picture;
+    }
+
+  DBG (3, "get_picture: drawing picture %s\n", key);
+  picture = oldest;
+  free_picture (picture);
+  strcpy (picture->key, key);
+  status = draw_picture (test_device, picture);
+  if (status != SANE_STATUS_GOOD)
+    return status;
+  picture->last_used = test_device->picture_uses;
+  test_device->picture = picture;
+  return SANE_STATUS_GOOD;
+}
+
+/* with nothing to simulate, sane_read() copies straight from the
+   picture, without a reader task */
+static SANE_Bool
+direct_read (Test_Device * test_device)
+{
+  return test_device->start_delay == 0
+    && test_device->val[opt_timing_bandwidth].w == 0
+    && test_device->val[opt_timing_stall_interval].w == 0
+    && test_device->val[opt_read_delay].w == SANE_FALSE
+    && test_device->val[opt_non_blocking].w == SANE_FALSE
+    && test_device->val[opt_select_fd].w == SANE_FALSE;
+}
+
+static SANE_Int
+read_picture (Test_Device * test_device, SANE_Byte * data, SANE_Int max_length)
+{
+  Test_Picture *picture = test_device->picture;
+  size_t bytes_total = (size_t) test_device->page_lines
+    * (size_t) test_device->bytes_per_line;
+  size_t count, offset, length = (size_t) max_length, done = 0;
+
+  if (length > bytes_total - test_device->bytes_total)
+    length = bytes_total - test_device->bytes_total;
+
+  /* the picture repeats every picture->size bytes */
+  while (done < length)
+    {
+      offset = (test_device->bytes_total + done) % picture->size;
+      count = length - done;
+      if (count > picture->size - offset)
+	count = picture->size - offset;
+      memcpy (data + done, picture->data + offset, count);
+      done += count;
+    }
+  return (SANE_Int) done;
+}
+
 static void
 cleanup_test_device (Test_Device * test_device)
 {
   DBG (2, "cleanup_test_device: test_device=%p\n", (void *) test_device);
   if (test_device->options_initialized)
     cleanup_options (test_device);
+  free_pictures (test_device);
   if (test_device->name)
     free (test_device->name);
   free (test_device);
@@ -1432,67 +1892,112 @@ read_option (SANE_String line, SANE_String option_string,
   return SANE_STATUS_GOOD;
 }
 
+/* current time in microseconds, for the performance simulation */
+static double
+timing_now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (double) tv.tv_sec * 1e6 + (double) tv.tv_usec;
+}
+
+static void
+timing_sleep (double usec)
+{
+  /* usleep () may not take a second or more */
+  while (usec >= 1e6)
+    {
+      sleep (1);
+      usec -= 1e6;
+    }
+  if (usec > 0)
+    usleep ((useconds_t) usec);
+}
+
 static SANE_Status
-reader_process (Test_Device * test_device, SANE_Int fd)
+reader_process (Test_Device * test_device, SANEI_Ring * ring)
 {
   SANE_Status status;
   size_t byte_count = 0;
   size_t bytes_total;
-  SANE_Byte *buffer = 0;
-  ssize_t bytes_written = 0;
-  size_t buffer_size = 0, write_count = 0;
+  SANE_Byte *buffer = test_device->picture->data;
+  size_t buffer_size = test_device->picture->size, write_count = 0, offset;
+  size_t bandwidth, stall_interval, chunk;
+  double next = 0;
 
-  DBG (2, "(child) reader_process: test_device=%p, fd=%d\n",
-       (void *) test_device, fd);
-
-  bytes_total = (size_t) test_device->lines * (size_t) test_device->bytes_per_line;
-  status = init_picture_buffer (test_device, &buffer, &buffer_size);
-  if (status != SANE_STATUS_GOOD)
-    return status;
+  DBG (2, "(child) reader_process: test_device=%p, ring=%p\n",
+       (void *) test_device, (void *) ring);
 
+  bytes_total = (size_t) test_device->page_lines * (size_t) test_device->bytes_per_line;
   DBG (2, "(child) reader_process: buffer=%p, buffersize=%lu\n",
        (void *) buffer, (u_long) buffer_size);
 
+  bandwidth = (size_t) test_device->val[opt_timing_bandwidth].w * 1024;
+  stall_interval = (size_t) test_device->val[opt_timing_stall_interval].w * 1024;
+
+  /* with a bandwidth limit, send about 10 ms of data at a time,
+     instead of the data of a whole buffer in a burst */
+  chunk = buffer_size;
+  if (bandwidth > 0 && chunk > bandwidth / 100)
+    chunk = bandwidth / 100 > 0 ? bandwidth / 100 : 1;
+
+  if (test_device->start_delay > 0)
+    {
+      DBG (4, "(child) reader_process: waiting %d ms for the page\n",
+	   test_device->start_delay);
+      timing_sleep (test_device->start_delay * 1000.0);
+    }
+  if (bandwidth > 0 || stall_interval > 0)
+    next = timing_now ();
+
   while (byte_count < bytes_total)
     {
-      if (write_count == 0)
+      /* the picture repeats every buffer_size bytes */
+      offset = byte_count % buffer_size;
+      write_count = chunk;
+      if (write_count > buffer_size - offset)
+	write_count = buffer_size - offset;
+      if (byte_count + (size_t) write_count > bytes_total)
+	write_count = (size_t) bytes_total - (size_t) byte_count;
+      if (stall_interval > 0
+	  && write_count > stall_interval - byte_count % stall_interval)
+	write_count = stall_interval - byte_count % stall_interval;
+
+      if (bandwidth > 0 || stall_interval > 0)
 	{
-	  write_count = buffer_size;
-	  if (byte_count + (size_t) write_count > bytes_total)
-	    write_count = (size_t) bytes_total - (size_t) byte_count;
+	  double now = timing_now ();
 
-	  if (test_device->val[opt_read_delay].w == SANE_TRUE)
-	    usleep ((useconds_t) test_device->val[opt_read_delay_duration].w);
+	  /* a frontend that fell behind gets no burst to catch up */
+	  if (now < next)
+	    timing_sleep (next - now);
+	  else
+	    next = now;
 	}
-      bytes_written = write (fd, buffer, write_count);
-      if (bytes_written < 0)
+
+      if (test_device->val[opt_read_delay].w == SANE_TRUE)
+	usleep ((useconds_t) test_device->val[opt_read_delay_duration].w);
+
+      status = sanei_ring_write (ring, buffer + offset, write_count);
+      if (status != SANE_STATUS_GOOD)
 	{
-	  DBG (1, "(child) reader_process: write returned %s\n",
-	       strerror (errno));
-	  return SANE_STATUS_IO_ERROR;
+	  DBG (1, "(child) reader_process: sanei_ring_write returned %s\n",
+	       sane_strstatus (status));
+	  return status;
 	}
-      byte_count += (size_t) bytes_written;
-      DBG (4, "(child) reader_process: wrote %ld bytes of %lu (%zu total)\n",
-	   bytes_written, write_count, byte_count);
-      write_count -= (size_t) bytes_written;
-    }
-
-  free (buffer);
+      byte_count += write_count;
+      DBG (4, "(child) reader_process: wrote %zu bytes (%zu total)\n",
+	   write_count, byte_count);
 
-  if (sanei_thread_is_forked ())
-    {
-	  DBG (4, "(child) reader_process: finished,  wrote %zu bytes, expected %zu "
-       "bytes, now waiting\n", byte_count, bytes_total);
-	  while (SANE_TRUE)
-	    sleep (10);
-	  DBG (4, "(child) reader_process: this should have never happened...");
-	  close (fd);
+      if (bandwidth > 0)
+	next += (double) write_count * 1e6 / (double) bandwidth;
+      if (stall_interval > 0 && byte_count % stall_interval == 0)
+	next += test_device->val[opt_timing_stall_duration].w * 1000.0;
     }
-  else
-    {
-	  DBG (4, "(child) reader_process: finished,  wrote %zu bytes, expected %zu "
+
+  /* the data stays in the ring when a reader process exits */
+  DBG (4, "(child) reader_process: finished,  wrote %zu bytes, expected %zu "
        "bytes\n", byte_count, bytes_total);
-    }
   return SANE_STATUS_GOOD;
 }
 
@@ -1510,9 +2015,6 @@ reader_task (void *data)
   if (sanei_thread_is_forked ())
     {
       DBG (3, "reader_task started (forked)\n");
-      close (test_device->pipe);
-      test_device->pipe = -1;
-
     }
   else
     {
@@ -1522,7 +2024,7 @@ reader_task (void *data)
   memset (&act, 0, sizeof (act));
   sigaction (SIGTERM, &act, 0);
 
-  status = reader_process (test_device, test_device->reader_fds);
+  status = reader_process (test_device, test_device->ring);
   DBG (2, "(child) reader_task: reader_process finished (%s)\n",
        sane_strstatus (status));
   return (int) status;
@@ -1535,13 +2037,8 @@ finish_pass (Test_Device * test_device)
 
   DBG (2, "finish_pass: test_device=%p\n", (void *) test_device);
   test_device->scanning = SANE_FALSE;
-  if (test_device->pipe >= 0)
-    {
-      DBG (2, "finish_pass: closing pipe\n");
-      close (test_device->pipe);
-      DBG (2, "finish_pass: pipe closed\n");
-      test_device->pipe = -1;
-    }
+  if (test_device->ring)
+    sanei_ring_cancel (test_device->ring);
   if (sanei_thread_is_valid (test_device->reader_pid))
     {
       int status;
@@ -1564,13 +2061,11 @@ finish_pass (Test_Device * test_device)
 	}
       sanei_thread_invalidate (test_device->reader_pid);
     }
-  /* this happens when running in thread context... */
-  if (test_device->reader_fds >= 0)
+  if (test_device->ring)
     {
-      DBG (2, "finish_pass: closing reader pipe\n");
-      close (test_device->reader_fds);
-      DBG (2, "finish_pass: reader pipe closed\n");
-      test_device->reader_fds = -1;
+      DBG (2, "finish_pass: freeing ring\n");
+      sanei_ring_free (test_device->ring);
+      test_device->ring = NULL;
     }
   return return_status;
 }
@@ -1690,6 +2185,11 @@ sane_init (SANE_Int * __sane_unused__ version_code, SANE_Auth_Callback __sane_un
   if (!init_read_status_code)
     goto fail;
 
+  free (init_timing_profile);
+  init_timing_profile = strdup ("None");
+  if (!init_timing_profile)
+    goto fail;
+
   free (init_string);
   init_string = strdup ("This is the contents of the string option. "
     "Fill some more words to see how the frontend behaves.");
@@ -1805,6 +2305,30 @@ sane_init (SANE_Int * __sane_unused__ version_code, SANE_Auth_Callback __sane_un
 	  if (read_option (line, "enable-test-options", param_bool,
 			   &init_enable_test_options) == SANE_STATUS_GOOD)
 	    continue;
+	  if (read_option (line, "timing-profile", param_string,
+			   &init_timing_profile) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "timing-bandwidth", param_int,
+			   &init_timing_bandwidth) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "timing-warm-up", param_int,
+			   &init_timing_warm_up) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "timing-stall-interval", param_int,
+			   &init_timing_stall_interval) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "timing-stall-duration", param_int,
+			   &init_timing_stall_duration) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "timing-page-gap", param_int,
+			   &init_timing_page_gap) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "timing-variable-length", param_bool,
+			   &init_timing_variable_length) == SANE_STATUS_GOOD)
+	    continue;
+	  if (read_option (line, "picture-cache", param_string,
+			   &picture_cache_dir) == SANE_STATUS_GOOD)
+	    continue;
 	  if (read_option (line, "geometry_min", param_fixed,
 			   &geometry_range.min) == SANE_STATUS_GOOD)
 	    continue;
@@ -1873,7 +2397,7 @@ sane_init (SANE_Int * __sane_unused__ version_code, SANE_Auth_Callback __sane_un
       test_device->cancelled = SANE_FALSE;
       test_device->options_initialized = SANE_FALSE;
       sanei_thread_initialize (test_device->reader_pid);
-      test_device->pipe = -1;
+      test_device->ring = NULL;
       DBG (4, "sane_init: new device: `%s' is a %s %s %s\n",
 	   test_device->sane.name, test_device->sane.vendor,
 	   test_device->sane.model, test_device->sane.type);
@@ -2020,6 +2544,7 @@ sane_open (SANE_String_Const devicename, SANE_Handle * handle)
   test_device->bytes_total = 0;
   test_device->pass = 0;
   test_device->number_of_scans = 0;
+  test_device->warmed_up = SANE_FALSE;
 
   return SANE_STATUS_GOOD;
 }
@@ -2222,6 +2747,11 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_read_limit_size:	/* Int */
 	case opt_ppl_loss:
 	case opt_read_delay_duration:
+	case opt_timing_bandwidth:
+	case opt_timing_warm_up:
+	case opt_timing_stall_interval:
+	case opt_timing_stall_duration:
+	case opt_timing_page_gap:
 	case opt_int:
 	case opt_int_constraint_range:
 	  if (test_device->val[option].w == *(SANE_Int *) value)
@@ -2248,6 +2778,7 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	       option, test_device->opt[option].name, *(SANE_Int *) value);
 	  break;
 	case opt_fuzzy_parameters:	/* Bool with parameter reloading */
+	case opt_timing_variable_length:
 	  if (test_device->val[option].w == *(SANE_Bool *) value)
 	    {
 	      DBG (4, "sane_control_option: option %d (%s) not changed\n",
@@ -2295,7 +2826,22 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	  DBG (4, "sane_control_option: set option %d (%s) to %d\n",
 	       option, test_device->opt[option].name, *(SANE_Int *) value);
 	  break;
+	case opt_timing_profile:	/* String list with options reload */
+	  if (strcmp (test_device->val[option].s, value) == 0)
+	    {
+	      DBG (4, "sane_control_option: option %d (%s) not changed\n",
+		   option, test_device->opt[option].name);
+	      break;
+	    }
+	  strcpy (test_device->val[option].s, (SANE_String) value);
+	  load_timing_profile (test_device);
+	  myinfo |= SANE_INFO_RELOAD_PARAMS;
+	  myinfo |= SANE_INFO_RELOAD_OPTIONS;
+	  DBG (4, "sane_control_option: set option %d (%s) to %s\n",
+	       option, test_device->opt[option].name, (SANE_String) value);
+	  break;
 	case opt_three_pass_order:	/* String list with parameter reload */
+	case opt_scan_source:
 	  if (strcmp (test_device->val[option].s, value) == 0)
 	    {
 	      DBG (4, "sane_control_option: option %d (%s) not changed\n",
@@ -2324,7 +2870,6 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_string:
 	case opt_string_constraint_string_list:
 	case opt_string_constraint_long_string_list:
-	case opt_scan_source:
 	  if (strcmp (test_device->val[option].s, value) == 0)
 	    {
 	      DBG (4, "sane_control_option: option %d (%s) not changed\n",
@@ -2535,6 +3080,7 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_read_limit:
 	case opt_read_delay:
 	case opt_fuzzy_parameters:
+	case opt_timing_variable_length:
 	case opt_non_blocking:
 	case opt_select_fd:
 	case opt_bool_soft_select_soft_detect:
@@ -2553,6 +3099,7 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_three_pass_order:
 	case opt_read_status_code:
 	case opt_test_picture:
+	case opt_timing_profile:
 	case opt_string:
 	case opt_string_constraint_string_list:
 	case opt_string_constraint_long_string_list:
@@ -2565,6 +3112,11 @@ sane_control_option (SANE_Handle handle, SANE_Int option, SANE_Action action,
 	case opt_read_limit_size:
 	case opt_ppl_loss:
 	case opt_read_delay_duration:
+	case opt_timing_bandwidth:
+	case opt_timing_warm_up:
+	case opt_timing_stall_interval:
+	case opt_timing_stall_duration:
+	case opt_timing_page_gap:
 	case opt_int:
         case opt_int_inexact:
 	case opt_int_constraint_range:
@@ -2672,6 +3224,8 @@ sane_get_parameters (SANE_Handle handle, SANE_Parameters * params)
       if (test_device->val[opt_fuzzy_parameters].w == SANE_TRUE
 	  && test_device->scanning == SANE_FALSE)
 	p->lines *= (SANE_Int) random_factor;
+      if (variable_length (test_device))
+	p->lines = -1;
     }
 
   if (strcmp (mode, SANE_VALUE_SCAN_MODE_GRAY) == 0)
@@ -2765,7 +3319,7 @@ SANE_Status
 sane_start (SANE_Handle handle)
 {
   Test_Device *test_device = handle;
-  int pipe_descriptor[2];
+  SANE_Status status;
 
   DBG (2, "sane_start: handle=%p\n", handle);
   if (!inited)
@@ -2798,6 +3352,7 @@ sane_start (SANE_Handle handle)
       return SANE_STATUS_INVAL;
     }
 
+  test_device->start_delay = 0;
   if (test_device->pass == 0)
     {
       test_device->number_of_scans++;
@@ -2807,8 +3362,15 @@ sane_start (SANE_Handle handle)
 	  (((test_device->number_of_scans) % 11) == 0))
 	{
 	  DBG (1, "sane_start: Document feeder is out of documents!\n");
+	  test_device->warmed_up = SANE_FALSE;
 	  return SANE_STATUS_NO_DOCS;
 	}
+
+      if (test_device->warmed_up)
+	test_device->start_delay = test_device->val[opt_timing_page_gap].w;
+      else
+	test_device->start_delay = test_device->val[opt_timing_warm_up].w;
+      test_device->warmed_up = SANE_TRUE;
     }
 
   test_device->scanning = SANE_TRUE;
@@ -2824,6 +3386,18 @@ sane_start (SANE_Handle handle)
       test_device->scanning = SANE_FALSE;
       return SANE_STATUS_INVAL;
     }
+
+  /* the same page length for all passes of a page */
+  test_device->page_lines = test_device->lines;
+  if (variable_length (test_device))
+    {
+      test_device->page_lines = (SANE_Word) ((double) test_device->lines
+	* (60 + (test_device->number_of_scans * 37) % 41) / 100);
+      if (test_device->page_lines < 1)
+	test_device->page_lines = 1;
+      DBG (3, "sane_start: page has %d of %d lines\n",
+	   test_device->page_lines, test_device->lines);
+    }
   if (test_device->params.pixels_per_line == 0)
     {
       DBG (1, "sane_start: pixels_per_line == 0\n");
@@ -2837,31 +3411,45 @@ sane_start (SANE_Handle handle)
       return SANE_STATUS_INVAL;
     }
 
-  if (pipe (pipe_descriptor) < 0)
+  status = get_picture (test_device);
+  if (status != SANE_STATUS_GOOD)
     {
-      DBG (1, "sane_start: pipe failed (%s)\n", strerror (errno));
-      return SANE_STATUS_IO_ERROR;
+      DBG (1, "sane_start: get_picture failed (%s)\n",
+	   sane_strstatus (status));
+      test_device->scanning = SANE_FALSE;
+      return status;
+    }
+
+  if (direct_read (test_device))
+    {
+      DBG (3, "sane_start: reading straight from the picture\n");
+      sanei_thread_invalidate (test_device->reader_pid);
+      return SANE_STATUS_GOOD;
+    }
+
+  status = sanei_ring_create (&test_device->ring, 0);
+  if (status != SANE_STATUS_GOOD)
+    {
+      DBG (1, "sane_start: sanei_ring_create failed (%s)\n",
+	   sane_strstatus (status));
+      test_device->scanning = SANE_FALSE;
+      return status;
     }
 
   /* create reader routine as new process or thread */
-  test_device->pipe = pipe_descriptor[0];
-  test_device->reader_fds = pipe_descriptor[1];
   test_device->reader_pid =
-    sanei_thread_begin (reader_task, (void *) test_device);
+    sanei_ring_begin (test_device->ring, reader_task, (void *) test_device);
 
   if (!sanei_thread_is_valid (test_device->reader_pid))
     {
-      DBG (1, "sane_start: sanei_thread_begin failed (%s)\n",
+      DBG (1, "sane_start: sanei_ring_begin failed (%s)\n",
 	   strerror (errno));
+      sanei_ring_free (test_device->ring);
+      test_device->ring = NULL;
+      test_device->scanning = SANE_FALSE;
       return SANE_STATUS_NO_MEM;
     }
 
-  if (sanei_thread_is_forked ())
-    {
-      close (test_device->reader_fds);
-      test_device->reader_fds = -1;
-    }
-
   return SANE_STATUS_GOOD;
 }
 
@@ -2872,9 +3460,9 @@ sane_read (SANE_Handle handle, SANE_Byte * data,
 {
   Test_Device *test_device = handle;
   SANE_Int max_scan_length;
-  ssize_t bytes_read;
-  size_t read_count;
-  size_t bytes_total = (size_t) test_device->lines * (size_t) test_device->bytes_per_line;
+  SANE_Int bytes_read;
+  SANE_Status status;
+  size_t bytes_total = (size_t) test_device->page_lines * (size_t) test_device->bytes_per_line;
 
 
   DBG (4, "sane_read: handle=%p, data=%p, max_length = %d, length=%p\n",
@@ -2959,13 +3547,24 @@ sane_read (SANE_Handle handle, SANE_Byte * data,
       DBG (1, "sane_read: not scanning (call sane_start first)\n");
       return SANE_STATUS_INVAL;
     }
-  read_count = (size_t) max_scan_length;
 
-  bytes_read = read (test_device->pipe, data, read_count);
-  if (bytes_read == 0
+  if (test_device->ring)
+    status = sanei_ring_read (test_device->ring, data, max_scan_length,
+			      &bytes_read);
+  else
+    {
+      bytes_read = read_picture (test_device, data, max_scan_length);
+      status = SANE_STATUS_GOOD;
+    }
+  if (status != SANE_STATUS_GOOD && status != SANE_STATUS_EOF)
+    {
+      DBG (1, "sane_read: sanei_ring_read returned %s\n",
+	   sane_strstatus (status));
+      return status;
+    }
+  if (status == SANE_STATUS_EOF
       || ((size_t) bytes_read + (size_t) test_device->bytes_total >= bytes_total))
     {
-      SANE_Status status;
       DBG (2, "sane_read: EOF reached\n");
       status = finish_pass (test_device);
       if (status != SANE_STATUS_GOOD)
@@ -2985,20 +3584,12 @@ sane_read (SANE_Handle handle, SANE_Byte * data,
       if (bytes_read == 0)
 	return SANE_STATUS_EOF;
     }
-  else if (bytes_read < 0)
+  else if (bytes_read == 0)
     {
-      if (errno == EAGAIN)
-	{
-	  DBG (2, "sane_read: no data available, try again\n");
-	  return SANE_STATUS_GOOD;
-	}
-      else
-	{
-	  DBG (1, "sane_read: read returned error: %s\n", strerror (errno));
-	  return SANE_STATUS_IO_ERROR;
-	}
+      DBG (2, "sane_read: no data available, try again\n");
+      return SANE_STATUS_GOOD;
     }
-  *length = (SANE_Int) bytes_read;
+  *length = bytes_read;
   test_device->bytes_total += (size_t) bytes_read;
 
   DBG (2, "sane_read: read %zu bytes of %zu, total %zu\n", (size_t) bytes_read,
@@ -3074,12 +3665,7 @@ sane_set_io_mode (SANE_Handle handle, SANE_Bool non_blocking)
     }
   if (test_device->val[opt_non_blocking].w == SANE_TRUE)
     {
-      if (fcntl (test_device->pipe,
-		 F_SETFL, non_blocking ? O_NONBLOCK : 0) < 0)
-	{
-	  DBG (1, "sane_set_io_mode: can't set io mode");
-	  return SANE_STATUS_INVAL;
-	}
+      sanei_ring_set_io_mode (test_device->ring, non_blocking);
     }
   else
     {
@@ -3119,7 +3705,7 @@ sane_get_select_fd (SANE_Handle handle, SANE_Int * fd)
     }
   if (test_device->val[opt_select_fd].w == SANE_TRUE)
     {
-      *fd = test_device->pipe;
+      *fd = sanei_ring_get_select_fd (test_device->ring);
       return SANE_STATUS_GOOD;
     }
   DBG(1,"sane_get_select_fd: unsupported\n");
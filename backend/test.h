@@ -80,6 +80,14 @@ typedef enum
   opt_select_fd,
   opt_enable_test_options,
   opt_print_options,
+  opt_timing_group,
+  opt_timing_profile,
+  opt_timing_bandwidth,
+  opt_timing_warm_up,
+  opt_timing_stall_interval,
+  opt_timing_stall_duration,
+  opt_timing_page_gap,
+  opt_timing_variable_length,
   opt_geometry_group,
   opt_tl_x,
   opt_tl_y,
@@ -119,6 +127,18 @@ typedef enum
 }
 test_opts;
 
+/* number of test pictures a device keeps drawn */
+#define PICTURE_CACHE_ENTRIES 3
+
+typedef struct
+{
+  SANE_Char key[128];		/* parameters the picture was drawn for */
+  SANE_Byte *data;		/* the picture, repeated to fill the page */
+  size_t size;
+  SANE_Bool mapped;		/* data is mmap()ed from the cache file */
+  SANE_Word last_used;
+}
+Test_Picture;
 
 typedef struct Test_Device
 {
@@ -130,13 +150,18 @@ typedef struct Test_Device
   SANE_Parameters params;
   SANE_String name;
   SANE_Pid reader_pid;
-  SANE_Int reader_fds;
-  SANE_Int pipe;
+  SANEI_Ring *ring;
   FILE *pipe_handle;
   SANE_Word pass;
   SANE_Word bytes_per_line;
   SANE_Word pixels_per_line;
   SANE_Word lines;
+  SANE_Word page_lines;		/* lines of the page being scanned */
+  SANE_Word start_delay;	/* ms before the page starts to arrive */
+  SANE_Bool warmed_up;		/* a page of this batch was scanned */
+  Test_Picture pictures[PICTURE_CACHE_ENTRIES];
+  Test_Picture *picture;	/* picture of the page being scanned */
+  SANE_Word picture_uses;
   size_t bytes_total;
   SANE_Bool open;
   SANE_Bool scanning;
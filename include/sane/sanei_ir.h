@@ -241,6 +241,7 @@ sanei_ir_spectral_clean (const SANE_Parameters * params, double *lut_ln,
  * @note At the image margins the size of the filtering window
  *       is adapted. So there is no need to pad the image.
  * @note Memory for the output image has to be allocated before
+ * @note Large images are filtered in bands of rows, one thread each
  */
 extern SANE_Status
 sanei_ir_filter_mean (const SANE_Parameters * params,
@@ -315,6 +316,8 @@ sanei_ir_add_threshold (const SANE_Parameters * params,
  * that the clean parts of the image can be dilated into the dirty ones. Thresholding
  * can be done on the distance. Conversely, if erode == 0 the distance of a clean
  * pixel to the closest dirty one is calculated which can be used to dilate the mask.
+ * If several pixels are equally close, one is picked by a hash of the pixel position,
+ * so the result is the same however many threads share the work.
  *
  * @ref extended and C version of
  *      http://ostermiller.org/dilate_and_erode.html
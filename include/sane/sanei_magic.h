@@ -119,6 +119,26 @@ extern SANE_Status
 sanei_magic_rotate (SANE_Parameters * params, SANE_Byte * buffer,
   int centerX, int centerY, double slope, int bg_color);
 
+/** Correct the skew of the media inside the image, optionally smoothing
+ *
+ * @param params describes image
+ * @param buffer contains image data
+ * @param centerX horizontal coordinate of center of rotation
+ * @param centerY vertical coordinate of center of rotation
+ * @param slope slope of rotation
+ * @param bg_color the replacement color for edges exposed by rotation
+ * @param bilinear interpolate between source pixels, instead of taking
+ * the nearest one. Gray and color images only.
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid image parameters
+ */
+extern SANE_Status
+sanei_magic_rotate2 (SANE_Parameters * params, SANE_Byte * buffer,
+  int centerX, int centerY, double slope, int bg_color, int bilinear);
+
 /** Find the edges of the media inside the image, parallel to image edges
  *
  * @param params describes image
@@ -223,6 +243,168 @@ extern SANE_Status
 sanei_magic_turn(SANE_Parameters * params, SANE_Byte * buffer,
   int angle);
 
+/** State of an image being processed band by band */
+typedef struct sanei_magic_band sanei_magic_band;
+
+/** Start processing an image band by band, while it is being read
+ *
+ * Deskew, despeck and blank page detection don't change the size of the
+ * image, so they can run
+ * on the rows that have arrived so far, instead of on the whole page. The
+ * caller collects the image in a buffer, and calls
+ * sanei_magic_bandProcess() as rows arrive. Rows are modified in place.
+ * Call sanei_magic_bandDeskew() or sanei_magic_bandRotate(), and
+ * sanei_magic_bandDespeck() before the first sanei_magic_bandProcess().
+ *
+ * @param[out] band new band state, free with sanei_magic_bandFinish()
+ * @param params describes image
+ * @param dpiX horizontal resolution
+ * @param dpiY vertical resolution
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid image parameters
+ */
+extern SANE_Status
+sanei_magic_bandStart (sanei_magic_band ** band, SANE_Parameters * params,
+  int dpiX, int dpiY);
+
+/** Find the skew of the media and correct it, band by band
+ *
+ * The skew is found from the top edge of the media, in the first two
+ * inches of the image. Until then, no rows are finished. If no skew is
+ * found, the image is not rotated.
+ *
+ * @param band band state
+ * @param bg_color the replacement color for edges exposed by rotation
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_INVAL - processing has already started
+ */
+extern SANE_Status
+sanei_magic_bandDeskew (sanei_magic_band * band, int bg_color);
+
+/** Correct a known skew, band by band
+ *
+ * @param band band state
+ * @param centerX horizontal coordinate of center of rotation
+ * @param centerY vertical coordinate of center of rotation
+ * @param slope slope of rotation
+ * @param bg_color the replacement color for edges exposed by rotation
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - processing has already started
+ */
+extern SANE_Status
+sanei_magic_bandRotate (sanei_magic_band * band,
+  int centerX, int centerY, double slope, int bg_color);
+
+/** Despeckle the image, band by band, after any deskew
+ *
+ * @param band band state
+ * @param diam maximum dot diameter to remove
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_INVAL - processing has already started
+ */
+extern SANE_Status
+sanei_magic_bandDespeck (sanei_magic_band * band, SANE_Int diam);
+
+/** Determine if image is blank, band by band, after any deskew or despeck
+ *
+ * Uses the same blocks as sanei_magic_isBlank2(). Get the result with
+ * sanei_magic_bandIsBlank() once all rows are finished.
+ *
+ * @param band band state
+ * @param thresh maximum % density for blankness (0-100)
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - processing has already started
+ */
+extern SANE_Status
+sanei_magic_bandBlank (sanei_magic_band * band, double thresh);
+
+/** Get the result of sanei_magic_bandBlank()
+ *
+ * @param band band state
+ *
+ * @return
+ * - SANE_STATUS_GOOD - page is not blank
+ * - SANE_STATUS_NO_DOCS - page is blank
+ * - SANE_STATUS_INVAL - not all rows are finished
+ */
+extern SANE_Status
+sanei_magic_bandIsBlank (sanei_magic_band * band);
+
+/** Process the rows that have arrived
+ *
+ * @param band band state
+ * @param buffer contains image data, the same buffer on every call
+ * @param lines number of rows in buffer, never decreasing
+ * @param[out] done number of rows at the top of buffer that are finished.
+ * All rows are finished once lines reaches the image height.
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid line count
+ */
+extern SANE_Status
+sanei_magic_bandProcess (sanei_magic_band * band, SANE_Byte * buffer,
+  int lines, int * done);
+
+/** Process the rows that have arrived, with only part of the image kept
+ *
+ * Like sanei_magic_bandProcess(), but buffer starts with row first of the
+ * image, so the caller can drop finished rows it has sent. Rows are never
+ * read again once finished, except the last finished one.
+ *
+ * @param band band state
+ * @param buffer contains rows first to lines-1 of the image
+ * @param first image row at the start of buffer, 0 until rows are
+ * finished, then at most the number of finished rows minus one
+ * @param lines number of rows of the image received, never decreasing
+ * @param[out] done number of rows at the top of the image that are
+ * finished. All rows are finished once lines reaches the image height.
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_NO_MEM - not enough memory
+ * - SANE_STATUS_INVAL - invalid line count or first row
+ */
+extern SANE_Status
+sanei_magic_bandProcessRows (sanei_magic_band * band, SANE_Byte * buffer,
+  int first, int lines, int * done);
+
+/** Get the skew that sanei_magic_bandDeskew() found
+ *
+ * @param band band state
+ * @param[out] centerX horizontal coordinate of center of rotation
+ * @param[out] centerY vertical coordinate of center of rotation
+ * @param[out] slope slope of rotation
+ *
+ * @return
+ * - SANE_STATUS_GOOD - success
+ * - SANE_STATUS_UNSUPPORTED - no skew found (yet)
+ */
+extern SANE_Status
+sanei_magic_bandGetSkew (sanei_magic_band * band,
+  int * centerX, int * centerY, double * slope);
+
+/** Free band state
+ *
+ * @param band band state, may be NULL
+ */
+extern void
+sanei_magic_bandFinish (sanei_magic_band * band);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
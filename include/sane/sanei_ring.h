@@ -0,0 +1,212 @@
+/* sane - Scanner Access Now Easy.
+   Copyright (C) 2026 Sane Developers.
+   This file is part of the SANE package.
+
+   SANE is free software; you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free
+   Software Foundation; either version 2 of the License, or (at your
+   option) any later version.
+
+   SANE is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+   for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with sane; see the file COPYING.
+   If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+
+*/
+
+/** @file sanei_ring.h
+ * Shared memory transport from a reader task to sane_read().
+ *
+ * Many backends start a reader task with sanei_thread_begin(), which
+ * write()s the image into a pipe that sane_read() reads from. That
+ * copies every byte through the kernel twice. A ring moves the data
+ * through memory shared by both tasks instead, and only uses a pipe to
+ * wake up the other side. It works for both processes and threads.
+ *
+ * Switching a backend from a pipe:
+ * - sane_start(): sanei_ring_create() instead of pipe(), and
+ *   sanei_ring_begin() instead of sanei_thread_begin()
+ * - reader task: sanei_ring_write() instead of write(). Returning from
+ *   the task ends the image, with SANE_STATUS_EOF if the task returned
+ *   SANE_STATUS_GOOD, or with the status it returned otherwise
+ * - sane_read(): sanei_ring_read() instead of read()
+ * - sane_set_io_mode() and sane_get_select_fd(): sanei_ring_set_io_mode()
+ *   and sanei_ring_get_select_fd()
+ * - sane_cancel(): sanei_ring_cancel() before killing the reader, and
+ *   sanei_ring_free() after sanei_thread_waitpid()
+ *
+ * Only one task may write to and one task may read from a ring.
+ *
+ * @sa sanei_thread.h
+ */
+
+#ifndef sanei_ring_h
+#define sanei_ring_h
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei_thread.h"
+
+/** Size of a ring if none is given */
+#define SANEI_RING_DEFAULT_SIZE (1024 * 1024)
+
+/** Ring buffer between a reader task and sane_read() */
+typedef struct sanei_ring SANEI_Ring;
+
+/** Create a ring.
+ *
+ * Must be called before the reader task is started.
+ *
+ * @param ring returns the new ring
+ * @param size capacity in bytes, rounded up to a power of two, or 0 for
+ * SANEI_RING_DEFAULT_SIZE
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_NO_MEM - if the memory or pipes could not be allocated
+ * - SANE_STATUS_UNSUPPORTED - if processes are used and the platform
+ *   can't share memory between them
+ */
+extern SANE_Status sanei_ring_create (SANEI_Ring ** ring, size_t size);
+
+/** Free a ring.
+ *
+ * The reader task must have finished, see sanei_thread_waitpid().
+ *
+ * @param ring the ring, may be NULL
+ */
+extern void sanei_ring_free (SANEI_Ring * ring);
+
+/** Start a reader task that writes into a ring.
+ *
+ * Like sanei_thread_begin(). When func returns, the ring is closed with
+ * SANE_STATUS_EOF if it returned SANE_STATUS_GOOD, or with the status
+ * it returned otherwise, unless sanei_ring_write_done() was called.
+ *
+ * @param ring the ring
+ * @param func reader task
+ * @param args argument of func
+ *
+ * @return
+ * - process id or thread id of the task, check with sanei_thread_is_valid()
+ */
+extern SANE_Pid sanei_ring_begin (SANEI_Ring * ring,
+				  int (*func) (void *args), void *args);
+
+/** Write data into a ring, called by the reader task.
+ *
+ * Waits until all data has been copied into the ring.
+ *
+ * @param ring the ring
+ * @param data the data
+ * @param len number of bytes
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_CANCELLED - if sanei_ring_cancel() was called
+ * - SANE_STATUS_IO_ERROR - if the reading side went away
+ */
+extern SANE_Status sanei_ring_write (SANEI_Ring * ring,
+				     const SANE_Byte * data, size_t len);
+
+/** Get free space of a ring to write into directly, called by the reader task.
+ *
+ * Waits until there is free space. Call sanei_ring_commit() when the
+ * data is in place.
+ *
+ * @param ring the ring
+ * @param data returns the start of the free space
+ * @param len returns the number of free bytes at data, at least 1
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_CANCELLED - if sanei_ring_cancel() was called
+ * - SANE_STATUS_IO_ERROR - if the reading side went away
+ */
+extern SANE_Status sanei_ring_get_space (SANEI_Ring * ring,
+					 SANE_Byte ** data, size_t * len);
+
+/** Hand data written with sanei_ring_get_space() to the reading side.
+ *
+ * @param ring the ring
+ * @param len number of bytes written, at most the length returned by
+ * sanei_ring_get_space()
+ */
+extern void sanei_ring_commit (SANEI_Ring * ring, size_t len);
+
+/** End the image, called by the reader task.
+ *
+ * sanei_ring_read() returns status once all data has been read.
+ *
+ * @param ring the ring
+ * @param status SANE_STATUS_EOF, or the error that ended the image
+ */
+extern void sanei_ring_write_done (SANEI_Ring * ring, SANE_Status status);
+
+/** Read data from a ring, like sane_read().
+ *
+ * @param ring the ring
+ * @param data buffer for the data
+ * @param max_len size of the buffer
+ * @param len returns the number of bytes read
+ *
+ * @return
+ * - SANE_STATUS_GOOD - if data was read, or if there is no data yet in
+ *   non-blocking mode
+ * - the status of sanei_ring_write_done() - once all data has been read
+ * - SANE_STATUS_IO_ERROR - if the reader task went away without ending
+ *   the image
+ */
+extern SANE_Status sanei_ring_read (SANEI_Ring * ring, SANE_Byte * data,
+				    SANE_Int max_len, SANE_Int * len);
+
+/** Set blocking or non-blocking mode of sanei_ring_read().
+ *
+ * @param ring the ring
+ * @param non_blocking SANE_TRUE for non-blocking mode
+ */
+extern void sanei_ring_set_io_mode (SANEI_Ring * ring,
+				    SANE_Bool non_blocking);
+
+/** Get a file descriptor that is readable when there is data to read.
+ *
+ * @param ring the ring
+ *
+ * @return
+ * - the file descriptor, for sane_get_select_fd()
+ */
+extern SANE_Int sanei_ring_get_select_fd (SANEI_Ring * ring);
+
+/** Tell the reader task to stop.
+ *
+ * sanei_ring_write() returns SANE_STATUS_CANCELLED from now on.
+ *
+ * @param ring the ring
+ */
+extern void sanei_ring_cancel (SANEI_Ring * ring);
+
+#endif /* sanei_ring_h */
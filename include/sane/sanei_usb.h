@@ -180,6 +180,39 @@ struct sanei_usb_dev_descriptor
 	SANE_Byte    max_packet_size;
 };
 
+/** Number of buckets of the latency histograms in sanei_usb_transfer_stats.
+ *
+ * Bucket 0 counts transfers that took less than 2 microseconds, bucket i
+ * counts transfers that took between 2^i and 2^(i+1) - 1 microseconds and
+ * the last bucket counts all slower transfers.
+ */
+#define SANEI_USB_LATENCY_BUCKETS 24
+
+/** Statistics of one kind of transfer of a device.
+ */
+struct sanei_usb_transfer_stats
+{
+	unsigned long      transfers;   /**< completed and failed transfers */
+	unsigned long long bytes;       /**< bytes actually transferred */
+	unsigned long      timeouts;    /**< transfers that timed out */
+	unsigned long      stalls;      /**< transfers that stalled the endpoint */
+	unsigned long      errors;      /**< transfers that failed otherwise */
+	unsigned long long total_usec;  /**< time spent in all transfers */
+	unsigned long      max_usec;    /**< slowest transfer */
+	unsigned long      latency[SANEI_USB_LATENCY_BUCKETS];
+};
+
+/** Transfer statistics of a device, see sanei_usb_get_stats().
+ */
+struct sanei_usb_stats
+{
+	struct sanei_usb_transfer_stats bulk_in;
+	struct sanei_usb_transfer_stats bulk_out;
+	struct sanei_usb_transfer_stats int_in;
+	struct sanei_usb_transfer_stats control_in;
+	struct sanei_usb_transfer_stats control_out;
+};
+
 /** Initialize sanei_usb for replay testing.
 
     Initializes sanei_usb for testing by mocking whole USB stack. This function
@@ -212,6 +245,48 @@ extern SANE_Status sanei_usb_testing_enable_replay(SANE_String_Const path,
 extern SANE_Status sanei_usb_testing_enable_record(SANE_String_Const path,
                                                    SANE_String_Const be_name);
 
+/** Compile an XML capture into a replay log.
+ *
+ * The replay log contains the transactions of the capture in the order in
+ * which they are replayed, with their payloads already decoded. It can be
+ * passed to sanei_usb_testing_enable_replay() instead of the XML file; it is
+ * memory-mapped where possible, so large captures don't need to be parsed on
+ * every run. The log uses the byte order of the host that compiled it and can
+ * not be used in development mode.
+ *
+ * @param xml_path Path to the XML data file.
+ * @param log_path Path of the replay log to write.
+ */
+extern SANE_Status sanei_usb_testing_compile_replay_log(SANE_String_Const xml_path,
+                                                        SANE_String_Const log_path);
+
+/** Initialize sanei_usb for streaming recording.
+ *
+ * Like sanei_usb_testing_enable_record(), but the transactions are appended
+ * to a binary stream with their timestamps as they happen instead of being
+ * kept in memory until sanei_usb_exit(). The stream can be converted to the
+ * XML format with sanei_usb_testing_convert_stream_record(). This function
+ * must be called before sanei_usb_init().
+ *
+ * @param path Path to the stream file.
+ * @param be_name The name of the backend to enable recording for.
+ */
+extern SANE_Status sanei_usb_testing_enable_stream_record(SANE_String_Const path,
+                                                          SANE_String_Const be_name);
+
+/** Convert a stream written in streaming recording mode to an XML capture.
+ *
+ * The XML file is the same as the one sanei_usb_testing_enable_record() would
+ * have written, except that the transactions carry their timestamps. A stream
+ * that has been cut off is converted up to its last complete record. This
+ * function may only be called when sanei_usb is not initialized.
+ *
+ * @param stream_path Path to the stream file.
+ * @param xml_path Path of the XML data file to write.
+ */
+extern SANE_Status sanei_usb_testing_convert_stream_record(SANE_String_Const stream_path,
+                                                           SANE_String_Const xml_path);
+
 /** Returns backend name for testing.
  *
  * Returns backend name for the file registered in sanei_usb_testing_enable.
@@ -260,6 +335,11 @@ extern void sanei_usb_exit (void);
 /** Search for USB devices.
  *
  * Search USB buses for scanner devices.
+ *
+ * If the environment variable SANE_USB_HOTPLUG is set to a non-zero value
+ * and libusb-1.0 supports hotplug events, only the first call enumerates the
+ * USB buses. Later calls update the device list from the devices that have
+ * arrived or left in the meantime.
  */
 extern void sanei_usb_scan_devices (void);
 
@@ -412,6 +492,65 @@ extern SANE_Status sanei_usb_reset (SANE_Int dn);
 extern SANE_Status
 sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size);
 
+/** Maximum number of bulk reads a device can have queued at the same time.
+ */
+#define SANEI_USB_MAX_ASYNC_READS 32
+
+/** Queue bulk transfer reads.
+ *
+ * Queues count reads of up to size bytes each from the bulk-in endpoint. With
+ * libusb-1.0 the reads are submitted right away as asynchronous transfers, so
+ * the device keeps sending data while the backend processes the buffers it
+ * already received. The reads are collected in the order they were queued
+ * with sanei_usb_reap_bulk_read().
+ *
+ * Without libusb-1.0 and in record and replay mode each queued read is
+ * performed by sanei_usb_reap_bulk_read() as a blocking sanei_usb_read_bulk(),
+ * which keeps captures deterministic.
+ *
+ * @param dn device number
+ * @param count number of reads to queue
+ * @param size size of each read
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_NO_MEM - if there is not enough memory
+ * - SANE_STATUS_IO_ERROR - if a read could not be submitted
+ * - SANE_STATUS_INVAL - if more than SANEI_USB_MAX_ASYNC_READS reads would be
+ *   queued and on every other error
+ */
+extern SANE_Status
+sanei_usb_submit_bulk_reads (SANE_Int dn, SANE_Int count, size_t size);
+
+/** Wait for the oldest queued bulk transfer read.
+ *
+ * Waits until the oldest read queued with sanei_usb_submit_bulk_reads() has
+ * completed and copies its data to buffer. After an error the remaining
+ * reads should be cancelled with sanei_usb_cancel_bulk_reads().
+ *
+ * @param dn device number
+ * @param buffer buffer to store read data in
+ * @param size size of the buffer, at least the size of the queued read. After
+ *             the read, size contains the number of bytes actually read.
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_EOF - if zero bytes have been read
+ * - SANE_STATUS_IO_ERROR - if an error occurred during the read
+ * - SANE_STATUS_INVAL - if no read is queued and on every other error
+ */
+extern SANE_Status
+sanei_usb_reap_bulk_read (SANE_Int dn, SANE_Byte * buffer, size_t * size);
+
+/** Cancel all queued bulk transfer reads.
+ *
+ * Data the cancelled reads already received is discarded. sanei_usb_close()
+ * cancels the pending reads too.
+ *
+ * @param dn device number
+ */
+extern void sanei_usb_cancel_bulk_reads (SANE_Int dn);
+
 /** Initiate a bulk transfer write.
  *
  * Write up to size bytes from buffer to the device. After the write size
@@ -589,6 +728,30 @@ sanei_usb_set_altinterface (SANE_Int dn, SANE_Int alternate);
 extern SANE_Status
 sanei_usb_get_descriptor( SANE_Int dn, struct sanei_usb_dev_descriptor *desc );
 
+/** Get the transfer statistics of a device.
+ *
+ * sanei_usb counts the bytes, transfers, timeouts and stalls of every bulk,
+ * interrupt and control transfer of a device and keeps a histogram of their
+ * latencies. The statistics are reset when the device is opened. If the
+ * environment variable SANE_USB_STATS is set to a non-zero value, they are
+ * also printed at debug level 1 when the device is closed.
+ *
+ * @param dn device number
+ * @param stats where to put the statistics to
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_INVAL - if the device number is invalid or stats is NULL
+ */
+extern SANE_Status
+sanei_usb_get_stats (SANE_Int dn, struct sanei_usb_stats *stats);
+
+/** Reset the transfer statistics of a device.
+ *
+ * @param dn device number
+ */
+extern void sanei_usb_reset_stats (SANE_Int dn);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -25,12 +25,26 @@
  * licensed under the GNU General Public License version 2 or later.
 */
 
+#include "../include/sane/config.h"
+
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
 #include <limits.h>
 #include <math.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef USE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define BACKEND_NAME sanei_ir	/* name of this module for debugging */
 
 #include "../include/sane/sane.h"
@@ -53,6 +67,107 @@ sanei_ir_init (void)
 }
 
 
+/* The filters below split large images into bands of rows or columns
+ * and run each band in its own thread
+ */
+#define IR_MAX_BANDS	16		/* upper limit of threads */
+#define IR_BAND_WORK	(1 << 18)	/* minimal pixels per band */
+
+/* number of bands, 0 for one per processor */
+static int ir_max_bands = 0;
+
+typedef void (*ir_band_func) (void *arg, int band, int first, int last);
+
+typedef struct
+{
+  ir_band_func func;
+  void *arg;
+  int band, first, last;
+} ir_band_job;
+
+
+/* Number of bands worth splitting count rows or columns of work pixels into
+ */
+static int
+ir_num_bands (int count, long work)
+{
+  long bands = 1;
+
+#ifdef USE_PTHREAD
+  bands = ir_max_bands;
+#ifdef _SC_NPROCESSORS_ONLN
+  if (bands <= 0)
+    bands = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  if (bands > work / IR_BAND_WORK)
+    bands = work / IR_BAND_WORK;
+  if (bands > count)
+    bands = count;
+  if (bands > IR_MAX_BANDS)
+    bands = IR_MAX_BANDS;
+  if (bands < 1)
+    bands = 1;
+#else
+  (void) count;
+  (void) work;
+#endif
+
+  return bands;
+}
+
+
+#ifdef USE_PTHREAD
+static void *
+ir_band_thread (void *arg)
+{
+  ir_band_job *job = arg;
+
+  job->func (job->arg, job->band, job->first, job->last);
+  return NULL;
+}
+#endif
+
+
+/* Call func for bands of count rows or columns, in parallel if possible
+ */
+static void
+ir_run_bands (ir_band_func func, void *arg, int count, int bands)
+{
+#ifdef USE_PTHREAD
+  pthread_t thread[IR_MAX_BANDS];
+  ir_band_job job[IR_MAX_BANDS];
+  int started[IR_MAX_BANDS];
+  int i;
+
+  for (i = 0; i < bands; i++)
+    {
+      job[i].func = func;
+      job[i].arg = arg;
+      job[i].band = i;
+      job[i].first = (long) count * i / bands;
+      job[i].last = (long) count * (i + 1) / bands;
+    }
+
+  /* the calling thread does the first band */
+  for (i = 1; i < bands; i++)
+    started[i] = (pthread_create (&thread[i], NULL, ir_band_thread,
+                                  &job[i]) == 0);
+  func (arg, 0, job[0].first, job[0].last);
+
+  for (i = 1; i < bands; i++)
+    {
+      if (started[i])
+        pthread_join (thread[i], NULL);
+      else
+        func (arg, i, job[i].first, job[i].last);
+    }
+#else
+  (void) bands;
+  func (arg, 0, 0, count);
+#endif
+}
+
+
 /* Create a normalized histogram of a grayscale image, internal
  */
 double *
@@ -646,6 +761,206 @@ sanei_ir_spectral_clean (const SANE_Parameters * params, double *lut_ln,
 }
 
 
+/* Exact division of n < 2^16 * d by d as (n * m) >> k, if d < 2^14,
+ * so that both n and m fit in 32 bits
+ */
+static int
+ir_div_magic (unsigned int d, unsigned int *m, int *k)
+{
+  int bits = 0;
+
+  while (bits < 32 && (1u << bits) <= d)
+    bits++;
+  if (bits > 14)
+    return 0;
+
+  *k = 16 + 2 * bits;
+  *m = ((UINT64_C (1) << *k) + d - 1) / d;
+  return 1;
+}
+
+
+/* Slide the column sums of the mean filter window by one row
+ */
+static void
+ir_mean_slide (unsigned int *sum, const SANE_Uint *add,
+               const SANE_Uint *sub, int num_cols)
+{
+  int j = 0;
+
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128 ();
+
+  for (; j + 8 <= num_cols; j += 8)
+    {
+      __m128i lo = _mm_loadu_si128 ((__m128i *) (sum + j));
+      __m128i hi = _mm_loadu_si128 ((__m128i *) (sum + j + 4));
+      __m128i v;
+
+      if (add)
+        {
+          v = _mm_loadu_si128 ((const __m128i *) (add + j));
+          lo = _mm_add_epi32 (lo, _mm_unpacklo_epi16 (v, zero));
+          hi = _mm_add_epi32 (hi, _mm_unpackhi_epi16 (v, zero));
+        }
+      if (sub)
+        {
+          v = _mm_loadu_si128 ((const __m128i *) (sub + j));
+          lo = _mm_sub_epi32 (lo, _mm_unpacklo_epi16 (v, zero));
+          hi = _mm_sub_epi32 (hi, _mm_unpackhi_epi16 (v, zero));
+        }
+      _mm_storeu_si128 ((__m128i *) (sum + j), lo);
+      _mm_storeu_si128 ((__m128i *) (sum + j + 4), hi);
+    }
+#endif
+
+  if (add)
+    for (; j < num_cols; j++)
+      sum[j] += add[j] - (sub ? sub[j] : 0);
+  else
+    for (; j < num_cols; j++)
+      sum[j] -= sub[j];
+}
+
+
+#ifdef __SSE2__
+/* Divide four sums by the magic numbers of ir_div_magic
+ */
+static __m128i
+ir_mean_div4 (__m128i n, __m128i m, __m128i k)
+{
+  __m128i even = _mm_srl_epi64 (_mm_mul_epu32 (n, m), k);
+  __m128i odd = _mm_srl_epi64 (_mm_mul_epu32 (_mm_srli_epi64 (n, 32), m), k);
+
+  return _mm_or_si128 (even, _mm_slli_epi64 (odd, 32));
+}
+#endif
+
+
+/* One row of the mean filter from the column sums of nrow rows
+ */
+static void
+ir_mean_row (const unsigned int *sum, unsigned int *prefix, SANE_Uint *dest,
+             int num_cols, int hwc, int nrow)
+{
+  int win_cols = 2 * hwc + 1;
+  unsigned int ndiv, m;
+  int j, k, left, right;
+
+  /* integral of the column sums, wrapping around is harmless
+   * as only differences of less than 2^32 are used */
+  prefix[0] = 0;
+  for (j = 0; j < num_cols; j++)
+    prefix[j + 1] = prefix[j] + sum[j];
+
+  /* at the margins the window is smaller */
+  for (j = 0; j < num_cols; j++)
+    {
+      if (j == hwc && j < num_cols - hwc)
+        j = num_cols - hwc;
+      if (j >= num_cols)
+        break;
+      left = j - hwc < 0 ? 0 : j - hwc;
+      right = j + hwc + 1 > num_cols ? num_cols : j + hwc + 1;
+      dest[j] = (prefix[right] - prefix[left]) / ((right - left) * nrow);
+    }
+
+  if (hwc >= num_cols - hwc)
+    return;
+
+  /* in the middle the window has the full width */
+  ndiv = win_cols * nrow;
+  j = hwc;
+  if (ir_div_magic (ndiv, &m, &k))
+    {
+#ifdef __SSE2__
+      __m128i vm = _mm_set1_epi32 (m);
+      __m128i vk = _mm_cvtsi32_si128 (k);
+      __m128i bias = _mm_set1_epi16 ((short) 0x8000);
+
+      for (; j + 8 <= num_cols - hwc; j += 8)
+        {
+          const unsigned int *p = prefix + j - hwc;
+          __m128i lo, hi;
+
+          lo = _mm_sub_epi32 (_mm_loadu_si128 ((const __m128i *) (p + win_cols)),
+                              _mm_loadu_si128 ((const __m128i *) p));
+          hi = _mm_sub_epi32 (_mm_loadu_si128 ((const __m128i *) (p + win_cols + 4)),
+                              _mm_loadu_si128 ((const __m128i *) (p + 4)));
+          lo = ir_mean_div4 (lo, vm, vk);
+          hi = ir_mean_div4 (hi, vm, vk);
+
+          /* pack to 16 bits without signed saturation */
+          lo = _mm_sub_epi32 (lo, _mm_set1_epi32 (0x8000));
+          hi = _mm_sub_epi32 (hi, _mm_set1_epi32 (0x8000));
+          _mm_storeu_si128 ((__m128i *) (dest + j),
+                            _mm_xor_si128 (_mm_packs_epi32 (lo, hi), bias));
+        }
+#endif
+      for (; j < num_cols - hwc; j++)
+        dest[j] = ((uint64_t) (prefix[j + hwc + 1] - prefix[j - hwc]) * m) >> k;
+    }
+  else
+    {
+      for (; j < num_cols - hwc; j++)
+        dest[j] = (prefix[j + hwc + 1] - prefix[j - hwc]) / ndiv;
+    }
+}
+
+
+typedef struct
+{
+  const SANE_Uint *in_img;
+  SANE_Uint *out_img;
+  int num_cols, num_rows;
+  int hwr, hwc;
+  unsigned int *buf;		/* sums and prefix sums for each band */
+} ir_mean_args;
+
+
+/* Mean filter for the rows of a band
+ */
+static void
+ir_mean_rows (void *arg, int band, int first, int last)
+{
+  ir_mean_args *a = arg;
+  int num_cols = a->num_cols;
+  int num_rows = a->num_rows;
+  int hwr = a->hwr;
+  unsigned int *sum = a->buf + (size_t) band * (2 * num_cols + 1);
+  unsigned int *prefix = sum + num_cols;
+  int i, top, bot;
+
+  /* column sums of the window around the first row */
+  memset (sum, 0, num_cols * sizeof (unsigned int));
+  top = first - hwr < 0 ? 0 : first - hwr;
+  bot = first + hwr >= num_rows ? num_rows - 1 : first + hwr;
+  for (i = top; i <= bot; i++)
+    ir_mean_slide (sum, a->in_img + (size_t) i * num_cols, NULL, num_cols);
+
+  for (i = first; i < last; i++)
+    {
+      /* move the window down */
+      if (i > first)
+        {
+          const SANE_Uint *add = NULL, *sub = NULL;
+
+          if (i + hwr < num_rows)
+            add = a->in_img + (size_t) (i + hwr) * num_cols;
+          if (i - hwr - 1 >= 0)
+            sub = a->in_img + (size_t) (i - hwr - 1) * num_cols;
+          if (add || sub)
+            ir_mean_slide (sum, add, sub, num_cols);
+        }
+
+      top = i - hwr < 0 ? 0 : i - hwr;
+      bot = i + hwr >= num_rows ? num_rows - 1 : i + hwr;
+      ir_mean_row (sum, prefix, a->out_img + (size_t) i * num_cols,
+                   num_cols, a->hwc, bot - top + 1);
+    }
+}
+
+
 /* Hopefully fast mean filter
  * JV: what does this do? Remove local mean?
  */
@@ -654,15 +969,8 @@ sanei_ir_filter_mean (const SANE_Parameters * params,
 		      const SANE_Uint *in_img, SANE_Uint *out_img,
 		      int win_rows, int win_cols)
 {
-  const SANE_Uint *src;
-  SANE_Uint *dest;
-  int num_cols, num_rows;
-  int itop, iadd, isub;
-  int ndiv, the_sum;
-  int nrow, ncol;
-  int hwr, hwc;
-  int *sum;
-  int i, j;
+  ir_mean_args args;
+  int bands;
 
   DBG (10, "sanei_ir_filter_mean, window: %d x%d\n", win_rows, win_cols);
 
@@ -672,92 +980,88 @@ sanei_ir_filter_mean (const SANE_Parameters * params,
       return SANE_STATUS_INVAL;
     }
 
-  num_cols = params->pixels_per_line;
-  num_rows = params->lines;
-
-  sum = malloc (num_cols * sizeof (int));
-  if (!sum)
+  args.in_img = in_img;
+  args.out_img = out_img;
+  args.num_cols = params->pixels_per_line;
+  args.num_rows = params->lines;
+  args.hwr = win_rows / 2;		/* half window sizes */
+  args.hwc = win_cols / 2;
+
+  bands = ir_num_bands (args.num_rows,
+                        (long) args.num_rows * args.num_cols);
+  args.buf = malloc ((size_t) bands * (2 * args.num_cols + 1)
+                     * sizeof (unsigned int));
+  if (!args.buf)
     {
       DBG (5, "sanei_ir_filter_mean: no buffer for sums\n");
       return SANE_STATUS_NO_MEM;
     }
-  dest = out_img;
 
-  hwr = win_rows / 2;		/* half window sizes */
-  hwc = win_cols / 2;
+  ir_run_bands (ir_mean_rows, &args, args.num_rows, bands);
 
-  /* pre-pre calculation */
-  for (j = 0; j < num_cols; j++)
-    {
-        sum[j] = 0;
-	src = in_img + j;
-	for (i = 0; i < hwr; i++)
-	  {
-	    sum[j] += *src;
-	    src += num_cols;
-	  }
-    }
+  free (args.buf);
+  return SANE_STATUS_GOOD;
+}
 
-  itop = num_rows * num_cols;
-  iadd = hwr * num_cols;
-  isub = (hwr - win_rows) * num_cols;
-  nrow = hwr;
 
-      for (i = 0; i < num_rows; i++)
-	{
-	  /* update row sums if possible */
-	  if (isub >= 0)	/* subtract old row */
-	    {
-	      nrow--;
-	      src = in_img + isub;
-	      for (j = 0; j < num_cols; j++)
-		sum[j] -= *src++;
-	    }
-	  isub += num_cols;
+typedef struct
+{
+  const SANE_Uint *in_img;
+  SANE_Uint *delta_ij;
+  const SANE_Uint *mad_ij;
+  SANE_Uint *out_ij;
+  int a_val, b_val;
+  double ab_term;
+} ir_madmean_args;
 
-	  if (iadd < itop)	/* add new row */
-	    {
-	      nrow++;
-	      src = in_img + iadd;
-	      for (j = 0; j < num_cols; j++)
-		sum[j] += *src++;
-	    }
-	  iadd += num_cols;
 
-	  /* now we do the image columns using only the precalculated sums */
+/* Differences to the local mean for a band of pixels
+ */
+static void
+ir_madmean_delta (void *arg, int band, int first, int last)
+{
+  ir_madmean_args *a = arg;
+  const SANE_Uint *mad_ptr = a->in_img + first;
+  SANE_Uint *delta_ptr = a->delta_ij + first;
+  int ival, i;
 
-	  the_sum = 0;		/* precalculation */
-	  for (j = 0; j < hwc; j++)
-	    the_sum += sum[j];
-	  ncol = hwc;
+  (void) band;
 
-	  /* at the left margin, real index hwc lower */
-	  for (j = hwc; j < win_cols; j++)
-	    {
-	      ncol++;
-	      the_sum += sum[j];
-	      *dest++ = the_sum / (ncol * nrow);
-	    }
+  for (i = first; i < last; i++)
+    {
+      ival = *mad_ptr++ - *delta_ptr;
+      *delta_ptr++ = abs (ival);
+    }
+}
 
-	  ndiv = ncol * nrow;
-	  /* in the middle, real index hwc + 1 higher */
-	  for (j = 0; j < num_cols - win_cols; j++)
-	    {
-	      the_sum -= sum[j];
-	      the_sum += sum[j + win_cols];
-	      *dest++ = the_sum / ndiv;
-	    }
 
-	  /* at the right margin, real index hwc + 1 higher */
-	  for (j = num_cols - win_cols; j < num_cols - hwc - 1; j++)
-	    {
-	      ncol--;
-	      the_sum -= sum[j];	/* j - hwc - 1 */
-	      *dest++ = the_sum / (ncol * nrow);
-	    }
-	}
-  free (sum);
-  return SANE_STATUS_GOOD;
+/* Noise map for a band of pixels
+ */
+static void
+ir_madmean_noise (void *arg, int band, int first, int last)
+{
+  ir_madmean_args *a = arg;
+  const SANE_Uint *mad_ptr = a->mad_ij + first;
+  const SANE_Uint *delta_ptr = a->delta_ij + first;
+  SANE_Uint *dest8 = a->out_ij + first;
+  int threshold, ival, i;
+
+  (void) band;
+
+  for (i = first; i < last; i++)
+    {
+      /* by calculating the threshold */
+      ival = *mad_ptr++;
+      if (ival >= a->b_val)	/* outlier */
+        threshold = a->a_val;
+      else
+        threshold = a->a_val + (double) ival * a->ab_term;
+      /* above threshold is noise, indicated by 0 */
+      if (*delta_ptr++ >= threshold)
+        *dest8++ = 0;
+      else
+        *dest8++ = 255;
+    }
 }
 
 
@@ -769,15 +1073,13 @@ sanei_ir_filter_madmean (const SANE_Parameters * params,
 			 SANE_Uint ** out_img, int win_size,
 			 int a_val, int b_val)
 {
-  SANE_Uint *delta_ij, *delta_ptr;
+  ir_madmean_args args;
+  SANE_Uint *delta_ij;
   SANE_Uint *mad_ij;
-  const SANE_Uint *mad_ptr;
-  SANE_Uint *out_ij, *dest8;
-  double ab_term;
+  SANE_Uint *out_ij;
   int num_rows, num_cols;
-  int threshold, itop;
+  int itop, bands;
   size_t size;
-  int ival, i;
   int depth;
   SANE_Status ret = SANE_STATUS_NO_MEM;
 
@@ -796,20 +1098,22 @@ sanei_ir_filter_madmean (const SANE_Parameters * params,
   out_ij = malloc (size);
   delta_ij = malloc (size);
   mad_ij = malloc (size);
+  bands = ir_num_bands (itop, itop);
+
+  args.in_img = in_img;
+  args.delta_ij = delta_ij;
+  args.mad_ij = mad_ij;
+  args.out_ij = out_ij;
+  args.a_val = a_val;
+  args.b_val = b_val;
 
   if (out_ij && delta_ij && mad_ij)
     {
       /* get the differences to the local mean */
-      mad_ptr = in_img;
-      if (sanei_ir_filter_mean (params, mad_ptr, delta_ij, win_size, win_size)
+      if (sanei_ir_filter_mean (params, in_img, delta_ij, win_size, win_size)
 	  == SANE_STATUS_GOOD)
 	{
-	  delta_ptr = delta_ij;
-	    for (i = 0; i < itop; i++)
-	      {
-		ival = *mad_ptr++ - *delta_ptr;
-		*delta_ptr++ = abs (ival);
-	      }
+	  ir_run_bands (ir_madmean_delta, &args, itop, bands);
 	  /* make the second filtering window a bit larger */
 	  win_size = MAD_WIN2_SIZE(win_size);
 	  /* and get the local mean differences */
@@ -817,26 +1121,11 @@ sanei_ir_filter_madmean (const SANE_Parameters * params,
 	      (params, delta_ij, mad_ij, win_size,
 	       win_size) == SANE_STATUS_GOOD)
 	    {
-	      mad_ptr = mad_ij;
-	      delta_ptr = delta_ij;
-	      dest8 = out_ij;
 	      /* construct the noise map */
-	      ab_term = (b_val - a_val) / (double) b_val;
-		for (i = 0; i < itop; i++)
-		  {
-		    /* by calculating the threshold */
-		    ival = *mad_ptr++;
-		    if (ival >= b_val)	/* outlier */
-		      threshold = a_val;
-		    else
-		      threshold = a_val + (double) ival *ab_term;
-		    /* above threshold is noise, indicated by 0 */
-		    if (*delta_ptr++ >= threshold)
-		      *dest8++ = 0;
-		    else
-		      *dest8++ = 255;
-		  }
+	      args.ab_term = (b_val - a_val) / (double) b_val;
+	      ir_run_bands (ir_madmean_noise, &args, itop, bands);
 	      *out_img = out_ij;
+	      out_ij = NULL;
 	      ret = SANE_STATUS_GOOD;
 	    }
 	}
@@ -844,6 +1133,7 @@ sanei_ir_filter_madmean (const SANE_Parameters * params,
   else
     DBG (5, "sanei_ir_filter_madmean: Cannot allocate buffers\n");
 
+  free (out_ij);
   free (mad_ij);
   free (delta_ij);
   return ret;
@@ -876,109 +1166,176 @@ sanei_ir_add_threshold (const SANE_Parameters * params,
 }
 
 
+/* Pick one of two equally close pixels, by a hash of the pixel index
+ * and the pass, so that the choice does not depend on the order in
+ * which the bands are done
+ */
+static int
+ir_coin (unsigned int i, unsigned int pass)
+{
+  i ^= pass * 0x9e3779b9u;
+  i ^= i >> 16;
+  i *= 0x7feb352du;
+  i ^= i >> 15;
+  i *= 0x846ca68bu;
+  i ^= i >> 16;
+  return i & 1;
+}
+
+
+typedef struct
+{
+  const SANE_Uint *mask_img;
+  unsigned int *dist_map, *idx_map;
+  int rows, cols;
+  unsigned int erode;
+} ir_dist_args;
+
+
+/* Distances to the closest pixel within the same row, for a band of rows
+ */
+static void
+ir_dist_rows (void *arg, int band, int first, int last)
+{
+  ir_dist_args *a = arg;
+  int cols = a->cols;
+  unsigned int far = a->cols + a->rows;
+  unsigned int *manhattan, *index;
+  const SANE_Uint *mask;
+  unsigned int start;
+  int i, j;
+
+  (void) band;
+
+  for (i = first; i < last; i++)
+    {
+      start = (unsigned int) i * cols;
+      mask = a->mask_img + start;
+      manhattan = a->dist_map + start;
+      index = a->idx_map + start;
+
+      /* left to right */
+      for (j = 0; j < cols; j++)
+        {
+          index[j] = start + j;
+          if (mask[j] == a->erode)
+            /* take original, distance = 0, index stays the same */
+            manhattan[j] = 0;
+          else if (j > 0 && manhattan[j - 1] + 1 < far)
+            {
+              manhattan[j] = manhattan[j - 1] + 1;
+              index[j] = index[j - 1];	/* index follows */
+            }
+          else
+            /* assume maximal distance to clean pixel */
+            manhattan[j] = far;
+        }
+
+      /* right to left */
+      for (j = cols - 2; j >= 0; j--)
+        {
+          unsigned int dist = manhattan[j + 1] + 1;
+
+          if (dist < manhattan[j])
+            {
+              manhattan[j] = dist;
+              index[j] = index[j + 1];
+            }
+          else if (dist == manhattan[j] && ir_coin (start + j, 0))
+            index[j] = index[j + 1];
+        }
+    }
+}
+
+
+/* Combine the row distances along a band of columns
+ */
+static void
+ir_dist_cols (void *arg, int band, int first, int last)
+{
+  ir_dist_args *a = arg;
+  int rows = a->rows;
+  int cols = a->cols;
+  unsigned int *manhattan, *index;
+  unsigned int start;
+  int i, j;
+
+  (void) band;
+
+  /* top to bottom, a row at a time to stay in the cache */
+  for (i = 1; i < rows; i++)
+    {
+      start = (unsigned int) i * cols;
+      manhattan = a->dist_map + start;
+      index = a->idx_map + start;
+      for (j = first; j < last; j++)
+        {
+          unsigned int dist = manhattan[j - cols] + 1;
+
+          if (dist < manhattan[j])
+            {
+              manhattan[j] = dist;
+              index[j] = index[j - cols];
+            }
+          else if (dist == manhattan[j] && ir_coin (start + j, 1))
+            index[j] = index[j - cols];
+        }
+    }
+
+  /* bottom to top */
+  for (i = rows - 2; i >= 0; i--)
+    {
+      start = (unsigned int) i * cols;
+      manhattan = a->dist_map + start;
+      index = a->idx_map + start;
+      for (j = first; j < last; j++)
+        {
+          unsigned int dist = manhattan[j + cols] + 1;
+
+          if (dist < manhattan[j])
+            {
+              manhattan[j] = dist;
+              index[j] = index[j + cols];
+            }
+          else if (dist == manhattan[j] && ir_coin (start + j, 2))
+            index[j] = index[j + cols];
+        }
+    }
+}
+
+
 /* Calculate minimal Manhattan distances for an image mask
+ *
+ * The distance is separable: first the closest pixel within each row,
+ * then the closest of those along each column. Both passes are split
+ * into bands. Ties between equally close pixels are broken by
+ * ir_coin instead of rand (), so results don't depend on the bands.
  */
 void
 sanei_ir_manhattan_dist (const SANE_Parameters * params,
 			const SANE_Uint * mask_img, unsigned int *dist_map,
 			unsigned int *idx_map, unsigned int erode)
 {
-  const SANE_Uint *mask;
-  unsigned int *index, *manhattan;
-  int rows, cols, itop;
-  int i, j;
+  ir_dist_args args;
+  long itop;
 
   DBG (10, "sanei_ir_manhattan_dist\n");
 
   if (erode != 0)
     erode = 255;
 
-  /* initialize maps */
-  cols = params->pixels_per_line;
-  rows = params->lines;
-  itop = rows * cols;
-  mask = mask_img;
-  manhattan = dist_map;
-  index = idx_map;
-  for (i = 0; i < itop; i++)
-    {
-      *manhattan++ = *mask++;
-      *index++ = i;
-    }
-
-  /* traverse from top left to bottom right */
-  manhattan = dist_map;
-  index = idx_map;
-  for (i = 0; i < rows; i++)
-    for (j = 0; j < cols; j++)
-      {
-	if (*manhattan == erode)
-	  {
-	    /* take original, distance = 0, index stays the same */
-	    *manhattan = 0;
-	  }
-	else
-	  {
-	    /* assume maximal distance to clean pixel */
-	    *manhattan = cols + rows;
-	    /* or one further away than pixel to the top */
-	    if (i > 0)
-	      if (manhattan[-cols] + 1 < *manhattan)
-		{
-		  *manhattan = manhattan[-cols] + 1;
-		  *index = index[-cols];	/* index follows */
-		}
-	    /* or one further away than pixel to the left */
-	    if (j > 0)
-	      {
-		if (manhattan[-1] + 1 < *manhattan)
-		  {
-		    *manhattan = manhattan[-1] + 1;
-		    *index = index[-1];	/* index follows */
-		  }
-		if (manhattan[-1] + 1 == *manhattan)
-		  if (rand () % 2 == 0)	/* chose index */
-		    *index = index[-1];
-	      }
-	  }
-	manhattan++;
-	index++;
-      }
-
-  /* traverse from bottom right to top left */
-  manhattan = dist_map + itop - 1;
-  index = idx_map + itop - 1;
-  for (i = rows - 1; i >= 0; i--)
-    for (j = cols - 1; j >= 0; j--)
-      {
-	if (i < rows - 1)
-	  {
-	    /* either what we had on the first pass
-	       or one more than the pixel to the bottm */
-	    if (manhattan[+cols] + 1 < *manhattan)
-	      {
-		*manhattan = manhattan[+cols] + 1;
-		*index = index[+cols];	/* index follows */
-	      }
-	    if (manhattan[+cols] + 1 == *manhattan)
-	      if (rand () % 2 == 0)	/* chose index */
-		*index = index[+cols];
-	  }
-	if (j < cols - 1)
-	  {
-	    /* or one more than pixel to the right */
-	    if (manhattan[1] + 1 < *manhattan)
-	      {
-		*manhattan = manhattan[1] + 1;
-		*index = index[1];	/* index follows */
-	      }
-	    if (manhattan[1] + 1 == *manhattan)
-	      if (rand () % 2 == 0)	/* chose index */
-		*index = index[1];
-	  }
-	manhattan--;
-	index--;
-      }
+  args.mask_img = mask_img;
+  args.dist_map = dist_map;
+  args.idx_map = idx_map;
+  args.cols = params->pixels_per_line;
+  args.rows = params->lines;
+  args.erode = erode;
+  itop = (long) args.rows * args.cols;
+
+  ir_run_bands (ir_dist_rows, &args, args.rows,
+                ir_num_bands (args.rows, itop));
+  ir_run_bands (ir_dist_cols, &args, args.cols,
+                ir_num_bands (args.cols / 16, itop));
 }
 
 
@@ -1109,6 +1466,37 @@ sanei_ir_find_crop (const SANE_Parameters * params,
 }
 
 
+typedef struct
+{
+  const unsigned int *dist_map, *idx_map;
+  int dist_max;
+  SANE_Uint *color;
+  const SANE_Uint *plane;
+} ir_dilate_args;
+
+
+/* Replace the dirty pixels of a band, either by the closest clean pixel,
+ * or by the smoothened plane
+ */
+static void
+ir_dilate_replace (void *arg, int band, int first, int last)
+{
+  ir_dilate_args *a = arg;
+  const unsigned int *manhattan = a->dist_map + first;
+  int dist;
+  int i;
+
+  (void) band;
+
+  for (i = first; i < last; i++)
+    {
+      dist = *manhattan++;
+      if ((dist != 0) && (dist <= a->dist_max))
+        a->color[i] = a->plane ? a->plane[i] : a->color[a->idx_map[i]];
+    }
+}
+
+
 /* Dilate clean image parts into dirty ones and smooth
  */
 SANE_Status
@@ -1119,13 +1507,13 @@ sanei_ir_dilate_mean (const SANE_Parameters * params,
                       SANE_Bool smooth, int inner,
                       int *crop)
 {
+  ir_dilate_args args;
   SANE_Uint *color;
   SANE_Uint *plane;
-  unsigned int *dist_map, *manhattan;
-  unsigned int *idx_map, *index;
-  int dist;
+  unsigned int *dist_map;
+  unsigned int *idx_map;
   int rows, cols;
-  int k, i, itop;
+  int k, itop, bands;
   SANE_Status ret = SANE_STATUS_NO_MEM;
 
   DBG (10, "sanei_ir_dilate_mean(): dist max = %d, expand = %d, win size = %d, smooth = %d, inner = %d\n",
@@ -1137,6 +1525,11 @@ sanei_ir_dilate_mean (const SANE_Parameters * params,
   idx_map = malloc (itop * sizeof (unsigned int));
   dist_map = malloc (itop * sizeof (unsigned int));
   plane = malloc (itop * sizeof (SANE_Uint));
+  bands = ir_num_bands (itop, itop);
+
+  args.dist_map = dist_map;
+  args.idx_map = idx_map;
+  args.dist_max = dist_max;
 
   if (!idx_map || !dist_map || !plane)
     DBG (5, "sanei_ir_dilate_mean: Cannot allocate buffers\n");
@@ -1155,16 +1548,12 @@ sanei_ir_dilate_mean (const SANE_Parameters * params,
       /* replace dirty pixels */
       for (k = 0; k < 3; k++)
 	{
-	  manhattan = dist_map;
-	  index = idx_map;
 	  color = in_img[k];
-	  /* first replacement */
-	    for (i = 0; i < itop; i++)
-	      {
-		dist = *manhattan++;
-		if ((dist != 0) && (dist <= dist_max))
-		  color[i] = color[index[i]];
-	      }
+	  args.color = color;
+	  args.plane = NULL;
+	  /* first replacement, clean pixels are never overwritten,
+	   * so the bands don't depend on each other */
+	  ir_run_bands (ir_dilate_replace, &args, itop, bands);
           /* adapt pixels to their new surround and
            * smooth the whole image or the replaced pixels only */
 	  ret =
@@ -1186,13 +1575,8 @@ sanei_ir_dilate_mean (const SANE_Parameters * params,
               {
                 /* replace with smoothened pixels only */
                 DBG (10, "sanei_ir_dilate_mean(): smoothing replaced pixels only\n");
-                manhattan = dist_map;
-                  for (i = 0; i < itop; i++)
-                    {
-                      dist = *manhattan++;
-                      if ((dist != 0) && (dist <= dist_max))
-                        color[i] = plane[i];
-                    }
+                args.plane = plane;
+                ir_run_bands (ir_dilate_replace, &args, itop, bands);
               }
       }
     }
@@ -72,6 +72,72 @@ static SANE_Status getLine (int height, int width, int * buff,
   int offsets, int minOffset, int maxOffset,
   double * finSlope, int * finOffset, int * finDensity);
 
+static SANE_Status getSkew (int pwidth, int height, int dpiY,
+  int * topBuf, int * botBuf, int * centerX, int * centerY,
+  double * finSlope);
+
+static SANE_Status despeckRows (SANE_Parameters * params,
+  SANE_Byte * buffer, SANE_Int diam, int first, int last);
+
+static int despeckWindow (SANE_Parameters * params,
+  SANE_Byte * buffer, SANE_Int diam, int i, int j);
+
+static SANE_Status rotateLine (SANE_Parameters * params, SANE_Byte * out,
+  int i, int centerX, int centerY, double slopeSin, double slopeCos,
+  SANE_Byte * src, int srcLines, int bg_color, int bilinear);
+
+/* Banded processing: deskew and despeck don't change the size of the
+ * image, so they can run on the rows that have arrived from the scanner,
+ * instead of waiting for the whole page. Rows are modified in place in
+ * the caller's buffer, lagging a little behind the rows received. */
+
+#define BAND_SKEW_NONE 0
+#define BAND_SKEW_FIND 1
+#define BAND_SKEW_ROTATE 2
+
+/* skew is found from this many inches at the top of the image */
+#define BAND_SKEW_INCHES 2
+
+struct sanei_magic_band
+{
+  SANE_Parameters params;
+  int dpiX;
+  int dpiY;
+
+  /* rows handed in by the caller so far, and rows finished */
+  int lines;
+  int done;
+
+  /* deskew */
+  int skew;
+  SANE_Status skewStatus;
+  int centerX;
+  int centerY;
+  double slope;
+  double slopeSin;
+  double slopeCos;
+  int bg_color;
+  int bilinear;
+
+  /* copies of the source rows that are still needed for rotation,
+   * since output rows are written over the input */
+  SANE_Byte * ring;
+  int ringLines;
+  int fed;
+  int rotated;
+
+  /* despeck */
+  int diam;
+  int despecked;
+
+  /* blank page detection, darkness of each block in a row of blocks */
+  int blank;
+  double blankThresh;
+  long * blankSums;
+  int blankDark;
+  int blanked;
+};
+
 void
 sanei_magic_init( void )
 {
@@ -83,190 +149,455 @@ SANE_Status
 sanei_magic_despeck (SANE_Parameters * params, SANE_Byte * buffer,
   SANE_Int diam)
 {
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  DBG (10, "sanei_magic_despeck: start\n");
+
+  ret = despeckRows(params, buffer, diam, 1, params->lines-1-diam);
+
+  DBG (10, "sanei_magic_despeck: finish\n");
+  return ret;
+}
+
+/* number of window rows handled per pass of despeckRows */
+#define DESPECK_STRIP 32
+
+/* largest binary window despeckRows checks without building tables */
+#define DESPECK_DIRECT 2
+
+/* sliding minimum over d values, in constant time per value, by splitting
+ * the input into blocks of d and taking the min of a suffix and a prefix.
+ * out[i] = min(in[i] .. in[i+d-1]), 0 <= i <= n-d. tmp holds 2*n ints */
+static void
+slideMin (int * in, int * out, int n, int d, int * tmp)
+{
+  int * pre = tmp;
+  int * suf = tmp + n;
+  int i, b;
+
+  if(d < 1 || d > n)
+    return;
+
+  for(i=0, b=0; i<n; i++, b++){
+    if(b == d)
+      b = 0;
+    pre[i] = (!b || in[i] < pre[i-1]) ? in[i] : pre[i-1];
+  }
+
+  suf[n-1] = in[n-1];
+  for(i=n-2, b=(n-2)%d; i>=0; i--, b--){
+    if(b < 0)
+      b = d-1;
+    suf[i] = (b == d-1 || in[i] < suf[i+1]) ? in[i] : suf[i+1];
+  }
+
+  for(i=0; i<=n-d; i++){
+    out[i] = suf[i] < pre[i+d-1] ? suf[i] : pre[i+d-1];
+  }
+}
+
+/* same as slideMin, but over n rows of w values each, so whole rows
+ * are combined at a time. tmp holds 2*n*w ints */
+static void
+slideMinRows (int * in, int * out, int n, int w, int d, int * tmp)
+{
+  int * pre = tmp;
+  int * suf = tmp + n*w;
+  int i, j, b;
+
+  if(d < 1 || d > n)
+    return;
+
+  for(i=0, b=0; i<n; i++, b++){
+    int * src = in + i*w;
+    int * dst = pre + i*w;
+
+    if(b == d)
+      b = 0;
+
+    if(!b){
+      memcpy(dst, src, w*sizeof(int));
+      continue;
+    }
+    for(j=0; j<w; j++)
+      dst[j] = src[j] < dst[j-w] ? src[j] : dst[j-w];
+  }
+
+  for(i=n-1, b=(n-1)%d; i>=0; i--, b--){
+    int * src = in + i*w;
+    int * dst = suf + i*w;
+
+    if(b < 0)
+      b = d-1;
+
+    if(b == d-1 || i == n-1){
+      memcpy(dst, src, w*sizeof(int));
+      continue;
+    }
+    for(j=0; j<w; j++)
+      dst[j] = src[j] < dst[j+w] ? src[j] : dst[j+w];
+  }
+
+  for(i=0; i<=n-d; i++){
+    int * s1 = suf + i*w;
+    int * p1 = pre + (i+d-1)*w;
+    int * dst = out + i*w;
+
+    for(j=0; j<w; j++)
+      dst[j] = s1[j] < p1[j] ? s1[j] : p1[j];
+  }
+}
+
+/* despeck the windows whose top row is in [first,last). A window reads
+ * the row above it and the diam rows starting at its top row, and only
+ * writes the latter, so rows above 'last' are final once this returns.
+ *
+ * Most windows are not changed, so each strip of rows first gets tables
+ * of the darkest pixel inside every window and along every border, built
+ * with sliding minimums in time independent of diam. Only windows which
+ * the tables can't rule out, or which read pixels changed since the
+ * tables were built, go through despeckWindow */
+static SANE_Status
+despeckRows (SANE_Parameters * params, SANE_Byte * buffer,
+  SANE_Int diam, int first, int last)
+{
 
   SANE_Status ret = SANE_STATUS_GOOD;
 
   int pw = params->pixels_per_line;
   int bw = params->bytes_per_line;
-  int h  = params->lines;
-  int bt = bw*h;
+  int rgb = 0;
+  int binary = 0;
 
-  int i,j,k,l,n;
+  /* table rows per strip, one above the windows and diam+1 below */
+  int tr = DESPECK_STRIP + diam + 1;
 
-  DBG (10, "sanei_magic_despeck: start\n");
+  int * lum = NULL;     /* darkness: gray value, rgb sum, or 0 for black */
+  int * rowMin = NULL;  /* min of diam pixels starting at column */
+  int * edgeMin = NULL; /* min of diam+2 pixels starting at column */
+  int * winMin = NULL;  /* min of the window with top left corner here */
+  int * colMin = NULL;  /* min of diam rows starting at row */
+  int * tmp = NULL;
+  int * modBottom = NULL; /* lowest row changed in each column */
+  int maxBottom = first-2;
 
-  if(params->format == SANE_FRAME_RGB){
+  int r0, r, j, k;
 
-    for(i=bw; i<bt-bw-(bw*diam); i+=bw){
+  if(params->format == SANE_FRAME_RGB)
+    rgb = 1;
+  else if(params->format == SANE_FRAME_GRAY && params->depth == 1)
+    binary = 1;
+  else if(params->format != SANE_FRAME_GRAY || params->depth != 8){
+    DBG (5, "sanei_magic_despeck: unsupported format/depth\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  if(last <= first || pw-1-diam <= 1 || diam < 1)
+    return ret;
+
+  /* small binary windows are cheaper to check directly */
+  if(binary && diam <= DESPECK_DIRECT){
+    for(r=first; r<last; r++){
       for(j=1; j<pw-1-diam; j++){
+        despeckWindow(params, buffer, diam, r*bw, j);
+      }
+    }
+    return ret;
+  }
+
+  lum = malloc(tr * pw * sizeof(int));
+  rowMin = malloc(tr * pw * sizeof(int));
+  edgeMin = malloc(tr * pw * sizeof(int));
+  winMin = malloc(DESPECK_STRIP * pw * sizeof(int));
+  colMin = malloc(DESPECK_STRIP * pw * sizeof(int));
+  tmp = malloc(2 * tr * pw * sizeof(int));
+  modBottom = malloc(pw * sizeof(int));
+  if(!lum || !rowMin || !edgeMin || !winMin || !colMin || !tmp || !modBottom){
+    DBG (5, "sanei_magic_despeck: no tables\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
 
-        int thresh = 255*3;
-        int outer[] = {0,0,0};
-        int hits = 0;
+  for(j=0; j<pw; j++)
+    modBottom[j] = first-2;
 
-        /* loop over rows and columns in window */
-        /* find darkest pixel */
-        for(k=0; k<diam; k++){
-          for(l=0; l<diam; l++){
-            int tmp = 0;
+  for(r0=first; r0<last; r0+=DESPECK_STRIP){
 
-            for(n=0; n<3; n++){
-              tmp += buffer[i + j*3 + k*bw + l*3 + n];
-            }
+    int r1 = r0 + DESPECK_STRIP;
+    int rows;
 
-            if(tmp < thresh)
-              thresh = tmp;
-          }
-        }
+    if(r1 > last)
+      r1 = last;
 
-        /* convert darkest pixel into a brighter threshold */
-        thresh = (thresh + 255*3 + 255*3)/3;
+    /* table row t is image row r0-1+t */
+    rows = r1 - r0 + diam + 1;
 
-        /*loop over rows and columns around window */
-        for(k=-1; k<diam+1; k++){
-          for(l=-1; l<diam+1; l++){
+    for(k=0; k<rows; k++){
+      SANE_Byte * ptr = buffer + (r0-1+k) * bw;
+      int * out = lum + k*pw;
 
-            int tmp[3];
+      if(rgb){
+        for(j=0; j<pw; j++)
+          out[j] = ptr[j*3] + ptr[j*3+1] + ptr[j*3+2];
+      }
+      else if(binary){
+        for(j=0; j<pw; j++)
+          out[j] = !(ptr[j/8] >> (7-(j%8)) & 1);
+      }
+      else{
+        for(j=0; j<pw; j++)
+          out[j] = ptr[j];
+      }
 
-            /* don't count pixels in the window */
-            if(k != -1 && k != diam && l != -1 && l != diam)
-              continue;
+      slideMin(out, rowMin + k*pw, pw, diam, tmp);
+      slideMin(out, edgeMin + k*pw, pw, diam+2, tmp);
+    }
 
-            for(n=0; n<3; n++){
-              tmp[n] = buffer[i + j*3 + k*bw + l*3 + n];
-              outer[n] += tmp[n];
-            }
-            if(tmp[0]+tmp[1]+tmp[2] < thresh){
-              hits++;
+    /* down the columns, over the diam rows of each window */
+    slideMinRows(rowMin + pw, winMin, rows-2, pw, diam, tmp);
+    slideMinRows(lum + pw, colMin, rows-2, pw, diam, tmp);
+
+    for(r=r0; r<r1; r++){
+
+      int t = r - r0;
+
+      for(j=1; j<pw-1-diam; j++){
+
+        int dirty = 0;
+
+        /* a window nearby was changed after the tables were built */
+        if(maxBottom >= r-1){
+          for(k=j-1; k<=j+diam; k++){
+            if(modBottom[k] >= r-1){
+              dirty = 1;
               break;
             }
           }
         }
 
-        /*no hits, overwrite with avg surrounding color*/
-        if(!hits){
+        if(!dirty){
+          int dark = winMin[t*pw + j];
+          int thresh, edge;
 
-          /* per channel replacement color */
-          for(n=0; n<3; n++){
-            outer[n] /= (4*diam + 4);
+          /* convert darkest pixel into a brighter threshold */
+          if(binary){
+            if(dark)
+              continue;
+            thresh = 1;
           }
+          else if(rgb)
+            thresh = (dark + 255*3 + 255*3)/3;
+          else
+            thresh = (dark + 255 + 255)/3;
+
+          /* darkest pixel around the window */
+          edge = edgeMin[t*pw + j-1];
+          if(edgeMin[(t+diam+1)*pw + j-1] < edge)
+            edge = edgeMin[(t+diam+1)*pw + j-1];
+          if(colMin[t*pw + j-1] < edge)
+            edge = colMin[t*pw + j-1];
+          if(colMin[t*pw + j+diam] < edge)
+            edge = colMin[t*pw + j+diam];
+
+          /* part of something bigger, leave it alone */
+          if(edge < thresh)
+            continue;
+        }
 
-          for(k=0; k<diam; k++){
-            for(l=0; l<diam; l++){
-              for(n=0; n<3; n++){
-                buffer[i + j*3 + k*bw + l*3 + n] = outer[n];
-              }
-            }
-          }
+        if(despeckWindow(params, buffer, diam, r*bw, j)){
+          for(k=j; k<j+diam; k++)
+            modBottom[k] = r+diam-1;
+          maxBottom = r+diam-1;
         }
       }
     }
   }
 
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 8){
-    for(i=bw; i<bt-bw-(bw*diam); i+=bw){
-      for(j=1; j<pw-1-diam; j++){
+  cleanup:
+  if(lum)
+    free(lum);
+  if(rowMin)
+    free(rowMin);
+  if(edgeMin)
+    free(edgeMin);
+  if(winMin)
+    free(winMin);
+  if(colMin)
+    free(colMin);
+  if(tmp)
+    free(tmp);
+  if(modBottom)
+    free(modBottom);
 
-        int thresh = 255;
-        int outer = 0;
-        int hits = 0;
+  return ret;
+}
 
-        for(k=0; k<diam; k++){
-          for(l=0; l<diam; l++){
-            if(buffer[i + j + k*bw + l] < thresh)
-              thresh = buffer[i + j + k*bw + l];
-          }
-        }
+/* check one window, whose top left pixel is at byte row i, column j.
+ * if nothing around the window is as dark as the darkest pixel inside,
+ * replace it with the surrounding color. returns 1 if replaced */
+static int
+despeckWindow (SANE_Parameters * params, SANE_Byte * buffer,
+  SANE_Int diam, int i, int j)
+{
+  int bw = params->bytes_per_line;
+  int k,l,n;
 
-        /* convert darkest pixel into a brighter threshold */
-        thresh = (thresh + 255 + 255)/3;
+  if(params->format == SANE_FRAME_RGB){
 
-        /*loop over rows and columns around window */
-        for(k=-1; k<diam+1; k++){
-          for(l=-1; l<diam+1; l++){
+    int thresh = 255*3;
+    int outer[] = {0,0,0};
+    int hits = 0;
 
-            int tmp = 0;
+    /* loop over rows and columns in window */
+    /* find darkest pixel */
+    for(k=0; k<diam; k++){
+      for(l=0; l<diam; l++){
+        int tmp = 0;
 
-            /* don't count pixels in the window */
-            if(k != -1 && k != diam && l != -1 && l != diam)
-              continue;
+        for(n=0; n<3; n++){
+          tmp += buffer[i + j*3 + k*bw + l*3 + n];
+        }
+
+        if(tmp < thresh)
+          thresh = tmp;
+      }
+    }
 
-            tmp = buffer[i + j + k*bw + l];
+    /* convert darkest pixel into a brighter threshold */
+    thresh = (thresh + 255*3 + 255*3)/3;
 
-            if(tmp < thresh){
-              hits++;
-              break;
-            }
+    /*loop over rows and columns around window */
+    for(k=-1; k<diam+1; k++){
+      for(l=-1; l<diam+1; l++){
 
-            outer += tmp;
-          }
+        int tmp[3];
+
+        /* don't count pixels in the window */
+        if(k != -1 && k != diam && l != -1 && l != diam)
+          continue;
+
+        for(n=0; n<3; n++){
+          tmp[n] = buffer[i + j*3 + k*bw + l*3 + n];
+          outer[n] += tmp[n];
+        }
+        if(tmp[0]+tmp[1]+tmp[2] < thresh){
+          hits++;
+          break;
         }
+      }
+    }
 
-        /*no hits, overwrite with avg surrounding color*/
-        if(!hits){
-          /* replacement color */
-          outer /= (4*diam + 4);
+    /*no hits, overwrite with avg surrounding color*/
+    if(!hits){
 
-          for(k=0; k<diam; k++){
-            for(l=0; l<diam; l++){
-              buffer[i + j + k*bw + l] = outer;
-            }
+      /* per channel replacement color */
+      for(n=0; n<3; n++){
+        outer[n] /= (4*diam + 4);
+      }
+
+      for(k=0; k<diam; k++){
+        for(l=0; l<diam; l++){
+          for(n=0; n<3; n++){
+            buffer[i + j*3 + k*bw + l*3 + n] = outer[n];
           }
         }
       }
+      return 1;
     }
   }
 
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
-    for(i=bw; i<bt-bw-(bw*diam); i+=bw){
-      for(j=1; j<pw-1-diam; j++){
+  else if(params->format == SANE_FRAME_GRAY && params->depth == 8){
 
-        int curr = 0;
-        int hits = 0;
+    int thresh = 255;
+    int outer = 0;
+    int hits = 0;
 
-        for(k=0; k<diam; k++){
-          for(l=0; l<diam; l++){
-            curr += buffer[i + k*bw + (j+l)/8] >> (7-(j+l)%8) & 1;
-          }
-        }
+    for(k=0; k<diam; k++){
+      for(l=0; l<diam; l++){
+        if(buffer[i + j + k*bw + l] < thresh)
+          thresh = buffer[i + j + k*bw + l];
+      }
+    }
 
-        if(!curr)
-          continue;
+    /* convert darkest pixel into a brighter threshold */
+    thresh = (thresh + 255 + 255)/3;
 
-        /*loop over rows and columns around window */
-        for(k=-1; k<diam+1; k++){
-          for(l=-1; l<diam+1; l++){
+    /*loop over rows and columns around window */
+    for(k=-1; k<diam+1; k++){
+      for(l=-1; l<diam+1; l++){
 
-            /* don't count pixels in the window */
-            if(k != -1 && k != diam && l != -1 && l != diam)
-              continue;
+        int tmp = 0;
 
-            hits += buffer[i + k*bw + (j+l)/8] >> (7-(j+l)%8) & 1;
+        /* don't count pixels in the window */
+        if(k != -1 && k != diam && l != -1 && l != diam)
+          continue;
 
-            if(hits)
-              break;
-          }
+        tmp = buffer[i + j + k*bw + l];
+
+        if(tmp < thresh){
+          hits++;
+          break;
         }
 
-        /*no hits, overwrite with white*/
-        if(!hits){
-          for(k=0; k<diam; k++){
-            for(l=0; l<diam; l++){
-              buffer[i + k*bw + (j+l)/8] &= ~(1 << (7-(j+l)%8));
-            }
-          }
+        outer += tmp;
+      }
+    }
+
+    /*no hits, overwrite with avg surrounding color*/
+    if(!hits){
+      /* replacement color */
+      outer /= (4*diam + 4);
+
+      for(k=0; k<diam; k++){
+        for(l=0; l<diam; l++){
+          buffer[i + j + k*bw + l] = outer;
         }
       }
+      return 1;
     }
   }
 
-  else{
-    DBG (5, "sanei_magic_despeck: unsupported format/depth\n");
-    ret = SANE_STATUS_INVAL;
+  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
+
+    int curr = 0;
+    int hits = 0;
+
+    for(k=0; k<diam; k++){
+      for(l=0; l<diam; l++){
+        curr += buffer[i + k*bw + (j+l)/8] >> (7-(j+l)%8) & 1;
+      }
+    }
+
+    if(!curr)
+      return 0;
+
+    /*loop over rows and columns around window */
+    for(k=-1; k<diam+1; k++){
+      for(l=-1; l<diam+1; l++){
+
+        /* don't count pixels in the window */
+        if(k != -1 && k != diam && l != -1 && l != diam)
+          continue;
+
+        hits += buffer[i + k*bw + (j+l)/8] >> (7-(j+l)%8) & 1;
+
+        if(hits)
+          break;
+      }
+    }
+
+    /*no hits, overwrite with white*/
+    if(!hits){
+      for(k=0; k<diam; k++){
+        for(l=0; l<diam; l++){
+          buffer[i + k*bw + (j+l)/8] &= ~(1 << (7-(j+l)%8));
+        }
+      }
+      return 1;
+    }
   }
 
-  DBG (10, "sanei_magic_despeck: finish\n");
-  return ret;
+  return 0;
 }
 
 /* find likely edges of media inside image background color */
@@ -508,21 +839,6 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
   int pwidth = params->pixels_per_line;
   int height = params->lines;
 
-  double TSlope = 0;
-  int TXInter = 0;
-  int TYInter = 0;
-  double TSlopeHalf = 0;
-  int TOffsetHalf = 0;
-
-  double LSlope = 0;
-  int LXInter = 0;
-  int LYInter = 0;
-  double LSlopeHalf = 0;
-  int LOffsetHalf = 0;
-
-  int rotateX = 0;
-  int rotateY = 0;
-
   int * topBuf = NULL, * botBuf = NULL;
 
   DBG (10, "sanei_magic_findSkew: start\n");
@@ -544,20 +860,54 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
     goto cleanup;
   }
 
+  ret = getSkew (pwidth, height, dpiY, topBuf, botBuf,
+    centerX, centerY, finSlope);
+
+  cleanup:
+  if(topBuf)
+    free(topBuf);
+  if(botBuf)
+    free(botBuf);
+
+  DBG (10, "sanei_magic_findSkew: finish\n");
+  return ret;
+}
+
+/* find skew from the top and bottom transitions of each column */
+static SANE_Status
+getSkew (int pwidth, int height, int dpiY, int * topBuf, int * botBuf,
+  int * centerX, int * centerY, double * finSlope)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+
+  double TSlope = 0;
+  int TXInter = 0;
+  int TYInter = 0;
+  double TSlopeHalf = 0;
+  int TOffsetHalf = 0;
+
+  double LSlope = 0;
+  int LXInter = 0;
+  int LYInter = 0;
+  double LSlopeHalf = 0;
+  int LOffsetHalf = 0;
+
+  int rotateX = 0;
+  int rotateY = 0;
+
   /* find best top line */
   ret = getTopEdge (pwidth, height, dpiY, topBuf,
     &TSlope, &TXInter, &TYInter);
   if(ret){
     DBG(5,"sanei_magic_findSkew: gTE error: %d",ret);
-    goto cleanup;
+    return ret;
   }
   DBG(15,"top: %04.04f %d %d\n",TSlope,TXInter,TYInter);
 
   /* slope is too shallow, don't want to divide by 0 */
   if(fabs(TSlope) < 0.0001){
     DBG(15,"sanei_magic_findSkew: slope too shallow: %0.08f\n",TSlope);
-    ret = SANE_STATUS_UNSUPPORTED;
-    goto cleanup;
+    return SANE_STATUS_UNSUPPORTED;
   }
 
   /* find best left line, perpendicular to top line */
@@ -566,7 +916,7 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
     &LXInter, &LYInter);
   if(ret){
     DBG(5,"sanei_magic_findSkew: gLE error: %d",ret);
-    goto cleanup;
+    return ret;
   }
   DBG(15,"sanei_magic_findSkew: left: %04.04f %d %d\n",LSlope,LXInter,LYInter);
 
@@ -587,47 +937,86 @@ sanei_magic_findSkew(SANE_Parameters * params, SANE_Byte * buffer,
   *centerY = rotateY;
   *finSlope = TSlope;
 
-  cleanup:
-  if(topBuf)
-    free(topBuf);
-  if(botBuf)
-    free(botBuf);
-
-  DBG (10, "sanei_magic_findSkew: finish\n");
   return ret;
 }
 
 /* function to do a simple rotation by a given slope, around
  * a given point. The point can be outside of image to get
- * proper edge alignment. Unused areas filled with bg color
- * FIXME: Do in-place rotation to save memory */
+ * proper edge alignment. Unused areas filled with bg color */
 SANE_Status
 sanei_magic_rotate (SANE_Parameters * params, SANE_Byte * buffer,
   int centerX, int centerY, double slope, int bg_color)
 {
+  return sanei_magic_rotate2(params, buffer, centerX, centerY, slope,
+    bg_color, 0);
+}
 
+/* rotation is done in place, band by band. Only the source rows
+ * which a few output rows need are copied aside, instead of the
+ * whole image */
+SANE_Status
+sanei_magic_rotate2 (SANE_Parameters * params, SANE_Byte * buffer,
+  int centerX, int centerY, double slope, int bg_color, int bilinear)
+{
   SANE_Status ret = SANE_STATUS_GOOD;
+  sanei_magic_band * band = NULL;
+  int done = 0;
+
+  DBG(10,"sanei_magic_rotate2: start: %d %d\n",centerX,centerY);
+
+  if(bilinear && params->format == SANE_FRAME_GRAY && params->depth == 1){
+    DBG (5, "sanei_magic_rotate2: no bilinear for binary\n");
+    bilinear = 0;
+  }
+
+  ret = sanei_magic_bandStart(&band, params, 0, 0);
+  if(ret){
+    DBG (5, "sanei_magic_rotate2: unsupported format/depth\n");
+    goto cleanup;
+  }
 
-  double slopeRad = -atan(slope);
-  double slopeSin = sin(slopeRad);
-  double slopeCos = cos(slopeRad);
+  band->bilinear = bilinear;
+
+  ret = sanei_magic_bandRotate(band, centerX, centerY, slope, bg_color);
+  if(ret){
+    DBG(15,"sanei_magic_rotate2: no ring\n");
+    goto cleanup;
+  }
 
+  ret = sanei_magic_bandProcess(band, buffer, params->lines, &done);
+
+  cleanup:
+  sanei_magic_bandFinish(band);
+
+  DBG(10,"sanei_magic_rotate2: finish\n");
+
+  return ret;
+}
+
+/* build output row i of a rotation. Source row y is read from
+ * src + (y % srcLines) * bytes_per_line, so src can be the whole
+ * image, or a ring holding just the rows this output row needs.
+ * The source coordinates move by a fixed step along the output row,
+ * so they are stepped instead of recomputed for each pixel. */
+static SANE_Status
+rotateLine (SANE_Parameters * params, SANE_Byte * out, int i,
+  int centerX, int centerY, double slopeSin, double slopeCos,
+  SANE_Byte * src, int srcLines, int bg_color, int bilinear)
+{
   int pwidth = params->pixels_per_line;
   int bwidth = params->bytes_per_line;
   int height = params->lines;
   int depth = 1;
 
-  unsigned char * outbuf;
-  int i, j, k;
+  int shiftY = centerY - i;
 
-  DBG(10,"sanei_magic_rotate: start: %d %d\n",centerX,centerY);
+  /* source x is centerX - vx, source y is centerY + vy */
+  double vx = centerX * slopeCos + shiftY * slopeSin;
+  double vy = -shiftY * slopeCos + centerX * slopeSin;
 
-  outbuf = malloc(bwidth*height);
-  if(!outbuf){
-    DBG(15,"sanei_magic_rotate: no outbuf\n");
-    ret = SANE_STATUS_NO_MEM;
-    goto cleanup;
-  }
+  SANE_Byte * line = NULL;
+  int lineY = -1;
+  int j, k;
 
   if(params->format == SANE_FRAME_RGB ||
     (params->format == SANE_FRAME_GRAY && params->depth == 8)
@@ -636,79 +1025,141 @@ sanei_magic_rotate (SANE_Parameters * params, SANE_Byte * buffer,
     if(params->format == SANE_FRAME_RGB)
       depth = 3;
 
-    memset(outbuf,bg_color,bwidth*height);
+    memset(out,bg_color,bwidth);
+
+    if(bilinear){
 
-    for (i=0; i<height; i++) {
-      int shiftY = centerY - i;
+      for (j=0; j<pwidth; j++, vx -= slopeCos, vy -= slopeSin) {
+        double fx = centerX - vx;
+        double fy = centerY + vy;
+        int x0, y0, wx, wy, w[4];
+        SANE_Byte * row0;
+        SANE_Byte * row1;
+
+        if (fx <= -1 || fx >= pwidth || fy <= -1 || fy >= height)
+          continue;
 
-      for (j=0; j<pwidth; j++) {
-        int shiftX = centerX - j;
+        /* truncation is floor, now that fx and fy are > -1 */
+        x0 = (int)(fx + 1) - 1;
+        y0 = (int)(fy + 1) - 1;
+        wx = (int)((fx - x0) * 256);
+        wy = (int)((fy - y0) * 256);
+
+        w[0] = (256-wx) * (256-wy);
+        w[1] = wx * (256-wy);
+        w[2] = (256-wx) * wy;
+        w[3] = wx * wy;
+
+        row0 = src + ((y0 < 0 ? 0 : y0) % srcLines) * bwidth;
+        row1 = src + ((y0+1 < height ? y0+1 : y0) % srcLines) * bwidth;
+
+        /* all four neighbors inside the image */
+        if (x0 >= 0 && x0+1 < pwidth && y0 >= 0 && y0+1 < height){
+          SANE_Byte * p0 = row0 + x0*depth;
+          SANE_Byte * p1 = row1 + x0*depth;
+
+          for (k=0; k<depth; k++) {
+            out[j*depth+k] = (p0[k] * w[0] + p0[k+depth] * w[1]
+              + p1[k] * w[2] + p1[k+depth] * w[3] + 32768) >> 16;
+          }
+        }
+
+        /* neighbors outside the image count as background */
+        else{
+          for (k=0; k<depth; k++) {
+            int sum = 32768;
+            int n;
+
+            for (n=0; n<4; n++) {
+              int x = x0 + n%2;
+              int y = y0 + n/2;
+              SANE_Byte * row = n/2 ? row1 : row0;
+
+              if (x >= 0 && x < pwidth && y >= 0 && y < height)
+                sum += row[x*depth+k] * w[n];
+              else
+                sum += bg_color * w[n];
+            }
+
+            out[j*depth+k] = sum >> 16;
+          }
+        }
+      }
+    }
+
+    else{
+
+      for (j=0; j<pwidth; j++, vx -= slopeCos, vy -= slopeSin) {
         int sourceX, sourceY;
 
-        sourceX = centerX - (int)(shiftX * slopeCos + shiftY * slopeSin);
+        sourceX = centerX - (int)vx;
         if (sourceX < 0 || sourceX >= pwidth)
           continue;
 
-        sourceY = centerY + (int)(-shiftY * slopeCos + shiftX * slopeSin);
+        sourceY = centerY + (int)vy;
         if (sourceY < 0 || sourceY >= height)
           continue;
 
+        if (sourceY != lineY){
+          lineY = sourceY;
+          line = src + (sourceY % srcLines) * bwidth;
+        }
+
         for (k=0; k<depth; k++) {
-          outbuf[i*bwidth+j*depth+k]
-            = buffer[sourceY*bwidth+sourceX*depth+k];
+          out[j*depth+k] = line[sourceX*depth+k];
         }
       }
     }
   }
 
+  /* collect eight output bits, then store the whole byte */
   else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
 
+    int bg = bg_color ? 1 : 0;
+    unsigned char acc = 0;
+
     if(bg_color)
       bg_color = 0xff;
 
-    memset(outbuf,bg_color,bwidth*height);
+    memset(out,bg_color,bwidth);
 
-    for (i=0; i<height; i++) {
-      int shiftY = centerY - i;
+    for (j=0; j<pwidth; j++, vx -= slopeCos, vy -= slopeSin) {
+      int sourceX, sourceY;
+      int bit = bg;
 
-      for (j=0; j<pwidth; j++) {
-        int shiftX = centerX - j;
-        int sourceX, sourceY;
+      sourceX = centerX - (int)vx;
+      sourceY = centerY + (int)vy;
 
-        sourceX = centerX - (int)(shiftX * slopeCos + shiftY * slopeSin);
-        if (sourceX < 0 || sourceX >= pwidth)
-          continue;
+      if (sourceX >= 0 && sourceX < pwidth
+        && sourceY >= 0 && sourceY < height){
+
+        if (sourceY != lineY){
+          lineY = sourceY;
+          line = src + (sourceY % srcLines) * bwidth;
+        }
 
-        sourceY = centerY + (int)(-shiftY * slopeCos + shiftX * slopeSin);
-        if (sourceY < 0 || sourceY >= height)
-          continue;
+        bit = (line[sourceX/8] >> (7-(sourceX%8))) & 1;
+      }
 
-        /* wipe out old bit */
-        outbuf[i*bwidth + j/8] &= ~(1 << (7-(j%8)));
+      acc = (acc << 1) | bit;
 
-        /* fill in new bit */
-        outbuf[i*bwidth + j/8] |=
-          ((buffer[sourceY*bwidth + sourceX/8]
-          >> (7-(sourceX%8))) & 1) << (7-(j%8));
+      if ((j & 7) == 7){
+        out[j/8] = acc;
+        acc = 0;
       }
     }
+
+    /* partial last byte, padding stays bg color */
+    if (pwidth & 7){
+      k = pwidth & 7;
+      out[pwidth/8] = (acc << (8-k)) | (bg_color & (0xff >> k));
+    }
   }
   else{
-    DBG (5, "sanei_magic_rotate: unsupported format/depth\n");
-    ret = SANE_STATUS_INVAL;
-    goto cleanup;
+    return SANE_STATUS_INVAL;
   }
 
-  memcpy(buffer,outbuf,bwidth*height);
-
-  cleanup:
-
-  if(outbuf)
-    free(outbuf);
-
-  DBG(10,"sanei_magic_rotate: finish\n");
-
-  return ret;
+  return SANE_STATUS_GOOD;
 }
 
 SANE_Status
@@ -782,106 +1233,39 @@ sanei_magic_isBlank (SANE_Parameters * params, SANE_Byte * buffer,
 /* Divide the image into 1/2 inch squares, skipping a 1/4 inch
  * margin on all sides. If all squares are under the user's density,
  * signal our caller to skip the image entirely, by returning
- * SANE_STATUS_NO_DOCS */
+ * SANE_STATUS_NO_DOCS. The squares are summed a row at a time by
+ * the band code, so the answer is also available while scanning */
 SANE_Status
 sanei_magic_isBlank2 (SANE_Parameters * params, SANE_Byte * buffer,
   int dpiX, int dpiY, double thresh)
 {
-  int xb,yb,x,y;
-
-  /* .25 inch, rounded down to 8 pixel */
-  int xquarter = dpiX/4/8*8;
-  int yquarter = dpiY/4/8*8;
-  int xhalf    = xquarter*2;
-  int yhalf    = yquarter*2;
-  int blockpix = xhalf*yhalf;
-  int xblocks  = (params->pixels_per_line-xhalf)/xhalf;
-  int yblocks  = (params->lines-yhalf)/yhalf;
-
-  /*convert thresh from percent (0-100) to 0-1 range*/
-  thresh /= 100;
-
-  DBG (10, "sanei_magic_isBlank2: start %d %d %f %d\n",xhalf,yhalf,thresh,blockpix);
-
-  if(params->depth == 8 &&
-    (params->format == SANE_FRAME_RGB || params->format == SANE_FRAME_GRAY)
-  ){
-
-    int Bpp = params->format == SANE_FRAME_RGB ? 3 : 1;
-
-    for(yb=0; yb<yblocks; yb++){
-      for(xb=0; xb<xblocks; xb++){
-
-        /*count dark pix in this block*/
-        double blocksum = 0;
-
-        for(y=0; y<yhalf; y++){
-
-          /* skip the top and left 1/4 inch */
-          int offset = (yquarter + yb*yhalf + y) * params->bytes_per_line
-            + (xquarter + xb*xhalf) * Bpp;
-          SANE_Byte * ptr = buffer + offset;
-
-          /*count darkness of pix in this row*/
-          int rowsum = 0;
-
-          for(x=0; x<xhalf*Bpp; x++){
-            rowsum += 255 - ptr[x];
-          }
+  SANE_Status ret = SANE_STATUS_GOOD;
+  sanei_magic_band * band = NULL;
+  int done = 0;
 
-          blocksum += (double)rowsum/(xhalf*Bpp)/255;
-        }
+  DBG (10, "sanei_magic_isBlank2: start %f\n",thresh);
 
-        /* block was darker than thresh, keep image */
-        if(blocksum/yhalf > thresh){
-          DBG (15, "sanei_magic_isBlank2: not blank %f %d %d\n", blocksum/yhalf, yb, xb);
-          return SANE_STATUS_GOOD;
-        }
-        DBG (20, "sanei_magic_isBlank2: block blank %f %d %d\n", blocksum/yhalf, yb, xb);
-      }
-    }
+  ret = sanei_magic_bandStart(&band, params, dpiX, dpiY);
+  if(ret){
+    DBG (5, "sanei_magic_isBlank2: unsupported format/depth\n");
+    goto cleanup;
   }
-  else if(params->format == SANE_FRAME_GRAY && params->depth == 1){
-
-    for(yb=0; yb<yblocks; yb++){
-      for(xb=0; xb<xblocks; xb++){
-
-        /*count dark pix in this block*/
-        double blocksum = 0;
 
-        for(y=0; y<yhalf; y++){
-
-          /* skip the top and left 1/4 inch */
-          int offset = (yquarter + yb*yhalf + y) * params->bytes_per_line
-            + (xquarter + xb*xhalf) / 8;
-          SANE_Byte * ptr = buffer + offset;
-
-          /*count darkness of pix in this row*/
-          int rowsum = 0;
+  ret = sanei_magic_bandBlank(band, thresh);
+  if(ret)
+    goto cleanup;
 
-          for(x=0; x<xhalf; x++){
-            rowsum += ptr[x/8] >> (7-(x%8)) & 1;
-          }
+  ret = sanei_magic_bandProcess(band, buffer, params->lines, &done);
+  if(ret)
+    goto cleanup;
 
-          blocksum += (double)rowsum/xhalf;
-        }
+  ret = sanei_magic_bandIsBlank(band);
 
-        /* block was darker than thresh, keep image */
-        if(blocksum/yhalf > thresh){
-          DBG (15, "sanei_magic_isBlank2: not blank %f %d %d\n", blocksum/yhalf, yb, xb);
-          return SANE_STATUS_GOOD;
-        }
-        DBG (20, "sanei_magic_isBlank2: block blank %f %d %d\n", blocksum/yhalf, yb, xb);
-      }
-    }
-  }
-  else{
-    DBG (5, "sanei_magic_isBlank2: unsupported format/depth\n");
-    return SANE_STATUS_INVAL;
-  }
+  cleanup:
+  sanei_magic_bandFinish(band);
 
-  DBG (10, "sanei_magic_isBlank2: returning blank\n");
-  return SANE_STATUS_NO_DOCS;
+  DBG (10, "sanei_magic_isBlank2: finish %d\n",ret);
+  return ret;
 }
 
 SANE_Status
@@ -1258,6 +1642,483 @@ sanei_magic_turn(SANE_Parameters * params, SANE_Byte * buffer,
   return ret;
 }
 
+/* find the first and last source rows that output row i is built from */
+static void
+bandRotateRange (sanei_magic_band * band, int i, int * first, int * last)
+{
+  int pwidth = band->params.pixels_per_line;
+  double base = (i - band->centerY) * band->slopeCos;
+  double a = band->centerX * band->slopeSin;
+  double b = (band->centerX - pwidth + 1) * band->slopeSin;
+
+  /* one row of slack either way for rounding */
+  *first = band->centerY + (int)floor(base + (a < b ? a : b)) - 1;
+  *last = band->centerY + (int)ceil(base + (a > b ? a : b)) + 1;
+}
+
+/* size the ring for the rotation and allocate it */
+static SANE_Status
+bandRotateStart (sanei_magic_band * band)
+{
+  int height = band->params.lines;
+  int i;
+
+  double slopeRad = -atan(band->slope);
+  band->slopeSin = sin(slopeRad);
+  band->slopeCos = cos(slopeRad);
+
+  /* output row i is written once source row max(i,last) has arrived,
+   * and by then the ring must still hold source row first. Later
+   * output rows never need earlier source rows. */
+  band->ringLines = 1;
+  for(i=0; i<height; i++){
+    int first, last;
+
+    bandRotateRange(band, i, &first, &last);
+    if(last < i)
+      last = i;
+    if(last > height-1)
+      last = height-1;
+    if(first < 0)
+      first = 0;
+
+    if(last - first + 1 > band->ringLines)
+      band->ringLines = last - first + 1;
+  }
+  if(band->ringLines > height)
+    band->ringLines = height;
+
+  DBG (15, "bandRotateStart: %d %d %f ring %d\n",
+    band->centerX, band->centerY, band->slope, band->ringLines);
+
+  band->ring = malloc(band->ringLines * band->params.bytes_per_line);
+  if(!band->ring){
+    DBG (5, "bandRotateStart: no ring\n");
+    return SANE_STATUS_NO_MEM;
+  }
+
+  band->skew = BAND_SKEW_ROTATE;
+  return SANE_STATUS_GOOD;
+}
+
+/* find skew from the top edge in the rows received so far. The bottom
+ * edge is not available yet, so only the top edge is used */
+static SANE_Status
+bandFindSkew (sanei_magic_band * band, SANE_Byte * buffer)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  SANE_Parameters params = band->params;
+  int pwidth = params.pixels_per_line;
+  int * topBuf = NULL, * botBuf = NULL;
+  int i;
+
+  DBG (10, "bandFindSkew: start %d\n", band->lines);
+
+  params.lines = band->lines;
+  band->skew = BAND_SKEW_NONE;
+
+  topBuf = sanei_magic_getTransY(&params,band->dpiY,buffer,1);
+  if(!topBuf){
+    DBG (5, "bandFindSkew: can't gTY\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+
+  botBuf = malloc(pwidth * sizeof(int));
+  if(!botBuf){
+    DBG (5, "bandFindSkew: no botBuf\n");
+    ret = SANE_STATUS_NO_MEM;
+    goto cleanup;
+  }
+  for(i=0; i<pwidth; i++)
+    botBuf[i] = -1;
+
+  band->skewStatus = getSkew(pwidth, params.lines, band->dpiY,
+    topBuf, botBuf, &band->centerX, &band->centerY, &band->slope);
+
+  /* no skew found, pass the image through */
+  if(band->skewStatus){
+    DBG (5, "bandFindSkew: no skew found: %d\n", band->skewStatus);
+    goto cleanup;
+  }
+
+  ret = bandRotateStart(band);
+
+  cleanup:
+  if(topBuf)
+    free(topBuf);
+  if(botBuf)
+    free(botBuf);
+
+  DBG (10, "bandFindSkew: finish\n");
+  return ret;
+}
+
+/* copy the new source rows into the ring, and write every output
+ * row whose source rows have all arrived */
+static SANE_Status
+bandRotate (sanei_magic_band * band, SANE_Byte * buffer, int top)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  int bwidth = band->params.bytes_per_line;
+  int height = band->params.lines;
+
+  while(band->fed < band->lines){
+
+    memcpy(band->ring + (band->fed % band->ringLines) * bwidth,
+      buffer + (band->fed - top) * bwidth, bwidth);
+    band->fed++;
+
+    /* don't overwrite source rows that are not in the ring yet */
+    while(band->rotated < band->fed){
+      int first, last;
+
+      bandRotateRange(band, band->rotated, &first, &last);
+      if(last >= band->fed && band->fed < height)
+        break;
+
+      ret = rotateLine(&band->params, buffer + (band->rotated - top) * bwidth,
+        band->rotated, band->centerX, band->centerY,
+        band->slopeSin, band->slopeCos,
+        band->ring, band->ringLines, band->bg_color, band->bilinear);
+      if(ret)
+        return ret;
+
+      band->rotated++;
+    }
+  }
+
+  return ret;
+}
+
+/* blocks used by blank page detection */
+static void
+bandBlankBlocks (sanei_magic_band * band, int * xquarter, int * yquarter,
+  int * xhalf, int * yhalf, int * xblocks, int * yblocks)
+{
+  /* .25 inch, rounded down to 8 pixel */
+  *xquarter = band->dpiX/4/8*8;
+  *yquarter = band->dpiY/4/8*8;
+  *xhalf    = *xquarter*2;
+  *yhalf    = *yquarter*2;
+  *xblocks  = 0;
+  *yblocks  = 0;
+
+  if(*xhalf && *yhalf){
+    *xblocks  = (band->params.pixels_per_line - *xhalf) / *xhalf;
+    *yblocks  = (band->params.lines - *yhalf) / *yhalf;
+  }
+}
+
+/* add the darkness of finished rows to their blocks, and check
+ * each row of blocks once it is complete */
+static void
+bandBlankRows (sanei_magic_band * band, SANE_Byte * buffer, int first,
+  int last)
+{
+  SANE_Parameters * params = &band->params;
+  int xquarter, yquarter, xhalf, yhalf, xblocks, yblocks;
+  int binary = (params->format == SANE_FRAME_GRAY && params->depth == 1);
+  int Bpp = params->format == SANE_FRAME_RGB ? 3 : 1;
+  double norm;
+  int y, xb, x;
+
+  bandBlankBlocks(band, &xquarter, &yquarter, &xhalf, &yhalf,
+    &xblocks, &yblocks);
+
+  /* darkness of a completely black block */
+  if(binary)
+    norm = (double)xhalf * yhalf;
+  else
+    norm = (double)xhalf * Bpp * 255 * yhalf;
+
+  for(y=band->blanked; y<last && !band->blankDark; y++){
+
+    /* skip the top 1/4 inch */
+    int yy = y - yquarter;
+    SANE_Byte * row = buffer + (y - first) * params->bytes_per_line;
+
+    if(yy < 0 || yy >= yblocks*yhalf)
+      continue;
+
+    for(xb=0; xb<xblocks; xb++){
+      long rowsum = 0;
+
+      /* skip the left 1/4 inch */
+      if(binary){
+        SANE_Byte * ptr = row + (xquarter + xb*xhalf) / 8;
+
+        for(x=0; x<xhalf/8; x++){
+          unsigned int b = ptr[x];
+          for(; b; b &= b-1)
+            rowsum++;
+        }
+      }
+      else{
+        SANE_Byte * ptr = row + (xquarter + xb*xhalf) * Bpp;
+
+        for(x=0; x<xhalf*Bpp; x++){
+          rowsum += 255 - ptr[x];
+        }
+      }
+
+      band->blankSums[xb] += rowsum;
+    }
+
+    if(yy % yhalf != yhalf-1)
+      continue;
+
+    for(xb=0; xb<xblocks; xb++){
+
+      /* block was darker than thresh, keep image */
+      if(band->blankSums[xb] / norm > band->blankThresh){
+        DBG (15, "bandBlankRows: not blank %f %d %d\n",
+          band->blankSums[xb] / norm, yy/yhalf, xb);
+        band->blankDark = 1;
+        break;
+      }
+      DBG (20, "bandBlankRows: block blank %f %d %d\n",
+        band->blankSums[xb] / norm, yy/yhalf, xb);
+
+      band->blankSums[xb] = 0;
+    }
+  }
+
+  band->blanked = last;
+}
+
+SANE_Status
+sanei_magic_bandStart (sanei_magic_band ** band, SANE_Parameters * params,
+  int dpiX, int dpiY)
+{
+  DBG (10, "sanei_magic_bandStart: start\n");
+
+  *band = NULL;
+
+  if(!(params->format == SANE_FRAME_RGB && params->depth == 8)
+    && !(params->format == SANE_FRAME_GRAY
+      && (params->depth == 8 || params->depth == 1))
+  ){
+    DBG (5, "sanei_magic_bandStart: unsupported format/depth\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  *band = calloc(1, sizeof(sanei_magic_band));
+  if(!*band){
+    DBG (5, "sanei_magic_bandStart: no band\n");
+    return SANE_STATUS_NO_MEM;
+  }
+
+  (*band)->params = *params;
+  (*band)->dpiX = dpiX;
+  (*band)->dpiY = dpiY;
+  (*band)->skewStatus = SANE_STATUS_UNSUPPORTED;
+  (*band)->despecked = 1;
+
+  DBG (10, "sanei_magic_bandStart: finish\n");
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_magic_bandDeskew (sanei_magic_band * band, int bg_color)
+{
+  if(band->lines){
+    DBG (5, "sanei_magic_bandDeskew: already started\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  band->skew = BAND_SKEW_FIND;
+  band->bg_color = bg_color;
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_magic_bandRotate (sanei_magic_band * band,
+  int centerX, int centerY, double slope, int bg_color)
+{
+  if(band->lines){
+    DBG (5, "sanei_magic_bandRotate: already started\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  band->skewStatus = SANE_STATUS_GOOD;
+  band->centerX = centerX;
+  band->centerY = centerY;
+  band->slope = slope;
+  band->bg_color = bg_color;
+
+  return bandRotateStart(band);
+}
+
+SANE_Status
+sanei_magic_bandDespeck (sanei_magic_band * band, SANE_Int diam)
+{
+  if(band->lines){
+    DBG (5, "sanei_magic_bandDespeck: already started\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  band->diam = diam;
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_magic_bandBlank (sanei_magic_band * band, double thresh)
+{
+  int xquarter, yquarter, xhalf, yhalf, xblocks, yblocks;
+
+  if(band->lines){
+    DBG (5, "sanei_magic_bandBlank: already started\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  bandBlankBlocks(band, &xquarter, &yquarter, &xhalf, &yhalf,
+    &xblocks, &yblocks);
+
+  band->blankSums = calloc(xblocks+1, sizeof(long));
+  if(!band->blankSums){
+    DBG (5, "sanei_magic_bandBlank: no sums\n");
+    return SANE_STATUS_NO_MEM;
+  }
+
+  /*convert thresh from percent (0-100) to 0-1 range*/
+  band->blankThresh = thresh / 100;
+  band->blank = 1;
+
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_magic_bandIsBlank (sanei_magic_band * band)
+{
+  if(!band->blank || band->blanked < band->params.lines){
+    DBG (5, "sanei_magic_bandIsBlank: not done\n");
+    return SANE_STATUS_INVAL;
+  }
+
+  if(band->blankDark)
+    return SANE_STATUS_GOOD;
+
+  DBG (10, "sanei_magic_bandIsBlank: blank\n");
+  return SANE_STATUS_NO_DOCS;
+}
+
+SANE_Status
+sanei_magic_bandProcess (sanei_magic_band * band, SANE_Byte * buffer,
+  int lines, int * done)
+{
+  return sanei_magic_bandProcessRows(band, buffer, 0, lines, done);
+}
+
+SANE_Status
+sanei_magic_bandProcessRows (sanei_magic_band * band, SANE_Byte * buffer,
+  int first, int lines, int * done)
+{
+  SANE_Status ret = SANE_STATUS_GOOD;
+  int height = band->params.lines;
+  int bwidth = band->params.bytes_per_line;
+  int diam = band->diam;
+  int rotated;
+
+  DBG (10, "sanei_magic_bandProcess: start %d %d\n", first, lines);
+
+  *done = 0;
+
+  if(lines < band->lines || lines > height){
+    DBG (5, "sanei_magic_bandProcess: bad line count %d\n", lines);
+    return SANE_STATUS_INVAL;
+  }
+
+  /* despeck reads the row above the finished ones */
+  if(first < 0 || first > lines || (first && first > band->done - 1)){
+    DBG (5, "sanei_magic_bandProcess: bad first line %d\n", first);
+    return SANE_STATUS_INVAL;
+  }
+  band->lines = lines;
+
+  /* wait for enough of the top edge to find the skew */
+  if(band->skew == BAND_SKEW_FIND){
+    if(lines < height && lines < band->dpiY * BAND_SKEW_INCHES){
+      DBG (10, "sanei_magic_bandProcess: finish, need skew\n");
+      return SANE_STATUS_GOOD;
+    }
+
+    ret = bandFindSkew(band, buffer);
+    if(ret){
+      DBG (5, "sanei_magic_bandProcess: find skew error: %d\n", ret);
+      return ret;
+    }
+  }
+
+  rotated = lines;
+  if(band->skew == BAND_SKEW_ROTATE){
+    ret = bandRotate(band, buffer, first);
+    if(ret){
+      DBG (5, "sanei_magic_bandProcess: rotate error: %d\n", ret);
+      return ret;
+    }
+    rotated = band->rotated;
+  }
+
+  /* a despeck window reads diam rows below its top row */
+  if(diam){
+    int last = rotated - diam;
+
+    if(rotated == height || last > height-1-diam)
+      last = height-1-diam;
+
+    /* rows are counted from the one above the next window */
+    if(band->despecked < last){
+      ret = despeckRows(&band->params,
+        buffer + (band->despecked - 1 - first) * bwidth, diam,
+        1, last - band->despecked + 1);
+      if(ret){
+        DBG (5, "sanei_magic_bandProcess: despeck error: %d\n", ret);
+        return ret;
+      }
+      band->despecked = last;
+    }
+
+    /* rows above the next window will not be changed again */
+    if(rotated < height && band->despecked < rotated)
+      rotated = band->despecked;
+  }
+
+  if(band->blank)
+    bandBlankRows(band, buffer, first, rotated);
+
+  band->done = rotated;
+  *done = rotated;
+
+  DBG (10, "sanei_magic_bandProcess: finish %d\n", *done);
+  return ret;
+}
+
+SANE_Status
+sanei_magic_bandGetSkew (sanei_magic_band * band,
+  int * centerX, int * centerY, double * slope)
+{
+  if(band->skewStatus == SANE_STATUS_GOOD){
+    *centerX = band->centerX;
+    *centerY = band->centerY;
+    *slope = band->slope;
+  }
+  return band->skewStatus;
+}
+
+void
+sanei_magic_bandFinish (sanei_magic_band * band)
+{
+  if(!band)
+    return;
+
+  if(band->ring)
+    free(band->ring);
+  if(band->blankSums)
+    free(band->blankSums);
+  free(band);
+}
+
 /* Utility functions, not used outside this file */
 
 /* Repeatedly call getLine to find the best range of slope and offset.
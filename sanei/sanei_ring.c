@@ -0,0 +1,538 @@
+/* sane - Scanner Access Now Easy.
+   Copyright (C) 2026 Sane Developers.
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+
+   Shared memory ring buffer between a reader task and sane_read().
+
+   The reader task is the only one to move head, sane_read() the only
+   one to move tail. Each side waits for the other on a pipe, the
+   "doorbell", which is only rung if the other side said it is waiting.
+   The doorbell of the reading side is also its select fd, so it is kept
+   readable as long as there is data left in the ring.  */
+
+#include "../include/sane/config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <sys/types.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#define BACKEND_NAME sanei_ring
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei_debug.h"
+#include "../include/sane/sanei_thread.h"
+#include "../include/sane/sanei_ring.h"
+
+/* both sides must see each other's stores in order, even from
+ * different processes */
+#if defined(__ATOMIC_SEQ_CST)
+#define RING_LOAD(x)		__atomic_load_n (&(x), __ATOMIC_SEQ_CST)
+#define RING_STORE(x, v)	__atomic_store_n (&(x), (v), __ATOMIC_SEQ_CST)
+#elif defined(__GNUC__)
+#define RING_LOAD(x)		(__sync_synchronize (), *(volatile __typeof__ (x) *) &(x))
+#define RING_STORE(x, v)	do { __sync_synchronize (); \
+    *(volatile __typeof__ (x) *) &(x) = (v); __sync_synchronize (); } while (0)
+#else
+#define RING_LOAD(x)		(x)
+#define RING_STORE(x, v)	((x) = (v))
+#endif
+
+/* state shared by both tasks, followed by the data */
+struct ring_shared
+{
+  /* written by the reader task */
+  size_t head;			/* bytes written */
+  int write_waiting;		/* waiting for free space */
+  int done;			/* image ended with status */
+  int status;
+  char pad[64];
+
+  /* written by sane_read() */
+  size_t tail;			/* bytes read */
+  int read_waiting;		/* waiting for data */
+  int cancelled;
+};
+
+struct sanei_ring
+{
+  struct ring_shared *shared;
+  SANE_Byte *data;
+  size_t size;			/* power of two */
+  size_t map_size;		/* 0 if not mmap()ed */
+
+  int data_fds[2];		/* doorbell of sane_read() and select fd */
+  int space_fds[2];		/* doorbell of the reader task */
+  int alive_fds[2];		/* closed when a reader process exits */
+
+  SANE_Bool non_blocking;
+  SANE_Bool drained;		/* sane_read() emptied its doorbell */
+
+  int (*func) (void *args);
+  void *args;
+};
+
+static int
+ring_pipe (int fds[2])
+{
+  if (pipe (fds) < 0)
+    {
+      fds[0] = fds[1] = -1;
+      return -1;
+    }
+  fcntl (fds[0], F_SETFL, O_NONBLOCK);
+  fcntl (fds[1], F_SETFL, O_NONBLOCK);
+  return 0;
+}
+
+static void
+ring_close (int *fd)
+{
+  if (*fd >= 0)
+    close (*fd);
+  *fd = -1;
+}
+
+/* tell the other side to look, a full pipe is readable anyway */
+static void
+ring_bell (int fd)
+{
+  char c = 0;
+  ssize_t ret;
+
+  do
+    ret = write (fd, &c, 1);
+  while (ret < 0 && errno == EINTR);
+}
+
+/* empty a doorbell, returns SANE_FALSE if no one can ring it anymore */
+static SANE_Bool
+ring_drain (int fd)
+{
+  char buf[64];
+  ssize_t ret;
+
+  do
+    ret = read (fd, buf, sizeof (buf));
+  while (ret > 0 || (ret < 0 && errno == EINTR));
+
+  return ret != 0;
+}
+
+/* wait until fd or other, if >= 0, is readable */
+static void
+ring_wait (int fd, int other)
+{
+  fd_set set;
+
+  do
+    {
+      FD_ZERO (&set);
+      FD_SET (fd, &set);
+      if (other >= 0)
+	FD_SET (other, &set);
+    }
+  while (select ((fd > other ? fd : other) + 1, &set, NULL, NULL, NULL) < 0
+	 && errno == EINTR);
+}
+
+SANE_Status
+sanei_ring_create (SANEI_Ring ** ringp, size_t size)
+{
+  SANEI_Ring *ring;
+  size_t want = size ? size : SANEI_RING_DEFAULT_SIZE;
+  void *mem;
+
+  DBG_INIT ();
+  DBG (4, "%s: size %lu\n", __func__, (unsigned long) want);
+
+  *ringp = NULL;
+
+  ring = calloc (1, sizeof (*ring));
+  if (!ring)
+    return SANE_STATUS_NO_MEM;
+
+  ring->data_fds[0] = ring->data_fds[1] = -1;
+  ring->space_fds[0] = ring->space_fds[1] = -1;
+  ring->alive_fds[0] = ring->alive_fds[1] = -1;
+
+  for (ring->size = 4096; ring->size < want; ring->size *= 2)
+    ;
+
+  /* a reader process needs the ring in memory shared with its parent */
+  if (sanei_thread_is_forked ())
+    {
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+      ring->map_size = sizeof (struct ring_shared) + ring->size;
+      mem = mmap (NULL, ring->map_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if (mem == MAP_FAILED)
+	{
+	  DBG (1, "%s: mmap failed: %s\n", __func__, strerror (errno));
+	  free (ring);
+	  return SANE_STATUS_NO_MEM;
+	}
+      memset (mem, 0, sizeof (struct ring_shared));
+#else
+      DBG (1, "%s: can't share memory with a reader process\n", __func__);
+      free (ring);
+      return SANE_STATUS_UNSUPPORTED;
+#endif
+    }
+  else
+    {
+      mem = calloc (1, sizeof (struct ring_shared) + ring->size);
+      if (!mem)
+	{
+	  free (ring);
+	  return SANE_STATUS_NO_MEM;
+	}
+    }
+
+  ring->shared = mem;
+  ring->data = (SANE_Byte *) mem + sizeof (struct ring_shared);
+
+  /* the doorbell is empty, the frontend may select() before reading */
+  ring->shared->read_waiting = 1;
+  ring->drained = SANE_TRUE;
+
+  if (ring_pipe (ring->data_fds) < 0 || ring_pipe (ring->space_fds) < 0)
+    {
+      DBG (1, "%s: pipe failed: %s\n", __func__, strerror (errno));
+      sanei_ring_free (ring);
+      return SANE_STATUS_NO_MEM;
+    }
+
+  *ringp = ring;
+  return SANE_STATUS_GOOD;
+}
+
+void
+sanei_ring_free (SANEI_Ring * ring)
+{
+  if (!ring)
+    return;
+
+  DBG (4, "%s\n", __func__);
+
+  ring_close (&ring->data_fds[0]);
+  ring_close (&ring->data_fds[1]);
+  ring_close (&ring->space_fds[0]);
+  ring_close (&ring->space_fds[1]);
+  ring_close (&ring->alive_fds[0]);
+  ring_close (&ring->alive_fds[1]);
+
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+  if (ring->map_size)
+    munmap (ring->shared, ring->map_size);
+  else
+#endif
+    free (ring->shared);
+
+  free (ring);
+}
+
+/* runs the reader task, and ends the image if it didn't */
+static int
+ring_task (void *args)
+{
+  SANEI_Ring *ring = args;
+  int status;
+
+  if (sanei_thread_is_forked ())
+    {
+      /* notice when the parent goes away */
+      ring_close (&ring->alive_fds[0]);
+      ring_close (&ring->space_fds[1]);
+    }
+
+  status = ring->func (ring->args);
+
+  if (!RING_LOAD (ring->shared->done))
+    {
+      if (status == SANE_STATUS_GOOD)
+	sanei_ring_write_done (ring, SANE_STATUS_EOF);
+      else if (status > 0 && status <= SANE_STATUS_ACCESS_DENIED)
+	sanei_ring_write_done (ring, status);
+      else
+	sanei_ring_write_done (ring, SANE_STATUS_IO_ERROR);
+    }
+
+  return status;
+}
+
+SANE_Pid
+sanei_ring_begin (SANEI_Ring * ring, int (*func) (void *args), void *args)
+{
+  SANE_Pid pid;
+
+  ring->func = func;
+  ring->args = args;
+
+  if (sanei_thread_is_forked () && pipe (ring->alive_fds) < 0)
+    ring->alive_fds[0] = ring->alive_fds[1] = -1;
+
+  pid = sanei_thread_begin (ring_task, ring);
+
+  if (ring->alive_fds[0] >= 0)
+    {
+      fcntl (ring->alive_fds[0], F_SETFL, O_NONBLOCK);
+      ring_close (&ring->alive_fds[1]);
+    }
+
+  return pid;
+}
+
+/* wait for free space in the ring */
+static SANE_Status
+ring_wait_space (SANEI_Ring * ring, size_t * space)
+{
+  struct ring_shared *shared = ring->shared;
+
+  for (;;)
+    {
+      if (RING_LOAD (shared->cancelled))
+	return SANE_STATUS_CANCELLED;
+
+      *space = ring->size - (shared->head - RING_LOAD (shared->tail));
+      if (*space)
+	return SANE_STATUS_GOOD;
+
+      /* look again after saying we are waiting, in case sane_read()
+       * made space before it could see that */
+      RING_STORE (shared->write_waiting, 1);
+      if (!ring_drain (ring->space_fds[0]))
+	{
+	  DBG (1, "%s: reading side went away\n", __func__);
+	  return SANE_STATUS_IO_ERROR;
+	}
+      if (RING_LOAD (shared->cancelled)
+	  || shared->head != RING_LOAD (shared->tail) + ring->size)
+	continue;
+
+      ring_wait (ring->space_fds[0], -1);
+    }
+}
+
+SANE_Status
+sanei_ring_get_space (SANEI_Ring * ring, SANE_Byte ** data, size_t * len)
+{
+  size_t pos = ring->shared->head & (ring->size - 1);
+  SANE_Status status;
+
+  status = ring_wait_space (ring, len);
+  if (status != SANE_STATUS_GOOD)
+    return status;
+
+  if (*len > ring->size - pos)
+    *len = ring->size - pos;
+  *data = ring->data + pos;
+
+  return SANE_STATUS_GOOD;
+}
+
+void
+sanei_ring_commit (SANEI_Ring * ring, size_t len)
+{
+  struct ring_shared *shared = ring->shared;
+
+  RING_STORE (shared->head, shared->head + len);
+
+  if (RING_LOAD (shared->read_waiting))
+    {
+      RING_STORE (shared->read_waiting, 0);
+      ring_bell (ring->data_fds[1]);
+    }
+}
+
+SANE_Status
+sanei_ring_write (SANEI_Ring * ring, const SANE_Byte * data, size_t len)
+{
+  SANE_Status status;
+  SANE_Byte *dest;
+  size_t count;
+
+  while (len > 0)
+    {
+      status = sanei_ring_get_space (ring, &dest, &count);
+      if (status != SANE_STATUS_GOOD)
+	return status;
+
+      if (count > len)
+	count = len;
+      memcpy (dest, data, count);
+      sanei_ring_commit (ring, count);
+
+      data += count;
+      len -= count;
+    }
+
+  return SANE_STATUS_GOOD;
+}
+
+void
+sanei_ring_write_done (SANEI_Ring * ring, SANE_Status status)
+{
+  DBG (4, "%s: status %d\n", __func__, status);
+
+  ring->shared->status = status;
+  RING_STORE (ring->shared->done, 1);
+  ring_bell (ring->data_fds[1]);
+}
+
+/* a reader process exited, without ending the image perhaps */
+static SANE_Bool
+ring_writer_gone (SANEI_Ring * ring)
+{
+  char c;
+
+  return ring->alive_fds[0] >= 0 && read (ring->alive_fds[0], &c, 1) == 0;
+}
+
+SANE_Status
+sanei_ring_read (SANEI_Ring * ring, SANE_Byte * data, SANE_Int max_len,
+		 SANE_Int * len)
+{
+  struct ring_shared *shared = ring->shared;
+  size_t avail, pos, count;
+  int done;
+
+  *len = 0;
+
+  for (;;)
+    {
+      done = RING_LOAD (shared->done);
+      avail = RING_LOAD (shared->head) - shared->tail;
+      if (avail || done)
+	break;
+
+      /* look again after saying we are waiting, in case the reader
+       * task wrote before it could see that */
+      RING_STORE (shared->read_waiting, 1);
+      ring_drain (ring->data_fds[0]);
+      ring->drained = SANE_TRUE;
+      if (RING_LOAD (shared->done) || RING_LOAD (shared->head) != shared->tail)
+	continue;
+
+      if (ring_writer_gone (ring))
+	{
+	  /* it may have ended the image just before */
+	  if (RING_LOAD (shared->done)
+	      || RING_LOAD (shared->head) != shared->tail)
+	    continue;
+	  DBG (1, "%s: reader process went away\n", __func__);
+	  return SANE_STATUS_IO_ERROR;
+	}
+
+      if (ring->non_blocking)
+	return SANE_STATUS_GOOD;
+
+      ring_wait (ring->data_fds[0], ring->alive_fds[0]);
+    }
+
+  if (!avail)
+    {
+      DBG (4, "%s: done, status %d\n", __func__, shared->status);
+      return shared->status;
+    }
+
+  if (avail > (size_t) max_len)
+    avail = max_len;
+
+  pos = shared->tail & (ring->size - 1);
+  count = ring->size - pos;
+  if (count > avail)
+    count = avail;
+  memcpy (data, ring->data + pos, count);
+  memcpy (data + count, ring->data, avail - count);
+  *len = avail;
+
+  RING_STORE (shared->tail, shared->tail + avail);
+
+  if (RING_LOAD (shared->write_waiting))
+    {
+      RING_STORE (shared->write_waiting, 0);
+      ring_bell (ring->space_fds[1]);
+    }
+
+  /* keep the select fd readable while data or the end is left */
+  if (ring->drained
+      && (RING_LOAD (shared->head) != shared->tail || RING_LOAD (shared->done)))
+    {
+      ring->drained = SANE_FALSE;
+      ring_bell (ring->data_fds[1]);
+    }
+
+  return SANE_STATUS_GOOD;
+}
+
+void
+sanei_ring_set_io_mode (SANEI_Ring * ring, SANE_Bool non_blocking)
+{
+  ring->non_blocking = non_blocking;
+}
+
+SANE_Int
+sanei_ring_get_select_fd (SANEI_Ring * ring)
+{
+  return ring->data_fds[0];
+}
+
+void
+sanei_ring_cancel (SANEI_Ring * ring)
+{
+  DBG (4, "%s\n", __func__);
+
+  RING_STORE (ring->shared->cancelled, 1);
+  ring_bell (ring->space_fds[1]);
+}
@@ -50,6 +50,7 @@
 # include <stdint.h>
 #endif
 #include <stdlib.h>
+#include <limits.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -63,15 +64,25 @@
 #include <stdio.h>
 #include <dirent.h>
 #include <time.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 
 #if WITH_USB_RECORD_REPLAY
 #include <libxml/tree.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #endif
 
 #ifdef HAVE_RESMGR
 #include <resmgr.h>
 #endif
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #ifdef HAVE_LIBUSB_LEGACY
 #ifdef HAVE_LUSB0_USB_H
 #include <lusb0_usb.h>
@@ -133,6 +144,18 @@ typedef enum
 }
 sanei_usb_access_method_type;
 
+/* a bulk read queued with sanei_usb_submit_bulk_reads() */
+typedef struct
+{
+  size_t size;
+  unsigned long long start_usec;
+#ifdef HAVE_LIBUSB
+  struct libusb_transfer *transfer;
+  int completed;
+#endif /* HAVE_LIBUSB */
+}
+sanei_usb_async_read;
+
 typedef struct
 {
   SANE_Bool open;
@@ -160,6 +183,11 @@ typedef struct
   libusb_device *lu_device;
   libusb_device_handle *lu_handle;
 #endif /* HAVE_LIBUSB */
+  struct sanei_usb_stats stats;
+  /* ring of SANEI_USB_MAX_ASYNC_READS queued bulk reads */
+  sanei_usb_async_read *async_reads;
+  int async_first;
+  int async_count;
 }
 device_list_type;
 
@@ -206,6 +234,141 @@ static xmlNode* testing_append_commands_node = NULL;
 static SANE_String testing_xml_path = NULL;
 static xmlDoc* testing_xml_doc = NULL;
 static xmlNode* testing_xml_next_tx_node = NULL;
+
+// Compiled replay log (see sanei_usb_testing_compile_replay_log). When
+// testing_log_header is not NULL, the replay functions read transactions from
+// the log instead of the XML document.
+#define SANEI_USB_REPLAY_LOG_MAGIC "SANEUSBL"
+#define SANEI_USB_REPLAY_LOG_VERSION 1
+#define SANEI_USB_REPLAY_LOG_BYTE_ORDER 0x01020304
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t vendor;
+  uint32_t product;
+  uint32_t endpoint_count;
+  uint32_t tx_count;
+  uint64_t endpoints_offset;
+  uint64_t tx_offset;
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint64_t backend_offset; // relative to data_offset, NUL-terminated
+}
+sanei_usb_replay_log_header;
+
+// An entry with transfer_type < 0 starts a new interface
+typedef struct
+{
+  int32_t interface_nr;
+  int32_t transfer_type;
+  int32_t address;
+  int32_t direction_is_in;
+}
+sanei_usb_replay_log_endpoint;
+
+typedef enum
+{
+  sanei_usb_replay_log_tx_control = 0,
+  sanei_usb_replay_log_tx_bulk,
+  sanei_usb_replay_log_tx_interrupt,
+  sanei_usb_replay_log_tx_get_descriptor,
+  sanei_usb_replay_log_tx_debug,
+  sanei_usb_replay_log_tx_known_commands_end,
+}
+sanei_usb_replay_log_tx_type;
+
+#define SANEI_USB_REPLAY_LOG_FLAG_IN          0x01
+#define SANEI_USB_REPLAY_LOG_FLAG_TIMEOUT     0x02
+#define SANEI_USB_REPLAY_LOG_FLAG_DEBUG_BREAK 0x04
+
+typedef struct
+{
+  uint64_t data_offset; // relative to data_offset of the header
+  uint32_t data_size;
+  uint32_t seq;
+  uint8_t type;
+  uint8_t flags;
+  uint8_t endpoint_number;
+  uint8_t bm_request_type;
+  uint16_t b_request;
+  uint16_t w_value;
+  uint16_t w_index;
+  uint16_t w_length;
+  uint16_t reserved[2];
+}
+sanei_usb_replay_log_tx;
+
+static void* testing_log_map = NULL;
+static size_t testing_log_map_size = 0;
+static int testing_log_is_mmapped = 0;
+static const sanei_usb_replay_log_header* testing_log_header = NULL;
+static const sanei_usb_replay_log_endpoint* testing_log_endpoints = NULL;
+static const sanei_usb_replay_log_tx* testing_log_tx = NULL;
+static const char* testing_log_data = NULL;
+static uint32_t testing_log_next_tx = 0;
+
+// Streaming recorder (see sanei_usb_testing_enable_stream_record). The stream
+// consists of a header, the backend name and a sequence of records, each
+// followed by data_size bytes of payload.
+#define SANEI_USB_STREAM_MAGIC "SANEUSBS"
+#define SANEI_USB_STREAM_VERSION 1
+#define SANEI_USB_STREAM_BUFFER_SIZE (1024 * 1024)
+
+// record types in addition to sanei_usb_replay_log_tx_type
+#define SANEI_USB_STREAM_RECORD_DESCRIPTION 0xfe
+#define SANEI_USB_STREAM_RECORD_CLEAR 0xff
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t backend_size;
+  uint32_t reserved;
+}
+sanei_usb_stream_header;
+
+typedef struct
+{
+  uint64_t time_usec;
+  uint32_t data_size;
+  uint32_t seq;
+  uint8_t type;
+  uint8_t flags; // SANEI_USB_REPLAY_LOG_FLAG_*
+  uint8_t endpoint_number;
+  uint8_t bm_request_type;
+  uint16_t b_request;
+  uint16_t w_value;
+  uint16_t w_index;
+  uint16_t w_length;
+  uint32_t wanted_size; // requested size of reads
+}
+sanei_usb_stream_record;
+
+// payload of SANEI_USB_STREAM_RECORD_DESCRIPTION
+typedef struct
+{
+  int32_t vendor;
+  int32_t product;
+  int32_t interface_nr;
+  int32_t bulk_in_ep;
+  int32_t bulk_out_ep;
+  int32_t iso_in_ep;
+  int32_t iso_out_ep;
+  int32_t int_in_ep;
+  int32_t int_out_ep;
+  int32_t control_in_ep;
+  int32_t control_out_ep;
+}
+sanei_usb_stream_description;
+
+static int testing_record_streaming = 0;
+static FILE* testing_record_stream = NULL;
+static char* testing_record_stream_buffer = NULL;
+static struct timeval testing_record_stream_start;
 #endif // WITH_USB_RECORD_REPLAY
 
 #if defined(HAVE_LIBUSB_LEGACY) || defined(HAVE_LIBUSB)
@@ -214,8 +377,162 @@ static int libusb_timeout = 30 * 1000;	/* 30 seconds */
 
 #ifdef HAVE_LIBUSB
 static libusb_context *sanei_usb_ctx;
+
+#if LIBUSB_API_VERSION >= 0x01000102
+#define SANEI_USB_HOTPLUG
+#endif
 #endif /* HAVE_LIBUSB */
 
+#ifdef SANEI_USB_HOTPLUG
+static char *sanei_libusb_strerror (int errcode);
+
+/**
+ * maximum number of hotplug events kept between two device scans, more
+ * events trigger a full rescan */
+#define MAX_HOTPLUG_EVENTS 64
+
+typedef struct
+{
+  libusb_device *device;	/* referenced, only for arrivals */
+  libusb_hotplug_event event;
+  int bus;
+  int address;
+}
+sanei_usb_hotplug_event;
+
+/* whether the device list is kept current through hotplug events */
+static int hotplug_enabled = 0;
+/* whether the device list has been filled by a full scan */
+static int hotplug_scanned = 0;
+static int hotplug_overflow = 0;
+static libusb_hotplug_callback_handle hotplug_handle;
+static sanei_usb_hotplug_event hotplug_events[MAX_HOTPLUG_EVENTS];
+static int hotplug_event_count = 0;
+
+/* the callback runs in whichever thread handles libusb events, e.g. a
+   reader thread in sanei_usb_async_wait() */
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t hotplug_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define HOTPLUG_LOCK() pthread_mutex_lock (&hotplug_mutex)
+#define HOTPLUG_UNLOCK() pthread_mutex_unlock (&hotplug_mutex)
+#else
+#define HOTPLUG_LOCK()
+#define HOTPLUG_UNLOCK()
+#endif
+
+static void
+sanei_usb_hotplug_queue (libusb_device * dev, libusb_hotplug_event event,
+			 int bus, int address)
+{
+  HOTPLUG_LOCK ();
+  if (hotplug_event_count < MAX_HOTPLUG_EVENTS)
+    {
+      hotplug_events[hotplug_event_count].device = dev;
+      hotplug_events[hotplug_event_count].event = event;
+      hotplug_events[hotplug_event_count].bus = bus;
+      hotplug_events[hotplug_event_count].address = address;
+      hotplug_event_count++;
+      dev = NULL;
+    }
+  else
+    hotplug_overflow = 1;
+  HOTPLUG_UNLOCK ();
+
+  if (dev)
+    libusb_unref_device (dev);
+}
+
+/* takes the queued events, returns their number and whether some were
+   lost */
+static int
+sanei_usb_hotplug_take (sanei_usb_hotplug_event * events, int *overflow)
+{
+  int count;
+
+  HOTPLUG_LOCK ();
+  count = hotplug_event_count;
+  memcpy (events, hotplug_events, count * sizeof (events[0]));
+  *overflow = hotplug_overflow;
+  hotplug_event_count = 0;
+  hotplug_overflow = 0;
+  HOTPLUG_UNLOCK ();
+
+  return count;
+}
+
+/* Hotplug callbacks must not do synchronous I/O, so the events are queued
+   and handled by the next sanei_usb_scan_devices() */
+static int LIBUSB_CALL
+sanei_usb_hotplug_callback (libusb_context * ctx, libusb_device * dev,
+			    libusb_hotplug_event event, void *user_data)
+{
+  (void) ctx;
+  (void) user_data;
+
+  sanei_usb_hotplug_queue (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+			   ? libusb_ref_device (dev) : NULL, event,
+			   libusb_get_bus_number (dev),
+			   libusb_get_device_address (dev));
+  return 0;
+}
+
+static void
+sanei_usb_hotplug_init (void)
+{
+  char *env;
+  int ret;
+
+  env = getenv ("SANE_USB_HOTPLUG");
+  if (!env || !atoi (env))
+    return;
+
+  if (!libusb_has_capability (LIBUSB_CAP_HAS_HOTPLUG))
+    {
+      DBG (1, "%s: libusb-1.0 has no hotplug support on this platform\n",
+	   __func__);
+      return;
+    }
+
+  ret = libusb_hotplug_register_callback (sanei_usb_ctx,
+					  LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+					  | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+					  LIBUSB_HOTPLUG_NO_FLAGS,
+					  LIBUSB_HOTPLUG_MATCH_ANY,
+					  LIBUSB_HOTPLUG_MATCH_ANY,
+					  LIBUSB_HOTPLUG_MATCH_ANY,
+					  sanei_usb_hotplug_callback, NULL,
+					  &hotplug_handle);
+  if (ret < 0)
+    {
+      DBG (1, "%s: failed to register hotplug callback: %s\n", __func__,
+	   sanei_libusb_strerror (ret));
+      return;
+    }
+
+  DBG (4, "%s: keeping the device list current through hotplug events\n",
+       __func__);
+  hotplug_enabled = 1;
+  hotplug_scanned = 0;
+}
+
+static void
+sanei_usb_hotplug_exit (void)
+{
+  sanei_usb_hotplug_event events[MAX_HOTPLUG_EVENTS];
+  int i, count, overflow;
+
+  if (!hotplug_enabled)
+    return;
+
+  libusb_hotplug_deregister_callback (sanei_usb_ctx, hotplug_handle);
+  count = sanei_usb_hotplug_take (events, &overflow);
+  for (i = 0; i < count; i++)
+    if (events[i].device)
+      libusb_unref_device (events[i].device);
+  hotplug_enabled = 0;
+}
+#endif /* SANEI_USB_HOTPLUG */
+
 #if defined (__APPLE__)
 /* macOS won't configure several USB scanners (i.e. ScanSnap 300M) because their
  * descriptors are vendor specific.  As a result the device will get configured
@@ -497,7 +814,115 @@ sanei_libusb_strerror (int errcode)
 }
 #endif /* HAVE_LIBUSB */
 
+typedef enum
+{
+  sanei_usb_stats_ok = 0,
+  sanei_usb_stats_timeout,
+  sanei_usb_stats_stall,
+  sanei_usb_stats_error
+}
+sanei_usb_stats_result;
+
+#ifdef HAVE_LIBUSB
+static sanei_usb_stats_result
+sanei_usb_stats_libusb_result (int ret)
+{
+  if (ret == LIBUSB_ERROR_TIMEOUT)
+    return sanei_usb_stats_timeout;
+  if (ret == LIBUSB_ERROR_PIPE)
+    return sanei_usb_stats_stall;
+  return sanei_usb_stats_error;
+}
+#endif /* HAVE_LIBUSB */
+
+static sanei_usb_stats_result
+sanei_usb_stats_errno_result (int err)
+{
+  if (err == ETIMEDOUT)
+    return sanei_usb_stats_timeout;
+  if (err == EPIPE)
+    return sanei_usb_stats_stall;
+  return sanei_usb_stats_error;
+}
+
+static unsigned long long
+sanei_usb_stats_now (void)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/* Accounts a transfer that started at start_usec and transferred size bytes,
+   a negative size marks a failed transfer */
+static void
+sanei_usb_stats_add (struct sanei_usb_transfer_stats *stats,
+		     unsigned long long start_usec, ssize_t size,
+		     sanei_usb_stats_result result)
+{
+  unsigned long long now = sanei_usb_stats_now ();
+  unsigned long usec = now > start_usec ? now - start_usec : 0;
+  int bucket = 0;
+
+  stats->transfers++;
+  if (size > 0)
+    stats->bytes += size;
+  if (size < 0 && result == sanei_usb_stats_ok)
+    result = sanei_usb_stats_error;
+  switch (result)
+    {
+    case sanei_usb_stats_timeout:
+      stats->timeouts++;
+      break;
+    case sanei_usb_stats_stall:
+      stats->stalls++;
+      break;
+    case sanei_usb_stats_error:
+      stats->errors++;
+      break;
+    default:
+      break;
+    }
+
+  stats->total_usec += usec;
+  if (usec > stats->max_usec)
+    stats->max_usec = usec;
+  while ((usec >>= 1) != 0 && bucket < SANEI_USB_LATENCY_BUCKETS - 1)
+    bucket++;
+  stats->latency[bucket]++;
+}
+
+static void
+sanei_usb_stats_print (SANE_Int dn, const char *name,
+		       const struct sanei_usb_transfer_stats *stats)
+{
+  char histogram[SANEI_USB_LATENCY_BUCKETS * 32];
+  size_t len = 0;
+  int i;
+
+  if (stats->transfers == 0)
+    return;
+
+  histogram[0] = 0;
+  for (i = 0; i < SANEI_USB_LATENCY_BUCKETS; i++)
+    if (stats->latency[i])
+      len += snprintf (histogram + len, sizeof (histogram) - len,
+		       " %lu@%d", stats->latency[i], i ? 1 << i : 0);
+
+  DBG (1, "sanei_usb_stats: dn %d %s: %lu transfers, %llu bytes, "
+       "%lu timeouts, %lu stalls, %lu errors, avg %llu us, max %lu us\n",
+       dn, name, stats->transfers, stats->bytes, stats->timeouts,
+       stats->stalls, stats->errors, stats->total_usec / stats->transfers,
+       stats->max_usec);
+  DBG (1, "sanei_usb_stats: dn %d %s latency (count@us):%s\n",
+       dn, name, histogram);
+}
+
 #if WITH_USB_RECORD_REPLAY
+static int sanei_usb_replay_log_is_compiled(SANE_String_Const path);
+static SANE_Status sanei_usb_replay_log_open(SANE_String_Const path);
+
 SANE_Status sanei_usb_testing_enable_replay(SANE_String_Const path,
                                             int development_mode)
 {
@@ -506,6 +931,18 @@ SANE_Status sanei_usb_testing_enable_replay(SANE_String_Const path,
 
   // TODO: we'll leak if no one ever inits sane_usb properly
   testing_xml_path = strdup(path);
+
+  if (sanei_usb_replay_log_is_compiled(path))
+    {
+      // development mode rewrites the capture, which needs the XML document
+      if (development_mode)
+        {
+          DBG(1, "%s: development mode requires an XML capture\n", __func__);
+          return SANE_STATUS_INVAL;
+        }
+      return sanei_usb_replay_log_open(path);
+    }
+
   testing_xml_doc = xmlReadFile(testing_xml_path, NULL, 0);
   if (!testing_xml_doc)
     return SANE_STATUS_ACCESS_DENIED;
@@ -541,6 +978,101 @@ SANE_Status sanei_usb_testing_enable_record(SANE_String_Const path, SANE_String_
   return SANE_STATUS_GOOD;
 }
 
+SANE_Status sanei_usb_testing_enable_stream_record(SANE_String_Const path,
+                                                   SANE_String_Const be_name)
+{
+  SANE_Status status = sanei_usb_testing_enable_record(path, be_name);
+  if (status == SANE_STATUS_GOOD)
+    testing_record_streaming = 1;
+  return status;
+}
+
+static SANE_Status sanei_usb_stream_open()
+{
+  sanei_usb_stream_header header;
+
+  testing_record_stream = fopen(testing_xml_path, "wb");
+  if (testing_record_stream == NULL)
+    {
+      DBG(1, "%s: could not open %s: %s\n", __func__, testing_xml_path,
+          strerror(errno));
+      return SANE_STATUS_ACCESS_DENIED;
+    }
+
+  // records are small, let stdio batch them into large writes
+  testing_record_stream_buffer = malloc(SANEI_USB_STREAM_BUFFER_SIZE);
+  if (testing_record_stream_buffer != NULL)
+    setvbuf(testing_record_stream, testing_record_stream_buffer, _IOFBF,
+            SANEI_USB_STREAM_BUFFER_SIZE);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SANEI_USB_STREAM_MAGIC, sizeof(header.magic));
+  header.version = SANEI_USB_STREAM_VERSION;
+  header.byte_order = SANEI_USB_REPLAY_LOG_BYTE_ORDER;
+  header.backend_size = strlen(testing_record_backend);
+
+  if (fwrite(&header, sizeof(header), 1, testing_record_stream) != 1 ||
+      fwrite(testing_record_backend, 1, header.backend_size,
+             testing_record_stream) != header.backend_size)
+    {
+      DBG(1, "%s: could not write %s: %s\n", __func__, testing_xml_path,
+          strerror(errno));
+      return SANE_STATUS_IO_ERROR;
+    }
+
+  gettimeofday(&testing_record_stream_start, NULL);
+  return SANE_STATUS_GOOD;
+}
+
+static void sanei_usb_stream_close()
+{
+  if (testing_record_stream != NULL)
+    fclose(testing_record_stream);
+  free(testing_record_stream_buffer);
+
+  testing_record_streaming = 0;
+  testing_record_stream = NULL;
+  testing_record_stream_buffer = NULL;
+}
+
+// Initializes a record of a transaction. The sequence number is assigned the
+// same way as the XML recorder does.
+static void sanei_usb_stream_record_init(sanei_usb_stream_record* rec,
+                                         uint8_t type, int endpoint_number,
+                                         int direction_is_in)
+{
+  memset(rec, 0, sizeof(*rec));
+  rec->type = type;
+  rec->endpoint_number = endpoint_number;
+  if (direction_is_in)
+    rec->flags |= SANEI_USB_REPLAY_LOG_FLAG_IN;
+  if (type < SANEI_USB_STREAM_RECORD_DESCRIPTION)
+    rec->seq = ++testing_last_known_seq;
+}
+
+static void sanei_usb_stream_append(sanei_usb_stream_record* rec,
+                                    const void* data, size_t data_size)
+{
+  struct timeval now;
+
+  if (testing_record_stream == NULL)
+    return;
+
+  gettimeofday(&now, NULL);
+  rec->time_usec =
+      (uint64_t) (now.tv_sec - testing_record_stream_start.tv_sec) * 1000000 +
+      now.tv_usec - testing_record_stream_start.tv_usec;
+  rec->data_size = data_size;
+
+  if (fwrite(rec, sizeof(*rec), 1, testing_record_stream) != 1 ||
+      (data_size > 0 &&
+       fwrite(data, 1, data_size, testing_record_stream) != data_size))
+    {
+      DBG(1, "%s: could not write USB capture: %s\n", __func__,
+          strerror(errno));
+    }
+}
+
 static xmlNode* sanei_xml_find_first_child_with_name(xmlNode* parent,
                                                      const char* name)
 {
@@ -1022,15 +1554,1021 @@ static int sanei_usb_check_data_equal(xmlNode* node,
                  "data differs (got size %lu, expected %lu):\n",
                  data_size, expected_size);
 
-  FAIL_TEST(parent_fun, "got: %s\n", data_hex);
-  FAIL_TEST(parent_fun, "expected: %s\n", expected_hex);
-  free(data_hex);
-  free(expected_hex);
-  return 0;
+  FAIL_TEST(parent_fun, "got: %s\n", data_hex);
+  FAIL_TEST(parent_fun, "expected: %s\n", expected_hex);
+  free(data_hex);
+  free(expected_hex);
+  return 0;
+}
+
+#define FAIL_TEST_LOG_TX(func, tx, ...)                                        \
+  do {                                                                         \
+    DBG(1, "%s: FAIL: in transaction with seq %u:\n", func, (tx)->seq);        \
+    DBG(1, "%s: FAIL: ", func);                                                \
+    DBG(1, __VA_ARGS__);                                                       \
+    fail_test();                                                               \
+  } while (0)
+
+static const char* sanei_usb_replay_log_tx_names[] = {
+  "control_tx", "bulk_tx", "interrupt_tx",
+  "get_descriptor", "debug", "known_commands_end"
+};
+
+typedef struct
+{
+  char* data;
+  size_t size;
+  size_t capacity;
+}
+sanei_usb_replay_log_buffer;
+
+// returns 1 on success
+static int sanei_usb_replay_log_buffer_append(sanei_usb_replay_log_buffer* buf,
+                                              const void* data, size_t size)
+{
+  if (buf->size + size > buf->capacity)
+    {
+      size_t new_capacity = buf->capacity ? buf->capacity : 4096;
+      while (new_capacity < buf->size + size)
+        new_capacity *= 2;
+
+      char* new_data = realloc(buf->data, new_capacity);
+      if (new_data == NULL)
+        return 0;
+      buf->data = new_data;
+      buf->capacity = new_capacity;
+    }
+  memcpy(buf->data + buf->size, data, size);
+  buf->size += size;
+  return 1;
+}
+
+static int sanei_usb_replay_log_append_endpoint(sanei_usb_replay_log_buffer* buf,
+                                                int interface_nr,
+                                                int transfer_type,
+                                                int address,
+                                                int direction_is_in)
+{
+  sanei_usb_replay_log_endpoint ep;
+  ep.interface_nr = interface_nr;
+  ep.transfer_type = transfer_type;
+  ep.address = address;
+  ep.direction_is_in = direction_is_in;
+  return sanei_usb_replay_log_buffer_append(buf, &ep, sizeof(ep));
+}
+
+// Walks the description node the same way sanei_usb_testing_init() does.
+// Returns 1 on success
+static int sanei_usb_replay_log_compile_description(xmlNode* el_root,
+                                                    sanei_usb_replay_log_header* header,
+                                                    sanei_usb_replay_log_buffer* endpoints)
+{
+  xmlNode* el_description =
+      sanei_xml_find_first_child_with_name(el_root, "description");
+  if (el_description == NULL)
+    {
+      DBG(1, "%s: could not find description node\n", __func__);
+      return 0;
+    }
+
+  int vendor = sanei_xml_get_prop_uint(el_description, "id_vendor");
+  int product = sanei_xml_get_prop_uint(el_description, "id_product");
+  if (vendor < 0 || product < 0)
+    {
+      DBG(1, "%s: no id_vendor or id_product attr in description node\n",
+          __func__);
+      return 0;
+    }
+  header->vendor = vendor;
+  header->product = product;
+
+  xmlNode* el_configurations =
+      sanei_xml_find_first_child_with_name(el_description, "configurations");
+  if (el_configurations == NULL)
+    {
+      DBG(1, "%s: could not find configurations node\n", __func__);
+      return 0;
+    }
+
+  xmlNode* el_configuration =
+      sanei_xml_find_first_child_with_name(el_configurations, "configuration");
+  if (el_configuration == NULL)
+    {
+      DBG(1, "%s: no configuration nodes\n", __func__);
+      return 0;
+    }
+
+  while (el_configuration != NULL)
+    {
+      xmlNode* el_interface =
+          sanei_xml_find_first_child_with_name(el_configuration, "interface");
+
+      while (el_interface != NULL)
+        {
+          int interface_nr = sanei_xml_get_prop_uint(el_interface, "number");
+          if (interface_nr < 0)
+            {
+              DBG(1, "%s: no number attr in interface node\n", __func__);
+              return 0;
+            }
+          if (!sanei_usb_replay_log_append_endpoint(endpoints, interface_nr,
+                                                    -1, 0, 0))
+            return 0;
+          header->endpoint_count++;
+
+          xmlNode* el_endpoint =
+              sanei_xml_find_first_child_with_name(el_interface, "endpoint");
+
+          while (el_endpoint != NULL)
+            {
+              char* transfer_attr = sanei_xml_get_prop(el_endpoint,
+                                                       "transfer_type");
+              int address = sanei_xml_get_prop_uint(el_endpoint, "address");
+              char* direction_attr = sanei_xml_get_prop(el_endpoint,
+                                                        "direction");
+              if (transfer_attr == NULL || direction_attr == NULL)
+                {
+                  DBG(1, "%s: incomplete endpoint node\n", __func__);
+                  xmlFree(transfer_attr);
+                  xmlFree(direction_attr);
+                  return 0;
+                }
+
+              int direction_is_in = strcmp(direction_attr, "IN") == 0 ? 1 : 0;
+              int transfer_type = -1;
+              if (strcmp(transfer_attr, "INTERRUPT") == 0)
+                transfer_type = USB_ENDPOINT_TYPE_INTERRUPT;
+              else if (strcmp(transfer_attr, "BULK") == 0)
+                transfer_type = USB_ENDPOINT_TYPE_BULK;
+              else if (strcmp(transfer_attr, "ISOCHRONOUS") == 0)
+                transfer_type = USB_ENDPOINT_TYPE_ISOCHRONOUS;
+              else if (strcmp(transfer_attr, "CONTROL") == 0)
+                transfer_type = USB_ENDPOINT_TYPE_CONTROL;
+              else
+                {
+                  DBG(3, "%s: unknown endpoint type %s\n",
+                      __func__, transfer_attr);
+                }
+
+              xmlFree(transfer_attr);
+              xmlFree(direction_attr);
+
+              if (transfer_type >= 0)
+                {
+                  if (!sanei_usb_replay_log_append_endpoint(endpoints,
+                                                            interface_nr,
+                                                            transfer_type,
+                                                            address,
+                                                            direction_is_in))
+                    return 0;
+                  header->endpoint_count++;
+                }
+
+              el_endpoint =
+                  sanei_xml_find_next_child_with_name(el_endpoint, "endpoint");
+            }
+
+          el_interface = sanei_xml_find_next_child_with_name(el_interface,
+                                                             "interface");
+        }
+      el_configuration =
+            sanei_xml_find_next_child_with_name(el_configurations,
+                                                "configuration");
+    }
+  return 1;
+}
+
+// returns 1 on success
+static int sanei_usb_replay_log_compile_tx(xmlNode* node,
+                                           sanei_usb_replay_log_tx* tx,
+                                           sanei_usb_replay_log_buffer* data)
+{
+  memset(tx, 0, sizeof(*tx));
+
+  int seq = sanei_xml_get_prop_uint(node, "seq");
+  tx->seq = seq > 0 ? seq : 0;
+  tx->data_offset = data->size;
+
+  char* attr = sanei_xml_get_prop(node, "debug_break");
+  if (attr != NULL)
+    {
+      tx->flags |= SANEI_USB_REPLAY_LOG_FLAG_DEBUG_BREAK;
+      xmlFree(attr);
+    }
+
+  unsigned type;
+  for (type = 0; type < sizeof(sanei_usb_replay_log_tx_names) /
+                        sizeof(sanei_usb_replay_log_tx_names[0]); ++type)
+    {
+      if (xmlStrcmp(node->name,
+                    (const xmlChar*) sanei_usb_replay_log_tx_names[type]) == 0)
+        break;
+    }
+  tx->type = type;
+
+  switch (type)
+    {
+      case sanei_usb_replay_log_tx_known_commands_end:
+        return 1;
+
+      case sanei_usb_replay_log_tx_debug:
+        {
+          attr = sanei_xml_get_prop(node, "message");
+          if (attr == NULL)
+            {
+              FAIL_TEST_TX(__func__, node, "no message attribute\n");
+              return 0;
+            }
+          tx->data_size = strlen(attr);
+          int ret = sanei_usb_replay_log_buffer_append(data, attr,
+                                                       tx->data_size + 1);
+          xmlFree(attr);
+          return ret;
+        }
+
+      case sanei_usb_replay_log_tx_get_descriptor:
+        {
+          // missing attributes are stored as -1 and reported during replay
+          const char* attr_names[] = {
+            "descriptor_type", "bcd_usb", "bcd_device", "device_class",
+            "device_sub_class", "device_protocol", "max_packet_size"
+          };
+          for (unsigned i = 0; i < sizeof(attr_names) / sizeof(attr_names[0]);
+               ++i)
+            {
+              int32_t value = sanei_xml_get_prop_uint(node, attr_names[i]);
+              if (!sanei_usb_replay_log_buffer_append(data, &value,
+                                                      sizeof(value)))
+                return 0;
+              tx->data_size += sizeof(value);
+            }
+          return 1;
+        }
+
+      case sanei_usb_replay_log_tx_control:
+      case sanei_usb_replay_log_tx_bulk:
+      case sanei_usb_replay_log_tx_interrupt:
+        break;
+
+      default:
+        FAIL_TEST_TX(__func__, node, "unknown transaction type %s\n",
+                     (const char*) node->name);
+        return 0;
+    }
+
+  int endpoint_number = sanei_xml_get_prop_uint(node, "endpoint_number");
+  if (endpoint_number < 0)
+    {
+      FAIL_TEST_TX(__func__, node, "no endpoint_number attribute\n");
+      return 0;
+    }
+  tx->endpoint_number = endpoint_number;
+
+  if (sanei_usb_attr_is(node, "direction", "IN"))
+    tx->flags |= SANEI_USB_REPLAY_LOG_FLAG_IN;
+  else if (!sanei_usb_attr_is(node, "direction", "OUT"))
+    {
+      FAIL_TEST_TX(__func__, node, "no valid direction attribute\n");
+      return 0;
+    }
+
+  if (sanei_usb_attr_is(node, "error", "timeout"))
+    tx->flags |= SANEI_USB_REPLAY_LOG_FLAG_TIMEOUT;
+
+  if (type == sanei_usb_replay_log_tx_control)
+    {
+      int rtype = sanei_xml_get_prop_uint(node, "bmRequestType");
+      int req = sanei_xml_get_prop_uint(node, "bRequest");
+      int value = sanei_xml_get_prop_uint(node, "wValue");
+      int index = sanei_xml_get_prop_uint(node, "wIndex");
+      int len = sanei_xml_get_prop_uint(node, "wLength");
+      if (rtype < 0 || req < 0 || value < 0 || index < 0 || len < 0)
+        {
+          FAIL_TEST_TX(__func__, node, "control_tx is missing attributes\n");
+          return 0;
+        }
+      tx->bm_request_type = rtype;
+      tx->b_request = req;
+      tx->w_value = value;
+      tx->w_index = index;
+      tx->w_length = len;
+    }
+
+  size_t size = 0;
+  char* hex_data = sanei_xml_get_hex_data(node, &size);
+  int ret = sanei_usb_replay_log_buffer_append(data, hex_data, size);
+  free(hex_data);
+  tx->data_size = size;
+  return ret;
+}
+
+SANE_Status sanei_usb_testing_compile_replay_log(SANE_String_Const xml_path,
+                                                 SANE_String_Const log_path)
+{
+  SANE_Status status = SANE_STATUS_INVAL;
+  sanei_usb_replay_log_header header;
+  sanei_usb_replay_log_buffer endpoints;
+  sanei_usb_replay_log_buffer txs;
+  sanei_usb_replay_log_buffer data;
+  FILE* out = NULL;
+  char* backend = NULL;
+
+  memset(&header, 0, sizeof(header));
+  memset(&endpoints, 0, sizeof(endpoints));
+  memset(&txs, 0, sizeof(txs));
+  memset(&data, 0, sizeof(data));
+
+  xmlDoc* doc = xmlReadFile(xml_path, NULL, 0);
+  if (doc == NULL)
+    {
+      DBG(1, "%s: could not read %s\n", __func__, xml_path);
+      return SANE_STATUS_ACCESS_DENIED;
+    }
+
+  xmlNode* el_root = xmlDocGetRootElement(doc);
+  if (el_root == NULL ||
+      xmlStrcmp(el_root->name, (const xmlChar*)"device_capture") != 0)
+    {
+      DBG(1, "%s: the given file is not USB capture\n", __func__);
+      goto cleanup;
+    }
+
+  backend = sanei_xml_get_prop(el_root, "backend");
+  if (backend == NULL)
+    {
+      DBG(1, "%s: no backend attr in description node\n", __func__);
+      goto cleanup;
+    }
+
+  if (!sanei_usb_replay_log_compile_description(el_root, &header, &endpoints))
+    goto cleanup;
+
+  header.backend_offset = 0;
+  if (!sanei_usb_replay_log_buffer_append(&data, backend, strlen(backend) + 1))
+    goto no_mem;
+
+  xmlNode* el_transactions =
+      sanei_xml_find_first_child_with_name(el_root, "transactions");
+  if (el_transactions == NULL)
+    {
+      DBG(1, "%s: could not find transactions node\n", __func__);
+      goto cleanup;
+    }
+
+  // the log contains exactly the transactions that sanei_xml_get_next_tx_node
+  // would return
+  xmlNode* node = sanei_xml_skip_non_tx_nodes(
+      xmlFirstElementChild(el_transactions));
+  while (node != NULL)
+    {
+      sanei_usb_replay_log_tx tx;
+      if (!sanei_usb_replay_log_compile_tx(node, &tx, &data))
+        goto cleanup;
+      if (!sanei_usb_replay_log_buffer_append(&txs, &tx, sizeof(tx)))
+        goto no_mem;
+      header.tx_count++;
+
+      node = sanei_xml_skip_non_tx_nodes(xmlNextElementSibling(node));
+    }
+
+  memcpy(header.magic, SANEI_USB_REPLAY_LOG_MAGIC, sizeof(header.magic));
+  header.version = SANEI_USB_REPLAY_LOG_VERSION;
+  header.byte_order = SANEI_USB_REPLAY_LOG_BYTE_ORDER;
+  header.endpoints_offset = sizeof(header);
+  header.tx_offset = header.endpoints_offset + endpoints.size;
+  header.data_offset = header.tx_offset + txs.size;
+  header.data_size = data.size;
+
+  out = fopen(log_path, "wb");
+  if (out == NULL)
+    {
+      DBG(1, "%s: could not open %s: %s\n", __func__, log_path,
+          strerror(errno));
+      status = SANE_STATUS_ACCESS_DENIED;
+      goto cleanup;
+    }
+
+  if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+      fwrite(endpoints.data, 1, endpoints.size, out) != endpoints.size ||
+      fwrite(txs.data, 1, txs.size, out) != txs.size ||
+      fwrite(data.data, 1, data.size, out) != data.size)
+    {
+      DBG(1, "%s: could not write %s: %s\n", __func__, log_path,
+          strerror(errno));
+      status = SANE_STATUS_IO_ERROR;
+      goto cleanup;
+    }
+
+  DBG(3, "%s: compiled %u transactions, %lu bytes of payload\n", __func__,
+      header.tx_count, (unsigned long) data.size);
+  status = SANE_STATUS_GOOD;
+  goto cleanup;
+
+no_mem:
+  status = SANE_STATUS_NO_MEM;
+
+cleanup:
+  if (out != NULL && fclose(out) != 0 && status == SANE_STATUS_GOOD)
+    status = SANE_STATUS_IO_ERROR;
+  xmlFree(backend);
+  free(endpoints.data);
+  free(txs.data);
+  free(data.data);
+  xmlFreeDoc(doc);
+  return status;
+}
+
+static int sanei_usb_replay_log_is_compiled(SANE_String_Const path)
+{
+  char magic[sizeof(((sanei_usb_replay_log_header*)0)->magic)];
+
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+
+  size_t read_size = fread(magic, 1, sizeof(magic), f);
+  fclose(f);
+
+  return read_size == sizeof(magic) &&
+      memcmp(magic, SANEI_USB_REPLAY_LOG_MAGIC, sizeof(magic)) == 0;
+}
+
+static void sanei_usb_replay_log_close()
+{
+#ifdef HAVE_MMAP
+  if (testing_log_is_mmapped)
+    munmap(testing_log_map, testing_log_map_size);
+  else
+#endif
+    free(testing_log_map);
+
+  testing_log_map = NULL;
+  testing_log_map_size = 0;
+  testing_log_is_mmapped = 0;
+  testing_log_header = NULL;
+  testing_log_endpoints = NULL;
+  testing_log_tx = NULL;
+  testing_log_data = NULL;
+  testing_log_next_tx = 0;
+}
+
+// returns 1 if the mapped log is consistent, so that the replay functions
+// don't need to check offsets
+static int sanei_usb_replay_log_validate(const char* map, size_t map_size)
+{
+  const sanei_usb_replay_log_header* header =
+      (const sanei_usb_replay_log_header*) map;
+
+  if (map_size < sizeof(*header) ||
+      memcmp(header->magic, SANEI_USB_REPLAY_LOG_MAGIC,
+             sizeof(header->magic)) != 0)
+    {
+      DBG(1, "%s: not a replay log\n", __func__);
+      return 0;
+    }
+  if (header->byte_order != SANEI_USB_REPLAY_LOG_BYTE_ORDER)
+    {
+      DBG(1, "%s: the replay log was compiled for a different byte order\n",
+          __func__);
+      return 0;
+    }
+  if (header->version != SANEI_USB_REPLAY_LOG_VERSION)
+    {
+      DBG(1, "%s: unsupported replay log version %u\n", __func__,
+          header->version);
+      return 0;
+    }
+
+  if (header->endpoints_offset % sizeof(uint64_t) != 0 ||
+      header->tx_offset % sizeof(uint64_t) != 0 ||
+      header->endpoints_offset > map_size ||
+      (map_size - header->endpoints_offset) /
+          sizeof(sanei_usb_replay_log_endpoint) < header->endpoint_count ||
+      header->tx_offset > map_size ||
+      (map_size - header->tx_offset) /
+          sizeof(sanei_usb_replay_log_tx) < header->tx_count ||
+      header->data_offset > map_size ||
+      map_size - header->data_offset < header->data_size ||
+      header->backend_offset >= header->data_size ||
+      memchr(map + header->data_offset + header->backend_offset, 0,
+             header->data_size - header->backend_offset) == NULL)
+    {
+      DBG(1, "%s: the replay log is truncated or corrupt\n", __func__);
+      return 0;
+    }
+
+  const sanei_usb_replay_log_tx* txs =
+      (const sanei_usb_replay_log_tx*) (map + header->tx_offset);
+  for (uint32_t i = 0; i < header->tx_count; ++i)
+    {
+      if (txs[i].data_offset > header->data_size ||
+          header->data_size - txs[i].data_offset < txs[i].data_size)
+        {
+          DBG(1, "%s: transaction %u points outside of the log\n", __func__, i);
+          return 0;
+        }
+    }
+  return 1;
+}
+
+static SANE_Status sanei_usb_replay_log_open(SANE_String_Const path)
+{
+  struct stat st;
+  char* map = NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return SANE_STATUS_ACCESS_DENIED;
+
+  if (fstat(fd, &st) < 0 || st.st_size <= 0)
+    {
+      close(fd);
+      return SANE_STATUS_ACCESS_DENIED;
+    }
+  testing_log_map_size = st.st_size;
+
+#ifdef HAVE_MMAP
+  map = mmap(NULL, testing_log_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    map = NULL;
+  else
+    testing_log_is_mmapped = 1;
+#endif
+
+  if (map == NULL)
+    {
+      map = malloc(testing_log_map_size);
+      size_t done = 0;
+      while (map != NULL && done < testing_log_map_size)
+        {
+          ssize_t ret = read(fd, map + done, testing_log_map_size - done);
+          if (ret <= 0)
+            {
+              free(map);
+              map = NULL;
+              break;
+            }
+          done += ret;
+        }
+    }
+  close(fd);
+
+  if (map == NULL)
+    {
+      DBG(1, "%s: could not load %s\n", __func__, path);
+      testing_log_map_size = 0;
+      return SANE_STATUS_NO_MEM;
+    }
+  testing_log_map = map;
+
+  if (!sanei_usb_replay_log_validate(map, testing_log_map_size))
+    {
+      sanei_usb_replay_log_close();
+      return SANE_STATUS_INVAL;
+    }
+
+  testing_log_header = (const sanei_usb_replay_log_header*) map;
+  testing_log_endpoints = (const sanei_usb_replay_log_endpoint*)
+      (map + testing_log_header->endpoints_offset);
+  testing_log_tx = (const sanei_usb_replay_log_tx*)
+      (map + testing_log_header->tx_offset);
+  testing_log_data = map + testing_log_header->data_offset;
+  testing_log_next_tx = 0;
+
+  DBG(3, "%s: loaded %u transactions from %s\n", __func__,
+      testing_log_header->tx_count, path);
+  return SANE_STATUS_GOOD;
+}
+
+static void sanei_usb_add_endpoint(device_list_type* device,
+                                   SANE_Int transfer_type,
+                                   SANE_Int ep_address,
+                                   SANE_Int ep_direction);
+
+// Counterpart of the device table setup in sanei_usb_testing_init()
+static SANE_Status sanei_usb_replay_log_init_devices()
+{
+  device_list_type* device = NULL;
+
+  for (uint32_t i = 0; i < testing_log_header->endpoint_count; ++i)
+    {
+      const sanei_usb_replay_log_endpoint* ep = &testing_log_endpoints[i];
+      if (ep->transfer_type < 0)
+        {
+          if (device_number >= MAX_DEVICES)
+            return SANE_STATUS_NO_MEM;
+
+          device = &devices[device_number++];
+          memset(device, 0, sizeof(*device));
+          device->devname = strdup(testing_xml_path);
+          device->method = sanei_usb_method_libusb;
+          device->vendor = testing_log_header->vendor;
+          device->product = testing_log_header->product;
+          device->interface_nr = ep->interface_nr;
+          continue;
+        }
+
+      if (device == NULL)
+        {
+          DBG(1, "%s: endpoint without interface\n", __func__);
+          return SANE_STATUS_INVAL;
+        }
+      sanei_usb_add_endpoint(device, ep->transfer_type, ep->address,
+                             ep->direction_is_in);
+    }
+
+  if (device_number == 0)
+    {
+      DBG(1, "%s: no interfaces within capture\n", __func__);
+      return SANE_STATUS_INVAL;
+    }
+  if (testing_log_header->tx_count == 0)
+    {
+      DBG(1, "%s: no transactions within capture\n", __func__);
+      return SANE_STATUS_INVAL;
+    }
+  return SANE_STATUS_GOOD;
+}
+
+static const sanei_usb_replay_log_tx* sanei_usb_replay_log_peek_next_tx()
+{
+  if (testing_log_next_tx >= testing_log_header->tx_count)
+    return NULL;
+  return &testing_log_tx[testing_log_next_tx];
+}
+
+static const sanei_usb_replay_log_tx* sanei_usb_replay_log_get_next_tx()
+{
+  const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_peek_next_tx();
+  if (tx != NULL)
+    {
+      testing_log_next_tx++;
+      if (tx->seq > 0)
+        testing_last_known_seq = tx->seq;
+      if (tx->flags & SANEI_USB_REPLAY_LOG_FLAG_DEBUG_BREAK)
+        sanei_xml_break();
+    }
+  return tx;
+}
+
+static const char* sanei_usb_replay_log_tx_data(const sanei_usb_replay_log_tx* tx)
+{
+  return testing_log_data + tx->data_offset;
+}
+
+// returns 1 if the transaction has the given type, direction and endpoint.
+// endpoint_number < 0 disables the endpoint check.
+static int sanei_usb_replay_log_check_tx(const sanei_usb_replay_log_tx* tx,
+                                         sanei_usb_replay_log_tx_type type,
+                                         int direction_is_in,
+                                         int endpoint_number,
+                                         const char* parent_fun)
+{
+  if (tx->type != type)
+    {
+      FAIL_TEST_LOG_TX(parent_fun, tx, "unexpected transaction type %s\n",
+                       sanei_usb_replay_log_tx_names[tx->type]);
+      return 0;
+    }
+
+  int tx_is_in = (tx->flags & SANEI_USB_REPLAY_LOG_FLAG_IN) != 0;
+  if (tx_is_in != direction_is_in)
+    {
+      FAIL_TEST_LOG_TX(parent_fun, tx,
+                       "unexpected direction attribute: %s, wanted %s\n",
+                       tx_is_in ? "IN" : "OUT", direction_is_in ? "IN" : "OUT");
+      return 0;
+    }
+
+  if (endpoint_number >= 0 && tx->endpoint_number != endpoint_number)
+    {
+      FAIL_TEST_LOG_TX(parent_fun, tx,
+                       "unexpected endpoint_number attribute: %d, wanted 0x%x\n",
+                       tx->endpoint_number, endpoint_number);
+      return 0;
+    }
+  return 1;
+}
+
+// returns 1 on success
+static int sanei_usb_replay_log_check_uint(const sanei_usb_replay_log_tx* tx,
+                                           const char* attr_name,
+                                           unsigned value, unsigned expected,
+                                           const char* parent_fun)
+{
+  if (value == expected)
+    return 1;
+
+  FAIL_TEST_LOG_TX(parent_fun, tx, "unexpected %s attribute: 0x%x, wanted 0x%x\n",
+                   attr_name, value, expected);
+  return 0;
+}
+
+// returns 1 on data equality
+static int sanei_usb_replay_log_check_data_equal(const sanei_usb_replay_log_tx* tx,
+                                                 const char* data,
+                                                 size_t data_size,
+                                                 const char* parent_fun)
+{
+  const char* expected_data = sanei_usb_replay_log_tx_data(tx);
+  size_t expected_size = tx->data_size;
+
+  if ((data_size == expected_size) &&
+      (memcmp(data, expected_data, data_size) == 0))
+    return 1;
+
+  char* data_hex = sanei_binary_to_hex_data(data, data_size, NULL);
+  char* expected_hex = sanei_binary_to_hex_data(expected_data, expected_size,
+                                                NULL);
+
+  if (data_size == expected_size)
+    FAIL_TEST_LOG_TX(parent_fun, tx, "data differs (size %lu):\n", data_size);
+  else
+    FAIL_TEST_LOG_TX(parent_fun, tx,
+                     "data differs (got size %lu, expected %lu):\n",
+                     data_size, expected_size);
+
+  FAIL_TEST(parent_fun, "got: %s\n", data_hex);
+  FAIL_TEST(parent_fun, "expected: %s\n", expected_hex);
+  free(data_hex);
+  free(expected_hex);
+  return 0;
+}
+
+static void sanei_usb_replay_log_debug_msg(SANE_String_Const message)
+{
+  const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_get_next_tx();
+  if (tx == NULL)
+    {
+      FAIL_TEST(__func__, "no more transactions\n");
+      return;
+    }
+
+  if (tx->type != sanei_usb_replay_log_tx_debug)
+    {
+      FAIL_TEST_LOG_TX(__func__, tx, "unexpected transaction type %s\n",
+                       sanei_usb_replay_log_tx_names[tx->type]);
+      return;
+    }
+
+  const char* expected = sanei_usb_replay_log_tx_data(tx);
+  if (strcmp(expected, message) != 0)
+    {
+      FAIL_TEST_LOG_TX(__func__, tx,
+                       "unexpected message attribute: %s, wanted %s\n",
+                       expected, message);
+    }
+}
+
+static int sanei_usb_replay_log_is_next_bulk(SANE_Int dn, int direction_is_in)
+{
+  const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_peek_next_tx();
+  if (tx == NULL || tx->type != sanei_usb_replay_log_tx_bulk)
+    return 0;
+
+  int tx_is_in = (tx->flags & SANEI_USB_REPLAY_LOG_FLAG_IN) != 0;
+  int ep = direction_is_in ? devices[dn].bulk_in_ep : devices[dn].bulk_out_ep;
+  return tx_is_in == direction_is_in && tx->endpoint_number == (ep & 0x0f);
+}
+
+static int sanei_usb_replay_log_read_bulk(SANE_Int dn, SANE_Byte* buffer,
+                                          size_t size)
+{
+  size_t wanted_size = size;
+  size_t total_got_size = 0;
+  while (wanted_size > 0)
+    {
+      const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_get_next_tx();
+      if (tx == NULL)
+        {
+          FAIL_TEST(__func__, "no more transactions\n");
+          return -1;
+        }
+
+      if (!sanei_usb_replay_log_check_tx(tx, sanei_usb_replay_log_tx_bulk, 1,
+                                         devices[dn].bulk_in_ep & 0x0f,
+                                         __func__))
+        return -1;
+
+      if (tx->data_size > wanted_size)
+        {
+          FAIL_TEST_LOG_TX(__func__, tx,
+                           "got more data than wanted (%lu vs %lu)\n",
+                           (unsigned long) tx->data_size, wanted_size);
+          return -1;
+        }
+
+      memcpy(buffer + total_got_size, sanei_usb_replay_log_tx_data(tx),
+             tx->data_size);
+      total_got_size += tx->data_size;
+      wanted_size -= tx->data_size;
+
+      if (!sanei_usb_replay_log_is_next_bulk(dn, 1))
+        return total_got_size;
+      if (sanei_usb_replay_log_peek_next_tx()->data_size > wanted_size)
+        return total_got_size;
+    }
+  return total_got_size;
+}
+
+static int sanei_usb_replay_log_write_bulk(SANE_Int dn, const SANE_Byte* buffer,
+                                           size_t size)
+{
+  size_t wanted_size = size;
+  size_t total_wrote_size = 0;
+  while (wanted_size > 0)
+    {
+      const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_get_next_tx();
+      if (tx == NULL)
+        {
+          FAIL_TEST(__func__, "no more transactions\n");
+          return -1;
+        }
+
+      if (!sanei_usb_replay_log_check_tx(tx, sanei_usb_replay_log_tx_bulk, 0,
+                                         devices[dn].bulk_out_ep & 0x0f,
+                                         __func__))
+        return -1;
+
+      size_t wrote_size = tx->data_size;
+      if (wrote_size > wanted_size)
+        {
+          FAIL_TEST_LOG_TX(__func__, tx,
+                           "wrote more data than wanted (%lu vs %lu)\n",
+                           wrote_size, wanted_size);
+          return -1;
+        }
+
+      if (!sanei_usb_replay_log_check_data_equal(tx,
+                                                 ((const char*) buffer) +
+                                                    total_wrote_size,
+                                                 wrote_size, __func__))
+        return -1;
+
+      if (wrote_size < wanted_size && !sanei_usb_replay_log_is_next_bulk(dn, 0))
+        {
+          FAIL_TEST_LOG_TX(__func__, tx,
+                           "wrote less data than wanted (%lu vs %lu)\n",
+                           wrote_size, wanted_size);
+          return -1;
+        }
+      total_wrote_size += wrote_size;
+      wanted_size -= wrote_size;
+    }
+  return total_wrote_size;
+}
+
+static SANE_Status
+sanei_usb_replay_log_control_msg(SANE_Int rtype, SANE_Int req,
+                                 SANE_Int value, SANE_Int index, SANE_Int len,
+                                 SANE_Byte* data)
+{
+  const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_get_next_tx();
+  if (tx == NULL)
+    {
+      FAIL_TEST(__func__, "no more transactions\n");
+      return SANE_STATUS_IO_ERROR;
+    }
+
+  int direction_is_in = (rtype & 0x80) == 0x80;
+
+  if (!sanei_usb_replay_log_check_tx(tx, sanei_usb_replay_log_tx_control,
+                                     direction_is_in, -1, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "bmRequestType",
+                                       tx->bm_request_type, rtype, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "bRequest",
+                                       tx->b_request, req, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "wValue",
+                                       tx->w_value, value, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "wIndex",
+                                       tx->w_index, index, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "wLength",
+                                       tx->w_length, len, __func__))
+    return SANE_STATUS_IO_ERROR;
+
+  if (direction_is_in)
+    {
+      if (tx->data_size != (size_t)len)
+        {
+          FAIL_TEST_LOG_TX(__func__, tx,
+                           "got different amount of data than wanted (%lu vs %lu)\n",
+                           (unsigned long) tx->data_size, (size_t)len);
+          return SANE_STATUS_IO_ERROR;
+        }
+      memcpy(data, sanei_usb_replay_log_tx_data(tx), tx->data_size);
+    }
+  else if (!sanei_usb_replay_log_check_data_equal(tx, (const char*)data, len,
+                                                  __func__))
+    {
+      return SANE_STATUS_IO_ERROR;
+    }
+  return SANE_STATUS_GOOD;
+}
+
+static int sanei_usb_replay_log_read_int(SANE_Int dn, SANE_Byte* buffer,
+                                         size_t size)
+{
+  const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_get_next_tx();
+  if (tx == NULL)
+    {
+      FAIL_TEST(__func__, "no more transactions\n");
+      return -1;
+    }
+
+  if (!sanei_usb_replay_log_check_tx(tx, sanei_usb_replay_log_tx_interrupt, 1,
+                                     devices[dn].int_in_ep & 0x0f, __func__))
+    return -1;
+
+  if (tx->flags & SANEI_USB_REPLAY_LOG_FLAG_TIMEOUT)
+    return -1;
+
+  if (tx->data_size > size)
+    {
+      FAIL_TEST_LOG_TX(__func__, tx, "got more data than wanted (%lu vs %lu)\n",
+                       (unsigned long) tx->data_size, size);
+      return -1;
+    }
+
+  memcpy(buffer, sanei_usb_replay_log_tx_data(tx), tx->data_size);
+  return tx->data_size;
+}
+
+static SANE_Status sanei_usb_replay_log_set_configuration(SANE_Int configuration)
+{
+  const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_get_next_tx();
+  if (tx == NULL)
+    {
+      FAIL_TEST(__func__, "no more transactions\n");
+      return SANE_STATUS_IO_ERROR;
+    }
+
+  if (!sanei_usb_replay_log_check_tx(tx, sanei_usb_replay_log_tx_control, 0,
+                                     -1, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "bmRequestType",
+                                       tx->bm_request_type, 0, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "bRequest",
+                                       tx->b_request, 9, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "wValue",
+                                       tx->w_value, configuration, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "wIndex",
+                                       tx->w_index, 0, __func__) ||
+      !sanei_usb_replay_log_check_uint(tx, "wLength",
+                                       tx->w_length, 0, __func__))
+    return SANE_STATUS_IO_ERROR;
+
+  return SANE_STATUS_GOOD;
+}
+
+static SANE_Status
+sanei_usb_replay_log_get_descriptor(struct sanei_usb_dev_descriptor *desc)
+{
+  const sanei_usb_replay_log_tx* tx = sanei_usb_replay_log_get_next_tx();
+  if (tx == NULL)
+    {
+      FAIL_TEST(__func__, "no more transactions\n");
+      return SANE_STATUS_IO_ERROR;
+    }
+
+  if (tx->type != sanei_usb_replay_log_tx_get_descriptor)
+    {
+      FAIL_TEST_LOG_TX(__func__, tx, "unexpected transaction type %s\n",
+                       sanei_usb_replay_log_tx_names[tx->type]);
+      return SANE_STATUS_IO_ERROR;
+    }
+
+  int32_t values[7];
+  if (tx->data_size != sizeof(values))
+    {
+      FAIL_TEST_LOG_TX(__func__, tx, "invalid get_descriptor record\n");
+      return SANE_STATUS_IO_ERROR;
+    }
+  memcpy(values, sanei_usb_replay_log_tx_data(tx), sizeof(values));
+
+  for (unsigned i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+      if (values[i] < 0)
+        {
+          FAIL_TEST_LOG_TX(__func__, tx,
+                           "get_descriptor recorded block is missing attributes\n");
+          return SANE_STATUS_IO_ERROR;
+        }
+    }
+
+  desc->desc_type = values[0];
+  desc->bcd_usb = values[1];
+  desc->bcd_dev = values[2];
+  desc->dev_class = values[3];
+  desc->dev_sub_class = values[4];
+  desc->dev_protocol = values[5];
+  desc->max_packet_size = values[6];
+  return SANE_STATUS_GOOD;
 }
 
 SANE_String sanei_usb_testing_get_backend()
 {
+  if (testing_log_header != NULL)
+    return strdup(testing_log_data + testing_log_header->backend_offset);
+
   if (testing_xml_doc == NULL)
     return NULL;
 
@@ -1063,6 +2601,14 @@ SANE_Bool sanei_usb_is_replay_mode_enabled()
 
 static void sanei_usb_record_debug_msg(xmlNode* node, SANE_String_Const message)
 {
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      sanei_usb_stream_record_init(&rec, sanei_usb_replay_log_tx_debug, 0, 0);
+      sanei_usb_stream_append(&rec, message, strlen(message));
+      return;
+    }
+
   int node_was_null = node == NULL;
   if (node_was_null)
     node = testing_append_commands_node;
@@ -1090,6 +2636,12 @@ static void sanei_usb_record_replace_debug_msg(xmlNode* node, SANE_String_Const
 
 static void sanei_usb_replay_debug_msg(SANE_String_Const message)
 {
+  if (testing_log_header != NULL)
+    {
+      sanei_usb_replay_log_debug_msg(message);
+      return;
+    }
+
   if (testing_known_commands_input_failed)
     return;
 
@@ -1133,6 +2685,14 @@ extern void sanei_usb_testing_record_clear()
   testing_known_commands_input_failed = 0;
   testing_last_known_seq = 0;
   testing_append_commands_node = NULL;
+
+  // the stream is append-only, the converter drops the preceding records
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      sanei_usb_stream_record_init(&rec, SANEI_USB_STREAM_RECORD_CLEAR, 0, 0);
+      sanei_usb_stream_append(&rec, NULL, 0);
+    }
 }
 
 extern void sanei_usb_testing_record_message(SANE_String_Const message)
@@ -1147,17 +2707,15 @@ extern void sanei_usb_testing_record_message(SANE_String_Const message)
     }
 }
 
-static void sanei_usb_add_endpoint(device_list_type* device,
-                                   SANE_Int transfer_type,
-                                   SANE_Int ep_address,
-                                   SANE_Int ep_direction);
-
 static SANE_Status sanei_usb_testing_init()
 {
   DBG_INIT();
 
   if (testing_mode == sanei_usb_testing_mode_record)
     {
+      if (testing_record_streaming)
+        return sanei_usb_stream_open();
+
       testing_xml_doc = xmlNewDoc((const xmlChar*)"1.0");
       return SANE_STATUS_GOOD;
     }
@@ -1165,6 +2723,9 @@ static SANE_Status sanei_usb_testing_init()
   if (device_number != 0)
     return SANE_STATUS_INVAL; // already opened
 
+  if (testing_log_header != NULL)
+    return sanei_usb_replay_log_init_devices();
+
   xmlNode* el_root = xmlDocGetRootElement(testing_xml_doc);
   if (xmlStrcmp(el_root->name, (const xmlChar*)"device_capture") != 0)
     {
@@ -1312,7 +2873,13 @@ static SANE_Status sanei_usb_testing_init()
 
 static void sanei_usb_testing_exit()
 {
-  if (testing_development_mode || testing_mode == sanei_usb_testing_mode_record)
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_close();
+      free(testing_record_backend);
+    }
+  else if (testing_development_mode ||
+           testing_mode == sanei_usb_testing_mode_record)
     {
       if (testing_mode == sanei_usb_testing_mode_record)
         {
@@ -1321,7 +2888,9 @@ static void sanei_usb_testing_exit()
         }
       xmlSaveFileEnc(testing_xml_path, testing_xml_doc, "UTF-8");
     }
-  xmlFreeDoc(testing_xml_doc);
+  if (testing_xml_doc != NULL)
+    xmlFreeDoc(testing_xml_doc);
+  sanei_usb_replay_log_close();
   free(testing_xml_path);
   xmlCleanupParser();
 
@@ -1357,6 +2926,36 @@ SANE_Status sanei_usb_testing_enable_record(SANE_String_Const path, SANE_String_
   return SANE_STATUS_UNSUPPORTED;
 }
 
+SANE_Status sanei_usb_testing_compile_replay_log(SANE_String_Const xml_path,
+                                                 SANE_String_Const log_path)
+{
+  (void) xml_path;
+  (void) log_path;
+
+  DBG(1, "USB record-replay mode support is missing\n");
+  return SANE_STATUS_UNSUPPORTED;
+}
+
+SANE_Status sanei_usb_testing_enable_stream_record(SANE_String_Const path,
+                                                   SANE_String_Const be_name)
+{
+  (void) path;
+  (void) be_name;
+
+  DBG(1, "USB record-replay mode support is missing\n");
+  return SANE_STATUS_UNSUPPORTED;
+}
+
+SANE_Status sanei_usb_testing_convert_stream_record(SANE_String_Const stream_path,
+                                                    SANE_String_Const xml_path)
+{
+  (void) stream_path;
+  (void) xml_path;
+
+  DBG(1, "USB record-replay mode support is missing\n");
+  return SANE_STATUS_UNSUPPORTED;
+}
+
 SANE_String sanei_usb_testing_get_backend()
 {
   return NULL;
@@ -1448,6 +3047,9 @@ sanei_usb_init (void)
 	libusb_set_debug (sanei_usb_ctx, 3);
 #endif /* LIBUSB_API_VERSION */
 #endif /* DBG_LEVEL */
+#ifdef SANEI_USB_HOTPLUG
+      sanei_usb_hotplug_init ();
+#endif
     }
 #endif /* HAVE_LIBUSB */
 
@@ -1501,6 +3103,9 @@ int i;
 #ifdef HAVE_LIBUSB
       if (sanei_usb_ctx)
         {
+#ifdef SANEI_USB_HOTPLUG
+          sanei_usb_hotplug_exit ();
+#endif
           libusb_exit (sanei_usb_ctx);
 	  /* reset libusb-1.0 context */
 	  sanei_usb_ctx=NULL;
@@ -1806,12 +3411,11 @@ static void libusb_scan_devices(void)
 /** scan for devices using libusb
  * Check for devices using libusb-1.0
  */
-static void libusb_scan_devices(void)
+/* stores the devices of the list that look like scanners */
+static void libusb_add_devices(libusb_device **devlist, ssize_t ndev)
 {
   device_list_type device;
   SANE_Char devname[1024];
-  libusb_device **devlist;
-  ssize_t ndev;
   libusb_device *dev;
   libusb_device_handle *hdl;
   struct libusb_device_descriptor desc;
@@ -1823,17 +3427,6 @@ static void libusb_scan_devices(void)
   int ret;
   int i;
 
-  DBG (4, "%s: Looking for libusb-1.0 devices\n", __func__);
-
-  ndev = libusb_get_device_list (sanei_usb_ctx, &devlist);
-  if (ndev < 0)
-    {
-      DBG (1,
-	   "%s: failed to get libusb-1.0 device list, error %d\n", __func__,
-	   (int) ndev);
-      return;
-    }
-
   for (i = 0; i < ndev; i++)
     {
       SANE_Bool found = SANE_FALSE;
@@ -1974,10 +3567,81 @@ static void libusb_scan_devices(void)
 
       store_device (device);
     }
+}
+
+static void libusb_scan_devices(void)
+{
+  libusb_device **devlist;
+  ssize_t ndev;
+
+  DBG (4, "%s: Looking for libusb-1.0 devices\n", __func__);
+
+  ndev = libusb_get_device_list (sanei_usb_ctx, &devlist);
+  if (ndev < 0)
+    {
+      DBG (1,
+	   "%s: failed to get libusb-1.0 device list, error %d\n", __func__,
+	   (int) ndev);
+      return;
+    }
+
+  libusb_add_devices (devlist, ndev);
 
   libusb_free_device_list (devlist, 1);
 
 }
+
+#ifdef SANEI_USB_HOTPLUG
+/** update the device list from the queued hotplug events
+ * @return SANE_FALSE if a full scan is needed
+ */
+static SANE_Bool libusb_hotplug_scan_devices(void)
+{
+  struct timeval no_wait = { 0, 0 };
+  sanei_usb_hotplug_event events[MAX_HOTPLUG_EVENTS];
+  SANE_Char devname[1024];
+  int i, j, count, overflow;
+
+  libusb_handle_events_timeout_completed (sanei_usb_ctx, &no_wait, NULL);
+
+  /* other threads may queue more events meanwhile */
+  count = sanei_usb_hotplug_take (events, &overflow);
+
+  if (overflow)
+    {
+      DBG (3, "%s: too many hotplug events, rescanning\n", __func__);
+      for (i = 0; i < count; i++)
+	if (events[i].device)
+	  libusb_unref_device (events[i].device);
+      return SANE_FALSE;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      if (events[i].event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+	{
+	  DBG (4, "%s: device arrived at %03d:%03d\n", __func__,
+	       events[i].bus, events[i].address);
+	  libusb_add_devices (&events[i].device, 1);
+	  libusb_unref_device (events[i].device);
+	}
+      else
+	{
+	  snprintf (devname, sizeof (devname), "libusb:%03d:%03d",
+		    events[i].bus, events[i].address);
+	  DBG (4, "%s: device left %s\n", __func__, devname);
+	  /* a missing slot is reused once it has been missed twice, keep
+	     the slot of an open device until it is closed */
+	  for (j = 0; j < device_number; j++)
+	    if (devices[j].method == sanei_usb_method_libusb
+		&& devices[j].devname
+		&& strcmp (devices[j].devname, devname) == 0)
+	      devices[j].missing = devices[j].open ? 1 : 2;
+	}
+    }
+  return SANE_TRUE;
+}
+#endif /* SANEI_USB_HOTPLUG */
 #endif /* HAVE_LIBUSB */
 
 
@@ -1999,6 +3663,14 @@ sanei_usb_scan_devices (void)
       // device added in sanei_usb_testing_init()
       return;
     }
+
+#ifdef SANEI_USB_HOTPLUG
+  /* after the first full scan the hotplug events keep the list current */
+  if (hotplug_enabled && hotplug_scanned && libusb_hotplug_scan_devices ())
+    return;
+  hotplug_scanned = hotplug_enabled;
+#endif
+
   /* we mark all already detected devices as missing */
   /* each scan method will reset this value to 0 (not missing)
    * when storing the device */
@@ -2345,6 +4017,30 @@ static void sanei_usb_record_open(SANE_Int dn)
   if (testing_already_opened)
     return;
 
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      sanei_usb_stream_description desc;
+
+      desc.vendor = devices[dn].vendor;
+      desc.product = devices[dn].product;
+      desc.interface_nr = devices[dn].interface_nr;
+      desc.bulk_in_ep = devices[dn].bulk_in_ep;
+      desc.bulk_out_ep = devices[dn].bulk_out_ep;
+      desc.iso_in_ep = devices[dn].iso_in_ep;
+      desc.iso_out_ep = devices[dn].iso_out_ep;
+      desc.int_in_ep = devices[dn].int_in_ep;
+      desc.int_out_ep = devices[dn].int_out_ep;
+      desc.control_in_ep = devices[dn].control_in_ep;
+      desc.control_out_ep = devices[dn].control_out_ep;
+
+      sanei_usb_stream_record_init(&rec, SANEI_USB_STREAM_RECORD_DESCRIPTION,
+                                   0, 0);
+      sanei_usb_stream_append(&rec, &desc, sizeof(desc));
+      testing_already_opened = 1;
+      return;
+    }
+
   xmlNode* e_root = xmlNewNode(NULL, (const xmlChar*) "device_capture");
   xmlDocSetRootElement(testing_xml_doc, e_root);
   xmlNewProp(e_root, (const xmlChar*)"backend", (const xmlChar*) testing_record_backend);
@@ -2981,6 +4677,7 @@ sanei_usb_open (SANE_String_Const devname, SANE_Int * dn)
 #endif
     }
 
+  memset (&devices[devcount].stats, 0, sizeof (devices[devcount].stats));
   devices[devcount].open = SANE_TRUE;
   *dn = devcount;
   DBG (3, "sanei_usb_open: opened usb device `%s' (*dn=%d)\n",
@@ -3014,6 +4711,21 @@ sanei_usb_close (SANE_Int dn)
 	   dn);
       return;
     }
+  sanei_usb_cancel_bulk_reads (dn);
+  free (devices[dn].async_reads);
+  devices[dn].async_reads = NULL;
+
+  env = getenv ("SANE_USB_STATS");
+  if (env && atoi (env))
+    {
+      sanei_usb_stats_print (dn, "bulk in", &devices[dn].stats.bulk_in);
+      sanei_usb_stats_print (dn, "bulk out", &devices[dn].stats.bulk_out);
+      sanei_usb_stats_print (dn, "int in", &devices[dn].stats.int_in);
+      sanei_usb_stats_print (dn, "control in", &devices[dn].stats.control_in);
+      sanei_usb_stats_print (dn, "control out",
+			     &devices[dn].stats.control_out);
+    }
+
   if (testing_mode == sanei_usb_testing_mode_replay)
     {
       DBG (1, "sanei_usb_close: closing fake USB device\n");
@@ -3063,8 +4775,21 @@ sanei_usb_close (SANE_Int dn)
     }
 #else /* not HAVE_LIBUSB_LEGACY && not HAVE_LIBUSB */
     DBG (1, "sanei_usb_close: libusb support missing\n");
+#endif
+#if WITH_USB_RECORD_REPLAY
+  /* keep the capture of a session up to date in case the frontend
+     never calls sane_exit */
+  if (testing_record_stream != NULL)
+    fflush (testing_record_stream);
 #endif
   devices[dn].open = SANE_FALSE;
+
+#ifdef SANEI_USB_HOTPLUG
+  /* a device that left while open kept its slot until now, full scans
+     don't count it as missed again while hotplug events are used */
+  if (hotplug_enabled && devices[dn].missing)
+    devices[dn].missing = 2;
+#endif
   return;
 }
 
@@ -3218,6 +4943,21 @@ static void sanei_usb_record_read_bulk(xmlNode* node, SANE_Int dn,
                                        SANE_Byte* buffer,
                                        size_t size, ssize_t read_size)
 {
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      sanei_usb_stream_record_init(&rec, sanei_usb_replay_log_tx_bulk,
+                                   devices[dn].bulk_in_ep & 0x0f, 1);
+      rec.wanted_size = size;
+      if (read_size < 0)
+        {
+          rec.flags |= SANEI_USB_REPLAY_LOG_FLAG_TIMEOUT;
+          read_size = 0;
+        }
+      sanei_usb_stream_append(&rec, buffer, read_size);
+      return;
+    }
+
   int node_was_null = node == NULL;
   if (node_was_null)
     node = testing_append_commands_node;
@@ -3267,6 +5007,9 @@ static void sanei_usb_record_replace_read_bulk(xmlNode* node, SANE_Int dn,
 static int sanei_usb_replay_read_bulk(SANE_Int dn, SANE_Byte* buffer,
                                       size_t size)
 {
+  if (testing_log_header != NULL)
+    return sanei_usb_replay_log_read_bulk(dn, buffer, size);
+
   // libusb may potentially combine multiple IN packets into a single transfer.
   // We recontruct that by looking into the next packet. If it can be
   // included into the current transfer without
@@ -3347,6 +5090,8 @@ SANE_Status
 sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 {
   ssize_t read_size = 0;
+  unsigned long long start_usec;
+  sanei_usb_stats_result stats_result = sanei_usb_stats_ok;
 
   if (!size)
     {
@@ -3361,6 +5106,7 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
     }
   DBG (5, "sanei_usb_read_bulk: trying to read %lu bytes\n",
        (unsigned long) *size);
+  start_usec = sanei_usb_stats_now ();
 
   if (testing_mode == sanei_usb_testing_mode_replay)
     {
@@ -3376,8 +5122,11 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
       read_size = read (devices[dn].fd, buffer, *size);
 
       if (read_size < 0)
-	DBG (1, "sanei_usb_read_bulk: read failed: %s\n",
-	     strerror (errno));
+	{
+	  stats_result = sanei_usb_stats_errno_result (errno);
+	  DBG (1, "sanei_usb_read_bulk: read failed: %s\n",
+	       strerror (errno));
+	}
     }
   else if (devices[dn].method == sanei_usb_method_libusb)
 #ifdef HAVE_LIBUSB_LEGACY
@@ -3389,8 +5138,11 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 				     (int) *size, libusb_timeout);
 
 	  if (read_size < 0)
-	    DBG (1, "sanei_usb_read_bulk: read failed: %s\n",
-		 strerror (errno));
+	    {
+	      stats_result = sanei_usb_stats_errno_result (errno);
+	      DBG (1, "sanei_usb_read_bulk: read failed: %s\n",
+		   strerror (errno));
+	    }
 	}
       else
 	{
@@ -3414,6 +5166,7 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
               DBG (1, "sanei_usb_read_bulk: read failed (still got %d bytes): %s\n",
                    rsize, sanei_libusb_strerror (ret));
 
+	      stats_result = sanei_usb_stats_libusb_result (ret);
 	      read_size = -1;
 	    }
 	  else
@@ -3450,72 +5203,372 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
       DBG (5, "Entered usbcalls UsbBulkRead with interface_nr = %d\n",devices[dn].interface_nr);
       DBG (5, "Entered usbcalls UsbBulkRead with usbcalls_timeout = %d\n",usbcalls_timeout);
 
-      if (devices[dn].bulk_in_ep){
-        rc = UsbBulkRead (dh, devices[dn].bulk_in_ep, devices[dn].interface_nr,
-                               &ulToRead, buffer_ptr, usbcalls_timeout);
-        DBG (1, "sanei_usb_read_bulk: rc = %d\n",rc);}
-      else
-      {
-          DBG (1, "sanei_usb_read_bulk: can't read without a bulk-in endpoint\n");
-          return SANE_STATUS_INVAL;
-      }
-      if (rc || (ulNum!=ulToRead)) return SANE_STATUS_INVAL;
-      requested_size -=ulToRead;
-      buffer_ptr += ulToRead;
-      read_size += ulToRead;
+      if (devices[dn].bulk_in_ep){
+        rc = UsbBulkRead (dh, devices[dn].bulk_in_ep, devices[dn].interface_nr,
+                               &ulToRead, buffer_ptr, usbcalls_timeout);
+        DBG (1, "sanei_usb_read_bulk: rc = %d\n",rc);}
+      else
+      {
+          DBG (1, "sanei_usb_read_bulk: can't read without a bulk-in endpoint\n");
+          return SANE_STATUS_INVAL;
+      }
+      if (rc || (ulNum!=ulToRead)) return SANE_STATUS_INVAL;
+      requested_size -=ulToRead;
+      buffer_ptr += ulToRead;
+      read_size += ulToRead;
+    }
+#else /* not HAVE_USBCALLS */
+    {
+      DBG (1, "sanei_usb_read_bulk: usbcalls support missing\n");
+      return SANE_STATUS_UNSUPPORTED;
+    }
+#endif /* not HAVE_USBCALLS */
+  }
+  else
+    {
+      DBG (1, "sanei_usb_read_bulk: access method %d not implemented\n",
+	   devices[dn].method);
+      return SANE_STATUS_INVAL;
+    }
+
+  sanei_usb_stats_add (&devices[dn].stats.bulk_in, start_usec, read_size,
+		       stats_result);
+
+  if (testing_mode == sanei_usb_testing_mode_record)
+    {
+#if WITH_USB_RECORD_REPLAY
+      sanei_usb_record_read_bulk(NULL, dn, buffer, *size, read_size);
+#else
+      DBG (1, "USB record-replay mode support is missing\n");
+      return SANE_STATUS_UNSUPPORTED;
+#endif
+    }
+
+  if (read_size < 0)
+    {
+      *size = 0;
+      if (testing_mode != sanei_usb_testing_mode_disabled)
+        return SANE_STATUS_IO_ERROR;
+
+#ifdef HAVE_LIBUSB_LEGACY
+      if (devices[dn].method == sanei_usb_method_libusb)
+	usb_clear_halt (devices[dn].libusb_handle, devices[dn].bulk_in_ep);
+#elif defined(HAVE_LIBUSB)
+      if (devices[dn].method == sanei_usb_method_libusb)
+	libusb_clear_halt (devices[dn].lu_handle, devices[dn].bulk_in_ep);
+#endif
+      return SANE_STATUS_IO_ERROR;
+    }
+  if (read_size == 0)
+    {
+      DBG (3, "sanei_usb_read_bulk: read returned EOF\n");
+      *size = 0;
+      return SANE_STATUS_EOF;
+    }
+  if (debug_level > 10)
+    print_buffer (buffer, read_size);
+  DBG (5, "sanei_usb_read_bulk: wanted %lu bytes, got %ld bytes\n",
+       (unsigned long) *size, (unsigned long) read_size);
+  *size = read_size;
+
+  return SANE_STATUS_GOOD;
+}
+
+#ifdef HAVE_LIBUSB
+static void LIBUSB_CALL
+sanei_usb_async_read_callback (struct libusb_transfer *transfer)
+{
+  *(int *) transfer->user_data = 1;
+}
+
+/* completes a transfer that was given up on, nobody waits for it */
+static void LIBUSB_CALL
+sanei_usb_async_abandoned_callback (struct libusb_transfer *transfer)
+{
+  libusb_free_transfer (transfer);
+}
+
+static SANE_Status
+sanei_usb_async_submit (SANE_Int dn, sanei_usb_async_read * read)
+{
+  unsigned char *buffer;
+  int ret;
+
+  read->transfer = libusb_alloc_transfer (0);
+  buffer = malloc (read->size);
+  if (!read->transfer || !buffer)
+    {
+      DBG (1, "sanei_usb_submit_bulk_reads: out of memory\n");
+      if (read->transfer)
+	libusb_free_transfer (read->transfer);
+      read->transfer = NULL;
+      free (buffer);
+      return SANE_STATUS_NO_MEM;
+    }
+
+  read->completed = 0;
+  libusb_fill_bulk_transfer (read->transfer, devices[dn].lu_handle,
+			     devices[dn].bulk_in_ep, buffer, (int) read->size,
+			     sanei_usb_async_read_callback, &read->completed,
+			     libusb_timeout);
+  read->transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+
+  ret = libusb_submit_transfer (read->transfer);
+  if (ret < 0)
+    {
+      DBG (1, "sanei_usb_submit_bulk_reads: submit failed: %s\n",
+	   sanei_libusb_strerror (ret));
+      libusb_free_transfer (read->transfer);
+      read->transfer = NULL;
+      return SANE_STATUS_IO_ERROR;
+    }
+  return SANE_STATUS_GOOD;
+}
+
+/* If libusb can't handle events, the transfer is cancelled and left to
+   free itself, should it ever complete. The caller must not touch it
+   anymore. */
+static SANE_Status
+sanei_usb_async_wait (sanei_usb_async_read * read)
+{
+  int ret;
+
+  while (!read->completed)
+    {
+      ret = libusb_handle_events_completed (sanei_usb_ctx, &read->completed);
+      if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED && !read->completed)
+	{
+	  DBG (1, "sanei_usb_async_wait: handling events failed: %s\n",
+	       sanei_libusb_strerror (ret));
+	  read->transfer->callback = sanei_usb_async_abandoned_callback;
+	  libusb_cancel_transfer (read->transfer);
+	  read->transfer = NULL;
+	  return SANE_STATUS_IO_ERROR;
+	}
+    }
+  return SANE_STATUS_GOOD;
+}
+#endif /* HAVE_LIBUSB */
+
+/* Queued reads go through libusb async transfers only when talking to a
+   real device, in the other cases sanei_usb_reap_bulk_read() performs
+   them synchronously so that they are recorded and replayed in order */
+static int
+sanei_usb_async_is_native (SANE_Int dn)
+{
+#ifdef HAVE_LIBUSB
+  return testing_mode == sanei_usb_testing_mode_disabled
+    && devices[dn].method == sanei_usb_method_libusb;
+#else
+  (void) dn;
+  return 0;
+#endif /* HAVE_LIBUSB */
+}
+
+SANE_Status
+sanei_usb_submit_bulk_reads (SANE_Int dn, SANE_Int count, size_t size)
+{
+  sanei_usb_async_read *read;
+  int i;
+
+  if (dn >= device_number || dn < 0)
+    {
+      DBG (1, "sanei_usb_submit_bulk_reads: dn >= device number || dn < 0\n");
+      return SANE_STATUS_INVAL;
+    }
+  if (count <= 0 || size == 0 || size > INT_MAX
+      || devices[dn].async_count + count > SANEI_USB_MAX_ASYNC_READS)
+    {
+      DBG (1, "sanei_usb_submit_bulk_reads: can't queue %d reads of %lu "
+	   "bytes (%d queued)\n", count, (unsigned long) size,
+	   devices[dn].async_count);
+      return SANE_STATUS_INVAL;
+    }
+  if (!devices[dn].bulk_in_ep)
+    {
+      DBG (1, "sanei_usb_submit_bulk_reads: can't read without a bulk-in "
+	   "endpoint\n");
+      return SANE_STATUS_INVAL;
+    }
+
+  if (!devices[dn].async_reads)
+    {
+      devices[dn].async_reads = calloc (SANEI_USB_MAX_ASYNC_READS,
+					sizeof (sanei_usb_async_read));
+      if (!devices[dn].async_reads)
+	return SANE_STATUS_NO_MEM;
+      devices[dn].async_first = 0;
+    }
+
+  DBG (5, "sanei_usb_submit_bulk_reads: queueing %d reads of %lu bytes\n",
+       count, (unsigned long) size);
+
+  for (i = 0; i < count; i++)
+    {
+      read = &devices[dn].async_reads[(devices[dn].async_first
+				       + devices[dn].async_count)
+				      % SANEI_USB_MAX_ASYNC_READS];
+      read->size = size;
+      read->start_usec = sanei_usb_stats_now ();
+#ifdef HAVE_LIBUSB
+      if (sanei_usb_async_is_native (dn))
+	{
+	  SANE_Status status = sanei_usb_async_submit (dn, read);
+	  if (status != SANE_STATUS_GOOD)
+	    return status;
+	}
+#endif /* HAVE_LIBUSB */
+      devices[dn].async_count++;
     }
-#else /* not HAVE_USBCALLS */
+
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status
+sanei_usb_reap_bulk_read (SANE_Int dn, SANE_Byte * buffer, size_t * size)
+{
+  sanei_usb_async_read *read;
+
+  if (!size)
     {
-      DBG (1, "sanei_usb_read_bulk: usbcalls support missing\n");
-      return SANE_STATUS_UNSUPPORTED;
+      DBG (1, "sanei_usb_reap_bulk_read: size == NULL\n");
+      return SANE_STATUS_INVAL;
     }
-#endif /* not HAVE_USBCALLS */
-  }
-  else
+  if (dn >= device_number || dn < 0)
     {
-      DBG (1, "sanei_usb_read_bulk: access method %d not implemented\n",
-	   devices[dn].method);
+      DBG (1, "sanei_usb_reap_bulk_read: dn >= device number || dn < 0\n");
+      return SANE_STATUS_INVAL;
+    }
+  if (devices[dn].async_count == 0)
+    {
+      DBG (1, "sanei_usb_reap_bulk_read: no read queued\n");
       return SANE_STATUS_INVAL;
     }
 
-  if (testing_mode == sanei_usb_testing_mode_record)
+  read = &devices[dn].async_reads[devices[dn].async_first];
+  if (*size < read->size)
     {
-#if WITH_USB_RECORD_REPLAY
-      sanei_usb_record_read_bulk(NULL, dn, buffer, *size, read_size);
-#else
-      DBG (1, "USB record-replay mode support is missing\n");
-      return SANE_STATUS_UNSUPPORTED;
-#endif
+      DBG (1, "sanei_usb_reap_bulk_read: buffer of %lu bytes is too small "
+	   "for %lu bytes\n", (unsigned long) *size,
+	   (unsigned long) read->size);
+      return SANE_STATUS_INVAL;
     }
 
-  if (read_size < 0)
+  devices[dn].async_first = (devices[dn].async_first + 1)
+    % SANEI_USB_MAX_ASYNC_READS;
+  devices[dn].async_count--;
+
+  if (!sanei_usb_async_is_native (dn))
     {
-      *size = 0;
-      if (testing_mode != sanei_usb_testing_mode_disabled)
-        return SANE_STATUS_IO_ERROR;
+      *size = read->size;
+      return sanei_usb_read_bulk (dn, buffer, size);
+    }
 
-#ifdef HAVE_LIBUSB_LEGACY
-      if (devices[dn].method == sanei_usb_method_libusb)
-	usb_clear_halt (devices[dn].libusb_handle, devices[dn].bulk_in_ep);
-#elif defined(HAVE_LIBUSB)
-      if (devices[dn].method == sanei_usb_method_libusb)
-	libusb_clear_halt (devices[dn].lu_handle, devices[dn].bulk_in_ep);
-#endif
-      return SANE_STATUS_IO_ERROR;
+#ifdef HAVE_LIBUSB
+  {
+    struct libusb_transfer *transfer = read->transfer;
+    sanei_usb_stats_result stats_result = sanei_usb_stats_ok;
+    ssize_t read_size = -1;
+
+    if (sanei_usb_async_wait (read) != SANE_STATUS_GOOD)
+      {
+	sanei_usb_stats_add (&devices[dn].stats.bulk_in, read->start_usec,
+			     -1, sanei_usb_stats_error);
+	*size = 0;
+	return SANE_STATUS_IO_ERROR;
+      }
+    read->transfer = NULL;
+
+    switch (transfer->status)
+      {
+      case LIBUSB_TRANSFER_COMPLETED:
+	read_size = transfer->actual_length;
+	break;
+      case LIBUSB_TRANSFER_TIMED_OUT:
+	stats_result = sanei_usb_stats_timeout;
+	break;
+      case LIBUSB_TRANSFER_STALL:
+	stats_result = sanei_usb_stats_stall;
+	break;
+      default:
+	stats_result = sanei_usb_stats_error;
+	break;
+      }
+    sanei_usb_stats_add (&devices[dn].stats.bulk_in, read->start_usec,
+			 read_size, stats_result);
+
+    if (read_size < 0)
+      {
+	DBG (1, "sanei_usb_reap_bulk_read: read failed with transfer "
+	     "status %d\n", transfer->status);
+	libusb_free_transfer (transfer);
+	*size = 0;
+	if (stats_result == sanei_usb_stats_stall)
+	  libusb_clear_halt (devices[dn].lu_handle, devices[dn].bulk_in_ep);
+	return SANE_STATUS_IO_ERROR;
+      }
+
+    memcpy (buffer, transfer->buffer, read_size);
+    libusb_free_transfer (transfer);
+
+    if (read_size == 0)
+      {
+	DBG (3, "sanei_usb_reap_bulk_read: read returned EOF\n");
+	*size = 0;
+	return SANE_STATUS_EOF;
+      }
+    if (debug_level > 10)
+      print_buffer (buffer, read_size);
+    DBG (5, "sanei_usb_reap_bulk_read: wanted %lu bytes, got %ld bytes\n",
+	 (unsigned long) read->size, (long) read_size);
+    *size = read_size;
+    return SANE_STATUS_GOOD;
+  }
+#else
+  return SANE_STATUS_UNSUPPORTED;
+#endif /* HAVE_LIBUSB */
+}
+
+void
+sanei_usb_cancel_bulk_reads (SANE_Int dn)
+{
+  if (dn >= device_number || dn < 0)
+    {
+      DBG (1, "sanei_usb_cancel_bulk_reads: dn >= device number || dn < 0\n");
+      return;
     }
-  if (read_size == 0)
+  if (devices[dn].async_count == 0)
+    return;
+
+  DBG (5, "sanei_usb_cancel_bulk_reads: cancelling %d reads\n",
+       devices[dn].async_count);
+
+#ifdef HAVE_LIBUSB
+  if (sanei_usb_async_is_native (dn))
     {
-      DBG (3, "sanei_usb_read_bulk: read returned EOF\n");
-      *size = 0;
-      return SANE_STATUS_EOF;
+      sanei_usb_async_read *read;
+      int i;
+
+      for (i = 0; i < devices[dn].async_count; i++)
+	{
+	  read = &devices[dn].async_reads[(devices[dn].async_first + i)
+					  % SANEI_USB_MAX_ASYNC_READS];
+	  if (!read->completed)
+	    libusb_cancel_transfer (read->transfer);
+	}
+      for (i = 0; i < devices[dn].async_count; i++)
+	{
+	  read = &devices[dn].async_reads[(devices[dn].async_first + i)
+					  % SANEI_USB_MAX_ASYNC_READS];
+	  if (sanei_usb_async_wait (read) == SANE_STATUS_GOOD)
+	    libusb_free_transfer (read->transfer);
+	  read->transfer = NULL;
+	}
     }
-  if (debug_level > 10)
-    print_buffer (buffer, read_size);
-  DBG (5, "sanei_usb_read_bulk: wanted %lu bytes, got %ld bytes\n",
-       (unsigned long) *size, (unsigned long) read_size);
-  *size = read_size;
+#endif /* HAVE_LIBUSB */
 
-  return SANE_STATUS_GOOD;
+  devices[dn].async_first = 0;
+  devices[dn].async_count = 0;
 }
 
 #if WITH_USB_RECORD_REPLAY
@@ -3523,6 +5576,15 @@ static int sanei_usb_record_write_bulk(xmlNode* node, SANE_Int dn,
                                        const SANE_Byte* buffer,
                                        size_t size, size_t write_size)
 {
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      sanei_usb_stream_record_init(&rec, sanei_usb_replay_log_tx_bulk,
+                                   devices[dn].bulk_out_ep & 0x0f, 0);
+      sanei_usb_stream_append(&rec, buffer, size);
+      return write_size;
+    }
+
   int node_was_null = node == NULL;
   if (node_was_null)
     node = testing_append_commands_node;
@@ -3578,6 +5640,9 @@ static int sanei_usb_replay_next_write_bulk_packet_size(SANE_Int dn)
 static int sanei_usb_replay_write_bulk(SANE_Int dn, const SANE_Byte* buffer,
                                        size_t size)
 {
+  if (testing_log_header != NULL)
+    return sanei_usb_replay_log_write_bulk(dn, buffer, size);
+
   size_t wanted_size = size;
   size_t total_wrote_size = 0;
   while (wanted_size > 0)
@@ -3681,6 +5746,8 @@ SANE_Status
 sanei_usb_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
 {
   ssize_t write_size = 0;
+  unsigned long long start_usec;
+  sanei_usb_stats_result stats_result = sanei_usb_stats_ok;
 
   if (!size)
     {
@@ -3697,6 +5764,7 @@ sanei_usb_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
        (unsigned long) *size);
   if (debug_level > 10)
     print_buffer (buffer, *size);
+  start_usec = sanei_usb_stats_now ();
 
   if (testing_mode == sanei_usb_testing_mode_replay)
     {
@@ -3712,8 +5780,11 @@ sanei_usb_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
       write_size = write (devices[dn].fd, buffer, *size);
 
       if (write_size < 0)
-	DBG (1, "sanei_usb_write_bulk: write failed: %s\n",
-	     strerror (errno));
+	{
+	  stats_result = sanei_usb_stats_errno_result (errno);
+	  DBG (1, "sanei_usb_write_bulk: write failed: %s\n",
+	       strerror (errno));
+	}
     }
   else if (devices[dn].method == sanei_usb_method_libusb)
 #ifdef HAVE_LIBUSB_LEGACY
@@ -3725,8 +5796,11 @@ sanei_usb_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
 				       (const char *) buffer,
 				       (int) *size, libusb_timeout);
 	  if (write_size < 0)
-	    DBG (1, "sanei_usb_write_bulk: write failed: %s\n",
-		 strerror (errno));
+	    {
+	      stats_result = sanei_usb_stats_errno_result (errno);
+	      DBG (1, "sanei_usb_write_bulk: write failed: %s\n",
+		   strerror (errno));
+	    }
 	}
       else
 	{
@@ -3751,6 +5825,7 @@ sanei_usb_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
 	      DBG (1, "sanei_usb_write_bulk: write failed: %s\n",
 		   sanei_libusb_strerror (ret));
 
+	      stats_result = sanei_usb_stats_libusb_result (ret);
 	      write_size = -1;
 	    }
 	  else
@@ -3814,6 +5889,9 @@ sanei_usb_write_bulk (SANE_Int dn, const SANE_Byte * buffer, size_t * size)
       return SANE_STATUS_INVAL;
     }
 
+  sanei_usb_stats_add (&devices[dn].stats.bulk_out, start_usec, write_size,
+		       stats_result);
+
   if (testing_mode == sanei_usb_testing_mode_record)
     {
 #if WITH_USB_RECORD_REPLAY
@@ -3854,6 +5932,20 @@ sanei_usb_record_control_msg(xmlNode* node,
 {
   (void) dn;
 
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      sanei_usb_stream_record_init(&rec, sanei_usb_replay_log_tx_control,
+                                   rtype & 0x1f, (rtype & 0x80) == 0x80);
+      rec.bm_request_type = rtype;
+      rec.b_request = req;
+      rec.w_value = value;
+      rec.w_index = index;
+      rec.w_length = len;
+      sanei_usb_stream_append(&rec, data, data != NULL ? len : 0);
+      return;
+    }
+
   int node_was_null = node == NULL;
   if (node_was_null)
     node = testing_append_commands_node;
@@ -3920,6 +6012,10 @@ sanei_usb_replay_control_msg(SANE_Int dn, SANE_Int rtype, SANE_Int req,
 {
   (void) dn;
 
+  if (testing_log_header != NULL)
+    return sanei_usb_replay_log_control_msg(rtype, req, value, index, len,
+                                            data);
+
   if (testing_known_commands_input_failed)
     return SANE_STATUS_IO_ERROR;
 
@@ -4005,6 +6101,9 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
 		       SANE_Int value, SANE_Int index, SANE_Int len,
 		       SANE_Byte * data)
 {
+  struct sanei_usb_transfer_stats *stats;
+  unsigned long long start_usec;
+
   if (dn >= device_number || dn < 0)
     {
       DBG (1, "sanei_usb_control_msg: dn >= device number || dn < 0, dn=%d\n",
@@ -4017,11 +6116,23 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
   if (!(rtype & 0x80) && debug_level > 10)
     print_buffer (data, len);
 
+  if (rtype & 0x80)
+    stats = &devices[dn].stats.control_in;
+  else
+    stats = &devices[dn].stats.control_out;
+  start_usec = sanei_usb_stats_now ();
+
   if (testing_mode == sanei_usb_testing_mode_replay)
     {
 #if WITH_USB_RECORD_REPLAY
-      return sanei_usb_replay_control_msg(dn, rtype, req, value, index, len,
-                                          data);
+      SANE_Status status;
+
+      status = sanei_usb_replay_control_msg(dn, rtype, req, value, index, len,
+                                            data);
+      sanei_usb_stats_add (stats, start_usec,
+                           status == SANE_STATUS_GOOD ? len : -1,
+                           sanei_usb_stats_ok);
+      return status;
 #else
       DBG (1, "USB record-replay mode support is missing\n");
       return SANE_STATUS_UNSUPPORTED;
@@ -4041,6 +6152,8 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
 
       if (ioctl (devices[dn].fd, SCANNER_IOCTL_CTRLMSG, &c) < 0)
 	{
+	  sanei_usb_stats_add (stats, start_usec, -1,
+			       sanei_usb_stats_errno_result (errno));
 	  DBG (5, "sanei_usb_control_msg: SCANNER_IOCTL_CTRLMSG error - %s\n",
 	       strerror (errno));
 	  return SANE_STATUS_IO_ERROR;
@@ -4059,6 +6172,8 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
 
       if (ioctl (devices[dn].fd, B_SCANNER_IOCTL_CTRLMSG, &c) < 0)
 	{
+	  sanei_usb_stats_add (stats, start_usec, -1,
+			       sanei_usb_stats_errno_result (errno));
 	  DBG (5, "sanei_usb_control_msg: SCANNER_IOCTL_CTRLMSG error - %s\n",
 	       strerror (errno));
 	  return SANE_STATUS_IO_ERROR;
@@ -4080,6 +6195,8 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
 				libusb_timeout);
       if (result < 0)
 	{
+	  sanei_usb_stats_add (stats, start_usec, -1,
+			       sanei_usb_stats_errno_result (-result));
 	  DBG (1, "sanei_usb_control_msg: libusb complained: %s\n",
 	       usb_strerror ());
 	  return SANE_STATUS_INVAL;
@@ -4096,6 +6213,8 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
 					libusb_timeout);
       if (result < 0)
 	{
+	  sanei_usb_stats_add (stats, start_usec, -1,
+			       sanei_usb_stats_libusb_result (result));
 	  DBG (1, "sanei_usb_control_msg: libusb complained: %s\n",
 	       sanei_libusb_strerror (result));
 	  return SANE_STATUS_INVAL;
@@ -4120,6 +6239,7 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
       DBG (5, "rc of usb_control_msg = %d\n",result);
       if (result < 0)
 	{
+	  sanei_usb_stats_add (stats, start_usec, -1, sanei_usb_stats_error);
 	  DBG (1, "sanei_usb_control_msg: usbcalls complained: %d\n",result);
 	  return SANE_STATUS_INVAL;
 	}
@@ -4139,6 +6259,8 @@ sanei_usb_control_msg (SANE_Int dn, SANE_Int rtype, SANE_Int req,
       return SANE_STATUS_UNSUPPORTED;
     }
 
+  sanei_usb_stats_add (stats, start_usec, len, sanei_usb_stats_ok);
+
   if (testing_mode == sanei_usb_testing_mode_record)
     {
 #if WITH_USB_RECORD_REPLAY
@@ -4160,6 +6282,21 @@ static void sanei_usb_record_read_int(xmlNode* node,
 {
   (void) size;
 
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      sanei_usb_stream_record_init(&rec, sanei_usb_replay_log_tx_interrupt,
+                                   devices[dn].int_in_ep & 0x0f, 1);
+      rec.wanted_size = size;
+      if (read_size < 0)
+        {
+          rec.flags |= SANEI_USB_REPLAY_LOG_FLAG_TIMEOUT;
+          read_size = 0;
+        }
+      sanei_usb_stream_append(&rec, buffer, read_size);
+      return;
+    }
+
   int node_was_null = node == NULL;
   if (node_was_null)
     node = testing_append_commands_node;
@@ -4210,6 +6347,9 @@ static void sanei_usb_record_replace_read_int(xmlNode* node,
 static int sanei_usb_replay_read_int(SANE_Int dn, SANE_Byte* buffer,
                                      size_t size)
 {
+  if (testing_log_header != NULL)
+    return sanei_usb_replay_log_read_int(dn, buffer, size);
+
   if (testing_known_commands_input_failed)
     return -1;
 
@@ -4282,6 +6422,8 @@ SANE_Status
 sanei_usb_read_int (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 {
   ssize_t read_size = 0;
+  unsigned long long start_usec;
+  sanei_usb_stats_result stats_result = sanei_usb_stats_ok;
 #if defined(HAVE_LIBUSB_LEGACY) || defined(HAVE_LIBUSB)
   SANE_Bool stalled = SANE_FALSE;
 #endif
@@ -4300,6 +6442,7 @@ sanei_usb_read_int (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 
   DBG (5, "sanei_usb_read_int: trying to read %lu bytes\n",
        (unsigned long) *size);
+  start_usec = sanei_usb_stats_now ();
   if (testing_mode == sanei_usb_testing_mode_replay)
     {
 #if WITH_USB_RECORD_REPLAY
@@ -4326,8 +6469,11 @@ sanei_usb_read_int (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 					  libusb_timeout);
 
 	  if (read_size < 0)
-	    DBG (1, "sanei_usb_read_int: read failed: %s\n",
-		 strerror (errno));
+	    {
+	      stats_result = sanei_usb_stats_errno_result (errno);
+	      DBG (1, "sanei_usb_read_int: read failed: %s\n",
+		   strerror (errno));
+	    }
 
 	  stalled = (read_size == -EPIPE);
 	}
@@ -4350,7 +6496,10 @@ sanei_usb_read_int (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 					   &trans_bytes, libusb_timeout);
 
 	  if (ret < 0)
-	    read_size = -1;
+	    {
+	      stats_result = sanei_usb_stats_libusb_result (ret);
+	      read_size = -1;
+	    }
 	  else
 	    read_size = trans_bytes;
 
@@ -4405,6 +6554,9 @@ sanei_usb_read_int (SANE_Int dn, SANE_Byte * buffer, size_t * size)
       return SANE_STATUS_INVAL;
     }
 
+  sanei_usb_stats_add (&devices[dn].stats.int_in, start_usec, read_size,
+		       stats_result);
+
   if (testing_mode == sanei_usb_testing_mode_record)
     {
 #if WITH_USB_RECORD_REPLAY
@@ -4453,6 +6605,9 @@ static SANE_Status sanei_usb_replay_set_configuration(SANE_Int dn,
 {
   (void) dn;
 
+  if (testing_log_header != NULL)
+    return sanei_usb_replay_log_set_configuration(configuration);
+
   xmlNode* node = sanei_xml_get_next_tx_node();
   if (node == NULL)
     {
@@ -4806,6 +6961,9 @@ sanei_usb_replay_get_descriptor(SANE_Int dn,
 {
   (void) dn;
 
+  if (testing_log_header != NULL)
+    return sanei_usb_replay_log_get_descriptor(desc);
+
   if (testing_known_commands_input_failed)
     return SANE_STATUS_IO_ERROR;
 
@@ -4866,12 +7024,25 @@ sanei_usb_record_get_descriptor(SANE_Int dn,
 {
   (void) dn;
 
+  if (testing_record_streaming)
+    {
+      sanei_usb_stream_record rec;
+      int32_t values[7] = {
+        desc->desc_type, desc->bcd_usb, desc->bcd_dev, desc->dev_class,
+        desc->dev_sub_class, desc->dev_protocol, desc->max_packet_size
+      };
+      sanei_usb_stream_record_init(&rec, sanei_usb_replay_log_tx_get_descriptor,
+                                   0, 1);
+      sanei_usb_stream_append(&rec, values, sizeof(values));
+      return;
+    }
+
   xmlNode* node = testing_append_commands_node;
 
   xmlNode* e_tx = xmlNewNode(NULL, (const xmlChar*)"get_descriptor");
 
   xmlNewProp(e_tx, (const xmlChar*)"time_usec", (const xmlChar*)"0");
-  sanei_xml_set_uint_attr(node, "seq", ++testing_last_known_seq);
+  sanei_xml_set_uint_attr(e_tx, "seq", ++testing_last_known_seq);
 
   sanei_xml_set_hex_attr(e_tx, "descriptor_type", desc->desc_type);
   sanei_xml_set_hex_attr(e_tx, "bcd_usb", desc->bcd_usb);
@@ -4885,6 +7056,245 @@ sanei_usb_record_get_descriptor(SANE_Int dn,
   testing_append_commands_node = node;
 }
 
+// Sets the endpoint used by the XML recorder for the given stream record
+static void sanei_usb_stream_set_endpoint(SANE_Int* ep, int endpoint_number,
+                                          int direction_is_in)
+{
+  *ep = endpoint_number | (direction_is_in ? USB_DIR_IN : USB_DIR_OUT);
+}
+
+static SANE_Status sanei_usb_stream_convert_record(const sanei_usb_stream_record* rec,
+                                                   char* data)
+{
+  device_list_type* device = &devices[0];
+  int direction_is_in = (rec->flags & SANEI_USB_REPLAY_LOG_FLAG_IN) != 0;
+
+  if (rec->type == SANEI_USB_STREAM_RECORD_CLEAR)
+    {
+      sanei_usb_testing_record_clear();
+      xmlFreeDoc(testing_xml_doc);
+      testing_xml_doc = xmlNewDoc((const xmlChar*)"1.0");
+      return SANE_STATUS_GOOD;
+    }
+
+  if (rec->type == SANEI_USB_STREAM_RECORD_DESCRIPTION)
+    {
+      sanei_usb_stream_description desc;
+      if (rec->data_size != sizeof(desc))
+        return SANE_STATUS_INVAL;
+      memcpy(&desc, data, sizeof(desc));
+
+      device->vendor = desc.vendor;
+      device->product = desc.product;
+      device->interface_nr = desc.interface_nr;
+      device->bulk_in_ep = desc.bulk_in_ep;
+      device->bulk_out_ep = desc.bulk_out_ep;
+      device->iso_in_ep = desc.iso_in_ep;
+      device->iso_out_ep = desc.iso_out_ep;
+      device->int_in_ep = desc.int_in_ep;
+      device->int_out_ep = desc.int_out_ep;
+      device->control_in_ep = desc.control_in_ep;
+      device->control_out_ep = desc.control_out_ep;
+      sanei_usb_record_open(0);
+      return SANE_STATUS_GOOD;
+    }
+
+  if (!testing_already_opened)
+    {
+      DBG(1, "%s: transaction before the device description\n", __func__);
+      return SANE_STATUS_INVAL;
+    }
+
+  // the XML recorder increments the sequence number itself
+  testing_last_known_seq = rec->seq - 1;
+  ssize_t read_size = (rec->flags & SANEI_USB_REPLAY_LOG_FLAG_TIMEOUT) ?
+      -1 : (ssize_t) rec->data_size;
+
+  switch (rec->type)
+    {
+      case sanei_usb_replay_log_tx_control:
+        if (rec->data_size != rec->w_length)
+          return SANE_STATUS_INVAL;
+        sanei_usb_record_control_msg(NULL, 0, rec->bm_request_type,
+                                     rec->b_request, rec->w_value,
+                                     rec->w_index, rec->w_length,
+                                     (const SANE_Byte*) data);
+        break;
+
+      case sanei_usb_replay_log_tx_bulk:
+        if (direction_is_in)
+          {
+            sanei_usb_stream_set_endpoint(&device->bulk_in_ep,
+                                          rec->endpoint_number, 1);
+            sanei_usb_record_read_bulk(NULL, 0, (SANE_Byte*) data,
+                                       rec->wanted_size, read_size);
+          }
+        else
+          {
+            sanei_usb_stream_set_endpoint(&device->bulk_out_ep,
+                                          rec->endpoint_number, 0);
+            sanei_usb_record_write_bulk(NULL, 0, (const SANE_Byte*) data,
+                                        rec->data_size, rec->data_size);
+          }
+        break;
+
+      case sanei_usb_replay_log_tx_interrupt:
+        sanei_usb_stream_set_endpoint(&device->int_in_ep,
+                                      rec->endpoint_number, 1);
+        sanei_usb_record_read_int(NULL, 0, (SANE_Byte*) data,
+                                  rec->wanted_size, read_size);
+        break;
+
+      case sanei_usb_replay_log_tx_get_descriptor:
+        {
+          struct sanei_usb_dev_descriptor desc;
+          int32_t values[7];
+          if (rec->data_size != sizeof(values))
+            return SANE_STATUS_INVAL;
+          memcpy(values, data, sizeof(values));
+
+          desc.desc_type = values[0];
+          desc.bcd_usb = values[1];
+          desc.bcd_dev = values[2];
+          desc.dev_class = values[3];
+          desc.dev_sub_class = values[4];
+          desc.dev_protocol = values[5];
+          desc.max_packet_size = values[6];
+          sanei_usb_record_get_descriptor(0, &desc);
+          break;
+        }
+
+      case sanei_usb_replay_log_tx_debug:
+        data[rec->data_size] = '\0';
+        sanei_usb_record_debug_msg(NULL, data);
+        // debug nodes don't carry a timestamp
+        return SANE_STATUS_GOOD;
+
+      default:
+        DBG(1, "%s: unknown record type %d\n", __func__, rec->type);
+        return SANE_STATUS_INVAL;
+    }
+
+  char time_usec[32];
+  snprintf(time_usec, sizeof(time_usec), "%llu",
+           (unsigned long long) rec->time_usec);
+  xmlSetProp(testing_append_commands_node, (const xmlChar*)"time_usec",
+             (const xmlChar*)time_usec);
+  return SANE_STATUS_GOOD;
+}
+
+SANE_Status sanei_usb_testing_convert_stream_record(SANE_String_Const stream_path,
+                                                    SANE_String_Const xml_path)
+{
+  SANE_Status status = SANE_STATUS_GOOD;
+  sanei_usb_stream_header header;
+  sanei_usb_stream_record rec;
+  char* data = NULL;
+  size_t data_capacity = 0;
+
+  // the conversion replays the records through the XML recorder
+  if (initialized || testing_mode != sanei_usb_testing_mode_disabled)
+    {
+      DBG(1, "%s: sanei_usb must not be in use\n", __func__);
+      return SANE_STATUS_INVAL;
+    }
+
+  FILE* in = fopen(stream_path, "rb");
+  if (in == NULL)
+    {
+      DBG(1, "%s: could not open %s: %s\n", __func__, stream_path,
+          strerror(errno));
+      return SANE_STATUS_ACCESS_DENIED;
+    }
+
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, SANEI_USB_STREAM_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SANEI_USB_STREAM_VERSION ||
+      header.byte_order != SANEI_USB_REPLAY_LOG_BYTE_ORDER)
+    {
+      DBG(1, "%s: %s is not a USB capture stream of this host\n", __func__,
+          stream_path);
+      fclose(in);
+      return SANE_STATUS_INVAL;
+    }
+
+  testing_record_backend = calloc(header.backend_size + 1, 1);
+  if (testing_record_backend == NULL ||
+      fread(testing_record_backend, 1, header.backend_size, in) !=
+          header.backend_size)
+    {
+      free(testing_record_backend);
+      testing_record_backend = NULL;
+      fclose(in);
+      return SANE_STATUS_INVAL;
+    }
+
+  testing_mode = sanei_usb_testing_mode_record;
+  testing_xml_path = strdup(xml_path);
+  testing_xml_doc = xmlNewDoc((const xmlChar*)"1.0");
+  memset(&devices[0], 0, sizeof(devices[0]));
+
+  while (fread(&rec, sizeof(rec), 1, in) == 1)
+    {
+      if (rec.data_size + 1 > data_capacity)
+        {
+          free(data);
+          data_capacity = rec.data_size + 1;
+          data = malloc(data_capacity);
+          if (data == NULL)
+            {
+              data_capacity = 0;
+              status = SANE_STATUS_NO_MEM;
+              break;
+            }
+        }
+
+      if (fread(data, 1, rec.data_size, in) != rec.data_size)
+        {
+          // the recording process has been interrupted
+          DBG(1, "%s: truncated record, ignoring the rest of the stream\n",
+              __func__);
+          break;
+        }
+
+      status = sanei_usb_stream_convert_record(&rec, data);
+      if (status != SANE_STATUS_GOOD)
+        {
+          DBG(1, "%s: invalid record with seq %u\n", __func__, rec.seq);
+          break;
+        }
+    }
+  fclose(in);
+  free(data);
+
+  if (!testing_already_opened)
+    {
+      DBG(1, "%s: no device has been opened in %s\n", __func__, stream_path);
+      if (status == SANE_STATUS_GOOD)
+        status = SANE_STATUS_INVAL;
+    }
+
+  if (status == SANE_STATUS_GOOD)
+    {
+      // writes the document and resets the recorder
+      sanei_usb_testing_exit();
+    }
+  else
+    {
+      free(testing_record_backend);
+      xmlFreeDoc(testing_xml_doc);
+      free(testing_xml_path);
+      testing_xml_doc = NULL;
+      testing_xml_path = NULL;
+      testing_record_backend = NULL;
+      testing_already_opened = 0;
+      testing_last_known_seq = 0;
+      testing_append_commands_node = NULL;
+    }
+  testing_mode = sanei_usb_testing_mode_disabled;
+  return status;
+}
+
 #endif // WITH_USB_RECORD_REPLAY
 
 extern SANE_Status
@@ -4968,3 +7378,29 @@ sanei_usb_get_descriptor( SANE_Int dn,
 
   return SANE_STATUS_GOOD;
 }
+
+SANE_Status
+sanei_usb_get_stats (SANE_Int dn, struct sanei_usb_stats *stats)
+{
+  if (dn >= device_number || dn < 0 || !stats)
+    {
+      DBG (1, "sanei_usb_get_stats: dn >= device number || dn < 0 || "
+	   "stats == NULL\n");
+      return SANE_STATUS_INVAL;
+    }
+
+  *stats = devices[dn].stats;
+  return SANE_STATUS_GOOD;
+}
+
+void
+sanei_usb_reset_stats (SANE_Int dn)
+{
+  if (dn >= device_number || dn < 0)
+    {
+      DBG (1, "sanei_usb_reset_stats: dn >= device number || dn < 0\n");
+      return;
+    }
+
+  memset (&devices[dn].stats, 0, sizeof (devices[dn].stats));
+}
@@ -0,0 +1,282 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+/*
+ * Checks the averaging of the calibration lines against the sort it
+ * replaced, with synthetic calibration data.  We include avision.c to
+ * get to the static functions.
+ */
+#include "../../../backend/avision.c"
+
+/* the averaging as it was before, with its bubble sort */
+static uint16_t
+ref_bubble_sort (uint8_t * sort_data, size_t count)
+{
+  size_t i, j, limit, k;
+  double sum = 0.0;
+
+  limit = count / 3;
+
+  for (i = 0; i < limit; ++i)
+    {
+      uint16_t ti = 0;
+      uint16_t tj = 0;
+
+      for (j = (i + 1); j < count; ++j)
+        {
+          ti = (uint16_t) get_double ((sort_data + i * 2));
+          tj = (uint16_t) get_double ((sort_data + j * 2));
+
+          if (ti > tj)
+            {
+              set_double ((sort_data + i * 2), tj);
+              set_double ((sort_data + j * 2), ti);
+            }
+        }
+    }
+
+  for (k = 0, i = limit; i < count; ++i)
+    {
+      sum += get_double ((sort_data + i * 2));
+      ++k;
+    }
+
+  if (k > 0)
+    return (uint16_t) (sum / (double) k);
+  else
+    return (uint16_t) (sum);
+}
+
+static uint8_t *
+ref_sort_and_average (struct calibration_format *format, uint8_t * data)
+{
+  const size_t elements_per_line = format->pixel_per_line * format->channels;
+  const size_t stride = format->bytes_per_channel * elements_per_line;
+  size_t i, line;
+  uint8_t *sort_data, *avg_data;
+
+  sort_data = malloc (format->lines * 2);
+  avg_data = malloc (elements_per_line * 2);
+  assert (sort_data && avg_data);
+
+  for (i = 0; i < elements_per_line; ++i)
+    {
+      uint8_t *ptr1 = data + i * format->bytes_per_channel;
+      uint16_t temp;
+
+      for (line = 0; line < format->lines; ++line)
+        {
+          uint8_t *ptr2 = ptr1 + line * stride;
+
+          if (format->bytes_per_channel == 1)
+            temp = 0xffff * *ptr2 / 255;
+          else
+            temp = get_double_le (ptr2);
+          set_double ((sort_data + line * 2), temp);
+        }
+
+      temp = ref_bubble_sort (sort_data, format->lines);
+      set_double ((avg_data + i * 2), temp);
+    }
+
+  free (sort_data);
+  return avg_data;
+}
+
+static unsigned
+next_random (unsigned *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+/* kinds of synthetic calibration data */
+enum pattern
+{
+  PATTERN_RANDOM,               /* any values */
+  PATTERN_NOISE,                /* a level per column with some noise */
+  PATTERN_FEW,                  /* few different values, many equal ones */
+  PATTERN_SORTED,               /* rising from line to line */
+  PATTERN_FLAT                  /* the same value everywhere */
+};
+
+static uint8_t *
+make_calibration (struct calibration_format *format, enum pattern pattern,
+                  unsigned *seed)
+{
+  size_t elements = format->pixel_per_line * format->channels;
+  size_t size = elements * format->lines * format->bytes_per_channel;
+  size_t i, line;
+  uint8_t *data = malloc (size);
+
+  assert (data);
+  for (line = 0; line < format->lines; ++line)
+    for (i = 0; i < elements; ++i)
+      {
+        unsigned v;
+
+        switch (pattern)
+          {
+          case PATTERN_RANDOM:
+            v = next_random (seed) << 1 ^ next_random (seed);
+            break;
+          case PATTERN_NOISE:
+            v = (i * 997) % 60000 + next_random (seed) % 2000;
+            break;
+          case PATTERN_FEW:
+            v = (next_random (seed) % 4) * 0x1111;
+            break;
+          case PATTERN_SORTED:
+            v = (line * 257 + i) & 0xffff;
+            break;
+          default:
+            v = 0x8080;
+            break;
+          }
+        v &= 0xffff;
+        if (format->bytes_per_channel == 1)
+          data[line * elements + i] = v >> 8;
+        else
+          {
+            data[(line * elements + i) * 2] = v & 0xff;
+            data[(line * elements + i) * 2 + 1] = v >> 8;
+          }
+      }
+  return data;
+}
+
+static void
+check_format (unsigned pixels, unsigned channels, unsigned bytes,
+              unsigned lines, enum pattern pattern, unsigned *seed)
+{
+  struct calibration_format format;
+  uint8_t *data, *avg, *ref;
+
+  memset (&format, 0, sizeof (format));
+  format.pixel_per_line = pixels;
+  format.channels = channels;
+  format.bytes_per_channel = bytes;
+  format.lines = lines;
+
+  data = make_calibration (&format, pattern, seed);
+  ref = ref_sort_and_average (&format, data);
+  avg = sort_and_average (&format, data);
+  assert (avg);
+  assert (memcmp (avg, ref, pixels * channels * 2) == 0);
+
+  free (avg);
+  free (ref);
+  free (data);
+}
+
+static void
+test_same_averages (void)
+{
+  static const unsigned lines[] = { 1, 2, 3, 4, 5, 7, 16, 17, 33, 64, 255 };
+  static const unsigned pixels[] = { 1, 5, 63, 64, 65, 200 };
+  unsigned seed = 1;
+  size_t l, p;
+  int pattern, bytes, channels;
+
+  for (l = 0; l < sizeof (lines) / sizeof (lines[0]); ++l)
+    for (p = 0; p < sizeof (pixels) / sizeof (pixels[0]); ++p)
+      for (pattern = PATTERN_RANDOM; pattern <= PATTERN_FLAT; ++pattern)
+        for (bytes = 1; bytes <= 2; ++bytes)
+          for (channels = 1; channels <= 3; channels += 2)
+            check_format (pixels[p], channels, bytes, lines[l], pattern,
+                          &seed);
+
+  printf ("%s: ok\n", __func__);
+}
+
+static void
+test_select_smallest (void)
+{
+  uint16_t v[300], sorted[300];
+  unsigned seed = 7;
+  size_t count, k, i, j;
+
+  for (count = 1; count < 300; count += 13)
+    for (k = 0; k <= count; ++k)
+      {
+        for (i = 0; i < count; ++i)
+          v[i] = next_random (&seed) % (k % 2 ? 8 : 65536);
+        memcpy (sorted, v, count * sizeof (v[0]));
+        for (i = 1; i < count; ++i)
+          for (j = i; j > 0 && sorted[j - 1] > sorted[j]; --j)
+            {
+              uint16_t t = sorted[j];
+              sorted[j] = sorted[j - 1];
+              sorted[j - 1] = t;
+            }
+
+        select_smallest (v, count, k);
+        /* the first k values are the k smallest ones */
+        for (i = 0; i < k; ++i)
+          for (j = k; j < count; ++j)
+            assert (v[i] <= v[j]);
+        /* and none got lost */
+        for (i = 1; i < count; ++i)
+          for (j = i; j > 0 && v[j - 1] > v[j]; --j)
+            {
+              uint16_t t = v[j];
+              v[j] = v[j - 1];
+              v[j - 1] = t;
+            }
+        assert (memcmp (v, sorted, count * sizeof (v[0])) == 0);
+      }
+
+  printf ("%s: ok\n", __func__);
+}
+
+/* a wide sheet-feeder: 3 colors of 5100 pixels, 16 bit, 255 lines */
+static void
+test_wide_calibration (void)
+{
+  struct calibration_format format;
+  uint8_t *data, *avg, *ref;
+  unsigned seed = 3;
+  clock_t t0, t1, t2;
+
+  memset (&format, 0, sizeof (format));
+  format.pixel_per_line = 5100;
+  format.channels = 3;
+  format.bytes_per_channel = 2;
+  format.lines = 255;
+
+  data = make_calibration (&format, PATTERN_NOISE, &seed);
+  t0 = clock ();
+  ref = ref_sort_and_average (&format, data);
+  t1 = clock ();
+  avg = sort_and_average (&format, data);
+  t2 = clock ();
+  assert (avg);
+  assert (memcmp (avg, ref, format.pixel_per_line * format.channels * 2)
+          == 0);
+
+  printf ("%s: bubble sort %.1f ms, selection %.1f ms\n", __func__,
+          (t1 - t0) * 1e3 / CLOCKS_PER_SEC, (t2 - t1) * 1e3 / CLOCKS_PER_SEC);
+
+  free (avg);
+  free (ref);
+  free (data);
+}
+
+int
+main (void)
+{
+  DBG_INIT ();
+
+  test_select_smallest ();
+  test_same_averages ();
+  test_wide_calibration ();
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
@@ -0,0 +1,157 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+/*
+ * Checks the storage of the rear page of duplex scans, in memory and in
+ * the rear file above the memory budget.  We include avision.c to get to
+ * the static functions.
+ */
+#include "../../../backend/avision.c"
+
+#define LINE_SIZE 1000
+#define LINES 300
+
+static uint8_t
+pattern (size_t line, size_t x)
+{
+  return (uint8_t) (line * 31 + x * 7 + line / 256);
+}
+
+static void
+store_page (Avision_Scanner * s, size_t lines_per_write)
+{
+  uint8_t *page = malloc (LINE_SIZE * LINES);
+  rear_buffer rb;
+  size_t line, x;
+
+  assert (page);
+  for (line = 0; line < LINES; ++line)
+    for (x = 0; x < LINE_SIZE; ++x)
+      page[line * LINE_SIZE + x] = pattern (line, x);
+
+  assert (rear_buffer_open_write (&rb, s) == SANE_STATUS_GOOD);
+  for (line = 0; line < LINES; line += lines_per_write)
+    {
+      size_t n = LINES - line < lines_per_write ? LINES - line : lines_per_write;
+      assert (rear_buffer_write (&rb, page + line * LINE_SIZE, n * LINE_SIZE)
+              == SANE_STATUS_GOOD);
+    }
+  rear_buffer_close (&rb);
+  free (page);
+}
+
+/* read the page back in chunks of the given size, which need not be
+   whole lines */
+static void
+check_page (Avision_Scanner * s, SANE_Bool reverse, size_t chunk)
+{
+  uint8_t *page = malloc (LINE_SIZE * LINES + chunk);
+  rear_buffer rb;
+  size_t pos = 0, got, line, x;
+
+  assert (page);
+  assert (rear_buffer_open_read (&rb, s, reverse, LINE_SIZE)
+          == SANE_STATUS_GOOD);
+  while ((got = rear_buffer_read (&rb, page + pos, chunk)) > 0)
+    pos += got;
+  rear_buffer_close (&rb);
+
+  assert (pos == LINE_SIZE * LINES);
+  for (line = 0; line < LINES; ++line)
+    for (x = 0; x < LINE_SIZE; ++x)
+      assert (page[line * LINE_SIZE + x]
+              == pattern (reverse ? LINES - 1 - line : line, x));
+  free (page);
+}
+
+static void
+check_storage (size_t memory, SANE_Bool in_memory)
+{
+  Avision_Scanner s;
+  int fd;
+
+  memset (&s, 0, sizeof (s));
+  strcpy (s.duplex_rear_fname, "/tmp/avision-rear-test-XXXXXX");
+  fd = mkstemp (s.duplex_rear_fname);
+  assert (fd >= 0);
+  close (fd);
+  duplex_rear_memory = memory;
+
+  store_page (&s, 1);
+  assert (s.duplex_rear_in_memory == in_memory);
+  check_page (&s, SANE_FALSE, 4096);
+  check_page (&s, SANE_TRUE, 4096);
+  check_page (&s, SANE_TRUE, LINE_SIZE);
+  check_page (&s, SANE_TRUE, 333);
+
+  store_page (&s, 64);
+  assert (s.duplex_rear_in_memory == in_memory);
+  check_page (&s, SANE_FALSE, 0x100000);
+  check_page (&s, SANE_TRUE, 0x100000);
+  check_page (&s, SANE_FALSE, 777);
+
+  rear_buffer_free_data (&s);
+  unlink (s.duplex_rear_fname);
+
+  printf ("%s: memory %lu: ok\n", __func__, (unsigned long) memory);
+}
+
+/* an empty page in memory must not be read from the rear file, which
+   still holds the page before */
+static void
+check_empty_page (void)
+{
+  Avision_Scanner s;
+  rear_buffer rb;
+  uint8_t buf[LINE_SIZE];
+  int fd;
+
+  memset (&s, 0, sizeof (s));
+  strcpy (s.duplex_rear_fname, "/tmp/avision-rear-test-XXXXXX");
+  fd = mkstemp (s.duplex_rear_fname);
+  assert (fd >= 0);
+  close (fd);
+
+  duplex_rear_memory = 0;
+  store_page (&s, 64);
+  rear_buffer_free_data (&s);
+
+  duplex_rear_memory = LINE_SIZE * LINES;
+  assert (rear_buffer_open_write (&rb, &s) == SANE_STATUS_GOOD);
+  rear_buffer_close (&rb);
+  assert (s.duplex_rear_in_memory && s.duplex_rear_size == 0);
+
+  assert (rear_buffer_open_read (&rb, &s, SANE_FALSE, LINE_SIZE)
+          == SANE_STATUS_GOOD);
+  assert (rear_buffer_read (&rb, buf, sizeof (buf)) == 0);
+  rear_buffer_close (&rb);
+
+  rear_buffer_free_data (&s);
+  unlink (s.duplex_rear_fname);
+
+  printf ("%s: ok\n", __func__);
+}
+
+int
+main (void)
+{
+  DBG_INIT ();
+
+  /* in memory */
+  check_storage (LINE_SIZE * LINES, SANE_TRUE);
+  /* spilled to the file after 100 lines */
+  check_storage (LINE_SIZE * 100, SANE_FALSE);
+  /* always the file */
+  check_storage (0, SANE_FALSE);
+
+  check_empty_page ();
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
@@ -0,0 +1,209 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Checks that images without software processing stream through a small
+ * ring, and come out the same as from a buffer for the whole page.  A
+ * fake scanner hands blocks to copy_simplex() the way read_from_scanner()
+ * does.  We include canon_dr.c to get to the static functions.
+ */
+#include "../../../backend/canon_dr.c"
+
+#define WIDTH 400
+#define HEIGHT 300
+
+static struct scanner *s;
+static unsigned char *data;
+
+static unsigned
+next_random (unsigned *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+static void
+set_params (struct img_params *p, int mode, SANE_Frame format)
+{
+  p->mode = mode;
+  p->source = SOURCE_ADF_FRONT;
+  p->format = format;
+  p->dpi_x = p->dpi_y = 300;
+  p->width = p->valid_width = WIDTH;
+  p->height = HEIGHT;
+  if (mode == MODE_COLOR)
+    p->Bpl = WIDTH * 3;
+  else if (mode == MODE_GRAYSCALE)
+    p->Bpl = WIDTH;
+  else
+    p->Bpl = WIDTH / 8;
+  p->valid_Bpl = p->Bpl;
+}
+
+/* scan data in mode s_mode, sent to the user in mode i_mode */
+static void
+setup (int s_mode, int i_mode, SANE_Frame format, int buffers)
+{
+  size_t i;
+
+  image_buffers (s, 0);
+  memset (s, 0, sizeof (*s));
+  s->threshold = 90;
+  s->bg_color = 0xee;
+  for (i = 0; i < 256; i++)
+    s->lut[i] = i;
+  set_params (&s->s, s_mode, format);
+  set_params (&s->i, i_mode, format);
+  set_params (&s->u, i_mode, format);
+  /* reads of 7 lines, not a whole number of them */
+  s->buffer_size = 7 * s->s.Bpl + 5;
+
+  assert (clean_params (s) == SANE_STATUS_GOOD);
+  assert (image_buffers (s, buffers) == SANE_STATUS_GOOD);
+}
+
+/* read a page like sane_read(), the scanner stops after the given number
+   of lines, returns the number of bytes */
+static int
+scan_page (int lines, unsigned char *out, unsigned *seed)
+{
+  int side = SIDE_FRONT, got, pos = 0;
+
+  while (s->u.bytes_sent[side] < s->i.bytes_tot[side])
+    {
+      if (!s->s.eof[side] && buffer_has_room (s, side))
+        {
+          int bytes = s->buffer_size - s->buffer_size % s->s.Bpl;
+          int remain = lines * s->s.Bpl - s->s.bytes_sent[side];
+
+          if (bytes > remain)
+            bytes = remain;
+          copy_simplex (s, data + s->s.bytes_sent[side], bytes, side);
+
+          if (bytes == remain)
+            {
+              if (s->s.format == SANE_FRAME_JPEG)
+                {
+                  s->i.bytes_tot[side] = s->i.bytes_sent[side];
+                  s->u.bytes_tot[side] = s->i.bytes_sent[side];
+                }
+              else
+                fill_image (s, side);
+              s->s.eof[side] = 1;
+            }
+        }
+
+      if (s->s.eof[side] && s->i.bytes_sent[side] < s->i.bytes_tot[side])
+        fill_image (s, side);
+
+      /* the ring never holds more than it has room for */
+      assert (s->i.bytes_sent[side] - s->u.bytes_sent[side]
+              <= s->buffer_len[side]);
+
+      assert (read_from_buffer (s, out + pos, 1 + next_random (seed) % 20000,
+                                &got, side) == SANE_STATUS_GOOD);
+      pos += got;
+    }
+  return pos;
+}
+
+static void
+check_mode (int s_mode, int i_mode, SANE_Frame format, int lines)
+{
+  static unsigned char page[WIDTH * 3 * HEIGHT], ring[WIDTH * 3 * HEIGHT];
+  unsigned seed = 1;
+  int page_len, ring_len, tot;
+
+  setup (s_mode, i_mode, format, 1);
+  tot = s->i.bytes_tot[SIDE_FRONT];
+  assert (s->buffer_len[SIDE_FRONT] == tot);
+  page_len = scan_page (lines, page, &seed);
+
+  seed = 1;
+  setup (s_mode, i_mode, format, 2);
+  assert (s->buffer_len[SIDE_FRONT] < tot / 2);
+  ring_len = scan_page (lines, ring, &seed);
+
+  assert (page_len == ring_len);
+  assert (memcmp (page, ring, page_len) == 0);
+  if (format == SANE_FRAME_JPEG)
+    assert (page_len == lines * s->s.Bpl);
+  else
+    assert (page_len == tot);
+  if (s_mode == i_mode)
+    assert (memcmp (page, data, lines * s->s.Bpl) == 0);
+
+  image_buffers (s, 0);
+}
+
+static void
+test_stream (void)
+{
+  check_mode (MODE_GRAYSCALE, MODE_GRAYSCALE, SANE_FRAME_GRAY, HEIGHT);
+  check_mode (MODE_COLOR, MODE_COLOR, SANE_FRAME_RGB, HEIGHT);
+  check_mode (MODE_COLOR, MODE_GRAYSCALE, SANE_FRAME_GRAY, HEIGHT);
+  check_mode (MODE_COLOR, MODE_LINEART, SANE_FRAME_GRAY, HEIGHT);
+  check_mode (MODE_LINEART, MODE_LINEART, SANE_FRAME_GRAY, HEIGHT);
+
+  /* short pages are filled with the background */
+  check_mode (MODE_GRAYSCALE, MODE_GRAYSCALE, SANE_FRAME_GRAY, HEIGHT / 3);
+  check_mode (MODE_COLOR, MODE_GRAYSCALE, SANE_FRAME_GRAY, 1);
+
+  /* jpeg pages end where the data does */
+  check_mode (MODE_COLOR, MODE_COLOR, SANE_FRAME_JPEG, HEIGHT / 2);
+
+  printf ("%s: ok\n", __func__);
+}
+
+static void
+test_whole_page (void)
+{
+  /* processing needs the whole page */
+  setup (MODE_GRAYSCALE, MODE_GRAYSCALE, SANE_FRAME_GRAY, 2);
+  s->swdespeck = 1;
+  assert (must_buffer_side (s, SIDE_FRONT));
+  s->swdespeck = 0;
+  s->swcrop = 1;
+  assert (must_buffer_side (s, SIDE_FRONT));
+  s->swcrop = 0;
+  assert (!must_buffer_side (s, SIDE_FRONT));
+
+  /* so does the back of duplex interlaced in the lines of the front */
+  s->s.source = SOURCE_ADF_DUPLEX;
+  s->duplex_interlace = DUPLEX_INTERLACE_FBfb;
+  assert (!must_buffer_side (s, SIDE_FRONT));
+  assert (must_buffer_side (s, SIDE_BACK));
+  s->duplex_interlace = DUPLEX_INTERLACE_NONE;
+  assert (!must_buffer_side (s, SIDE_BACK));
+
+  image_buffers (s, 0);
+  printf ("%s: ok\n", __func__);
+}
+
+int
+main (void)
+{
+  unsigned seed = 3;
+  size_t i;
+
+  DBG_INIT ();
+
+  s = calloc (1, sizeof (*s));
+  data = malloc (WIDTH * 3 * HEIGHT);
+  assert (s && data);
+  for (i = 0; i < WIDTH * 3 * HEIGHT; i++)
+    data[i] = next_random (&seed);
+
+  test_stream ();
+  test_whole_page ();
+
+  free (data);
+  free (s);
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
@@ -0,0 +1,426 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+ * Loopback stand-in for a networked Epson scanner, to check the extended
+ * image data handshaking over TCP.
+ *
+ * The scanner answers FS G with the block layout of the image, sends the
+ * first block on the read request that follows and every other block on
+ * the ACK of the previous one. Each answer is delayed by LATENCY_US, like
+ * on a slow network.
+ */
+#define DEBUG_DECLARE_ONLY
+
+#include "../../../backend/epson2.h"
+#include "../../../backend/epson2-ops.h"
+#include "../../../backend/epson2_net.h"
+
+#define LATENCY_US 2000
+
+struct scanner
+{
+  int listen_fd;
+  int fd;
+  pthread_t thread;
+
+  /* the image: blocks of block_len bytes, the last one of last_len */
+  int blocks;
+  size_t block_len, last_len;
+  int cancel_req;               /* block with FSG_STATUS_CANCEL_REQ set */
+  unsigned image;               /* number of the image */
+
+  /* updated by the scanner task */
+  volatile int sent;            /* blocks of the image sent so far */
+  volatile int cancels;         /* CAN received */
+};
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static SANE_Byte
+pattern (unsigned image, int block, size_t pos)
+{
+  return (SANE_Byte) (pos * 7 + pos / 251 + block * 3 + image);
+}
+
+static int
+read_full (int fd, void *buf, size_t len)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len)
+    {
+      n = read (fd, (char *) buf + done, len - done);
+      if (n <= 0)
+        return -1;
+      done += n;
+    }
+  return 0;
+}
+
+static void
+write_full (int fd, const void *buf, size_t len)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len)
+    {
+      n = write (fd, (const char *) buf + done, len - done);
+      assert (n > 0);
+      done += n;
+    }
+}
+
+static void
+put_be32 (unsigned char *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void
+put_le32 (unsigned char *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static uint32_t
+get_be32 (const unsigned char *p)
+{
+  return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void
+reply (struct scanner *sc, const unsigned char *payload, size_t len)
+{
+  unsigned char header[12];
+
+  usleep (LATENCY_US);
+  memset (header, 0, sizeof (header));
+  header[0] = 'I';
+  header[1] = 'S';
+  header[2] = 0x20;
+  put_be32 (header + 6, len);
+  write_full (sc->fd, header, sizeof (header));
+  write_full (sc->fd, payload, len);
+}
+
+static size_t
+block_size (struct scanner *sc, int block)
+{
+  return block == sc->blocks && sc->last_len ? sc->last_len : sc->block_len;
+}
+
+static void
+send_block (struct scanner *sc, size_t reply_len)
+{
+  int block = sc->sent + 1;
+  size_t len = block_size (sc, block), i;
+  unsigned char *data = malloc (len + 1);
+
+  assert (data);
+  assert (block <= sc->blocks);
+  /* the host asks for the size of the block and its status byte */
+  assert (reply_len == len + 1);
+
+  for (i = 0; i < len; i++)
+    data[i] = pattern (sc->image, block, i);
+  data[len] = block == sc->cancel_req ? FSG_STATUS_CANCEL_REQ : 0;
+
+  reply (sc, data, len + 1);
+  sc->sent = block;
+  free (data);
+}
+
+static void *
+scanner_task (void *args)
+{
+  struct scanner *sc = args;
+  unsigned char header[12], h2[8], payload[16];
+  size_t size, buf_size, reply_len;
+  int val = 1;
+
+  sc->fd = accept (sc->listen_fd, NULL, NULL);
+  assert (sc->fd >= 0);
+  setsockopt (sc->fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof (val));
+
+  while (read_full (sc->fd, header, sizeof (header)) == 0)
+    {
+      assert (header[0] == 'I' && header[1] == 'S');
+      assert (header[2] == 0x20 && header[3] == 0x00);
+      size = get_be32 (header + 6);
+      assert (size >= 8 && size - 8 <= sizeof (payload));
+      assert (read_full (sc->fd, h2, sizeof (h2)) == 0);
+      buf_size = get_be32 (h2);
+      reply_len = get_be32 (h2 + 4);
+      assert (buf_size == size - 8);
+      assert (read_full (sc->fd, payload, buf_size) == 0);
+
+      if (buf_size == 2 && payload[0] == FS && payload[1] == 'G')
+        {
+          unsigned char layout[14];
+
+          /* a new image */
+          assert (reply_len == sizeof (layout));
+          sc->image++;
+          sc->sent = 0;
+          layout[0] = STX;
+          layout[1] = 0;
+          put_le32 (layout + 2, (uint32_t) sc->block_len);
+          put_le32 (layout + 6,
+                    (uint32_t) (sc->last_len ? sc->blocks - 1 : sc->blocks));
+          put_le32 (layout + 10, (uint32_t) sc->last_len);
+          reply (sc, layout, sizeof (layout));
+        }
+      else if (buf_size == 0)
+        {
+          /* the read request for the first block */
+          assert (sc->sent == 0);
+          send_block (sc, reply_len);
+        }
+      else if (buf_size == 1 && payload[0] == S_ACK[0])
+        {
+          assert (sc->sent < sc->blocks);
+          assert (sc->sent != sc->cancel_req);
+          send_block (sc, reply_len);
+        }
+      else if (buf_size == 1 && payload[0] == S_CAN[0])
+        {
+          /* sent by the host after the last block it received */
+          assert (reply_len == 1);
+          assert (sc->sent < sc->blocks);
+          sc->cancels++;
+          reply (sc, (const unsigned char *) S_ACK, 1);
+        }
+      else
+        assert (!"unexpected command");
+    }
+
+  close (sc->fd);
+  return NULL;
+}
+
+static void
+start_scanner (struct scanner *sc, Epson_Scanner * s, Epson_Device * dev)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof (addr);
+  int val = 1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  sc->listen_fd = socket (AF_INET, SOCK_STREAM, 0);
+  assert (sc->listen_fd >= 0);
+  assert (bind (sc->listen_fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+  assert (listen (sc->listen_fd, 1) == 0);
+  assert (getsockname (sc->listen_fd, (struct sockaddr *) &addr, &len) == 0);
+  assert (pthread_create (&sc->thread, NULL, scanner_task, sc) == 0);
+
+  memset (dev, 0, sizeof (*dev));
+  dev->connection = SANE_EPSON_NET;
+  dev->extended_commands = SANE_TRUE;
+
+  memset (s, 0, sizeof (*s));
+  s->hw = dev;
+  s->fd = socket (AF_INET, SOCK_STREAM, 0);
+  assert (s->fd >= 0);
+  setsockopt (s->fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof (val));
+  assert (connect (s->fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+}
+
+static void
+stop_scanner (struct scanner *sc, Epson_Scanner * s)
+{
+  close (s->fd);
+  pthread_join (sc->thread, NULL);
+  close (sc->listen_fd);
+}
+
+/*
+ * Scans an image of the given layout and reads it in chunks of chunk
+ * bytes, taking delay_us for each chunk, like a slow frontend. With
+ * cancel_at, sane_cancel() is called once that many bytes were read.
+ * Returns the status that ended the scan.
+ */
+static SANE_Status
+scan (struct scanner *sc, Epson_Scanner * s, int blocks, size_t block_len,
+      size_t last_len, size_t chunk, int delay_us, size_t cancel_at)
+{
+  SANE_Byte *data = malloc (chunk);
+  SANE_Status status;
+  SANE_Int len;
+  size_t pos = 0, total, i;
+  int block = 1;
+  double t;
+
+  assert (data);
+  sc->blocks = blocks;
+  sc->block_len = block_len;
+  sc->last_len = last_len;
+  total = (blocks - 1) * block_len + (last_len ? last_len : block_len);
+
+  /* what sane_start() does */
+  s->params.format = SANE_FRAME_GRAY;
+  s->params.depth = 8;
+  s->block = SANE_TRUE;
+  s->eof = SANE_FALSE;
+  s->canceling = SANE_FALSE;
+  s->buf = malloc (block_len + 1);
+  assert (s->buf);
+  s->ptr = s->end = s->buf;
+  assert (e2_start_ext_scan (s) == SANE_STATUS_GOOD);
+  sanei_epson_net_write (s, 0x2000, NULL, 0, s->ext_block_len + 1, &status);
+  assert (status == SANE_STATUS_GOOD);
+
+  /* what sane_read() does */
+  t = now ();
+  for (;;)
+    {
+      if (cancel_at && pos >= cancel_at)
+        s->canceling = SANE_TRUE;
+
+      status = e2_ext_read (s);
+      if (status != SANE_STATUS_GOOD || s->canceling)
+        break;
+
+      e2_copy_image_data (s, data, chunk, &len);
+      for (i = 0; i < (size_t) len; i++, pos++)
+        {
+          size_t start = (block - 1) * block_len;
+
+          if (pos == start + block_len)
+            {
+              /* the frontend took its time with the previous block, so
+                 the next two were received and acked meanwhile */
+              if (delay_us && block + 2 <= blocks && sc->cancel_req == 0)
+                assert (sc->sent >= block + 2);
+              block++;
+              start += block_len;
+            }
+          assert (data[i] == pattern (sc->image, block, pos - start));
+        }
+      if (delay_us)
+        usleep (delay_us);
+    }
+  t = now () - t;
+
+  if (status == SANE_STATUS_EOF)
+    assert (pos == total);
+  if (s->canceling)
+    status = SANE_STATUS_CANCELLED;
+  e2_scan_finish (s);
+
+  printf ("%s: %d blocks of %lu, %lu bytes read, %s, %.1f ms\n", __func__,
+          blocks, (unsigned long) block_len, (unsigned long) pos,
+          sane_strstatus (status), t * 1e3);
+  free (data);
+  return status;
+}
+
+static void
+test_transfers (void)
+{
+  struct scanner sc;
+  Epson_Scanner s;
+  Epson_Device dev;
+
+  memset (&sc, 0, sizeof (sc));
+  start_scanner (&sc, &s, &dev);
+
+  assert (scan (&sc, &s, 1, 1000, 0, 65536, 0, 0) == SANE_STATUS_EOF);
+  assert (scan (&sc, &s, 1, 777, 777, 100, 0, 0) == SANE_STATUS_EOF);
+  assert (scan (&sc, &s, 2, 4096, 10, 65536, 0, 0) == SANE_STATUS_EOF);
+  assert (scan (&sc, &s, 20, 32768, 1234, 65536, 0, 0) == SANE_STATUS_EOF);
+  assert (scan (&sc, &s, 20, 32768, 0, 3000, 0, 0) == SANE_STATUS_EOF);
+  assert (scan (&sc, &s, 10, 16384, 99, 4096, 3 * LATENCY_US, 0)
+          == SANE_STATUS_EOF);
+  assert (sc.cancels == 0);
+
+  stop_scanner (&sc, &s);
+  printf ("%s: ok\n", __func__);
+}
+
+/* after a cancel, the connection is still in step with the scanner */
+static void
+test_cancel (void)
+{
+  struct scanner sc;
+  Epson_Scanner s;
+  Epson_Device dev;
+
+  memset (&sc, 0, sizeof (sc));
+  start_scanner (&sc, &s, &dev);
+
+  /* the frontend cancels in the middle of a block */
+  assert (scan (&sc, &s, 10, 8192, 100, 1000, 0, 20000)
+          == SANE_STATUS_CANCELLED);
+  assert (sc.cancels == 1);
+  assert (scan (&sc, &s, 4, 8192, 100, 65536, 0, 0) == SANE_STATUS_EOF);
+
+  /* while the next block is on its way */
+  assert (scan (&sc, &s, 10, 8192, 0, 8192, 3 * LATENCY_US, 8192)
+          == SANE_STATUS_CANCELLED);
+  assert (sc.cancels == 2);
+  assert (scan (&sc, &s, 4, 8192, 100, 65536, 0, 0) == SANE_STATUS_EOF);
+
+  /* when everything was received, there is nothing to cancel */
+  assert (scan (&sc, &s, 2, 8192, 0, 1000, 3 * LATENCY_US, 9000)
+          == SANE_STATUS_CANCELLED);
+  assert (sc.cancels == 2);
+
+  /* the scanner asks to cancel */
+  sc.cancel_req = 3;
+  assert (scan (&sc, &s, 10, 8192, 100, 65536, 0, 0)
+          == SANE_STATUS_CANCELLED);
+  assert (sc.cancels == 3);
+  sc.cancel_req = 0;
+  assert (scan (&sc, &s, 4, 8192, 100, 65536, 0, 0) == SANE_STATUS_EOF);
+
+  /* the frontend cancelled and started again without reading, so the
+     smaller buffer of the previous scan is still there */
+  s.ext_next = malloc (100);
+  assert (s.ext_next);
+  assert (scan (&sc, &s, 4, 8192, 100, 65536, 0, 0) == SANE_STATUS_EOF);
+
+  stop_scanner (&sc, &s);
+  printf ("%s: ok\n", __func__);
+}
+
+int
+main (void)
+{
+  DBG_INIT ();
+
+  test_transfers ();
+  test_cancel ();
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
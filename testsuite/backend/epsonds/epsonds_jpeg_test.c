@@ -0,0 +1,160 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Feeds a JPEG image to the streaming decoder in small chunks, which cut
+ * through the markers and the entropy coded data, and compares the
+ * decoded rows with those of a decode with all data fed at once.
+ */
+#define DEBUG_DECLARE_ONLY
+
+#include "../../../backend/epsonds.h"
+#include "../../../backend/epsonds-ops.h"
+#include "../../../backend/epsonds-jpeg.h"
+
+#define WIDTH 203
+#define HEIGHT 157
+
+/** an image with a pattern, as the scanner would send it
+ */
+static unsigned char *
+make_jpeg (int components, long *size)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  JSAMPROW row_pointer[1];
+  unsigned char row[WIDTH * 3];
+  unsigned char *jpeg;
+  FILE *file;
+  int i;
+
+  file = tmpfile ();
+  assert (file != NULL);
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_compress (&cinfo);
+  jpeg_stdio_dest (&cinfo, file);
+  cinfo.image_width = WIDTH;
+  cinfo.image_height = HEIGHT;
+  cinfo.input_components = components;
+  cinfo.in_color_space = components == 3 ? JCS_RGB : JCS_GRAYSCALE;
+  jpeg_set_defaults (&cinfo);
+  jpeg_start_compress (&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height)
+    {
+      for (i = 0; i < WIDTH * components; i++)
+        row[i] = (unsigned char) (cinfo.next_scanline * 5 + i * 3
+                                  + (i / 17) * 40);
+      row_pointer[0] = row;
+      jpeg_write_scanlines (&cinfo, row_pointer, 1);
+    }
+  jpeg_finish_compress (&cinfo);
+  jpeg_destroy_compress (&cinfo);
+
+  *size = ftell (file);
+  jpeg = malloc (*size);
+  assert (jpeg != NULL);
+  rewind (file);
+  assert (fread (jpeg, 1, *size, file) == (size_t) *size);
+  fclose (file);
+  return jpeg;
+}
+
+/* decodes the image, feeding chunk bytes at a time, into out */
+static void
+decode (const unsigned char *jpeg, long size, long chunk,
+        SANE_Byte * out, int row_size)
+{
+  epsonds_scanner s;
+  ring_buffer ring;
+  eds_jpeg_stream *js;
+  SANE_Status status;
+  long pos = 0, got = 0;
+  SANE_Int n;
+
+  memset (&s, 0, sizeof (s));
+  memset (&ring, 0, sizeof (ring));
+  s.params.lines = HEIGHT;
+
+  js = eds_jpeg_stream_new (&s, SANE_FALSE);
+  assert (js != NULL);
+
+  for (;;)
+    {
+      /* decode while there is room in the ring */
+      do
+        {
+          status = eds_jpeg_stream_decode (js, &ring);
+          n = ring.ring ? eds_ring_avail (&ring) : 0;
+          assert (got + n <= (long) row_size * HEIGHT);
+          if (n)
+            got += eds_ring_read (&ring, out + got, n);
+        }
+      while (status == SANE_STATUS_GOOD && n > 0);
+
+      if (status == SANE_STATUS_EOF)
+        break;
+      assert (status == SANE_STATUS_GOOD);
+
+      /* suspended, the decoder needs more data */
+      assert (pos < size);
+      n = size - pos < chunk ? size - pos : chunk;
+      assert (eds_jpeg_stream_feed (js, jpeg + pos, n) == SANE_STATUS_GOOD);
+      pos += n;
+      if (pos == size)
+        eds_jpeg_stream_end (js, 0);
+    }
+
+  assert (got == (long) row_size * HEIGHT);
+
+  eds_jpeg_stream_free (js);
+  eds_ring_destory (&ring);
+}
+
+static void
+check_chunks (int components)
+{
+  static const long chunks[] = { 1, 2, 3, 7, 61, 509, 4096 };
+  int row_size = WIDTH * components;
+  SANE_Byte *ref = malloc (row_size * HEIGHT);
+  SANE_Byte *out = malloc (row_size * HEIGHT);
+  unsigned char *jpeg;
+  long size;
+  unsigned int i;
+  int row;
+
+  assert (ref && out);
+  jpeg = make_jpeg (components, &size);
+
+  decode (jpeg, size, size, ref, row_size);
+
+  for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++)
+    {
+      memset (out, 0, row_size * HEIGHT);
+      decode (jpeg, size, chunks[i], out, row_size);
+      for (row = 0; row < HEIGHT; row++)
+        assert (memcmp (out + row * row_size, ref + row * row_size,
+                        row_size) == 0);
+    }
+
+  free (jpeg);
+  free (ref);
+  free (out);
+  printf ("%s: %d components: ok\n", __func__, components);
+}
+
+int
+main (void)
+{
+  DBG_INIT ();
+
+  check_chunks (1);
+  check_chunks (3);
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
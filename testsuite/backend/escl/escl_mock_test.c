@@ -0,0 +1,506 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <curl/curl.h>
+#include <jpeglib.h>
+
+/* sane includes for the backend functions called */
+#include "../../../include/sane/sane.h"
+#include "../../../include/sane/sanei.h"
+#include "../../../include/sane/saneopts.h"
+#define DEBUG_DECLARE_ONLY
+#include "../../../include/sane/sanei_backend.h"
+
+/*
+ * Scans pages from a mock eSCL scanner on the loopback interface, and
+ * prints the time taken by each request. All requests of an opened
+ * device must go through the same connection. Then scans ADF jobs with
+ * and without prefetching the pages.
+ *
+ * usage: escl_mock_test [scans]
+ */
+
+#define MAX_CLIENTS 16
+#define PIXELS 75               /* 1 inch at 75 dpi */
+#define ADF_PAGES 3
+
+#define INPUT_CAPS \
+  "<scan:MinWidth>16</scan:MinWidth><scan:MaxWidth>300</scan:MaxWidth>" \
+  "<scan:MinHeight>16</scan:MinHeight><scan:MaxHeight>300</scan:MaxHeight>" \
+  "<scan:MaxScanRegions>1</scan:MaxScanRegions>" \
+  "<scan:SettingProfiles><scan:SettingProfile>" \
+  "<scan:ColorModes><scan:ColorMode>RGB24</scan:ColorMode></scan:ColorModes>" \
+  "<scan:DocumentFormats>" \
+  "<pwg:DocumentFormat>image/jpeg</pwg:DocumentFormat>" \
+  "</scan:DocumentFormats>" \
+  "<scan:SupportedResolutions><scan:DiscreteResolutions>" \
+  "<scan:DiscreteResolution><scan:XResolution>75</scan:XResolution>" \
+  "<scan:YResolution>75</scan:YResolution></scan:DiscreteResolution>" \
+  "</scan:DiscreteResolutions></scan:SupportedResolutions>" \
+  "</scan:SettingProfile></scan:SettingProfiles>"
+
+static const char capabilities[] =
+  "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+  "<scan:ScannerCapabilities"
+  " xmlns:scan=\"http://schemas.hp.com/imaging/escl/2011/05/03\""
+  " xmlns:pwg=\"http://www.pwg.org/schemas/2010/12/sm\">"
+  "<pwg:Version>2.63</pwg:Version>"
+  "<pwg:MakeAndModel>SANE eSCL mock</pwg:MakeAndModel>"
+  "<scan:Platen><scan:PlatenInputCaps>" INPUT_CAPS
+  "</scan:PlatenInputCaps></scan:Platen>"
+  "<scan:Adf><scan:AdfSimplexInputCaps>" INPUT_CAPS
+  "</scan:AdfSimplexInputCaps></scan:Adf>"
+  "</scan:ScannerCapabilities>\n";
+
+/* idle, with the state of the last job */
+static const char status_format[] =
+  "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+  "<scan:ScannerStatus"
+  " xmlns:scan=\"http://schemas.hp.com/imaging/escl/2011/05/03\""
+  " xmlns:pwg=\"http://www.pwg.org/schemas/2010/12/sm\">"
+  "<pwg:Version>2.63</pwg:Version>"
+  "<pwg:State>Idle</pwg:State>"
+  "<scan:AdfState>ScannerAdfLoaded</scan:AdfState>"
+  "<scan:Jobs><scan:JobInfo>"
+  "<pwg:JobUri>/eSCL/ScanJobs/%d</pwg:JobUri>"
+  "<pwg:JobState>%s</pwg:JobState>"
+  "</scan:JobInfo></scan:Jobs>"
+  "</scan:ScannerStatus>\n";
+
+struct client
+{
+  int fd;
+  char buf[16384];
+  size_t len;
+};
+
+struct server
+{
+  int fd;
+  int port;
+  volatile int stop;
+  unsigned char *jpeg;
+  long jpeg_size;
+  int job;
+  int pages;                    /* left in the current job */
+  int connections;
+  int requests;
+  int documents;                /* pages sent */
+};
+
+/** a page with a gradient, as the scanner would send it
+ */
+static void
+make_jpeg (struct server *srv)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  JSAMPROW row_pointer[1];
+  unsigned char row[PIXELS * 3];
+  FILE *file;
+  int i;
+
+  file = tmpfile ();
+  assert (file != NULL);
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_compress (&cinfo);
+  jpeg_stdio_dest (&cinfo, file);
+  cinfo.image_width = PIXELS;
+  cinfo.image_height = PIXELS;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults (&cinfo);
+  jpeg_start_compress (&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height)
+    {
+      for (i = 0; i < PIXELS * 3; i++)
+        row[i] = (unsigned char) (cinfo.next_scanline * 3 + i);
+      row_pointer[0] = row;
+      jpeg_write_scanlines (&cinfo, row_pointer, 1);
+    }
+  jpeg_finish_compress (&cinfo);
+  jpeg_destroy_compress (&cinfo);
+
+  srv->jpeg_size = ftell (file);
+  srv->jpeg = malloc (srv->jpeg_size);
+  assert (srv->jpeg != NULL);
+  rewind (file);
+  assert (fread (srv->jpeg, 1, srv->jpeg_size, file)
+          == (size_t) srv->jpeg_size);
+  fclose (file);
+}
+
+static void
+send_all (int fd, const void *data, size_t len)
+{
+  const char *p = data;
+  ssize_t n;
+
+  while (len > 0)
+    {
+      n = send (fd, p, len, 0);
+      if (n <= 0)
+        return;
+      p += n;
+      len -= n;
+    }
+}
+
+static void
+respond (int fd, const char *status, const char *headers,
+         const char *type, const void *body, size_t len)
+{
+  char head[512];
+
+  snprintf (head, sizeof (head),
+            "HTTP/1.1 %s\r\n%sContent-Type: %s\r\n"
+            "Content-Length: %lu\r\n\r\n",
+            status, headers, type, (unsigned long) len);
+  send_all (fd, head, strlen (head));
+  send_all (fd, body, len);
+}
+
+static void
+handle_request (struct server *srv, int fd, const char *request)
+{
+  char method[16], path[256], location[128], next[64], status[1024];
+
+  assert (sscanf (request, "%15s %255s", method, path) == 2);
+  srv->requests++;
+  snprintf (next, sizeof (next), "/eSCL/ScanJobs/%d/NextDocument", srv->job);
+
+  if (!strcmp (path, "/eSCL/ScannerCapabilities"))
+    respond (fd, "200 OK", "", "text/xml", capabilities,
+             strlen (capabilities));
+  else if (!strcmp (path, "/eSCL/ScannerStatus"))
+    {
+      snprintf (status, sizeof (status), status_format, srv->job,
+                srv->pages ? "Processing" : "Completed");
+      respond (fd, "200 OK", "", "text/xml", status, strlen (status));
+    }
+  else if (!strcmp (method, "POST") && !strcmp (path, "/eSCL/ScanJobs"))
+    {
+      srv->job++;
+      srv->pages = strstr (request, "Feeder") ? ADF_PAGES : 1;
+      snprintf (location, sizeof (location),
+                "Location: http://127.0.0.1:%d/eSCL/ScanJobs/%d\r\n",
+                srv->port, srv->job);
+      respond (fd, "201 Created", location, "text/plain", "", 0);
+    }
+  else if (!strcmp (path, next) && srv->pages > 0)
+    {
+      srv->pages--;
+      srv->documents++;
+      respond (fd, "200 OK", "", "image/jpeg", srv->jpeg, srv->jpeg_size);
+    }
+  else
+    respond (fd, "404 Not Found", "", "text/plain", "", 0);
+}
+
+/** answer the complete requests in the buffer of a client
+ *
+ * @return 0, or -1 if the connection must be closed
+ */
+static int
+handle_client (struct server *srv, struct client *c)
+{
+  char *end, *length;
+  size_t head, body;
+
+  for (;;)
+    {
+      c->buf[c->len] = '\0';
+      end = strstr (c->buf, "\r\n\r\n");
+      if (end == NULL)
+        return c->len < sizeof (c->buf) - 1 ? 0 : -1;
+      head = end + 4 - c->buf;
+
+      body = 0;
+      length = strstr (c->buf, "Content-Length:");
+      if (length != NULL && length < end)
+        body = strtoul (length + 15, NULL, 10);
+      if (head + body >= sizeof (c->buf))
+        return -1;
+      if (c->len < head + body)
+        {
+          if (strstr (c->buf, "Expect: 100-continue") != NULL
+              && c->len == head)
+            send_all (c->fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+          return 0;
+        }
+
+      handle_request (srv, c->fd, c->buf);
+      memmove (c->buf, c->buf + head + body, c->len - head - body);
+      c->len -= head + body;
+    }
+}
+
+static void *
+server_thread (void *arg)
+{
+  struct server *srv = arg;
+  struct client clients[MAX_CLIENTS];
+  struct pollfd fds[MAX_CLIENTS + 1];
+  int nclients = 0, i, fd, one = 1;
+  ssize_t n;
+
+  while (!srv->stop)
+    {
+      fds[0].fd = srv->fd;
+      fds[0].events = POLLIN;
+      for (i = 0; i < nclients; i++)
+        {
+          fds[i + 1].fd = clients[i].fd;
+          fds[i + 1].events = POLLIN;
+        }
+      if (poll (fds, nclients + 1, 50) <= 0)
+        continue;
+
+      for (i = nclients - 1; i >= 0; i--)
+        {
+          if (!fds[i + 1].revents)
+            continue;
+          n = recv (clients[i].fd, clients[i].buf + clients[i].len,
+                    sizeof (clients[i].buf) - 1 - clients[i].len, 0);
+          if (n > 0)
+            clients[i].len += n;
+          if (n <= 0 || handle_client (srv, &clients[i]) < 0)
+            {
+              close (clients[i].fd);
+              clients[i] = clients[--nclients];
+            }
+        }
+
+      if (fds[0].revents)
+        {
+          fd = accept (srv->fd, NULL, NULL);
+          if (fd < 0)
+            continue;
+          if (nclients == MAX_CLIENTS)
+            {
+              close (fd);
+              continue;
+            }
+          /* answer right away, the client waits for it */
+          setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+          srv->connections++;
+          clients[nclients].fd = fd;
+          clients[nclients].len = 0;
+          nclients++;
+        }
+    }
+
+  for (i = 0; i < nclients; i++)
+    close (clients[i].fd);
+  return NULL;
+}
+
+static void
+start_server (struct server *srv, pthread_t * thread)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof (addr);
+
+  memset (srv, 0, sizeof (*srv));
+  make_jpeg (srv);
+
+  srv->fd = socket (AF_INET, SOCK_STREAM, 0);
+  assert (srv->fd >= 0);
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  assert (bind (srv->fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+  assert (listen (srv->fd, 8) == 0);
+  assert (getsockname (srv->fd, (struct sockaddr *) &addr, &len) == 0);
+  srv->port = ntohs (addr.sin_port);
+
+  assert (pthread_create (thread, NULL, server_thread, srv) == 0);
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/** print the time taken and the requests made since start
+ */
+static void
+report (struct server *srv, const char *what, double start, int requests)
+{
+  printf ("%s: %-8s %2d request(s) %8.3f ms\n", __func__, what,
+          srv->requests - requests, (now () - start) * 1000);
+}
+
+/** scan and read a page
+ *
+ * @return the status of sane_start()
+ */
+static SANE_Status
+scan_page (struct server *srv, SANE_Handle h)
+{
+  SANE_Parameters params;
+  SANE_Byte buf[4096];
+  SANE_Status status;
+  SANE_Int len;
+  long total = 0;
+  double start;
+  int requests;
+
+  start = now ();
+  requests = srv->requests;
+  status = sane_start (h);
+  report (srv, "start", start, requests);
+  if (status != SANE_STATUS_GOOD)
+    return status;
+
+  status = sane_get_parameters (h, &params);
+  assert (status == SANE_STATUS_GOOD);
+  assert (params.pixels_per_line == PIXELS && params.lines == PIXELS);
+
+  start = now ();
+  requests = srv->requests;
+  while ((status = sane_read (h, buf, sizeof (buf), &len))
+         == SANE_STATUS_GOOD)
+    total += len;
+  assert (status == SANE_STATUS_EOF);
+  assert (total == (long) params.bytes_per_line * params.lines);
+  report (srv, "read", start, requests);
+  return SANE_STATUS_GOOD;
+}
+
+static void
+cancel (struct server *srv, SANE_Handle h)
+{
+  double start = now ();
+  int requests = srv->requests;
+
+  sane_cancel (h);
+  report (srv, "cancel", start, requests);
+}
+
+/** scan an ADF job, with the given escl.conf line
+ */
+static void
+scan_adf (struct server *srv, const char *name, const char *conf,
+          const char *option)
+{
+  const SANE_Option_Descriptor *opt;
+  SANE_Handle h;
+  SANE_Status status;
+  FILE *file;
+  int i, pages = 0, documents = srv->documents;
+
+  printf ("%s: '%s'\n", __func__, option);
+  file = fopen (conf, "w");
+  assert (file != NULL);
+  fprintf (file, "%s\n", option);
+  fclose (file);
+
+  status = sane_open (name, &h);
+  assert (status == SANE_STATUS_GOOD);
+  for (i = 1; (opt = sane_get_option_descriptor (h, i)) != NULL; i++)
+    if (opt->name && !strcmp (opt->name, SANE_NAME_SCAN_SOURCE))
+      break;
+  assert (opt != NULL);
+  status = sane_control_option (h, i, SANE_ACTION_SET_VALUE, "ADF", NULL);
+  assert (status == SANE_STATUS_GOOD);
+
+  while ((status = scan_page (srv, h)) == SANE_STATUS_GOOD)
+    pages++;
+  assert (status == SANE_STATUS_NO_DOCS);
+  assert (pages == ADF_PAGES);
+  assert (srv->documents - documents == ADF_PAGES);
+  cancel (srv, h);
+  sane_close (h);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct server srv;
+  pthread_t thread;
+  SANE_Handle h;
+  SANE_Status status;
+  char name[64], dir[] = "/tmp/escl_mock_test.XXXXXX", conf[64];
+  double begin, start;
+  int scans = 5, connections, i;
+
+  if (argc > 1)
+    scans = atoi (argv[1]);
+  if (scans < 1)
+    {
+      fprintf (stderr, "usage: %s [scans]\n", argv[0]);
+      return 1;
+    }
+
+  start_server (&srv, &thread);
+  snprintf (name, sizeof (name), "http://127.0.0.1:%d", srv.port);
+  printf ("%s: mock scanner at %s\n", __func__, name);
+
+  /* our own escl.conf */
+  assert (mkdtemp (dir) != NULL);
+  snprintf (conf, sizeof (conf), "%s/escl.conf", dir);
+  setenv ("SANE_CONFIG_DIR", dir, 1);
+
+  status = sane_init (NULL, NULL);
+  assert (status == SANE_STATUS_GOOD);
+
+  begin = start = now ();
+  status = sane_open (name, &h);
+  assert (status == SANE_STATUS_GOOD);
+  report (&srv, "open", start, 0);
+
+  for (i = 0; i < scans; i++)
+    {
+      status = scan_page (&srv, h);
+      assert (status == SANE_STATUS_GOOD);
+      cancel (&srv, h);
+    }
+
+  sane_close (h);
+  printf ("%s: %d requests over %d connection(s), %.3f ms/request\n",
+          __func__, srv.requests, srv.connections,
+          (now () - begin) * 1000 / srv.requests);
+  connections = srv.connections;
+
+  scan_adf (&srv, name, conf, "");
+  scan_adf (&srv, name, conf, "prefetch 1");
+  scan_adf (&srv, name, conf, "prefetch 2");
+  scan_adf (&srv, name, conf, "nostream\nprefetch 2");
+
+  sane_exit ();
+  unlink (conf);
+  rmdir (dir);
+
+  srv.stop = 1;
+  pthread_join (thread, NULL);
+  close (srv.fd);
+  free (srv.jpeg);
+
+#if LIBCURL_VERSION_NUM >= 0x073900
+  /* older libcurl can't share connections between handles */
+  assert (connections == 1);
+#endif
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
@@ -0,0 +1,361 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Feeds an interlaced duplex JPEG to sane_read() through a fake SCSI
+ * read, which hands out pieces of random length, and checks that both
+ * sides come out as the JPEG the scanner would have sent for them.  The
+ * front buffer stays small, the back buffer grows as the back arrives,
+ * or is drained and moved down in low-mem mode.  We include fujitsu.c
+ * to get to the static functions.
+ */
+#define sanei_scsi_cmd2 mock_scsi_cmd2
+
+#include "../../../backend/fujitsu.c"
+
+#undef sanei_scsi_cmd2
+
+#define WIDTH 600
+#define HEIGHT 400
+#define DPI 300
+#define BUFFER_SIZE 1024
+#define SEGMENTS 60
+
+struct stream
+{
+  unsigned char *data;
+  size_t len;
+  size_t pos;
+};
+
+static struct stream scanner, expect[2];
+static unsigned seed;
+
+static unsigned
+next_random (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+static void
+put (struct stream *st, const unsigned char *bytes, size_t len)
+{
+  st->data = realloc (st->data, st->len + len);
+  assert (st->data != NULL);
+  memcpy (st->data + st->len, bytes, len);
+  st->len += len;
+}
+
+static void
+put_byte (struct stream *st, unsigned char byte)
+{
+  put (st, &byte, 1);
+}
+
+static void
+free_stream (struct stream *st)
+{
+  free (st->data);
+  memset (st, 0, sizeof (*st));
+}
+
+/* a header, which both sides get as is */
+static void
+put_head (const unsigned char *bytes, size_t len)
+{
+  put (&scanner, bytes, len);
+  put (&expect[SIDE_FRONT], bytes, len);
+  put (&expect[SIDE_BACK], bytes, len);
+}
+
+/* entropy coded data of one side, with stuffed ff bytes */
+static void
+put_segment (int side)
+{
+  int len = 40 + next_random () % 260;
+  int i;
+
+  for (i = 0; i < len; i++)
+    {
+      unsigned char byte = next_random () & 0xff;
+
+      if (next_random () % 16 == 0)
+        byte = 0xff;
+      put_byte (&scanner, byte);
+      put_byte (&expect[side], byte);
+      if (byte == 0xff)
+        {
+          put_byte (&scanner, 0x00);
+          put_byte (&expect[side], 0x00);
+        }
+    }
+}
+
+/* the scanner numbers the blocks of both sides in one sequence, even
+ * ones are the back, each side should get its own sequence from 0 */
+static void
+make_streams (void)
+{
+  static const unsigned char soi[] = { 0xff, 0xd8 };
+  static const unsigned char app0[] = {
+    0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46,
+    0x00, 0x01, 0x02, 0x01, DPI >> 8, DPI & 0xff, DPI >> 8, DPI & 0xff,
+    0x00, 0x00
+  };
+  static const unsigned char dht[] = { 0xff, 0xc4, 0x00, 0x05, 0x00, 0x01,
+    0x02
+  };
+  static const unsigned char sos[] = { 0xff, 0xda, 0x00, 0x0c, 0x03, 0x01,
+    0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3f, 0x00
+  };
+  static const unsigned char eoi[] = { 0xff, 0xd9 };
+  unsigned char dqt[5 + 64] = { 0xff, 0xdb, 0x00, 0x43, 0x00 };
+  unsigned char sof[] = { 0xff, 0xc0, 0x00, 0x11, 0x08,
+    HEIGHT >> 8, HEIGHT & 0xff, 0, 0,
+    0x03, 0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01
+  };
+  int i, side;
+
+  free_stream (&scanner);
+  free_stream (&expect[SIDE_FRONT]);
+  free_stream (&expect[SIDE_BACK]);
+
+  for (i = 0; i < 64; i++)
+    dqt[5 + i] = i + 1;
+
+  put_head (soi, sizeof (soi));
+
+  /* the scanner sends bare jpeg, both sides get a JFIF header */
+  put (&expect[SIDE_FRONT], app0, sizeof (app0));
+  put (&expect[SIDE_BACK], app0, sizeof (app0));
+
+  put_head (dqt, sizeof (dqt));
+
+  /* the scanner sends both sides next to each other */
+  sof[7] = (2 * WIDTH) >> 8;
+  sof[8] = (2 * WIDTH) & 0xff;
+  put (&scanner, sof, sizeof (sof));
+  sof[7] = WIDTH >> 8;
+  sof[8] = WIDTH & 0xff;
+  put (&expect[SIDE_FRONT], sof, sizeof (sof));
+  put (&expect[SIDE_BACK], sof, sizeof (sof));
+
+  put_head (dht, sizeof (dht));
+  put_head (sos, sizeof (sos));
+
+  for (i = 0; i < 2 * SEGMENTS; i++)
+    {
+      side = i % 2 ? SIDE_BACK : SIDE_FRONT;
+      if (i)
+        {
+          put_byte (&scanner, 0xff);
+          put_byte (&scanner, 0xd0 + (i - 1) % 8);
+        }
+      if (i > 1)
+        {
+          put_byte (&expect[side], 0xff);
+          put_byte (&expect[side], 0xd0 + (i / 2 - 1) % 8);
+        }
+      put_segment (side);
+    }
+
+  put_head (eoi, sizeof (eoi));
+}
+
+SANE_Status
+mock_scsi_cmd2 (int fd, const void *cmd, size_t cmd_size,
+                const void *src, size_t src_size,
+                void *dst, size_t * dst_size)
+{
+  size_t len;
+
+  (void) fd;
+  (void) cmd;
+  (void) cmd_size;
+  (void) src;
+  (void) src_size;
+
+  assert (dst != NULL && *dst_size > 0);
+
+  /* short reads cut through the markers */
+  len = 1 + next_random () % *dst_size;
+  if (len > scanner.len - scanner.pos)
+    len = scanner.len - scanner.pos;
+
+  memcpy (dst, scanner.data + scanner.pos, len);
+  scanner.pos += len;
+  *dst_size = len;
+
+  return len ? SANE_STATUS_GOOD : SANE_STATUS_EOF;
+}
+
+static struct fujitsu *
+setup (int low_mem)
+{
+  struct fujitsu *s = calloc (1, sizeof (*s));
+  int side;
+
+  assert (s != NULL);
+  s->connection = CONNECTION_SCSI;
+  s->source = SOURCE_ADF_DUPLEX;
+  s->jpeg_interlace = JPEG_INTERLACE_ALT;
+  s->compress = COMP_JPEG;
+  s->s_mode = s->u_mode = MODE_COLOR;
+  s->s_params.format = SANE_FRAME_JPEG;
+  s->s_params.pixels_per_line = WIDTH;
+  s->s_params.bytes_per_line = WIDTH * 3;
+  s->s_params.lines = HEIGHT;
+  s->resolution_x = s->resolution_y = DPI;
+  s->buffer_size = BUFFER_SIZE;
+  s->low_mem = low_mem;
+
+  /* as sane_start sets them up for interlaced jpeg */
+  for (side = 0; side < 2; side++)
+    {
+      s->bytes_tot[side] = s->s_params.bytes_per_line * s->s_params.lines;
+      s->buff_tot[side] = s->buffer_size;
+    }
+  assert (setup_buffers (s) == SANE_STATUS_GOOD);
+
+  s->jpeg_stage = JPEG_STAGE_NONE;
+  s->jpeg_ff_offset = -1;
+  s->started = 1;
+  s->side = SIDE_FRONT;
+
+  return s;
+}
+
+static void
+check_duplex (int low_mem, unsigned start)
+{
+  struct fujitsu *s;
+  unsigned char *out[2];
+  size_t got[2] = { 0, 0 };
+  int max_back = 0;
+  int side;
+
+  seed = start;
+  make_streams ();
+  s = setup (low_mem);
+
+  for (side = 0; side < 2; side++)
+    {
+      out[side] = malloc (expect[side].len);
+      assert (out[side] != NULL);
+    }
+
+  while (!s->eof_tx[SIDE_FRONT] || !s->eof_tx[SIDE_BACK])
+    {
+      SANE_Byte buf[700];
+      SANE_Int len = 0;
+      SANE_Status status;
+
+      side = s->side;
+      status = sane_read ((SANE_Handle) s, buf, 1 + next_random () % 700,
+                          &len);
+
+      assert (got[side] + len <= expect[side].len);
+      memcpy (out[side] + got[side], buf, len);
+      got[side] += len;
+
+      assert (s->buff_tot[SIDE_FRONT] == BUFFER_SIZE);
+      if (s->buff_tot[SIDE_BACK] > max_back)
+        max_back = s->buff_tot[SIDE_BACK];
+
+      if (status == SANE_STATUS_EOF)
+        {
+          /* sane_start would move to the back */
+          if (!low_mem && side == SIDE_FRONT)
+            s->side = SIDE_BACK;
+          continue;
+        }
+      assert (status == SANE_STATUS_GOOD);
+    }
+
+  for (side = 0; side < 2; side++)
+    {
+      assert (got[side] == expect[side].len);
+      assert (memcmp (out[side], expect[side].data, got[side]) == 0);
+      free (out[side]);
+    }
+  assert (scanner.pos == scanner.len);
+
+  /* the back waits for the front, unless the frontend swaps sides */
+  if (low_mem)
+    {
+      assert (max_back == BUFFER_SIZE);
+      assert (expect[SIDE_BACK].len > 4 * BUFFER_SIZE);
+    }
+  else
+    {
+      assert (max_back > BUFFER_SIZE);
+      assert (max_back <= s->bytes_tot[SIDE_BACK]);
+      assert ((size_t) max_back >= expect[SIDE_BACK].len);
+    }
+
+  s->started = 0;
+  free (s->buffers[SIDE_FRONT]);
+  free (s->buffers[SIDE_BACK]);
+  free (s);
+
+  printf ("%s: low_mem %d, seed %u: ok\n", __func__, low_mem, start);
+}
+
+/* hardware deskew tells the size after the transfer, also for jpeg */
+static void
+check_fully_buffer (void)
+{
+  struct fujitsu *s = calloc (1, sizeof (*s));
+
+  assert (s != NULL);
+  s->s_params.format = SANE_FRAME_JPEG;
+
+  s->hwdeskewcrop = 1;
+  assert (must_fully_buffer (s));
+  assert (!must_band_process (s));
+
+  s->hwdeskewcrop = 0;
+  s->swcrop = 1;
+  assert (!must_fully_buffer (s));
+  s->swcrop = 0;
+  s->swdeskew = 1;
+  assert (!must_fully_buffer (s));
+  assert (!must_band_process (s));
+
+  s->s_params.format = SANE_FRAME_GRAY;
+  assert (must_band_process (s));
+  s->swcrop = 1;
+  assert (must_fully_buffer (s));
+
+  free (s);
+  printf ("%s: ok\n", __func__);
+}
+
+int
+main (void)
+{
+  unsigned start;
+
+  DBG_INIT ();
+
+  check_fully_buffer ();
+
+  for (start = 1; start <= 4; start++)
+    {
+      check_duplex (0, start);
+      check_duplex (1, start);
+    }
+
+  free_stream (&scanner);
+  free_stream (&expect[SIDE_FRONT]);
+  free_stream (&expect[SIDE_BACK]);
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
@@ -0,0 +1,374 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+ * Loopback stand-in for a BJNP scanner, to check the bulk reads over
+ * TCP. We include pixma_bjnp.c to set up a device without the UDP
+ * discovery and session commands.
+ *
+ * The scanner answers the read requests with blocks of BLOCK bytes and
+ * a shorter last block, and doesn't answer read requests beyond the
+ * data. Each answer is delayed by LATENCY_US, like on a slow network.
+ * Depending on the late mode, those requests are answered when the next
+ * image is started: without data, or with the first blocks of that
+ * image, before or after the command is confirmed.
+ */
+#include "../../../backend/pixma/pixma_bjnp.c"
+
+#define BLOCK 4096
+#define LATENCY_US 1000
+#define MAX_QUEUED 64
+
+struct scanner
+{
+  int listen_fd;
+  int fd;
+  int late;                     /* answer ignored read requests later:
+                                   0 never, 1 empty, 2 with data before
+                                   the confirmation, 3 after it */
+  size_t left;                  /* image data not sent yet */
+  size_t pos;                   /* position of the next byte sent */
+  unsigned transfer;            /* number of the image */
+  int requests;                 /* read requests received */
+  int ignored;                  /* read requests not answered */
+  int in_flight;                /* most read requests waiting for an answer */
+  struct BJNP_command stale[MAX_QUEUED];
+  struct BJNP_command queue[MAX_QUEUED];
+  uint32_t size[MAX_QUEUED];    /* image size for the commands */
+  double due[MAX_QUEUED];
+  int queued;
+};
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static SANE_Byte
+pattern (unsigned transfer, size_t pos)
+{
+  return (SANE_Byte) (pos * 7 + pos / 251 + transfer);
+}
+
+static int
+read_full (int fd, void *buf, size_t len)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len)
+    {
+      n = read (fd, (char *) buf + done, len - done);
+      if (n <= 0)
+        return -1;
+      done += n;
+    }
+  return 0;
+}
+
+static void
+write_full (int fd, const void *buf, size_t len)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len)
+    {
+      n = write (fd, (const char *) buf + done, len - done);
+      assert (n > 0);
+      done += n;
+    }
+}
+
+static void
+answer (struct scanner *s, const struct BJNP_command *cmd,
+        const void *payload, size_t len)
+{
+  struct BJNP_command resp = *cmd;
+
+  resp.dev_type = BJNP_RES_SCAN;
+  resp.payload_len = htonl (len);
+  write_full (s->fd, &resp, sizeof (resp));
+  if (len)
+    write_full (s->fd, payload, len);
+}
+
+/* answer a read request with the next block of the image */
+static void
+send_block (struct scanner *s, const struct BJNP_command *cmd)
+{
+  SANE_Byte block[BLOCK];
+  size_t len, i;
+
+  len = s->left < BLOCK ? s->left : BLOCK;
+  for (i = 0; i < len; i++)
+    block[i] = pattern (s->transfer, s->pos + i);
+  s->pos += len;
+  s->left -= len;
+  answer (s, cmd, block, len);
+}
+
+/* answer the ignored read requests with data of the image just started,
+   those beyond its data stay ignored */
+static void
+answer_ignored (struct scanner *s)
+{
+  int i;
+
+  for (i = 0; i < s->ignored && s->left > 0; i++)
+    send_block (s, &s->stale[i]);
+  s->ignored -= i;
+  memmove (s->stale, s->stale + i, s->ignored * sizeof (s->stale[0]));
+}
+
+/** answer a queued command once its latency has passed
+ */
+static void
+process (struct scanner *s, const struct BJNP_command *cmd, uint32_t size)
+{
+  uint32_t confirm;
+  int i;
+
+  if (cmd->cmd_code == CMD_TCP_SEND)
+    {
+      /* read requests beyond the data may be answered now, without data */
+      if (s->late == 1)
+        {
+          for (i = 0; i < s->ignored; i++)
+            answer (s, &s->stale[i], NULL, 0);
+          s->ignored = 0;
+        }
+
+      /* a command starting an image of the given size */
+      s->left = size;
+      s->pos = 0;
+      s->transfer++;
+      if (s->late == 2)
+        answer_ignored (s);
+      confirm = htonl (4);
+      answer (s, cmd, &confirm, sizeof (confirm));
+      if (s->late == 3)
+        answer_ignored (s);
+      return;
+    }
+
+  assert (cmd->cmd_code == CMD_TCP_REQ);
+  if (s->left == 0)
+    {
+      /* no data, the scanner keeps quiet */
+      assert (s->ignored < MAX_QUEUED);
+      s->stale[s->ignored++] = *cmd;
+      return;
+    }
+  send_block (s, cmd);
+}
+
+static void *
+scanner_task (void *args)
+{
+  struct scanner *s = args;
+  struct BJNP_command cmd;
+  uint32_t size = 0;
+  struct pollfd pfd;
+  double t;
+  int timeout, i;
+
+  s->fd = accept (s->listen_fd, NULL, NULL);
+  assert (s->fd >= 0);
+  i = 1;
+  setsockopt (s->fd, IPPROTO_TCP, TCP_NODELAY, &i, sizeof (i));
+
+  for (;;)
+    {
+      /* wait for a command, or for the next answer to be due */
+      timeout = -1;
+      if (s->queued)
+        {
+          t = s->due[0] - now ();
+          timeout = t > 0 ? (int) (t * 1000) + 1 : 0;
+        }
+      pfd.fd = s->fd;
+      pfd.events = POLLIN;
+      if (poll (&pfd, 1, timeout) > 0)
+        {
+          if (read_full (s->fd, &cmd, sizeof (cmd)) < 0)
+            break;
+          if (cmd.cmd_code == CMD_TCP_SEND)
+            {
+              assert (ntohl (cmd.payload_len) == sizeof (size));
+              assert (read_full (s->fd, &size, sizeof (size)) == 0);
+              size = ntohl (size);
+            }
+          else
+            s->requests++;
+          assert (s->queued < MAX_QUEUED);
+          s->queue[s->queued] = cmd;
+          s->size[s->queued] = size;
+          s->due[s->queued] = now () + LATENCY_US / 1e6;
+          s->queued++;
+          if (cmd.cmd_code == CMD_TCP_REQ && s->queued > s->in_flight)
+            s->in_flight = s->queued;
+        }
+
+      while (s->queued && s->due[0] <= now ())
+        {
+          process (s, &s->queue[0], s->size[0]);
+          s->queued--;
+          memmove (s->queue, s->queue + 1, s->queued * sizeof (s->queue[0]));
+          memmove (s->size, s->size + 1, s->queued * sizeof (s->size[0]));
+          memmove (s->due, s->due + 1, s->queued * sizeof (s->due[0]));
+        }
+    }
+  close (s->fd);
+  return NULL;
+}
+
+static void
+start_scanner (struct scanner *s, pthread_t * thread)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof (addr);
+  int fd, val = 1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  s->listen_fd = socket (AF_INET, SOCK_STREAM, 0);
+  assert (s->listen_fd >= 0);
+  assert (bind (s->listen_fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+  assert (listen (s->listen_fd, 1) == 0);
+  assert (getsockname (s->listen_fd, (struct sockaddr *) &addr, &len) == 0);
+  assert (pthread_create (thread, NULL, scanner_task, s) == 0);
+
+  /* what bjnp_open_tcp() does after the session is set up */
+  fd = socket (AF_INET, SOCK_STREAM, 0);
+  assert (fd >= 0);
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof (val));
+  val = BJNP_TCP_RCVBUF;
+  setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof (val));
+  assert (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+
+  memset (&device[0], 0, sizeof (device[0]));
+  device[0].open = 1;
+  device[0].protocol_string = "BJNP";
+  device[0].tcp_socket = fd;
+  device[0].serial = -1;
+  device[0].bjnp_ip_timeout = 2000;
+  device[0].blocksize = BJNP_BLOCKSIZE_START;
+  bjnp_no_devices = 1;
+}
+
+static void
+stop_scanner (struct scanner *s, pthread_t thread)
+{
+  close (device[0].tcp_socket);
+  device[0].tcp_socket = -1;
+  pthread_join (thread, NULL);
+  close (s->listen_fd);
+}
+
+/** start an image of size bytes and read it in chunks of chunk bytes
+ */
+static void
+scan (struct scanner *s, size_t size, size_t chunk)
+{
+  SANE_Byte *buf = malloc (chunk);
+  uint32_t cmd = htonl (size);
+  size_t len, pos = 0, i;
+  int requests = s->requests;
+  double t;
+
+  assert (buf);
+  len = sizeof (cmd);
+  assert (sanei_bjnp_write_bulk (0, (SANE_Byte *) & cmd, &len)
+          == SANE_STATUS_GOOD);
+
+  t = now ();
+  while (pos < size)
+    {
+      len = chunk;
+      assert (sanei_bjnp_read_bulk (0, buf, &len) == SANE_STATUS_GOOD);
+      assert (len > 0 && len <= chunk && pos + len <= size);
+
+      /* unless their data is still coming, the stale read requests are
+         forgotten once a fresh one is answered, and no new ones are
+         left before the last block */
+      if (pos == 0 && len == chunk && pos + len < size && s->late < 2)
+        assert (device[0].stale_read_requests == 0);
+      for (i = 0; i < len; i++)
+        assert (buf[i] == pattern (s->transfer, pos + i));
+      pos += len;
+    }
+  t = now () - t;
+
+  /* all blocks were received, including the short one */
+  len = chunk;
+  assert (sanei_bjnp_read_bulk (0, buf, &len) == SANE_STATUS_EOF);
+  assert (len == 0);
+
+  /* requests are sent ahead when more than a block is wanted beyond the
+     blocks in flight */
+  if (size > 3 * BLOCK && chunk > 3 * BLOCK)
+    assert (s->in_flight > 1);
+  s->in_flight = 0;
+
+  printf ("%s: %lu bytes in chunks of %lu: %d requests, %.1f ms\n",
+          __func__, (unsigned long) size, (unsigned long) chunk,
+          s->requests - requests, t * 1e3);
+  free (buf);
+}
+
+static void
+check_transfers (int late)
+{
+  struct scanner s;
+  pthread_t thread;
+
+  printf ("%s: late %d\n", __func__, late);
+
+  memset (&s, 0, sizeof (s));
+  s.late = late;
+  start_scanner (&s, &thread);
+
+  scan (&s, 100, 65536);
+  scan (&s, 64 * BLOCK + 123, 65536);
+  scan (&s, 64 * BLOCK + 1, 1000);
+  scan (&s, 3 * BLOCK + 7, 3 * BLOCK + 7);
+  scan (&s, 64 * BLOCK + 99, 1024 * 1024);
+  scan (&s, 10, 65536);
+  scan (&s, 16 * BLOCK + 5, 2 * BLOCK + 1);
+
+  stop_scanner (&s, thread);
+}
+
+int
+main (void)
+{
+  DBG_INIT ();
+
+  check_transfers (0);
+  check_transfers (1);
+  check_transfers (2);
+  check_transfers (3);
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
@@ -0,0 +1,142 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "../../../backend/pixma/pixma_rename.h"
+#include "../../../backend/pixma/pixma_common.h"
+
+/*
+ * Benchmark of the pixma line functions used by post_process_image_data()
+ * against the per pixel loops they replaced, on A4 wide lines.
+ *
+ * usage: pixma_image_bench [lines]
+ */
+
+static void
+old_reorder_pixels (uint8_t * linebuf, uint8_t * sptr, unsigned c,
+                    unsigned n, unsigned m, unsigned w, unsigned line_size)
+{
+  unsigned i;
+
+  for (i = 0; i < w; i++)
+    memcpy (linebuf + c * (n * (i % m) + i / m), sptr + c * i, c);
+  memcpy (sptr, linebuf, line_size);
+}
+
+static uint8_t *
+old_shrink_image (uint8_t * dptr, uint8_t * sptr, unsigned xs, unsigned w,
+                  unsigned wx, unsigned scale, unsigned c)
+{
+  unsigned i, ic, l, k;
+  uint16_t pixel;
+
+  sptr += c * xs;
+  for (i = 0; i < w; i++)
+    {
+      for (ic = 0; ic < c; ic++)
+        {
+          pixel = 0;
+          for (l = 0; l < scale; l++)
+            for (k = 0; k < scale; k++)
+              pixel += sptr[ic + c * k + wx * c * l];
+          dptr[ic] = pixel / (scale * scale);
+        }
+      sptr += c * scale;
+      dptr += c;
+    }
+  return dptr;
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+bench_reorder (uint8_t * line, uint8_t * linebuf, unsigned lines,
+               unsigned c, unsigned n)
+{
+  /* 2400 dpi */
+  unsigned w = 8.5 * 2400, m = w / n;
+  double t0, t1, t2;
+  unsigned i;
+
+  t0 = now ();
+  for (i = 0; i < lines; i++)
+    old_reorder_pixels (linebuf, line, c, n, m, w, c * w);
+  t1 = now ();
+  for (i = 0; i < lines; i++)
+    pixma_reorder_pixels (linebuf, line, c, n, m, w, c * w);
+  t2 = now ();
+
+  printf ("reorder c %u n %u: %8.2f ms -> %8.2f ms (%.1fx)\n", c, n,
+          (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t1 - t0) / (t2 - t1));
+}
+
+static void
+bench_shrink (uint8_t * src, uint8_t * dst, unsigned lines,
+              unsigned c, unsigned scale)
+{
+  /* 300 dpi sampled, shrunk to 300 / scale dpi */
+  unsigned wx = 8.5 * 300, w = wx / scale;
+  double t0, t1, t2;
+  unsigned i;
+
+  t0 = now ();
+  for (i = 0; i < lines; i++)
+    old_shrink_image (dst, src, 0, w, wx, scale, c);
+  t1 = now ();
+  for (i = 0; i < lines; i++)
+    pixma_shrink_image (dst, src, 0, w, wx, scale, c);
+  t2 = now ();
+
+  printf ("shrink c %u scale %u: %8.2f ms -> %8.2f ms (%.1fx)\n", c, scale,
+          (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t1 - t0) / (t2 - t1));
+}
+
+int
+main (int argc, char **argv)
+{
+  static const unsigned cs[] = { 1, 3, 6 };
+  static const unsigned scales[] = { 2, 3, 4 };
+  unsigned lines = argc > 1 ? atoi (argv[1]) : 1000;
+  size_t size = 6 * 8.5 * 2400 * 4;
+  uint8_t *src = malloc (size);
+  uint8_t *dst = malloc (size);
+  size_t i;
+
+  if (!src || !dst || !lines)
+    {
+      fprintf (stderr, "usage: %s [lines]\n", argv[0]);
+      return 1;
+    }
+  for (i = 0; i < size; i++)
+    src[i] = rand ();
+
+  for (i = 0; i < sizeof (cs) / sizeof (cs[0]); i++)
+    {
+      bench_reorder (src, dst, lines, cs[i], 2);
+      bench_reorder (src, dst, lines, cs[i], 4);
+    }
+  for (i = 0; i < sizeof (cs) / sizeof (cs[0]); i++)
+    {
+      unsigned j;
+
+      for (j = 0; j < sizeof (scales) / sizeof (scales[0]); j++)
+        bench_shrink (src, dst, lines, cs[i], scales[j]);
+    }
+
+  free (src);
+  free (dst);
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
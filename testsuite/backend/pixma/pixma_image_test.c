@@ -0,0 +1,141 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../../../backend/pixma/pixma_rename.h"
+#include "../../../backend/pixma/pixma_common.h"
+
+/* the line functions as they were before they got their fast paths */
+static void
+ref_reorder_pixels (uint8_t * linebuf, uint8_t * sptr, unsigned c,
+                    unsigned n, unsigned m, unsigned w, unsigned line_size)
+{
+  unsigned i;
+
+  for (i = 0; i < w; i++)
+    memcpy (linebuf + c * (n * (i % m) + i / m), sptr + c * i, c);
+  memcpy (sptr, linebuf, line_size);
+}
+
+static uint8_t *
+ref_shrink_image (uint8_t * dptr, uint8_t * sptr, unsigned xs, unsigned w,
+                  unsigned wx, unsigned scale, unsigned c)
+{
+  unsigned i, ic, l, k;
+  uint16_t pixel;
+
+  sptr += c * xs;
+  for (i = 0; i < w; i++)
+    {
+      for (ic = 0; ic < c; ic++)
+        {
+          pixel = 0;
+          for (l = 0; l < scale; l++)
+            for (k = 0; k < scale; k++)
+              pixel += sptr[ic + c * k + wx * c * l];
+          dptr[ic] = pixel / (scale * scale);
+        }
+      sptr += c * scale;
+      dptr += c;
+    }
+  return dptr;
+}
+
+static void
+fill (uint8_t * buf, size_t len, int extreme)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    buf[i] = extreme ? 255 - (rand () & 1) : rand ();
+}
+
+/** reorder lines of n sub images, including widths that m doesn't divide
+ */
+static void
+check_reorder (unsigned c, unsigned n, unsigned w)
+{
+  unsigned m = w / n;
+  unsigned line_size = c * w + 7;
+  uint8_t *line = malloc (line_size);
+  uint8_t *expected = malloc (line_size);
+  uint8_t *linebuf = calloc (1, line_size);
+  uint8_t *ref_linebuf = calloc (1, line_size);
+
+  printf ("%s: c %u, n %u, w %u\n", __func__, c, n, w);
+
+  assert (line && expected && linebuf && ref_linebuf);
+  fill (line, line_size, 0);
+  memcpy (expected, line, line_size);
+
+  ref_reorder_pixels (ref_linebuf, expected, c, n, m, w, line_size);
+  pixma_reorder_pixels (linebuf, line, c, n, m, w, line_size);
+  assert (memcmp (line, expected, line_size) == 0);
+
+  free (line);
+  free (expected);
+  free (linebuf);
+  free (ref_linebuf);
+}
+
+/** shrink a line made of scale scanned lines of wx pixels
+ */
+static void
+check_shrink (unsigned c, unsigned scale, unsigned w, unsigned xs, int extreme)
+{
+  unsigned wx = (xs + w) * scale + 5;
+  size_t len = (size_t) wx * c * scale;
+  uint8_t *src = malloc (len);
+  uint8_t *dst = malloc (c * w + 1);
+  uint8_t *expected = malloc (c * w + 1);
+
+  printf ("%s: c %u, scale %u, w %u, xs %u, extreme %d\n", __func__,
+          c, scale, w, xs, extreme);
+
+  assert (src && dst && expected);
+  fill (src, len, extreme);
+  dst[c * w] = expected[c * w] = 0x5a;
+
+  assert (pixma_shrink_image (dst, src, xs, w, wx, scale, c) == dst + c * w);
+  ref_shrink_image (expected, src, xs, w, wx, scale, c);
+  assert (memcmp (dst, expected, c * w + 1) == 0);
+
+  free (src);
+  free (dst);
+  free (expected);
+}
+
+int
+main (void)
+{
+  static const unsigned cs[] = { 1, 2, 3, 6 };
+  static const unsigned scales[] = { 1, 2, 3, 4, 5, 8, 16 };
+  static const unsigned ns[] = { 2, 4, 8 };
+  static const unsigned ws[] = { 1, 7, 16, 100, 2551, 5103 };
+  unsigned i, j, k;
+
+  srand (time (NULL));
+
+  for (i = 0; i < sizeof (cs) / sizeof (cs[0]); i++)
+    for (j = 0; j < sizeof (ns) / sizeof (ns[0]); j++)
+      for (k = 0; k < sizeof (ws) / sizeof (ws[0]); k++)
+        if (ws[k] >= ns[j])
+          check_reorder (cs[i], ns[j], ws[k]);
+
+  for (i = 0; i < sizeof (cs) / sizeof (cs[0]); i++)
+    for (j = 0; j < sizeof (scales) / sizeof (scales[0]); j++)
+      for (k = 0; k < sizeof (ws) / sizeof (ws[0]); k++)
+        {
+          check_shrink (cs[i], scales[j], ws[k], 0, 0);
+          check_shrink (cs[i], scales[j], ws[k], 3, 1);
+        }
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
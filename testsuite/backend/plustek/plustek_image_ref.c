@@ -0,0 +1,1494 @@
+/* The pixel copy and scaling functions of plustek-usbimg.c before they were
+ * replaced by generic kernels, as a reference for plustek_image_test.c.
+ * Apart from the prefix, they are unchanged, except for one fix in
+ * ref_ColorScalePseudo16().
+ */
+
+/** do a simple memcopy from scan-buffer to user buffer
+ */
+static void ref_ColorDuplicate8( Plustek_Device *dev )
+{
+	int      next;
+	u_long   dw, pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	for( dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next ) {
+
+		scan->UserBuf.pb_rgb[pixels].Red   = scan->Red.pcb[dw].a_bColor[0];
+		scan->UserBuf.pb_rgb[pixels].Green = scan->Green.pcb[dw].a_bColor[0];
+		scan->UserBuf.pb_rgb[pixels].Blue  = scan->Blue.pcb[dw].a_bColor[0];
+	}
+}
+
+/** reorder from rgb line to rgb pixel (CIS scanner)
+ */
+static void ref_ColorDuplicate8_2( Plustek_Device *dev )
+{
+	int      next;
+	u_long   dw, pixels;
+	ScanDef *scan = &dev->scanning;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next  = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	for( dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next ) {
+
+		scan->UserBuf.pb_rgb[pixels].Red   = (u_char)scan->Red.pb[dw];
+		scan->UserBuf.pb_rgb[pixels].Green = (u_char)scan->Green.pb[dw];
+		scan->UserBuf.pb_rgb[pixels].Blue  = (u_char)scan->Blue.pb[dw];
+	}
+}
+
+/**
+ */
+static void ref_ColorDuplicate16( Plustek_Device *dev )
+{
+	int       next;
+	u_char    ls;
+	u_long    dw, pixels;
+	ScanDef  *scan = &dev->scanning;
+	SANE_Bool swap = usb_HostSwap();
+
+	usb_AverageColorWord( dev );
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next  = 1;
+		pixels = 0;
+	}
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+
+		if( swap ) {
+			scan->UserBuf.pw_rgb[pixels].Red =
+			                  _HILO2WORD(scan->Red.pcw[dw].HiLo[0]) >> ls;
+			scan->UserBuf.pw_rgb[pixels].Green =
+			                  _HILO2WORD(scan->Green.pcw[dw].HiLo[0]) >> ls;
+			scan->UserBuf.pw_rgb[pixels].Blue =
+			                  _HILO2WORD(scan->Blue.pcw[dw].HiLo[0]) >> ls;
+		} else {
+			scan->UserBuf.pw_rgb[pixels].Red  = scan->Red.pw[dw]   >> ls;
+			scan->UserBuf.pw_rgb[pixels].Green= scan->Green.pw[dw] >> ls;
+			scan->UserBuf.pw_rgb[pixels].Blue = scan->Blue.pw[dw]  >> ls;
+		}
+	}
+}
+
+/**
+ */
+static void ref_ColorDuplicate16_2( Plustek_Device *dev )
+{
+	int       next;
+	u_char    ls;
+	HiLoDef   tmp;
+	u_long    dw, pixels;
+	ScanDef  *scan = &dev->scanning;
+	SANE_Bool swap = usb_HostSwap();
+
+	usb_AverageColorWord( dev );
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	for( dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+
+		if( swap ) {
+			tmp = *((HiLoDef*)&scan->Red.pw[dw]);
+			scan->UserBuf.pw_rgb[pixels].Red = _HILO2WORD(tmp) >> ls;
+
+			tmp = *((HiLoDef*)&scan->Green.pw[dw]);
+			scan->UserBuf.pw_rgb[pixels].Green = _HILO2WORD(tmp) >> ls;
+
+			tmp = *((HiLoDef*)&scan->Blue.pw[dw]);
+			scan->UserBuf.pw_rgb[pixels].Blue = _HILO2WORD(tmp) >> ls;
+
+		} else {
+
+			scan->UserBuf.pw_rgb[pixels].Red   = scan->Red.pw[dw]   >> ls;
+			scan->UserBuf.pw_rgb[pixels].Green = scan->Green.pw[dw] >> ls;
+			scan->UserBuf.pw_rgb[pixels].Blue  = scan->Blue.pw[dw]  >> ls;
+		}
+	}
+}
+
+/**
+ */
+static void ref_ColorDuplicatePseudo16( Plustek_Device *dev )
+{
+	int      next;
+	u_short  wR, wG, wB;
+	u_long   dw, pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	wR = (u_short)scan->Red.pcb[0].a_bColor[0];
+	wG = (u_short)scan->Green.pcb[0].a_bColor[0];
+	wB = (u_short)scan->Blue.pcb[0].a_bColor[0];
+
+	for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+
+		scan->UserBuf.pw_rgb[pixels].Red   =
+		                        (wR + scan->Red.pcb[dw].a_bColor[0]) << bShift;
+		scan->UserBuf.pw_rgb[pixels].Green =
+		                      (wG + scan->Green.pcb[dw].a_bColor[0]) << bShift;
+		scan->UserBuf.pw_rgb[pixels].Blue  =
+		                       (wB + scan->Blue.pcb[dw].a_bColor[0]) << bShift;
+
+		wR = (u_short)scan->Red.pcb[dw].a_bColor[0];
+		wG = (u_short)scan->Green.pcb[dw].a_bColor[0];
+		wB = (u_short)scan->Blue.pcb[dw].a_bColor[0];
+	}
+}
+
+/**
+ */
+static void ref_ColorDuplicateGray( Plustek_Device *dev )
+{
+	int      next;
+	u_long   dw, pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	switch(scan->fGrayFromColor) {
+
+	case 1:
+		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+			scan->UserBuf.pb[pixels] = scan->Red.pcb[dw].a_bColor[0];
+		break;
+	case 2:
+		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+			scan->UserBuf.pb[pixels] = scan->Green.pcb[dw].a_bColor[0];
+		break;
+	case 3:
+		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+			scan->UserBuf.pb[pixels] = scan->Blue.pcb[dw].a_bColor[0];
+		break;
+	}
+}
+
+/**
+ */
+static void ref_ColorDuplicateGray_2( Plustek_Device *dev )
+{
+	int      next;
+	u_long   dw, pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	switch(scan->fGrayFromColor)
+	{
+	case 1:
+		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+			scan->UserBuf.pb[pixels] = scan->Red.pb[dw];
+		break;
+	case 3:
+		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+			scan->UserBuf.pb[pixels] = scan->Blue.pb[dw];
+		break;
+	default:
+		for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+			scan->UserBuf.pb[pixels] = scan->Green.pb[dw];
+		break;
+	}
+}
+
+/**
+ */
+static void ref_ColorDuplicateGray16( Plustek_Device *dev )
+{
+	int       next;
+	u_char    ls;
+	u_long    dw, pixels;
+	ScanDef  *scan = &dev->scanning;
+	SANE_Bool swap = usb_HostSwap();
+
+	usb_AverageColorWord( dev );
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	switch(scan->fGrayFromColor) {
+
+	case 1:
+		if( swap ) {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+				scan->UserBuf.pw[pixels] =
+				                   _HILO2WORD(scan->Red.pcw[dw].HiLo[0]) >> ls;
+		} else {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+				scan->UserBuf.pw[pixels] = scan->Red.pw[dw] >> ls;
+		}
+		break;
+	case 2:
+		if( swap ) {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+				scan->UserBuf.pw[pixels] =
+				                 _HILO2WORD(scan->Green.pcw[dw].HiLo[0]) >> ls;
+		} else {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+				scan->UserBuf.pw[pixels] = scan->Green.pw[dw] >> ls;
+		}
+		break;
+	case 3:
+		if( swap ) {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+				scan->UserBuf.pw[pixels] =
+				                   _HILO2WORD(scan->Blue.pcw[dw].HiLo[0]) >> ls;
+		} else {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next)
+				scan->UserBuf.pw[pixels] = scan->Blue.pw[dw] >> ls;
+		}
+		break;
+	}
+}
+
+/**
+ */
+static void ref_ColorDuplicateGray16_2( Plustek_Device *dev )
+{
+	int       next;
+	u_char    ls;
+	u_long    dw, pixels;
+	HiLoDef   tmp;
+	ScanDef  *scan = &dev->scanning;
+	SANE_Bool swap = usb_HostSwap();
+
+	usb_AverageColorWord( dev );
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	switch(scan->fGrayFromColor) {
+	case 1:
+		if( swap ) {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+				tmp = *((HiLoDef*)&scan->Red.pw[dw]);
+				scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
+			}
+		} else {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+				scan->UserBuf.pw[pixels] = scan->Red.pw[dw] >> ls;
+			}
+		}
+		break;
+	case 2:
+		if( swap ) {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+				tmp = *((HiLoDef*)&scan->Green.pw[dw]);
+				scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
+			}
+		} else {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+				scan->UserBuf.pw[pixels] = scan->Green.pw[dw] >> ls;
+			}
+		}
+		break;
+	case 3:
+		if( swap ) {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+				tmp = *((HiLoDef*)&scan->Blue.pw[dw]);
+				scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
+			}
+		} else {
+			for (dw = 0; dw < scan->sParam.Size.dwPixels; dw++, pixels += next) {
+				scan->UserBuf.pw[pixels] = scan->Blue.pw[dw] >> ls;
+			}
+		}
+		break;
+	}
+}
+
+/**
+ */
+static void ref_GrayDuplicate8( Plustek_Device *dev )
+{
+	u_char  *dest, *src;
+	u_long   pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageGrayByte( dev );
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+
+		pixels = scan->sParam.Size.dwPixels;
+		src    = scan->Green.pb;
+		dest   = scan->UserBuf.pb + pixels - 1;
+
+		for(; pixels; pixels--, src++, dest--)
+			*dest = *src;
+	} else {
+		memcpy( scan->UserBuf.pb, scan->Green.pb, scan->sParam.Size.dwBytes );
+	}
+}
+
+/**
+ */
+static void ref_GrayDuplicate16( Plustek_Device *dev )
+{
+	int       next;
+	u_char    ls;
+	u_short  *dest;
+	u_long    pixels;
+	HiLoDef  *pwm;
+	ScanDef  *scan = &dev->scanning;
+	SANE_Bool swap = usb_HostSwap();
+
+	usb_AverageGrayWord( dev );
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next = -1;
+		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
+	} else {
+		next = 1;
+		dest = scan->UserBuf.pw;
+	}
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	pwm = scan->Green.philo;
+	for( pixels=scan->sParam.Size.dwPixels; pixels--; pwm++, dest += next ) {
+		if( swap )
+			*dest = (_PHILO2WORD(pwm)) >> ls;
+		else
+			*dest = (_PLOHI2WORD(pwm)) >> ls;
+	}
+}
+
+/**
+ */
+static void ref_GrayDuplicatePseudo16( Plustek_Device *dev )
+{
+	u_char  *src;
+	int      next;
+	u_short  g;
+	u_short *dest;
+	u_long   pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageGrayByte( dev );
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		next = -1;
+		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
+	} else {
+		next = 1;
+		dest = scan->UserBuf.pw;
+	}
+
+	src = scan->Green.pb;
+	g = (u_short)*src;
+
+	for( pixels=scan->sParam.Size.dwPixels; pixels--; src++, dest += next ) {
+
+		*dest = (g + *src) << bShift;
+		g = (u_short)*src;
+	}
+}
+
+
+/** generate binary data from one of the three color inputs according to the
+ *  value in fGrayFromColor (CCD version)
+ */
+static void ref_BWDuplicateFromColor( Plustek_Device *dev )
+{
+	int           next;
+	u_char        d, s, *dest;
+	u_short       j;
+	u_long        pixels;
+	ColorByteDef *src;
+	ScanDef      *scan = &dev->scanning;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
+		next = -1;
+	} else {
+		dest = scan->UserBuf.pb;
+		next = 1;
+	}
+
+	switch(scan->fGrayFromColor) {
+		case 1:  src = scan->Red.pcb;   break;
+		case 3:  src = scan->Blue.pcb;  break;
+		default: src = scan->Green.pcb; break;
+	}
+
+	d = j = 0;
+	for( pixels = scan->sParam.Size.dwPixels; pixels; pixels--, src++ ) {
+
+		s = src->a_bColor[0];
+		if( s != 0 )
+			d |= BitTable[j];
+		j++;
+		if( j == 8 ) {
+			*dest = d;
+			dest += next;
+
+			d = j = 0;
+		}
+	}
+}
+
+/** generate binary data from one of the three color inputs according to the
+ *  value in fGrayFromColor (CIS version)
+ */
+static void ref_BWDuplicateFromColor_2( Plustek_Device *dev )
+{
+	int      next;
+	u_char   d, *dest, *src;
+	u_short  j;
+	u_long   pixels;
+	ScanDef *scan = &dev->scanning;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
+		next = -1;
+	} else {
+		dest = scan->UserBuf.pb;
+		next = 1;
+	}
+
+	switch(scan->fGrayFromColor) {
+		case 1:  src = scan->Red.pb;   break;
+		case 3:  src = scan->Blue.pb;  break;
+		default: src = scan->Green.pb; break;
+	}
+
+	d = j = 0;
+	for( pixels = scan->sParam.Size.dwPixels; pixels; pixels--, src++ ) {
+
+		if( *src != 0 )
+			d |= BitTable[j];
+		j++;
+		if( j == 8 ) {
+			*dest = d;
+			dest += next;
+
+			d = j = 0;
+		}
+	}
+}
+
+/************************** the scaling functions ****************************/
+
+/**
+ */
+static void ref_ColorScaleGray( Plustek_Device *dev )
+{
+	int           izoom, ddax, next;
+	u_long        dw, pixels;
+	ColorByteDef *src;
+	ScanDef      *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	switch(scan->fGrayFromColor) {
+		case 1:  src = scan->Red.pcb;   break;
+		case 3:  src = scan->Blue.pcb;  break;
+		default: src = scan->Green.pcb; break;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	for( ddax = 0; dw; src++ ) {
+
+		ddax -= _SCALER;
+		while((ddax < 0) && (dw > 0)) {
+
+			scan->UserBuf.pb[pixels] = src->a_bColor[0];
+
+			pixels += next;
+			ddax   += izoom;
+			dw--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_ColorScaleGray_2( Plustek_Device *dev )
+{
+	u_char  *src;
+	int      izoom, ddax, next;
+	u_long   dw, pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	switch(scan->fGrayFromColor) {
+		case 1:  src = scan->Red.pb;   break;
+		case 3:  src = scan->Blue.pb;  break;
+		default: src = scan->Green.pb; break;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	for( ddax = 0; dw; src++ ) {
+
+		ddax -= _SCALER;
+		while((ddax < 0) && (dw > 0)) {
+
+			scan->UserBuf.pb[pixels] = *src;
+
+			pixels += next;
+			ddax   += izoom;
+			dw--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_ColorScaleGray16( Plustek_Device *dev )
+{
+	u_char    ls;
+	int       izoom, ddax, next;
+	u_long    dw, pixels, bitsput;
+	SANE_Bool swap = usb_HostSwap();
+	ScanDef  *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	switch( scan->fGrayFromColor ) {
+
+	case 1:
+		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+			ddax -= _SCALER;
+
+			while((ddax < 0) && (dw > 0)) {
+				if( swap ) {
+					scan->UserBuf.pw[pixels] =
+					        _HILO2WORD(scan->Red.pcw[bitsput].HiLo[0]) >> ls;
+				} else {
+					scan->UserBuf.pw[pixels] = scan->Red.pw[bitsput] >> ls;
+				}
+				pixels += next;
+				ddax   += izoom;
+				dw--;
+			}
+		}
+		break;
+
+	case 2:
+		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+			ddax -= _SCALER;
+
+			while((ddax < 0) && (dw > 0)) {
+				if( swap ) {
+					scan->UserBuf.pw[pixels] =
+					      _HILO2WORD(scan->Green.pcw[bitsput].HiLo[0]) >> ls;
+				} else {
+					scan->UserBuf.pw[pixels] = scan->Green.pw[bitsput] >> ls;
+				}
+				pixels += next;
+				ddax   += izoom;
+				dw--;
+			}
+		}
+		break;
+
+	case 3:
+		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+			ddax -= _SCALER;
+
+			while((ddax < 0) && (dw > 0)) {
+				if( swap ) {
+					scan->UserBuf.pw[pixels] =
+					       _HILO2WORD(scan->Blue.pcw[bitsput].HiLo[0]) >> ls;
+				} else {
+					scan->UserBuf.pw[pixels] = scan->Blue.pw[bitsput] >> ls;
+				}
+				pixels += next;
+				ddax   += izoom;
+				dw--;
+			}
+		}
+		break;
+	}
+}
+
+/**
+ */
+static void ref_ColorScaleGray16_2( Plustek_Device *dev )
+{
+	u_char    ls;
+	int       izoom, ddax, next;
+	u_long    dw, pixels, bitsput;
+	HiLoDef   tmp;
+	SANE_Bool swap = usb_HostSwap();
+	ScanDef  *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	switch( scan->fGrayFromColor ) {
+
+	case 1:
+		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+			ddax -= _SCALER;
+
+			while((ddax < 0) && (dw > 0)) {
+				if( swap ) {
+					tmp = *((HiLoDef*)&scan->Red.pw[bitsput]);
+					scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
+				} else {
+					scan->UserBuf.pw[pixels] = scan->Red.pw[dw] >> ls;
+				}
+				pixels += next;
+				ddax   += izoom;
+				dw--;
+			}
+		}
+		break;
+
+	case 2:
+		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+			ddax -= _SCALER;
+
+			while((ddax < 0) && (dw > 0)) {
+				if( swap ) {
+					tmp = *((HiLoDef*)&scan->Green.pw[bitsput]);
+					scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
+				} else {
+					scan->UserBuf.pw[pixels] = scan->Green.pw[bitsput] >> ls;
+				}
+				pixels += next;
+				ddax   += izoom;
+				dw--;
+			}
+		}
+		break;
+
+	case 3:
+		for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+			ddax -= _SCALER;
+
+			while((ddax < 0) && (dw > 0)) {
+				if( swap ) {
+					tmp = *((HiLoDef*)&scan->Blue.pw[bitsput]);
+					scan->UserBuf.pw[pixels] = _HILO2WORD(tmp) >> ls;
+				} else {
+					scan->UserBuf.pw[pixels] = scan->Blue.pw[bitsput] >> ls;
+				}
+				pixels += next;
+				ddax   += izoom;
+				dw--;
+			}
+		}
+		break;
+	}
+}
+
+/** here we copy and scale from scanner world to user world...
+ */
+static void ref_ColorScale8( Plustek_Device *dev )
+{
+	int      izoom, ddax, next;
+	u_long   dw, pixels, bitsput;
+    ScanDef *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (dw > 0)) {
+
+			scan->UserBuf.pb_rgb[pixels].Red =
+			                            scan->Red.pcb[bitsput].a_bColor[0];
+			scan->UserBuf.pb_rgb[pixels].Green =
+			                            scan->Green.pcb[bitsput].a_bColor[0];
+			scan->UserBuf.pb_rgb[pixels].Blue =
+			                            scan->Blue.pcb[bitsput].a_bColor[0];
+			pixels += next;
+			ddax   += izoom;
+			dw--;
+		}
+	}
+}
+
+static void ref_ColorScale8_2( Plustek_Device *dev )
+{
+	int      izoom, ddax, next;
+	u_long   dw, pixels, bitsput;
+	ScanDef *scan = &dev->scanning;
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (dw > 0)) {
+
+			scan->UserBuf.pb_rgb[pixels].Red   = scan->Red.pb[bitsput];
+			scan->UserBuf.pb_rgb[pixels].Green = scan->Green.pb[bitsput];
+			scan->UserBuf.pb_rgb[pixels].Blue  = scan->Blue.pb[bitsput];
+
+			pixels += next;
+			ddax   += izoom;
+			dw--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_ColorScale16( Plustek_Device *dev )
+{
+	u_char    ls;
+	int       izoom, ddax, next;
+	u_long    dw, pixels, bitsput;
+	SANE_Bool swap = usb_HostSwap();
+	ScanDef  *scan = &dev->scanning;
+
+	usb_AverageColorWord( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (dw > 0)) {
+
+			if( swap ) {
+
+				scan->UserBuf.pw_rgb[pixels].Red =
+				          _HILO2WORD(scan->Red.pcw[bitsput].HiLo[0]) >> ls;
+
+				scan->UserBuf.pw_rgb[pixels].Green =
+					      _HILO2WORD(scan->Green.pcw[bitsput].HiLo[0]) >> ls;
+
+				scan->UserBuf.pw_rgb[pixels].Blue =
+					      _HILO2WORD(scan->Blue.pcw[bitsput].HiLo[0]) >> ls;
+
+			} else {
+
+				scan->UserBuf.pw_rgb[pixels].Red   = scan->Red.pw[bitsput]>>ls;
+				scan->UserBuf.pw_rgb[pixels].Green = scan->Green.pw[bitsput] >> ls;
+				scan->UserBuf.pw_rgb[pixels].Blue  = scan->Blue.pw[bitsput] >> ls;
+			}
+			pixels += next;
+			ddax   += izoom;
+			dw--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_ColorScale16_2( Plustek_Device *dev )
+{
+	u_char     ls;
+	HiLoDef    tmp;
+	int        izoom, ddax, next;
+	u_long     dw, pixels, bitsput;
+	SANE_Bool  swap = usb_HostSwap();
+	ScanDef   *scan = &dev->scanning;
+
+	usb_AverageColorWord( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (dw > 0)) {
+
+			if( swap ) {
+
+				tmp = *((HiLoDef*)&scan->Red.pw[bitsput]);
+				scan->UserBuf.pw_rgb[pixels].Red = _HILO2WORD(tmp) >> ls;
+
+				tmp = *((HiLoDef*)&scan->Green.pw[bitsput]);
+				scan->UserBuf.pw_rgb[pixels].Green = _HILO2WORD(tmp) >> ls;
+
+				tmp = *((HiLoDef*)&scan->Blue.pw[bitsput]);
+				scan->UserBuf.pw_rgb[pixels].Blue = _HILO2WORD(tmp) >> ls;
+
+			} else {
+
+				scan->UserBuf.pw_rgb[pixels].Red   = scan->Red.pw[bitsput] >> ls;
+				scan->UserBuf.pw_rgb[pixels].Green = scan->Green.pw[bitsput] >> ls;
+				scan->UserBuf.pw_rgb[pixels].Blue  = scan->Blue.pw[bitsput] >> ls;
+			}
+			pixels += next;
+			ddax   += izoom;
+			dw--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_ColorScalePseudo16( Plustek_Device *dev )
+{
+	int      izoom, ddax, next;
+	u_short  wR, wG, wB;
+	u_long   dw, pixels, bitsput;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageColorByte( dev );
+
+	dw = scan->sParam.Size.dwPixels;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next   = -1;
+		pixels = scan->sParam.Size.dwPixels - 1;
+	} else {
+		next   = 1;
+		pixels = 0;
+	}
+
+	izoom = usb_GetScaler( scan );
+
+	/* these took green and blue of the first pixel from the wrong bytes */
+	wR = (u_short)scan->Red.pcb[0].a_bColor[0];
+	wG = (u_short)scan->Green.pcb[0].a_bColor[0];
+	wB = (u_short)scan->Blue.pcb[0].a_bColor[0];
+
+	for( bitsput = 0, ddax = 0; dw; bitsput++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (dw > 0)) {
+
+			scan->UserBuf.pw_rgb[pixels].Red =
+				(wR + scan->Red.pcb[bitsput].a_bColor[0]) << bShift;
+
+			scan->UserBuf.pw_rgb[pixels].Green =
+				(wG + scan->Green.pcb[bitsput].a_bColor[0]) << bShift;
+
+			scan->UserBuf.pw_rgb[pixels].Blue =
+				(wB + scan->Blue.pcb[bitsput].a_bColor[0]) << bShift;
+
+			pixels += next;
+			ddax   += izoom;
+			dw--;
+		}
+
+		wR = (u_short)scan->Red.pcb[bitsput].a_bColor[0];
+		wG = (u_short)scan->Green.pcb[bitsput].a_bColor[0];
+		wB = (u_short)scan->Blue.pcb[bitsput].a_bColor[0];
+	}
+}
+
+
+/**
+ */
+static void ref_BWScaleFromColor( Plustek_Device *dev )
+{
+	u_char        d, s, *dest;
+	u_short       j;
+	u_long        pixels;
+	int           izoom, ddax, next;
+	ColorByteDef *src;
+	ScanDef      *scan = &dev->scanning;
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
+		next = -1;
+	} else {
+		dest = scan->UserBuf.pb;
+		next = 1;
+	}
+
+	/* setup the source buffer */
+	switch(scan->fGrayFromColor) {
+	case 1:  src = scan->Red.pcb;   break;
+	case 3:  src = scan->Blue.pcb;  break;
+	default: src = scan->Green.pcb; break;
+	}
+
+	izoom = usb_GetScaler( scan );
+	ddax  = 0;
+
+	d = j = 0;
+	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (pixels > 0)) {
+
+			s = src->a_bColor[0];
+			if( s != 0 )
+				d |= BitTable[j];
+			j++;
+			if( j == 8 ) {
+				*dest = d;
+				dest += next;
+				d = j = 0;
+			}
+			ddax   += izoom;
+			pixels--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_BWScaleFromColor_2( Plustek_Device *dev )
+{
+	u_char        d, *dest, *src;
+	u_short       j;
+	u_long        pixels;
+	int           izoom, ddax, next;
+	ScanDef      *scan = &dev->scanning;
+
+	if (scan->sParam.bSource == SOURCE_ADF) {
+		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
+		next = -1;
+	} else {
+		dest = scan->UserBuf.pb;
+		next = 1;
+	}
+
+	/* setup the source buffer */
+	switch(scan->fGrayFromColor) {
+	case 1:  src = scan->Red.pb;   break;
+	case 3:  src = scan->Blue.pb;  break;
+	default: src = scan->Green.pb; break;
+	}
+
+	izoom = usb_GetScaler( scan );
+	ddax  = 0;
+
+	d = j = 0;
+	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (pixels > 0)) {
+
+			if( *src != 0 )
+				d |= BitTable[j];
+			j++;
+			if( j == 8 ) {
+				*dest = d;
+				dest += next;
+				d = j = 0;
+			}
+			ddax   += izoom;
+			pixels--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_GrayScale8( Plustek_Device *dev )
+{
+	u_char  *dest, *src;
+	int      izoom, ddax, next;
+	u_long   pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageGrayByte( dev );
+
+	src = scan->Green.pb;
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		dest = scan->UserBuf.pb + scan->sParam.Size.dwPixels - 1;
+		next = -1;
+	} else {
+		dest = scan->UserBuf.pb;
+		next = 1;
+	}
+
+	izoom = usb_GetScaler( scan );
+	ddax  = 0;
+
+	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (pixels > 0)) {
+
+			*dest = *src;
+			dest += next;
+			ddax   += izoom;
+			pixels--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_GrayScale16( Plustek_Device *dev )
+{
+	u_char    ls;
+	int       izoom, ddax, next;
+	u_short  *dest;
+	u_long    pixels;
+	HiLoDef  *pwm;
+	ScanDef  *scan = &dev->scanning;
+	SANE_Bool swap = usb_HostSwap();
+
+	usb_AverageGrayWord( dev);
+
+	pwm  = scan->Green.philo;
+	wSum = scan->sParam.PhyDpi.x;
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next = -1;
+		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
+	} else {
+		next = 1;
+		dest = scan->UserBuf.pw;
+	}
+
+	izoom = usb_GetScaler( scan );
+	ddax  = 0;
+
+	if( scan->dwFlag & SCANFLAG_RightAlign )
+		ls = Shift;
+	else
+		ls = 0;
+
+	for( pixels = scan->sParam.Size.dwPixels; pixels; pwm++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (pixels > 0)) {
+
+			if( swap )
+				*dest = _PHILO2WORD(pwm) >> ls;
+			else
+				*dest = _PLOHI2WORD(pwm) >> ls;
+
+			dest += next;
+			ddax += izoom;
+			pixels--;
+		}
+	}
+}
+
+/**
+ */
+static void ref_GrayScalePseudo16( Plustek_Device *dev )
+{
+	u_char  *src;
+	int      izoom, ddax, next;
+	u_short *dest, g;
+	u_long   pixels;
+	ScanDef *scan = &dev->scanning;
+
+	usb_AverageGrayByte( dev );
+
+	if( scan->sParam.bSource == SOURCE_ADF ) {
+		next = -1;
+		dest = scan->UserBuf.pw + scan->sParam.Size.dwPixels - 1;
+	} else {
+		next = 1;
+		dest = scan->UserBuf.pw;
+	}
+
+	src = scan->Green.pb;
+	g   = (u_short)*src;
+
+	izoom = usb_GetScaler( scan );
+	ddax  = 0;
+
+	for( pixels = scan->sParam.Size.dwPixels; pixels; src++ ) {
+
+		ddax -= _SCALER;
+
+		while((ddax < 0) && (pixels > 0)) {
+
+			*dest = (g + *src) << bShift;
+			dest += next;
+			ddax += izoom;
+			pixels--;
+		}
+		g = (u_short)*src;
+	}
+}
+
+/** function to select the appropriate pixel copy function
+ */
+static void ref_GetImageProc( Plustek_Device *dev )
+{
+    ScanDef  *scan = &dev->scanning;
+	DCapsDef *sc   = &dev->usbDev.Caps;
+	HWDef    *hw   = &dev->usbDev.HwSetting;
+
+	bShift = 0;
+
+	if( scan->sParam.UserDpi.x != scan->sParam.PhyDpi.x ) {
+
+		/* Pixel scaling... */
+		switch( scan->sParam.bDataType ) {
+
+			case SCANDATATYPE_Color:
+				if (scan->sParam.bBitDepth > 8) {
+
+					if( usb_IsCISDevice(dev)){
+						scan->pfnProcess = ref_ColorScale16_2;
+						DBG( _DBG_INFO, "ImageProc is: ColorScale16_2\n" );
+					} else {
+						scan->pfnProcess = ref_ColorScale16;
+						DBG( _DBG_INFO, "ImageProc is: ColorScale16\n" );
+					}
+					if (scan->fGrayFromColor) {
+						if( usb_IsCISDevice(dev)){
+							scan->pfnProcess = ref_ColorScaleGray16_2;
+							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray16_2\n" );
+						} else {
+							scan->pfnProcess = ref_ColorScaleGray16;
+							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray16\n" );
+						}
+					}
+				} else if (scan->dwFlag & SCANFLAG_Pseudo48) {
+					scan->pfnProcess = ref_ColorScalePseudo16;
+					DBG( _DBG_INFO, "ImageProc is: ColorScalePseudo16\n" );
+
+				} else if (scan->fGrayFromColor) {
+
+					if( usb_IsCISDevice(dev)){
+						if (scan->fGrayFromColor > 7 ) {
+							scan->pfnProcess = ref_BWScaleFromColor_2;
+							DBG( _DBG_INFO, "ImageProc is: BWScaleFromColor_2\n" );
+						} else {
+							scan->pfnProcess = ref_ColorScaleGray_2;
+							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray_2\n" );
+						}
+					} else {
+						if (scan->fGrayFromColor > 7 ) {
+							scan->pfnProcess = ref_BWScaleFromColor;
+							DBG( _DBG_INFO, "ImageProc is: BWScaleFromColor\n" );
+						} else {
+							scan->pfnProcess = ref_ColorScaleGray;
+							DBG( _DBG_INFO, "ImageProc is: ColorScaleGray\n" );
+						}
+					}
+				} else {
+
+					if( usb_IsCISDevice(dev)){
+						scan->pfnProcess = ref_ColorScale8_2;
+						DBG( _DBG_INFO, "ImageProc is: ColorScale8_2\n" );
+					} else {
+						scan->pfnProcess = ref_ColorScale8;
+						DBG( _DBG_INFO, "ImageProc is: ColorScale8\n" );
+					}
+				}
+				break;
+
+			case SCANDATATYPE_Gray:
+				if (scan->sParam.bBitDepth > 8) {
+					scan->pfnProcess = ref_GrayScale16;
+					DBG( _DBG_INFO, "ImageProc is: GrayScale16\n" );
+				} else {
+
+					if (scan->dwFlag & SCANFLAG_Pseudo48) {
+						scan->pfnProcess = ref_GrayScalePseudo16;
+						DBG( _DBG_INFO, "ImageProc is: GrayScalePseudo16\n" );
+					} else {
+						scan->pfnProcess = ref_GrayScale8;
+						DBG( _DBG_INFO, "ImageProc is: GrayScale8\n" );
+					}
+				}
+				break;
+
+			default:
+				scan->pfnProcess = usb_BWScale;
+				DBG( _DBG_INFO, "ImageProc is: BWScale\n" );
+				break;
+		}
+
+	} else {
+
+		/* Pixel copy */
+		switch( scan->sParam.bDataType ) {
+
+			case SCANDATATYPE_Color:
+				if (scan->sParam.bBitDepth > 8) {
+					if( usb_IsCISDevice(dev)){
+						scan->pfnProcess = ref_ColorDuplicate16_2;
+						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate16_2\n" );
+					} else {
+						scan->pfnProcess = ref_ColorDuplicate16;
+						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate16\n" );
+					}
+					if (scan->fGrayFromColor) {
+						if( usb_IsCISDevice(dev)){
+							scan->pfnProcess = ref_ColorDuplicateGray16_2;
+							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray16_2\n" );
+						} else {
+							scan->pfnProcess = ref_ColorDuplicateGray16;
+							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray16\n" );
+						}
+					}
+				} else if (scan->dwFlag & SCANFLAG_Pseudo48) {
+					scan->pfnProcess = ref_ColorDuplicatePseudo16;
+					DBG( _DBG_INFO, "ImageProc is: ColorDuplicatePseudo16\n" );
+				} else if (scan->fGrayFromColor) {
+					if( usb_IsCISDevice(dev)){
+						if (scan->fGrayFromColor > 7 ) {
+							scan->pfnProcess = ref_BWDuplicateFromColor_2;
+							DBG( _DBG_INFO, "ImageProc is: BWDuplicateFromColor_2\n" );
+						} else {
+							scan->pfnProcess = ref_ColorDuplicateGray_2;
+							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray_2\n" );
+						}
+					} else {
+						if (scan->fGrayFromColor > 7 ) {
+							scan->pfnProcess = ref_BWDuplicateFromColor;
+							DBG( _DBG_INFO, "ImageProc is: BWDuplicateFromColor\n" );
+						} else {
+							scan->pfnProcess = ref_ColorDuplicateGray;
+							DBG( _DBG_INFO, "ImageProc is: ColorDuplicateGray\n" );
+						}
+					}
+				} else {
+					if( usb_IsCISDevice(dev)){
+						scan->pfnProcess = ref_ColorDuplicate8_2;
+						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate8_2\n" );
+					} else {
+						scan->pfnProcess = ref_ColorDuplicate8;
+						DBG( _DBG_INFO, "ImageProc is: ColorDuplicate8\n" );
+					}
+				}
+				break;
+
+			case SCANDATATYPE_Gray:
+				if (scan->sParam.bBitDepth > 8) {
+					scan->pfnProcess = ref_GrayDuplicate16;
+					DBG( _DBG_INFO, "ImageProc is: GrayDuplicate16\n" );
+				} else {
+					if (scan->dwFlag & SCANFLAG_Pseudo48) {
+						scan->pfnProcess = ref_GrayDuplicatePseudo16;
+						DBG( _DBG_INFO, "ImageProc is: GrayDuplicatePseudo16\n" );
+					} else {
+						scan->pfnProcess = ref_GrayDuplicate8;
+						DBG( _DBG_INFO, "ImageProc is: GrayDuplicate8\n" );
+					}
+				}
+				break;
+
+			default:
+				scan->pfnProcess = usb_BWDuplicate;
+				DBG( _DBG_INFO, "ImageProc is: BWDuplicate\n" );
+				break;
+		}
+	}
+
+	if( scan->sParam.bBitDepth == 8 ) {
+
+		if( scan->dwFlag & SCANFLAG_Pseudo48 ) {
+			if( scan->dwFlag & SCANFLAG_RightAlign ) {
+				bShift = 5;
+			} else {
+
+				/* this should fix the Bearpaw/U12 discrepancy
+				 * in general the fix is needed, but not for the U12
+				 * why? - no idea!
+				 */
+				if(_WAF_BSHIFT7_BUG == (_WAF_BSHIFT7_BUG & sc->workaroundFlag))
+					bShift = 0; /* Holger Bischof 16.12.2001 */
+				else
+					bShift = 7;
+			}
+			DBG( _DBG_INFO, "bShift adjusted: %u\n", bShift );
+		}
+	}
+
+	if( _LM9833 == hw->chip ) {
+		Shift = 0;
+		Mask  = 0xFFFF;
+	} else {
+		Shift = 2;
+		Mask  = 0xFFFC;
+	}
+}
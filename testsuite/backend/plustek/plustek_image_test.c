@@ -0,0 +1,232 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+/*
+ * Checks the pixel copy and scaling kernels of plustek-usbimg.c against
+ * the functions they replaced, for all scan modes with random data.  We
+ * include plustek.c to get to the static functions.
+ */
+#include "../../../backend/plustek.c"
+
+#include "plustek_image_ref.c"
+
+/* enough for the source pixels of 1000 user pixels at 1/8 of the optical
+   resolution, 3 channels of 16 bit each; the averaging of negatives steps
+   through the blue plane of CIS devices as if it were pixel interleaved */
+#define MAX_PIXELS 1000
+#define RAW_SIZE   (MAX_PIXELS * 8 * 10 + 64)
+#define USER_SIZE  (MAX_PIXELS * 6 + 64)
+
+static Plustek_Device dev;
+static u_char raw[RAW_SIZE];
+static u_char work[RAW_SIZE];
+
+static unsigned
+next_random (unsigned *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+struct mode
+{
+  u_char data_type;
+  u_char depth;
+  u_long flags;
+  int gray_from_color;
+  SANE_Bool cis;
+  u_char source;
+  u_short user_dpi, phy_dpi;
+  u_long pixels;
+};
+
+/* set up the scan like usbDev_Prepare() does, with the image in work */
+static void
+setup (const struct mode *m, u_char * user)
+{
+  ScanDef *scan = &dev.scanning;
+  u_long bps = m->depth > 8 ? 2 : 1;
+  u_long phy_pixels = m->pixels * m->phy_dpi / m->user_dpi + 2;
+
+  memcpy (work, raw, RAW_SIZE);
+  memset (user, 0xa5, USER_SIZE);
+
+  dev.usbDev.HwSetting.bReg_0x26 = m->cis ? _ONE_CH_COLOR : 0;
+  scan->sParam.bDataType = m->data_type;
+  scan->sParam.bBitDepth = m->depth;
+  scan->sParam.bSource = m->source;
+  scan->sParam.UserDpi.x = m->user_dpi;
+  scan->sParam.PhyDpi.x = m->phy_dpi;
+  scan->sParam.Size.dwPixels = m->pixels;
+  scan->sParam.Size.dwValidPixels = m->pixels;
+  scan->sParam.Size.dwPhyPixels = phy_pixels;
+  scan->sParam.Size.dwBytes = m->data_type == SCANDATATYPE_BW
+    ? (m->pixels + 7) / 8 : m->pixels * bps;
+  scan->dwBytesLine = scan->sParam.Size.dwBytes;
+  scan->dwFlag = m->flags;
+  scan->fGrayFromColor = m->gray_from_color;
+  scan->UserBuf.pb = user;
+
+  if (m->data_type == SCANDATATYPE_Color && !m->cis)
+    {
+      /* pixel interleaved */
+      scan->Red.pb = work;
+      scan->Green.pb = work + bps;
+      scan->Blue.pb = work + 2 * bps;
+    }
+  else
+    {
+      /* one plane per channel */
+      scan->Red.pb = work;
+      scan->Green.pb = work + phy_pixels * bps;
+      scan->Blue.pb = work + 2 * phy_pixels * bps;
+      if (m->data_type != SCANDATATYPE_Color)
+        scan->Green.pb = work;
+    }
+}
+
+static void
+check_mode (const struct mode *m)
+{
+  static u_char ref[USER_SIZE], out[USER_SIZE];
+
+  setup (m, ref);
+  ref_GetImageProc (&dev);
+  dev.scanning.pfnProcess (&dev);
+
+  setup (m, out);
+  assert (usb_GetImageProc (&dev) == 0);
+  dev.scanning.pfnProcess (&dev);
+  usb_FreeScaleMap (&dev.scanning);
+
+  if (memcmp (ref, out, USER_SIZE) != 0)
+    {
+      printf ("%s: differs: type %d depth %d flags 0x%lx gray %d cis %d "
+              "source %d dpi %d/%d pixels %lu\n", __func__, m->data_type,
+              m->depth, m->flags, m->gray_from_color, m->cis, m->source,
+              m->user_dpi, m->phy_dpi, m->pixels);
+      assert (0);
+    }
+}
+
+static void
+test_same_output (void)
+{
+  static const u_short dpi[][2] = {
+    { 600, 600 }, { 300, 600 }, { 150, 1200 }, { 1000, 1200 }, { 400, 300 },
+    { 1200, 1200 }, { 75, 600 }
+  };
+  static const u_long pixels[] = { 1, 7, 8, 17, 333, MAX_PIXELS };
+  static const u_char sources[] = {
+    SOURCE_Reflection, SOURCE_ADF, SOURCE_Negative
+  };
+  static const u_long flags[] = {
+    0, SCANFLAG_RightAlign, SCANFLAG_Pseudo48,
+    SCANFLAG_Pseudo48 | SCANFLAG_RightAlign
+  };
+  static const int gray[] = { 0, 1, 2, 3, 10 };
+  struct mode m;
+  size_t d, p, s, f, g;
+  int type, depth, cis, count = 0;
+
+  for (type = SCANDATATYPE_BW; type <= SCANDATATYPE_Color; type++)
+    for (depth = 8; depth <= 16; depth += 8)
+      for (cis = 0; cis <= 1; cis++)
+        for (f = 0; f < sizeof (flags) / sizeof (flags[0]); f++)
+          for (g = 0; g < sizeof (gray) / sizeof (gray[0]); g++)
+            for (s = 0; s < sizeof (sources); s++)
+              for (d = 0; d < sizeof (dpi) / sizeof (dpi[0]); d++)
+                for (p = 0; p < sizeof (pixels) / sizeof (pixels[0]); p++)
+                  {
+                    if (type == SCANDATATYPE_BW && depth > 8)
+                      continue;
+                    if (type != SCANDATATYPE_Color && gray[g])
+                      continue;
+                    if ((depth > 8 || type == SCANDATATYPE_BW)
+                        && (flags[f] & SCANFLAG_Pseudo48))
+                      continue;
+                    if (depth > 8 && gray[g] > 7)
+                      continue;
+                    /* the old 16 bit functions read the data differently
+                       when the host needs no swapping */
+                    if (depth > 8 && !usb_HostSwap ())
+                      continue;
+
+                    m.data_type = type;
+                    m.depth = depth;
+                    m.flags = flags[f];
+                    m.gray_from_color = gray[g];
+                    m.cis = cis;
+                    m.source = sources[s];
+                    m.user_dpi = dpi[d][0];
+                    m.phy_dpi = dpi[d][1];
+                    m.pixels = pixels[p];
+                    check_mode (&m);
+                    count++;
+                  }
+
+  printf ("%s: %d modes ok\n", __func__, count);
+}
+
+/* a line of a CIS scanner at 1200 dpi, 16 bit color, 8.5 inch wide */
+static void
+test_speed (void)
+{
+  static u_char line[10200 * 6], user[10200 * 6];
+  ScanDef *scan = &dev.scanning;
+  clock_t t0, t1, t2;
+  int i;
+
+  memset (line, 0x5a, sizeof (line));
+  dev.usbDev.HwSetting.bReg_0x26 = _ONE_CH_COLOR;
+  scan->sParam.bDataType = SCANDATATYPE_Color;
+  scan->sParam.bBitDepth = 16;
+  scan->sParam.bSource = SOURCE_Reflection;
+  scan->sParam.UserDpi.x = 1200;
+  scan->sParam.PhyDpi.x = 1200;
+  scan->sParam.Size.dwPixels = 10200;
+  scan->sParam.Size.dwPhyPixels = 10200;
+  scan->dwFlag = 0;
+  scan->fGrayFromColor = 0;
+  scan->UserBuf.pb = user;
+  scan->Red.pb = line;
+  scan->Green.pb = line + 10200 * 2;
+  scan->Blue.pb = line + 10200 * 4;
+
+  t0 = clock ();
+  ref_GetImageProc (&dev);
+  for (i = 0; i < 500; i++)
+    scan->pfnProcess (&dev);
+  t1 = clock ();
+  assert (usb_GetImageProc (&dev) == 0);
+  for (i = 0; i < 500; i++)
+    scan->pfnProcess (&dev);
+  t2 = clock ();
+
+  printf ("%s: 500 lines, old %.1f ms, new %.1f ms\n", __func__,
+          (t1 - t0) * 1e3 / CLOCKS_PER_SEC, (t2 - t1) * 1e3 / CLOCKS_PER_SEC);
+}
+
+int
+main (void)
+{
+  unsigned seed = 1;
+  size_t i;
+
+  DBG_INIT ();
+
+  for (i = 0; i < RAW_SIZE; i++)
+    raw[i] = next_random (&seed) % 8 ? next_random (&seed) : 0;
+
+  test_same_output ();
+  test_speed ();
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
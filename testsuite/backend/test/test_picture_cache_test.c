@@ -0,0 +1,236 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/*
+ * Checks that the test backend draws its pictures once, keeps them in
+ * memory and in the picture cache directory, and delivers the same data
+ * straight from them as through the reader task. We include test.c to get
+ * to the device structure.
+ */
+#include "../../../backend/test.c"
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* the backend only accepts options whose descriptor was fetched since
+   the last reload, like a frontend does */
+static SANE_Status
+control (SANE_Handle h, int option, SANE_Action action, void *value)
+{
+  assert (sane_get_option_descriptor (h, option));
+  return sane_control_option (h, option, action, value, NULL);
+}
+
+static void
+set_int (SANE_Handle h, int option, SANE_Word value)
+{
+  assert (control (h, option, SANE_ACTION_SET_VALUE, &value)
+          == SANE_STATUS_GOOD);
+}
+
+static void
+set_string (SANE_Handle h, int option, const char *value)
+{
+  char buf[64];
+
+  strcpy (buf, value);
+  assert (control (h, option, SANE_ACTION_SET_VALUE, buf)
+          == SANE_STATUS_GOOD);
+}
+
+static SANE_Handle
+open_device (const char *mode)
+{
+  SANE_Handle h;
+
+  assert (sane_open ("0", &h) == SANE_STATUS_GOOD);
+  set_string (h, opt_test_picture, "Grid");
+  set_string (h, opt_mode, mode);
+  set_int (h, opt_resolution, SANE_FIX (100.0));
+  set_int (h, opt_br_x, SANE_FIX (51.0));
+  set_int (h, opt_br_y, SANE_FIX (26.0));
+  return h;
+}
+
+/** scan a page, check whether it came through the ring and return it */
+static SANE_Byte *
+scan_page (SANE_Handle h, SANE_Bool through_ring, size_t * size)
+{
+  SANE_Parameters params;
+  SANE_Byte *page;
+  SANE_Int len;
+  SANE_Status status;
+  size_t total = 0;
+
+  assert (sane_get_parameters (h, &params) == SANE_STATUS_GOOD);
+  *size = (size_t) params.bytes_per_line * params.lines;
+  page = malloc (*size + 1000);
+  assert (page);
+
+  assert (sane_start (h) == SANE_STATUS_GOOD);
+  assert ((((Test_Device *) h)->ring != NULL) == through_ring);
+  /* odd read sizes cross the end of the picture */
+  while ((status = sane_read (h, page + total, 997, &len))
+         == SANE_STATUS_GOOD)
+    total += len;
+  assert (status == SANE_STATUS_EOF);
+  assert (total == *size);
+  return page;
+}
+
+static void
+check_page (Test_Device * dev, SANE_Byte * page, size_t size)
+{
+  SANE_Byte *b;
+  size_t b_size, i;
+
+  assert (init_picture_buffer (dev, &b, &b_size) == SANE_STATUS_GOOD);
+  assert (b_size < size);
+  for (i = 0; i < size; i += b_size)
+    assert (memcmp (page + i, b, size - i < b_size ? size - i : b_size) == 0);
+  free (b);
+}
+
+static void
+test_memory (void)
+{
+  SANE_Handle h = open_device (SANE_VALUE_SCAN_MODE_GRAY);
+  Test_Device *dev = h;
+  SANE_Byte *page, *ring_page, *gray;
+  size_t size, ring_size;
+
+  page = scan_page (h, SANE_FALSE, &size);
+  check_page (dev, page, size);
+  gray = dev->picture->data;
+  assert (!dev->picture->mapped);
+  free (page);
+
+  /* the next scan reuses the picture */
+  page = scan_page (h, SANE_FALSE, &size);
+  assert (dev->picture->data == gray);
+  free (page);
+
+  /* other parameters need another picture, the gray one is kept */
+  set_string (h, opt_mode, SANE_VALUE_SCAN_MODE_COLOR);
+  page = scan_page (h, SANE_FALSE, &size);
+  check_page (dev, page, size);
+  assert (dev->picture->data != gray);
+  free (page);
+  set_string (h, opt_mode, SANE_VALUE_SCAN_MODE_GRAY);
+  page = scan_page (h, SANE_FALSE, &size);
+  assert (dev->picture->data == gray);
+
+  /* the reader task delivers the same data */
+  set_string (h, opt_timing_profile, "Custom");
+  set_int (h, opt_timing_bandwidth, 1024 * 1024);
+  ring_page = scan_page (h, SANE_TRUE, &ring_size);
+  assert (ring_size == size);
+  assert (memcmp (ring_page, page, size) == 0);
+  assert (dev->picture->data == gray);
+  free (ring_page);
+  free (page);
+
+  set_string (h, opt_timing_profile, "None");
+  sane_close (h);
+  printf ("%s: ok\n", __func__);
+}
+
+static void
+test_file (void)
+{
+  SANE_Handle h = open_device (SANE_VALUE_SCAN_MODE_COLOR);
+  Test_Device *dev = h;
+  char dir[] = "/tmp/test-picture-cache-XXXXXX";
+  char key[sizeof (dev->pictures[0].key)], path[PATH_MAX];
+  SANE_Byte *page, *mapped_page;
+  size_t size, mapped_size;
+
+  assert (mkdtemp (dir));
+  picture_cache_dir = strdup (dir);
+  free_pictures (dev);
+
+  /* the first scan draws the picture and stores it */
+  page = scan_page (h, SANE_FALSE, &size);
+  check_page (dev, page, size);
+  assert (dev->picture->mapped);
+  picture_key (dev, key, sizeof (key));
+  snprintf (path, sizeof (path), "%s/test-%s.pic", dir, key);
+  assert (access (path, R_OK) == 0);
+
+  /* a later session maps it */
+  free_pictures (dev);
+  mapped_page = scan_page (h, SANE_FALSE, &mapped_size);
+  assert (dev->picture->mapped);
+  assert (mapped_size == size);
+  assert (memcmp (mapped_page, page, size) == 0);
+  free (mapped_page);
+  free (page);
+
+  free_pictures (dev);
+  unlink (path);
+  rmdir (dir);
+  free (picture_cache_dir);
+  picture_cache_dir = NULL;
+  sane_close (h);
+  printf ("%s: ok\n", __func__);
+}
+
+/* 16 bit color at 600 dpi, about 60 MB */
+static void
+test_throughput (void)
+{
+  SANE_Handle h = open_device (SANE_VALUE_SCAN_MODE_COLOR);
+  SANE_Byte *buf = malloc (1024 * 1024);
+  SANE_Int len;
+  SANE_Status status;
+  size_t total = 0;
+  double t0, t1;
+
+  assert (buf);
+  set_int (h, opt_depth, 16);
+  set_int (h, opt_resolution, SANE_FIX (600.0));
+  set_int (h, opt_br_x, SANE_FIX (200.0));
+  set_int (h, opt_br_y, SANE_FIX (100.0));
+
+  t0 = now ();
+  assert (sane_start (h) == SANE_STATUS_GOOD);
+  while ((status = sane_read (h, buf, 1024 * 1024, &len))
+         == SANE_STATUS_GOOD)
+    total += len;
+  assert (status == SANE_STATUS_EOF);
+  t1 = now ();
+
+  printf ("%s: %lu MB in %.3f s\n", __func__,
+          (unsigned long) (total >> 20), t1 - t0);
+  free (buf);
+  sane_close (h);
+}
+
+int
+main (void)
+{
+  /* don't read a test.conf that may be installed */
+  setenv ("SANE_CONFIG_DIR", "/dev/null", 1);
+  assert (sane_init (NULL, NULL) == SANE_STATUS_GOOD);
+
+  test_memory ();
+  test_file ();
+  test_throughput ();
+
+  sane_exit ();
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
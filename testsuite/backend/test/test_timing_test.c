@@ -0,0 +1,238 @@
+#include "../../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+
+/*
+ * Checks the performance simulation of the test backend: the bandwidth
+ * limit, stalls, warm-up and page gaps, and the variable length of ADF
+ * pages. We include test.c to get to the device structure.
+ */
+#include "../../../backend/test.c"
+
+/* bytes per line and per page of the flatbed scans */
+static size_t line_size;
+static size_t page_size;
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* the backend only accepts options whose descriptor was fetched since
+   the last reload, like a frontend does */
+static SANE_Status
+control (SANE_Handle h, int option, SANE_Action action, void *value)
+{
+  assert (sane_get_option_descriptor (h, option));
+  return sane_control_option (h, option, action, value, NULL);
+}
+
+static SANE_Handle
+open_device (void)
+{
+  SANE_Handle h;
+  SANE_Parameters params;
+  SANE_Fixed f;
+
+  assert (sane_open ("0", &h) == SANE_STATUS_GOOD);
+
+  /* 100 dpi 8 bit gray, about 200 x 100 pixels */
+  f = SANE_FIX (100.0);
+  assert (control (h, opt_resolution, SANE_ACTION_SET_VALUE, &f) == SANE_STATUS_GOOD);
+  f = SANE_FIX (51.0);
+  assert (control (h, opt_br_x, SANE_ACTION_SET_VALUE, &f) == SANE_STATUS_GOOD);
+  f = SANE_FIX (26.0);
+  assert (control (h, opt_br_y, SANE_ACTION_SET_VALUE, &f) == SANE_STATUS_GOOD);
+
+  assert (sane_get_parameters (h, &params) == SANE_STATUS_GOOD);
+  line_size = params.bytes_per_line;
+  page_size = line_size * params.lines;
+  assert (page_size > 16384 && page_size < 24576);
+  return h;
+}
+
+static void
+set_int (SANE_Handle h, int option, SANE_Word value)
+{
+  assert (control (h, option, SANE_ACTION_SET_VALUE, &value)
+          == SANE_STATUS_GOOD);
+}
+
+static void
+set_string (SANE_Handle h, int option, const char *value)
+{
+  char buf[64];
+
+  strcpy (buf, value);
+  assert (control (h, option, SANE_ACTION_SET_VALUE, buf)
+          == SANE_STATUS_GOOD);
+}
+
+/** scan a page, return its size and the time to its first byte and to
+ *  its end
+ */
+static size_t
+scan_page (SANE_Handle h, double *first, double *last)
+{
+  SANE_Byte buf[4096];
+  SANE_Int len;
+  SANE_Status status;
+  size_t total = 0;
+  double t0;
+
+  t0 = now ();
+  assert (sane_start (h) == SANE_STATUS_GOOD);
+  *first = -1;
+  while ((status = sane_read (h, buf, sizeof (buf), &len))
+         == SANE_STATUS_GOOD)
+    {
+      if (len > 0 && *first < 0)
+        *first = now () - t0;
+      total += len;
+    }
+  assert (status == SANE_STATUS_EOF);
+  *last = now () - t0;
+  return total;
+}
+
+static void
+test_profiles (void)
+{
+  SANE_Handle h = open_device ();
+  SANE_Word value;
+
+  /* a profile fills in the values, which can't be changed then */
+  set_string (h, opt_timing_profile, "Flatbed");
+  value = ((Test_Device *) h)->val[opt_timing_bandwidth].w;
+  assert (value == 4 * 1024);
+  assert (!SANE_OPTION_IS_ACTIVE (sane_get_option_descriptor
+                                  (h, opt_timing_bandwidth)->cap));
+  value = 1;
+  assert (control (h, opt_timing_bandwidth, SANE_ACTION_SET_VALUE, &value)
+          == SANE_STATUS_INVAL);
+
+  /* custom starts from the last profile */
+  set_string (h, opt_timing_profile, "Custom");
+  assert (SANE_OPTION_IS_ACTIVE (sane_get_option_descriptor
+                                 (h, opt_timing_bandwidth)->cap));
+  assert (control (h, opt_timing_page_gap, SANE_ACTION_GET_VALUE, &value)
+          == SANE_STATUS_GOOD);
+  assert (value == 2000);
+
+  set_string (h, opt_timing_profile, "None");
+  sane_close (h);
+  printf ("%s: ok\n", __func__);
+}
+
+static void
+test_bandwidth (void)
+{
+  SANE_Handle h = open_device ();
+  double first, last;
+  size_t size;
+
+  set_string (h, opt_timing_profile, "Custom");
+
+  /* about 20 KB at 100 KB/s take about 0.2 s */
+  set_int (h, opt_timing_bandwidth, 100);
+  size = scan_page (h, &first, &last);
+  assert (size == page_size);
+  printf ("%s: %lu bytes at 100 KB/s in %.3f s\n", __func__,
+          (unsigned long) size, last);
+  assert (last > 0.17);
+
+  /* two stalls of 100 ms within the page, without a bandwidth limit */
+  set_int (h, opt_timing_bandwidth, 0);
+  set_int (h, opt_timing_stall_interval, 8);
+  set_int (h, opt_timing_stall_duration, 100);
+  size = scan_page (h, &first, &last);
+  assert (size == page_size);
+  printf ("%s: %lu bytes with 2 stalls in %.3f s\n", __func__,
+          (unsigned long) size, last);
+  assert (last > 0.19);
+
+  set_string (h, opt_timing_profile, "None");
+  size = scan_page (h, &first, &last);
+  assert (size == page_size);
+  assert (last < 0.1);
+
+  sane_close (h);
+}
+
+static void
+test_batch (void)
+{
+  SANE_Handle h = open_device ();
+  SANE_Parameters params;
+  double first, last;
+  size_t size, sizes[10];
+  int page, i, different = 0;
+
+  set_string (h, opt_scan_source, "Automatic Document Feeder");
+  set_string (h, opt_timing_profile, "Custom");
+  set_int (h, opt_timing_warm_up, 300);
+  set_int (h, opt_timing_page_gap, 50);
+  set_int (h, opt_timing_variable_length, SANE_TRUE);
+
+  assert (sane_get_parameters (h, &params) == SANE_STATUS_GOOD);
+  assert (params.lines == -1);
+  assert ((size_t) params.bytes_per_line == line_size);
+
+  for (page = 0; page < 10; page++)
+    {
+      size = scan_page (h, &first, &last);
+      assert (size % line_size == 0);
+      assert (size >= page_size * 6 / 10 - line_size && size <= page_size);
+      if (page == 0)
+        assert (first > 0.28);
+      else
+        assert (first > 0.04 && first < 0.28);
+      sizes[page] = size;
+      for (i = 0; i < page; i++)
+        if (sizes[i] != size)
+          {
+            different = 1;
+            break;
+          }
+    }
+  assert (different);
+
+  /* the feeder is empty, the next batch warms up again */
+  assert (sane_start (h) == SANE_STATUS_NO_DOCS);
+  scan_page (h, &first, &last);
+  assert (first > 0.28);
+
+  /* flatbed pages have their full length */
+  set_string (h, opt_scan_source, "Flatbed");
+  assert (sane_get_parameters (h, &params) == SANE_STATUS_GOOD);
+  assert ((size_t) params.lines * line_size == page_size);
+  assert (scan_page (h, &first, &last) == page_size);
+
+  sane_close (h);
+  printf ("%s: ok\n", __func__);
+}
+
+int
+main (void)
+{
+  /* don't read a test.conf that may be installed */
+  setenv ("SANE_CONFIG_DIR", "/dev/null", 1);
+  assert (sane_init (NULL, NULL) == SANE_STATUS_GOOD);
+
+  test_profiles ();
+  test_bandwidth ();
+  test_batch ();
+
+  sane_exit ();
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
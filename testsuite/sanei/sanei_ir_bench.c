@@ -0,0 +1,141 @@
+#include "../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+
+/* sane includes for the sanei functions called */
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_ir.h"
+
+/*
+ * Benchmark of the sanei_ir dust removal filters on synthetic film
+ * frames, single threaded and with one band per processor.
+ * We include sanei_ir.c to choose the number of bands.
+ *
+ * usage: sanei_ir_bench [megapixels]
+ */
+#include "../../sanei/sanei_ir.c"
+
+static SANE_Parameters params;
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/** film-like frame: gradients, grain and dust spots
+ */
+static void
+make_frame (SANE_Uint * img, unsigned int seed)
+{
+  int width = params.pixels_per_line;
+  int height = params.lines;
+  int i, j, k;
+
+  srand (seed);
+  for (i = 0; i < height; i++)
+    for (j = 0; j < width; j++)
+      img[i * width + j] = (i * 7 + j * 3) % 60000 + rand () % 2000;
+
+  for (k = 0; k < width * height / 10000; k++)
+    {
+      int x = rand () % (width - 20);
+      int y = rand () % (height - 20);
+
+      for (i = 0; i < 1 + k % 19; i++)
+        for (j = 0; j < 1 + k % 13; j++)
+          img[(y + i) * width + x + j] = 0;
+    }
+}
+
+static void
+run (int bands)
+{
+  long itop = (long) params.pixels_per_line * params.lines;
+  SANE_Uint *img[3], *out, *mask;
+  unsigned int *dist, *idx;
+  SANE_Status status;
+  double start;
+  int k;
+
+  ir_max_bands = bands;
+  printf ("%d band(s):\n", ir_num_bands (params.lines, itop));
+
+  for (k = 0; k < 3; k++)
+    {
+      img[k] = malloc (itop * sizeof (SANE_Uint));
+      assert (img[k] != NULL);
+      make_frame (img[k], k + 1);
+    }
+  out = malloc (itop * sizeof (SANE_Uint));
+  dist = malloc (itop * sizeof (unsigned int));
+  idx = malloc (itop * sizeof (unsigned int));
+  assert (out != NULL && dist != NULL && idx != NULL);
+
+  start = now ();
+  status = sanei_ir_filter_mean (&params, img[0], out, 9, 9);
+  assert (status == SANE_STATUS_GOOD);
+  printf ("  filter_mean 9x9    %8.3f s\n", now () - start);
+
+  start = now ();
+  status = sanei_ir_filter_madmean (&params, img[0], &mask, 9, 20, 100);
+  assert (status == SANE_STATUS_GOOD);
+  printf ("  filter_madmean     %8.3f s\n", now () - start);
+
+  start = now ();
+  sanei_ir_manhattan_dist (&params, mask, dist, idx, 1);
+  printf ("  manhattan_dist     %8.3f s\n", now () - start);
+
+  start = now ();
+  status = sanei_ir_dilate_mean (&params, img, mask, 10, 2, 5, SANE_TRUE,
+                                 0, NULL);
+  assert (status == SANE_STATUS_GOOD);
+  printf ("  dilate_mean        %8.3f s\n", now () - start);
+
+  free (mask);
+  free (idx);
+  free (dist);
+  free (out);
+  for (k = 0; k < 3; k++)
+    free (img[k]);
+}
+
+int
+main (int argc, char **argv)
+{
+  double megapixels = 24;
+
+  if (argc > 1)
+    megapixels = atof (argv[1]);
+  if (megapixels < 0.01)
+    {
+      fprintf (stderr, "usage: %s [megapixels]\n", argv[0]);
+      return 1;
+    }
+
+  /* 3:2 frame like a 35mm slide */
+  params.format = SANE_FRAME_GRAY;
+  params.last_frame = SANE_TRUE;
+  params.depth = 16;
+  params.pixels_per_line = sqrt (megapixels * 1e6 * 3 / 2);
+  params.lines = params.pixels_per_line * 2 / 3;
+  params.bytes_per_line = params.pixels_per_line * 2;
+
+  sanei_ir_init ();
+
+  printf ("%d x %d pixels\n", params.pixels_per_line, params.lines);
+  run (1);
+  run (0);
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
@@ -0,0 +1,309 @@
+#include "../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/* sane includes for the sanei functions called */
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_ir.h"
+
+/*
+ * The filters split large images into bands, we include sanei_ir.c
+ * to choose the number of bands.
+ */
+#include "../../sanei/sanei_ir.c"
+
+#define WIDTH 1031
+#define HEIGHT 797
+
+static SANE_Parameters params = {
+  SANE_FRAME_GRAY, SANE_TRUE, WIDTH * 2, WIDTH, HEIGHT, 16
+};
+
+/** film-like frame: gradients, grain and a few dust spots
+ */
+static SANE_Uint *
+make_frame (unsigned int seed)
+{
+  SANE_Uint *img;
+  int i, j, k;
+
+  img = malloc (WIDTH * HEIGHT * sizeof (SANE_Uint));
+  assert (img != NULL);
+
+  srand (seed);
+  for (i = 0; i < HEIGHT; i++)
+    for (j = 0; j < WIDTH; j++)
+      img[i * WIDTH + j] = (i * 40 + j * 23) % 60000 + rand () % 5000;
+
+  for (k = 0; k < 200; k++)
+    {
+      int x = rand () % (WIDTH - 10);
+      int y = rand () % (HEIGHT - 10);
+
+      for (i = 0; i < 1 + k % 9; i++)
+        for (j = 0; j < 1 + k % 7; j++)
+          img[(y + i) * WIDTH + x + j] = k % 2 ? 0 : 65535;
+    }
+  return img;
+}
+
+/** dirt mask of the frame: 0 is dirty, 255 clean
+ */
+static SANE_Uint *
+make_mask (const SANE_Uint * img)
+{
+  SANE_Uint *mask;
+  int i;
+
+  mask = malloc (WIDTH * HEIGHT * sizeof (SANE_Uint));
+  assert (mask != NULL);
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    mask[i] = (img[i] == 0 || img[i] == 65535) ? 0 : 255;
+  return mask;
+}
+
+/** straightforward mean filter, window clipped at the margins
+ */
+static void
+ref_filter_mean (const SANE_Uint * in, SANE_Uint * out, int win_rows,
+                 int win_cols)
+{
+  int i, j, y, x, n;
+  long sum;
+
+  for (i = 0; i < HEIGHT; i++)
+    for (j = 0; j < WIDTH; j++)
+      {
+        sum = 0;
+        n = 0;
+        for (y = i - win_rows / 2; y <= i + win_rows / 2; y++)
+          for (x = j - win_cols / 2; x <= j + win_cols / 2; x++)
+            if (y >= 0 && y < HEIGHT && x >= 0 && x < WIDTH)
+              {
+                sum += in[y * WIDTH + x];
+                n++;
+              }
+        out[i * WIDTH + j] = sum / n;
+      }
+}
+
+/** straightforward distances, by breadth first search from clean pixels
+ */
+static void
+ref_manhattan_dist (const SANE_Uint * mask, unsigned int *dist,
+                    unsigned int erode)
+{
+  int *queue;
+  int head = 0, tail = 0;
+  int i, k;
+
+  queue = malloc (WIDTH * HEIGHT * sizeof (int));
+  assert (queue != NULL);
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      dist[i] = WIDTH + HEIGHT;
+      if (mask[i] == erode)
+        {
+          dist[i] = 0;
+          queue[tail++] = i;
+        }
+    }
+
+  while (head < tail)
+    {
+      int p = queue[head++];
+      int next[4];
+
+      next[0] = p % WIDTH > 0 ? p - 1 : -1;
+      next[1] = p % WIDTH < WIDTH - 1 ? p + 1 : -1;
+      next[2] = p >= WIDTH ? p - WIDTH : -1;
+      next[3] = p < WIDTH * (HEIGHT - 1) ? p + WIDTH : -1;
+      for (k = 0; k < 4; k++)
+        if (next[k] >= 0 && dist[next[k]] > dist[p] + 1)
+          {
+            dist[next[k]] = dist[p] + 1;
+            queue[tail++] = next[k];
+          }
+    }
+  free (queue);
+}
+
+static void
+check_filter_mean (int bands, int win_rows, int win_cols)
+{
+  SANE_Uint *img, *out, *ref;
+  SANE_Status status;
+
+  printf ("%s: %d bands, %dx%d window\n", __func__, bands, win_rows,
+          win_cols);
+
+  ir_max_bands = bands;
+  img = make_frame (1);
+  out = malloc (WIDTH * HEIGHT * sizeof (SANE_Uint));
+  ref = malloc (WIDTH * HEIGHT * sizeof (SANE_Uint));
+  assert (out != NULL && ref != NULL);
+
+  status = sanei_ir_filter_mean (&params, img, out, win_rows, win_cols);
+  assert (status == SANE_STATUS_GOOD);
+  ref_filter_mean (img, ref, win_rows, win_cols);
+  assert (memcmp (out, ref, WIDTH * HEIGHT * sizeof (SANE_Uint)) == 0);
+
+  status = sanei_ir_filter_mean (&params, img, out, win_rows + 1, win_cols);
+  assert (status == SANE_STATUS_INVAL);
+
+  free (ref);
+  free (out);
+  free (img);
+}
+
+static void
+check_filter_madmean (int bands)
+{
+  SANE_Uint *img, *out, *ref, *delta, *mad;
+  SANE_Status status;
+  int a_val = 20 << 8, b_val = 100 << 8;
+  int i, threshold;
+
+  printf ("%s: %d bands\n", __func__, bands);
+
+  ir_max_bands = bands;
+  img = make_frame (2);
+  ref = malloc (WIDTH * HEIGHT * sizeof (SANE_Uint));
+  delta = malloc (WIDTH * HEIGHT * sizeof (SANE_Uint));
+  mad = malloc (WIDTH * HEIGHT * sizeof (SANE_Uint));
+  assert (ref != NULL && delta != NULL && mad != NULL);
+
+  status = sanei_ir_filter_madmean (&params, img, &out, 9, 20, 100);
+  assert (status == SANE_STATUS_GOOD);
+
+  ref_filter_mean (img, delta, 9, 9);
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    delta[i] = abs (img[i] - delta[i]);
+  ref_filter_mean (delta, mad, MAD_WIN2_SIZE (9), MAD_WIN2_SIZE (9));
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      if (mad[i] >= b_val)
+        threshold = a_val;
+      else
+        threshold = a_val + (double) mad[i] * ((b_val - a_val)
+                                               / (double) b_val);
+      ref[i] = delta[i] >= threshold ? 0 : 255;
+    }
+  assert (memcmp (out, ref, WIDTH * HEIGHT * sizeof (SANE_Uint)) == 0);
+
+  free (mad);
+  free (delta);
+  free (ref);
+  free (out);
+  free (img);
+}
+
+static void
+check_manhattan_dist (int bands, unsigned int erode)
+{
+  SANE_Uint *img, *mask;
+  unsigned int *dist, *idx, *ref;
+  int i, dx, dy;
+
+  printf ("%s: %d bands, erode %u\n", __func__, bands, erode);
+
+  ir_max_bands = bands;
+  img = make_frame (3);
+  mask = make_mask (img);
+  dist = malloc (WIDTH * HEIGHT * sizeof (unsigned int));
+  idx = malloc (WIDTH * HEIGHT * sizeof (unsigned int));
+  ref = malloc (WIDTH * HEIGHT * sizeof (unsigned int));
+  assert (dist != NULL && idx != NULL && ref != NULL);
+
+  sanei_ir_manhattan_dist (&params, mask, dist, idx, erode);
+  ref_manhattan_dist (mask, ref, erode ? 255 : 0);
+  assert (memcmp (dist, ref, WIDTH * HEIGHT * sizeof (unsigned int)) == 0);
+
+  /* the index is one of the closest pixels */
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      assert (idx[i] < WIDTH * HEIGHT);
+      assert (ref[idx[i]] == 0);
+      dx = abs ((int) (idx[i] % WIDTH) - i % WIDTH);
+      dy = abs ((int) (idx[i] / WIDTH) - i / WIDTH);
+      assert ((unsigned int) (dx + dy) == dist[i]);
+    }
+
+  free (ref);
+  free (idx);
+  free (dist);
+  free (mask);
+  free (img);
+}
+
+/** the result must not depend on the number of bands
+ */
+static void
+check_dilate_mean (SANE_Bool smooth)
+{
+  SANE_Uint *img[3], *ref[3], *mask;
+  SANE_Status status;
+  int crop[4], ref_crop[4];
+  int bands, k;
+
+  printf ("%s: smooth %d\n", __func__, smooth);
+
+  for (bands = 1; bands <= 3; bands += 2)
+    {
+      ir_max_bands = bands;
+      for (k = 0; k < 3; k++)
+        img[k] = make_frame (4 + k);
+      mask = make_mask (img[0]);
+
+      status = sanei_ir_dilate_mean (&params, img, mask, 10, 1, 5, smooth,
+                                     0, crop);
+      assert (status == SANE_STATUS_GOOD);
+
+      if (bands == 1)
+        {
+          memcpy (ref, img, sizeof (ref));
+          memcpy (ref_crop, crop, sizeof (ref_crop));
+        }
+      else
+        {
+          assert (memcmp (crop, ref_crop, sizeof (crop)) == 0);
+          for (k = 0; k < 3; k++)
+            {
+              assert (memcmp (img[k], ref[k],
+                              WIDTH * HEIGHT * sizeof (SANE_Uint)) == 0);
+              free (ref[k]);
+              free (img[k]);
+            }
+        }
+      free (mask);
+    }
+}
+
+int
+main (void)
+{
+  int bands;
+
+  sanei_ir_init ();
+
+  for (bands = 1; bands <= 3; bands += 2)
+    {
+      check_filter_mean (bands, 1, 1);
+      check_filter_mean (bands, 5, 9);
+      check_filter_mean (bands, 13, 3);
+      check_filter_madmean (bands);
+      check_manhattan_dist (bands, 0);
+      check_manhattan_dist (bands, 1);
+    }
+  check_dilate_mean (SANE_FALSE);
+  check_dilate_mean (SANE_TRUE);
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
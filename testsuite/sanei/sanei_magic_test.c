@@ -0,0 +1,581 @@
+/* sane - Scanner Access Now Easy.
+
+   Copyright (C) 2026 Sane Developers.
+
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/* sane includes for the sanei functions called */
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_magic.h"
+
+/* a 4 by 5 inch gray page on a dark background, skewed */
+#define DPI 100
+#define WIDTH 400
+#define HEIGHT 500
+#define SLOPE 0.04
+#define BG 0
+#define DIAM 1
+
+static void
+init_params (SANE_Parameters * params)
+{
+  memset (params, 0, sizeof (*params));
+  params->format = SANE_FRAME_GRAY;
+  params->last_frame = SANE_TRUE;
+  params->depth = 8;
+  params->pixels_per_line = WIDTH;
+  params->bytes_per_line = WIDTH;
+  params->lines = HEIGHT;
+}
+
+/* white paper with some dark bars of text and a few specks,
+ * rotated by SLOPE around the center of the image */
+static SANE_Byte *
+make_page (void)
+{
+  SANE_Byte *page = malloc (WIDTH * HEIGHT);
+  double a = atan (SLOPE);
+  int x, y;
+
+  assert (page);
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        double dx = x - WIDTH / 2, dy = y - HEIGHT / 2;
+        double px = dx * cos (a) + dy * sin (a) + WIDTH / 2;
+        double py = -dx * sin (a) + dy * cos (a) + HEIGHT / 2;
+        SANE_Byte v = BG;
+
+        if (px >= 40 && px < WIDTH - 40 && py >= 40 && py < HEIGHT - 40)
+          {
+            v = 0xff;
+            if (px >= 80 && px < WIDTH - 80 && ((int) py / 10) % 3 == 0)
+              v = 0x20;
+          }
+        page[y * WIDTH + x] = v;
+      }
+
+  /* single pixel specks for despeck */
+  for (y = 70; y < HEIGHT - 70; y += 37)
+    page[y * WIDTH + WIDTH - 60] = 0x10;
+
+  return page;
+}
+
+/* run the band functions over the page, handing in rows in chunks */
+static void
+process_bands (sanei_magic_band * band, SANE_Byte * page, int chunk)
+{
+  int lines = 0, done, last = 0;
+
+  while (lines < HEIGHT)
+    {
+      lines += chunk;
+      if (lines > HEIGHT)
+        lines = HEIGHT;
+      assert (sanei_magic_bandProcess (band, page, lines, &done)
+              == SANE_STATUS_GOOD);
+      assert (done >= last && done <= lines);
+      last = done;
+    }
+  assert (done == HEIGHT);
+}
+
+/* like process_bands, but keep only the rows not finished yet and the
+ * last finished one in a window, as a backend with a small buffer does.
+ * Finished rows are written back to the page. Returns the most rows
+ * that were kept */
+static int
+process_window (sanei_magic_band * band, SANE_Parameters * params,
+                SANE_Byte * page, int chunk)
+{
+  int bw = params->bytes_per_line;
+  SANE_Byte *win = malloc (bw * HEIGHT);
+  int first = 0, lines = 0, done = 0, sent = 0, most = 0;
+
+  assert (win);
+  while (lines < HEIGHT)
+    {
+      int n = chunk < HEIGHT - lines ? chunk : HEIGHT - lines;
+
+      memcpy (win + (lines - first) * bw, page + lines * bw, n * bw);
+      lines += n;
+      if (lines - first > most)
+        most = lines - first;
+
+      assert (sanei_magic_bandProcessRows (band, win, first, lines, &done)
+              == SANE_STATUS_GOOD);
+      assert (done >= sent && done <= lines);
+
+      memcpy (page + sent * bw, win + (sent - first) * bw,
+              (done - sent) * bw);
+      sent = done;
+
+      /* the row above the finished ones is still needed */
+      if (done - 1 > first)
+        {
+          if (lines < HEIGHT)
+            assert (sanei_magic_bandProcessRows (band, win, done, lines,
+                                                 &n) == SANE_STATUS_INVAL);
+          memmove (win, win + (done - 1 - first) * bw,
+                   (lines - done + 1) * bw);
+          first = done - 1;
+        }
+    }
+  assert (done == HEIGHT);
+
+  free (win);
+  return most;
+}
+
+/* whole page deskew and despeck */
+static void
+whole_page (SANE_Byte * page, int centerX, int centerY, double slope)
+{
+  SANE_Parameters params;
+
+  init_params (&params);
+  assert (sanei_magic_rotate (&params, page, centerX, centerY, slope, BG)
+          == SANE_STATUS_GOOD);
+  assert (sanei_magic_despeck (&params, page, DIAM) == SANE_STATUS_GOOD);
+}
+
+/** a known skew corrected band by band must match the whole page
+ * result, whatever the band size */
+static void
+test_band_rotate (void)
+{
+  static const int chunks[] = { 1, 7, 64, HEIGHT };
+  SANE_Parameters params;
+  SANE_Byte *orig = make_page ();
+  SANE_Byte *ref = make_page ();
+  SANE_Byte *page = malloc (WIDTH * HEIGHT);
+  int centerX, centerY;
+  double slope;
+  unsigned int i;
+
+  assert (page);
+
+  init_params (&params);
+  assert (sanei_magic_findSkew (&params, ref, DPI, DPI, &centerX, &centerY,
+                                &slope) == SANE_STATUS_GOOD);
+  assert (fabs (slope - SLOPE) < 0.01);
+  whole_page (ref, centerX, centerY, slope);
+
+  for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++)
+    {
+      sanei_magic_band *band;
+
+      memcpy (page, orig, WIDTH * HEIGHT);
+
+      assert (sanei_magic_bandStart (&band, &params, DPI, DPI)
+              == SANE_STATUS_GOOD);
+      assert (sanei_magic_bandRotate (band, centerX, centerY, slope, BG)
+              == SANE_STATUS_GOOD);
+      assert (sanei_magic_bandDespeck (band, DIAM) == SANE_STATUS_GOOD);
+      process_bands (band, page, chunks[i]);
+      sanei_magic_bandFinish (band);
+
+      assert (memcmp (page, ref, WIDTH * HEIGHT) == 0);
+
+      /* the same with only the rows still needed kept */
+      memcpy (page, orig, WIDTH * HEIGHT);
+
+      assert (sanei_magic_bandStart (&band, &params, DPI, DPI)
+              == SANE_STATUS_GOOD);
+      assert (sanei_magic_bandRotate (band, centerX, centerY, slope, BG)
+              == SANE_STATUS_GOOD);
+      assert (sanei_magic_bandDespeck (band, DIAM) == SANE_STATUS_GOOD);
+      if (chunks[i] < HEIGHT / 4)
+        assert (process_window (band, &params, page, chunks[i]) < HEIGHT / 2);
+      else
+        process_window (band, &params, page, chunks[i]);
+      sanei_magic_bandFinish (band);
+
+      assert (memcmp (page, ref, WIDTH * HEIGHT) == 0);
+    }
+
+  free (orig);
+  free (page);
+  free (ref);
+  printf ("%s: ok\n", __func__);
+}
+
+/** the skew found from the top of the page must be close to the one
+ * found from the whole page, and be corrected the same way */
+static void
+test_band_deskew (void)
+{
+  SANE_Parameters params;
+  SANE_Byte *page = make_page ();
+  SANE_Byte *ref = make_page ();
+  sanei_magic_band *band;
+  int centerX, centerY, wholeX, wholeY;
+  double slope, wholeSlope;
+
+  init_params (&params);
+  assert (sanei_magic_findSkew (&params, ref, DPI, DPI, &wholeX, &wholeY,
+                                &wholeSlope) == SANE_STATUS_GOOD);
+
+  assert (sanei_magic_bandStart (&band, &params, DPI, DPI)
+          == SANE_STATUS_GOOD);
+  assert (sanei_magic_bandDeskew (band, BG) == SANE_STATUS_GOOD);
+  assert (sanei_magic_bandDespeck (band, DIAM) == SANE_STATUS_GOOD);
+
+  /* no skew before the top of the page has arrived */
+  assert (sanei_magic_bandGetSkew (band, &centerX, &centerY, &slope)
+          == SANE_STATUS_UNSUPPORTED);
+
+  process_bands (band, page, 16);
+  assert (sanei_magic_bandGetSkew (band, &centerX, &centerY, &slope)
+          == SANE_STATUS_GOOD);
+  sanei_magic_bandFinish (band);
+
+  assert (fabs (slope - wholeSlope) < 0.005);
+
+  whole_page (ref, centerX, centerY, slope);
+  assert (memcmp (page, ref, WIDTH * HEIGHT) == 0);
+
+  /* the top of the page is kept until the skew is found */
+  free (page);
+  page = make_page ();
+  assert (sanei_magic_bandStart (&band, &params, DPI, DPI)
+          == SANE_STATUS_GOOD);
+  assert (sanei_magic_bandDeskew (band, BG) == SANE_STATUS_GOOD);
+  assert (sanei_magic_bandDespeck (band, DIAM) == SANE_STATUS_GOOD);
+  assert (process_window (band, &params, page, 16) < HEIGHT);
+  sanei_magic_bandFinish (band);
+  assert (memcmp (page, ref, WIDTH * HEIGHT) == 0);
+
+  free (page);
+  free (ref);
+  printf ("%s: ok\n", __func__);
+}
+
+/* bilinear rotation in floating point, outside pixels are background */
+static SANE_Byte
+rotate_ref (SANE_Parameters * params, SANE_Byte * src, int i, int j, int k,
+            int centerX, int centerY, double slope)
+{
+  int depth = params->format == SANE_FRAME_RGB ? 3 : 1;
+  double a = -atan (slope);
+  double fx = centerX - centerX * cos (a) - (centerY - i) * sin (a)
+    + j * cos (a);
+  double fy = centerY - (centerY - i) * cos (a) + centerX * sin (a)
+    - j * sin (a);
+  int x0 = (int) floor (fx), y0 = (int) floor (fy);
+  double sum = 0;
+  int n;
+
+  if (fx <= -1 || fx >= params->pixels_per_line
+      || fy <= -1 || fy >= params->lines)
+    return BG;
+
+  for (n = 0; n < 4; n++)
+    {
+      int x = x0 + n % 2, y = y0 + n / 2;
+      double w = (n % 2 ? fx - x0 : 1 - (fx - x0))
+        * (n / 2 ? fy - y0 : 1 - (fy - y0));
+
+      if (x >= 0 && x < params->pixels_per_line && y >= 0
+          && y < params->lines)
+        sum += w * src[y * params->bytes_per_line + x * depth + k];
+      else
+        sum += w * BG;
+    }
+
+  return (SANE_Byte) floor (sum + 0.5);
+}
+
+/** bilinear rotation leaves an unrotated image alone, and matches a
+ * floating point reference, in gray and color */
+static void
+test_rotate2_bilinear (void)
+{
+  static const double slopes[] = { 0, SLOPE, -0.013 };
+  SANE_Byte *gray = make_page ();
+  SANE_Parameters params;
+  SANE_Byte *src, *dst;
+  unsigned int f, s;
+  int i, j, k;
+
+  for (f = 0; f < 2; f++)
+    {
+      int depth = f ? 3 : 1;
+
+      init_params (&params);
+      if (f)
+        {
+          params.format = SANE_FRAME_RGB;
+          params.bytes_per_line = WIDTH * 3;
+        }
+
+      /* color channels differ, so a mixup shows */
+      src = malloc (params.bytes_per_line * HEIGHT);
+      dst = malloc (params.bytes_per_line * HEIGHT);
+      assert (src && dst);
+      for (i = 0; i < HEIGHT * WIDTH; i++)
+        for (k = 0; k < depth; k++)
+          src[i * depth + k] = gray[i] ^ (k * 0x55);
+
+      for (s = 0; s < sizeof (slopes) / sizeof (slopes[0]); s++)
+        {
+          int maxdiff = 0;
+
+          memcpy (dst, src, params.bytes_per_line * HEIGHT);
+          assert (sanei_magic_rotate2 (&params, dst, WIDTH / 2 + 13,
+                                       HEIGHT / 2 - 7, slopes[s], BG, 1)
+                  == SANE_STATUS_GOOD);
+
+          if (slopes[s] == 0)
+            {
+              assert (memcmp (dst, src, params.bytes_per_line * HEIGHT)
+                      == 0);
+              continue;
+            }
+
+          for (i = 0; i < HEIGHT; i++)
+            for (j = 0; j < WIDTH; j++)
+              for (k = 0; k < depth; k++)
+                {
+                  int diff = dst[i * params.bytes_per_line + j * depth + k]
+                    - rotate_ref (&params, src, i, j, k, WIDTH / 2 + 13,
+                                  HEIGHT / 2 - 7, slopes[s]);
+
+                  if (abs (diff) > maxdiff)
+                    maxdiff = abs (diff);
+                }
+
+          /* weights are in 1/256 steps */
+          assert (maxdiff <= 2);
+        }
+
+      free (src);
+      free (dst);
+    }
+
+  free (gray);
+  printf ("%s: ok\n", __func__);
+}
+
+/* unskewed white paper, with bars of text if text is set, and dark
+ * square specks of 1 to 5 pixels, some close to the text, the edges
+ * and each other */
+static SANE_Byte *
+make_plain_page (int text)
+{
+  SANE_Byte *page = malloc (WIDTH * HEIGHT);
+  int x, y, n, k, l;
+
+  assert (page);
+  memset (page, 0xff, WIDTH * HEIGHT);
+  for (y = 0; text && y < HEIGHT; y++)
+    for (x = 60; x < WIDTH - 60; x++)
+      if ((y / 10) % 3 == 0 && y >= 40 && y < HEIGHT - 40)
+        page[y * WIDTH + x] = 0x20 + x % 7;
+
+  for (n = 0; n < 60; n++)
+    {
+      int size = 1 + n % 5;
+      int x0 = (n * 97 + n / 5 * 13) % (WIDTH - size);
+      int y0 = (n * 61 + n * n) % (HEIGHT - size);
+
+      for (k = 0; k < size; k++)
+        for (l = 0; l < size; l++)
+          page[(y0 + k) * WIDTH + x0 + l] = 0x10 + n;
+    }
+
+  return page;
+}
+
+enum
+{
+  FORMAT_GRAY,
+  FORMAT_RGB,
+  FORMAT_BINARY,
+  FORMATS
+};
+
+static const char *const format_names[] = { "gray", "RGB", "binary" };
+
+/* convert a gray page to the given format, binary is black below 0x80,
+ * dark colors differ per channel */
+static SANE_Byte *
+convert_page (SANE_Parameters * params, const SANE_Byte * gray, int format)
+{
+  SANE_Byte *page;
+  int i, k;
+
+  init_params (params);
+  if (format == FORMAT_RGB)
+    {
+      params->format = SANE_FRAME_RGB;
+      params->bytes_per_line = WIDTH * 3;
+    }
+  else if (format == FORMAT_BINARY)
+    {
+      params->depth = 1;
+      params->bytes_per_line = (WIDTH + 7) / 8;
+    }
+
+  page = calloc (params->bytes_per_line, HEIGHT);
+  assert (page);
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    {
+      int x = i % WIDTH, y = i / WIDTH;
+
+      if (format == FORMAT_GRAY)
+        page[i] = gray[i];
+      else if (format == FORMAT_RGB)
+        for (k = 0; k < 3; k++)
+          page[i * 3 + k] = gray[i] < 0x80 ? gray[i] + k * 0x11 : gray[i];
+      else if (gray[i] < 0x80)
+        page[y * params->bytes_per_line + x / 8] |= 0x80 >> (x % 8);
+    }
+  return page;
+}
+
+/** despeck band by band must match the whole page result, whatever
+ * the band size, for each format and dot size */
+static void
+test_band_despeck (void)
+{
+  static const int chunks[] = { 1, 7, 64, HEIGHT };
+  static const int diams[] = { 3, 5 };
+  SANE_Byte *gray = make_plain_page (1);
+  SANE_Parameters params;
+  unsigned int d, i;
+  int f;
+
+  for (f = 0; f < FORMATS; f++)
+    for (d = 0; d < sizeof (diams) / sizeof (diams[0]); d++)
+      {
+        SANE_Byte *orig = convert_page (&params, gray, f);
+        int size = params.bytes_per_line * HEIGHT;
+        SANE_Byte *ref = malloc (size);
+        SANE_Byte *page = malloc (size);
+
+        assert (ref && page);
+        memcpy (ref, orig, size);
+        assert (sanei_magic_despeck (&params, ref, diams[d])
+                == SANE_STATUS_GOOD);
+
+        /* there were specks to remove */
+        assert (memcmp (ref, orig, size) != 0);
+
+        for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++)
+          {
+            sanei_magic_band *band;
+
+            memcpy (page, orig, size);
+            assert (sanei_magic_bandStart (&band, &params, DPI, DPI)
+                    == SANE_STATUS_GOOD);
+            assert (sanei_magic_bandDespeck (band, diams[d])
+                    == SANE_STATUS_GOOD);
+            process_bands (band, page, chunks[i]);
+            sanei_magic_bandFinish (band);
+
+            assert (memcmp (page, ref, size) == 0);
+
+            memcpy (page, orig, size);
+            assert (sanei_magic_bandStart (&band, &params, DPI, DPI)
+                    == SANE_STATUS_GOOD);
+            assert (sanei_magic_bandDespeck (band, diams[d])
+                    == SANE_STATUS_GOOD);
+            process_window (band, &params, page, chunks[i]);
+            sanei_magic_bandFinish (band);
+
+            assert (memcmp (page, ref, size) == 0);
+          }
+
+        printf ("%s: %s diam %d: ok\n", __func__, format_names[f],
+                diams[d]);
+        free (orig);
+        free (ref);
+        free (page);
+      }
+
+  free (gray);
+}
+
+/** a page with a few specks is blank, one with text isn't, for the
+ * whole page and band by band, whatever the band size */
+static void
+test_band_blank (void)
+{
+  static const int chunks[] = { 1, 7, 64, HEIGHT };
+  SANE_Parameters params;
+  int f, text;
+  unsigned int i;
+
+  for (text = 0; text < 2; text++)
+    {
+      SANE_Byte *gray = make_plain_page (text);
+      SANE_Status expected = text ? SANE_STATUS_GOOD : SANE_STATUS_NO_DOCS;
+
+      for (f = 0; f < FORMATS; f++)
+        {
+          SANE_Byte *page = convert_page (&params, gray, f);
+
+          assert (sanei_magic_isBlank2 (&params, page, DPI, DPI, 5.0)
+                  == expected);
+
+          for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++)
+            {
+              sanei_magic_band *band;
+
+              assert (sanei_magic_bandStart (&band, &params, DPI, DPI)
+                      == SANE_STATUS_GOOD);
+              assert (sanei_magic_bandBlank (band, 5.0) == SANE_STATUS_GOOD);
+
+              /* no result before all rows are finished */
+              assert (sanei_magic_bandIsBlank (band) == SANE_STATUS_INVAL);
+
+              process_bands (band, page, chunks[i]);
+              assert (sanei_magic_bandIsBlank (band) == expected);
+              sanei_magic_bandFinish (band);
+            }
+
+          printf ("%s: %s %s: ok\n", __func__, format_names[f],
+                  text ? "text" : "blank");
+          free (page);
+        }
+      free (gray);
+    }
+}
+
+int
+main (void)
+{
+  test_band_rotate ();
+  test_band_deskew ();
+  test_rotate2_bilinear ();
+  test_band_despeck ();
+  test_band_blank ();
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
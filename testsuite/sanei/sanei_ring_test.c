@@ -0,0 +1,233 @@
+#include "../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+/* sane includes for the sanei functions called */
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_thread.h"
+#include "../include/sane/sanei_ring.h"
+
+/* much more data than fits into the ring */
+#define RING_SIZE 4096
+#define IMAGE_SIZE (RING_SIZE * 64 + 123)
+
+struct writer
+{
+  SANEI_Ring *ring;
+  size_t chunk;                 /* write size, 0 for get_space/commit */
+  SANE_Status end;              /* returned after the data */
+};
+
+static SANE_Byte
+pattern (size_t pos)
+{
+  return (SANE_Byte) (pos * 7 + pos / 251);
+}
+
+static int
+writer_task (void *args)
+{
+  struct writer *w = args;
+  SANE_Byte buf[1000];
+  SANE_Byte *space;
+  size_t pos = 0, count, i;
+  SANE_Status status;
+
+  while (pos < IMAGE_SIZE)
+    {
+      if (w->chunk)
+        {
+          count = w->chunk;
+          if (count > IMAGE_SIZE - pos)
+            count = IMAGE_SIZE - pos;
+          for (i = 0; i < count; i++)
+            buf[i] = pattern (pos + i);
+          status = sanei_ring_write (w->ring, buf, count);
+          if (status != SANE_STATUS_GOOD)
+            return status;
+        }
+      else
+        {
+          status = sanei_ring_get_space (w->ring, &space, &count);
+          if (status != SANE_STATUS_GOOD)
+            return status;
+          assert (count > 0 && count <= RING_SIZE);
+          if (count > IMAGE_SIZE - pos)
+            count = IMAGE_SIZE - pos;
+          for (i = 0; i < count; i++)
+            space[i] = pattern (pos + i);
+          sanei_ring_commit (w->ring, count);
+        }
+      pos += count;
+    }
+  return w->end;
+}
+
+/** read everything, checking the data, and return the final status
+ */
+static SANE_Status
+read_all (SANEI_Ring * ring, SANE_Int max_len, SANE_Bool non_blocking)
+{
+  SANE_Byte buf[3000];
+  SANE_Status status;
+  SANE_Int len, i;
+  size_t pos = 0;
+  fd_set set;
+  int fd;
+
+  sanei_ring_set_io_mode (ring, non_blocking);
+  fd = sanei_ring_get_select_fd (ring);
+  assert (fd >= 0);
+
+  for (;;)
+    {
+      if (non_blocking)
+        {
+          FD_ZERO (&set);
+          FD_SET (fd, &set);
+          assert (select (fd + 1, &set, NULL, NULL, NULL) == 1);
+        }
+
+      status = sanei_ring_read (ring, buf, max_len, &len);
+      if (status != SANE_STATUS_GOOD)
+        {
+          assert (len == 0);
+          break;
+        }
+      assert (len <= max_len);
+      assert (len > 0 || non_blocking);
+      for (i = 0; i < len; i++)
+        assert (buf[i] == pattern (pos + i));
+      pos += len;
+    }
+
+  assert (pos == IMAGE_SIZE);
+  return status;
+}
+
+static void
+check_transfer (size_t chunk, SANE_Int max_len, SANE_Bool non_blocking)
+{
+  struct writer w;
+  SANE_Byte buf[10];
+  SANE_Int len;
+  SANE_Status status;
+  SANE_Pid pid;
+  int ret;
+
+  printf ("%s: chunk %lu, max_len %d, non_blocking %d\n", __func__,
+          (unsigned long) chunk, max_len, non_blocking);
+
+  status = sanei_ring_create (&w.ring, RING_SIZE);
+  assert (status == SANE_STATUS_GOOD);
+  w.chunk = chunk;
+  w.end = SANE_STATUS_GOOD;
+
+  pid = sanei_ring_begin (w.ring, writer_task, &w);
+  assert (sanei_thread_is_valid (pid));
+
+  status = read_all (w.ring, max_len, non_blocking);
+  assert (status == SANE_STATUS_EOF);
+
+  /* EOF stays */
+  assert (sanei_ring_read (w.ring, buf, sizeof (buf), &len)
+          == SANE_STATUS_EOF);
+
+  pid = sanei_thread_waitpid (pid, &ret);
+  assert (sanei_thread_is_valid (pid));
+  assert (ret == SANE_STATUS_GOOD);
+
+  sanei_ring_free (w.ring);
+}
+
+/** an error ends the image after the data written before
+ */
+static void
+check_error (void)
+{
+  struct writer w;
+  SANE_Status status;
+  SANE_Pid pid;
+  int ret;
+
+  printf ("%s\n", __func__);
+
+  status = sanei_ring_create (&w.ring, RING_SIZE);
+  assert (status == SANE_STATUS_GOOD);
+  w.chunk = 1000;
+  w.end = SANE_STATUS_JAMMED;
+
+  pid = sanei_ring_begin (w.ring, writer_task, &w);
+  assert (sanei_thread_is_valid (pid));
+
+  status = read_all (w.ring, 3000, SANE_FALSE);
+  assert (status == SANE_STATUS_JAMMED);
+
+  pid = sanei_thread_waitpid (pid, &ret);
+  assert (ret == SANE_STATUS_JAMMED);
+
+  sanei_ring_free (w.ring);
+}
+
+/** a writer blocked on a full ring returns once cancelled
+ */
+static void
+check_cancel (void)
+{
+  struct writer w;
+  SANE_Byte buf[100];
+  SANE_Status status;
+  SANE_Pid pid;
+  SANE_Int len;
+  int ret;
+
+  printf ("%s\n", __func__);
+
+  status = sanei_ring_create (&w.ring, RING_SIZE);
+  assert (status == SANE_STATUS_GOOD);
+  w.chunk = 1000;
+  w.end = SANE_STATUS_GOOD;
+
+  pid = sanei_ring_begin (w.ring, writer_task, &w);
+  assert (sanei_thread_is_valid (pid));
+
+  status = sanei_ring_read (w.ring, buf, sizeof (buf), &len);
+  assert (status == SANE_STATUS_GOOD && len > 0);
+
+  sanei_ring_cancel (w.ring);
+
+  pid = sanei_thread_waitpid (pid, &ret);
+  assert (sanei_thread_is_valid (pid));
+  assert (ret == SANE_STATUS_CANCELLED);
+
+  sanei_ring_free (w.ring);
+}
+
+int
+main (void)
+{
+  sanei_thread_init ();
+
+  check_transfer (1000, 3000, SANE_FALSE);
+  check_transfer (1000, 1, SANE_FALSE);
+  check_transfer (0, 2999, SANE_FALSE);
+  check_transfer (1, 3000, SANE_TRUE);
+  check_transfer (0, 17, SANE_TRUE);
+  check_error ();
+  check_cancel ();
+
+  return 0;
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
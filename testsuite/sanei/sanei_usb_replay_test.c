@@ -0,0 +1,269 @@
+#include "../../include/sane/config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define BACKEND_NAME	sanei_usb
+
+/* sane includes for the sanei functions called */
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_backend.h"
+#include "../include/sane/sanei_usb.h"
+
+/*
+ * The recorder needs an opened device, so we include sanei_usb.c to
+ * mock one and feed the recording functions directly.
+ */
+#include "../../sanei/sanei_usb.c"
+
+#define XSTR(s) STR(s)
+#define STR(s) #s
+#define DATA_PATH XSTR(TESTSUITE_SANEI_SRCDIR) "/data"
+
+#define CAPTURE_PATH DATA_PATH "/usb_replay.xml"
+#define REPLAY_LOG_PATH "sanei_usb_replay_test.log"
+#define STREAM_PATH "sanei_usb_replay_test.stream"
+#define STREAM_XML_PATH "sanei_usb_replay_test.xml"
+
+/** replays data/usb_replay.xml from the given file
+ * @param path XML capture or compiled replay log
+ * @param async whether to read the bulk data through queued reads
+ */
+static void
+replay_capture (const char *path, int async)
+{
+  SANE_Status status;
+  SANE_Int dn;
+  SANE_Byte data[16];
+  size_t size;
+  struct sanei_usb_dev_descriptor desc;
+  struct sanei_usb_stats stats;
+  unsigned long count;
+  int i;
+  char *backend;
+
+  printf ("%s: replaying %s%s\n", __func__, path,
+          async ? " with queued reads" : "");
+
+  status = sanei_usb_testing_enable_replay (path, 0);
+  assert (status == SANE_STATUS_GOOD);
+
+  sanei_usb_init ();
+
+  backend = sanei_usb_testing_get_backend ();
+  assert (backend != NULL);
+  assert (strcmp (backend, "test") == 0);
+  free (backend);
+
+  status = sanei_usb_open (path, &dn);
+  assert (status == SANE_STATUS_GOOD);
+
+  data[0] = 0x01;
+  data[1] = 0x02;
+  status = sanei_usb_control_msg (dn, 0x40, 0x0c, 0x83, 0, 2, data);
+  assert (status == SANE_STATUS_GOOD);
+
+  memset (data, 0, sizeof (data));
+  status = sanei_usb_control_msg (dn, 0xc0, 0x0c, 0x84, 0, 4, data);
+  assert (status == SANE_STATUS_GOOD);
+  assert (memcmp (data, "\xde\xad\xbe\xef", 4) == 0);
+
+  size = 3;
+  status = sanei_usb_write_bulk (dn, (const SANE_Byte *) "\x10\x20\x30",
+                                 &size);
+  assert (status == SANE_STATUS_GOOD);
+  assert (size == 3);
+
+  if (async)
+    {
+      status = sanei_usb_submit_bulk_reads (dn, 2, 4);
+      assert (status == SANE_STATUS_GOOD);
+
+      /* the buffer must hold a whole read */
+      size = 2;
+      status = sanei_usb_reap_bulk_read (dn, data, &size);
+      assert (status == SANE_STATUS_INVAL);
+
+      memset (data, 0, sizeof (data));
+      size = sizeof (data);
+      status = sanei_usb_reap_bulk_read (dn, data, &size);
+      assert (status == SANE_STATUS_GOOD);
+      assert (size == 4);
+      assert (memcmp (data, "\x00\x01\x02\x03", 4) == 0);
+
+      size = sizeof (data);
+      status = sanei_usb_reap_bulk_read (dn, data, &size);
+      assert (status == SANE_STATUS_GOOD);
+      assert (size == 2);
+      assert (memcmp (data, "\x04\x05", 2) == 0);
+
+      /* cancelled reads don't touch the capture */
+      status = sanei_usb_submit_bulk_reads (dn, 3, 4);
+      assert (status == SANE_STATUS_GOOD);
+      sanei_usb_cancel_bulk_reads (dn);
+      size = sizeof (data);
+      status = sanei_usb_reap_bulk_read (dn, data, &size);
+      assert (status == SANE_STATUS_INVAL);
+
+      status = sanei_usb_submit_bulk_reads (dn, SANEI_USB_MAX_ASYNC_READS + 1,
+                                            4);
+      assert (status == SANE_STATUS_INVAL);
+    }
+  else
+    {
+      /* the two recorded IN packets are merged into a single transfer */
+      memset (data, 0, sizeof (data));
+      size = 6;
+      status = sanei_usb_read_bulk (dn, data, &size);
+      assert (status == SANE_STATUS_GOOD);
+      assert (size == 6);
+      assert (memcmp (data, "\x00\x01\x02\x03\x04\x05", 6) == 0);
+    }
+
+  sanei_usb_testing_record_message ("page done");
+
+  size = 8;
+  status = sanei_usb_read_int (dn, data, &size);
+  assert (status == SANE_STATUS_GOOD);
+  assert (size == 1);
+  assert (data[0] == 0x55);
+
+  size = 8;
+  status = sanei_usb_read_int (dn, data, &size);
+  assert (status == SANE_STATUS_IO_ERROR);
+
+  status = sanei_usb_get_descriptor (dn, &desc);
+  assert (status == SANE_STATUS_GOOD);
+  assert (desc.bcd_usb == 0x200);
+  assert (desc.bcd_dev == 0x100);
+  assert (desc.max_packet_size == 0x40);
+
+  status = sanei_usb_get_stats (dn, &stats);
+  assert (status == SANE_STATUS_GOOD);
+  assert (stats.control_out.transfers == 1);
+  assert (stats.control_out.bytes == 2);
+  assert (stats.control_in.transfers == 1);
+  assert (stats.control_in.bytes == 4);
+  assert (stats.bulk_out.transfers == 1);
+  assert (stats.bulk_out.bytes == 3);
+  assert (stats.bulk_in.transfers == (async ? 2 : 1));
+  assert (stats.bulk_in.bytes == 6);
+  assert (stats.int_in.transfers == 2);
+  assert (stats.int_in.bytes == 1);
+  assert (stats.int_in.errors == 1);
+  for (i = 0, count = 0; i < SANEI_USB_LATENCY_BUCKETS; i++)
+    count += stats.int_in.latency[i];
+  assert (count == 2);
+
+  sanei_usb_reset_stats (dn);
+  status = sanei_usb_get_stats (dn, &stats);
+  assert (status == SANE_STATUS_GOOD);
+  assert (stats.int_in.transfers == 0);
+
+  /* the capture is exhausted */
+  size = 3;
+  status = sanei_usb_write_bulk (dn, (const SANE_Byte *) "\x10\x20\x30",
+                                 &size);
+  assert (status == SANE_STATUS_IO_ERROR);
+
+  sanei_usb_close (dn);
+  sanei_usb_exit ();
+}
+
+#if WITH_USB_RECORD_REPLAY
+/** records the transactions of data/usb_replay.xml in streaming mode
+ */
+static void
+record_stream (void)
+{
+  SANE_Status status;
+  SANE_Int dn;
+  struct sanei_usb_dev_descriptor desc;
+
+  printf ("%s: recording %s\n", __func__, STREAM_PATH);
+
+  status = sanei_usb_testing_enable_stream_record (STREAM_PATH, "test");
+  assert (status == SANE_STATUS_GOOD);
+
+  sanei_usb_init ();
+
+  /* mock the device the backend would have opened */
+  dn = device_number++;
+  memset (&devices[dn], 0, sizeof (devices[dn]));
+  devices[dn].devname = strdup ("mock");
+  devices[dn].vendor = 0x04a9;
+  devices[dn].product = 0x1234;
+  devices[dn].bulk_in_ep = 0x81;
+  devices[dn].bulk_out_ep = 0x02;
+  devices[dn].int_in_ep = 0x83;
+  sanei_usb_record_open (dn);
+
+  sanei_usb_record_control_msg (NULL, dn, 0x40, 0x0c, 0x83, 0, 2,
+                                (const SANE_Byte *) "\x01\x02");
+  sanei_usb_record_control_msg (NULL, dn, 0xc0, 0x0c, 0x84, 0, 4,
+                                (const SANE_Byte *) "\xde\xad\xbe\xef");
+  sanei_usb_record_write_bulk (NULL, dn, (const SANE_Byte *) "\x10\x20\x30",
+                               3, 3);
+  sanei_usb_record_read_bulk (NULL, dn, (SANE_Byte *) "\x00\x01\x02\x03",
+                              6, 4);
+  sanei_usb_record_read_bulk (NULL, dn, (SANE_Byte *) "\x04\x05", 2, 2);
+  sanei_usb_testing_record_message ("page done");
+  sanei_usb_record_read_int (NULL, dn, (SANE_Byte *) "\x55", 8, 1);
+  sanei_usb_record_read_int (NULL, dn, NULL, 8, -1);
+
+  memset (&desc, 0, sizeof (desc));
+  desc.desc_type = 1;
+  desc.bcd_usb = 0x200;
+  desc.bcd_dev = 0x100;
+  desc.max_packet_size = 0x40;
+  sanei_usb_record_get_descriptor (dn, &desc);
+
+  sanei_usb_exit ();
+  testing_mode = sanei_usb_testing_mode_disabled;
+}
+#endif
+
+int
+main (void)
+{
+#if WITH_USB_RECORD_REPLAY
+  SANE_Status status;
+
+  replay_capture (CAPTURE_PATH, 0);
+  replay_capture (CAPTURE_PATH, 1);
+
+  status = sanei_usb_testing_compile_replay_log (CAPTURE_PATH,
+                                                 REPLAY_LOG_PATH);
+  assert (status == SANE_STATUS_GOOD);
+
+  replay_capture (REPLAY_LOG_PATH, 0);
+  replay_capture (REPLAY_LOG_PATH, 1);
+
+  /* development mode needs the XML capture */
+  status = sanei_usb_testing_enable_replay (REPLAY_LOG_PATH, 1);
+  assert (status == SANE_STATUS_INVAL);
+
+  unlink (REPLAY_LOG_PATH);
+
+  /* a streamed recording converts to an equivalent capture */
+  record_stream ();
+  status = sanei_usb_testing_convert_stream_record (STREAM_PATH,
+                                                    STREAM_XML_PATH);
+  assert (status == SANE_STATUS_GOOD);
+
+  replay_capture (STREAM_XML_PATH, 0);
+
+  unlink (STREAM_PATH);
+  unlink (STREAM_XML_PATH);
+  return 0;
+#else
+  printf ("USB record-replay mode support is missing, skipping\n");
+  return 77;
+#endif
+}
+
+/* vim: set sw=2 cino=>2se-1sn-1s{s^-1st0(0u0 smarttab expandtab: */
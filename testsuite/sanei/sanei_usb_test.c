@@ -31,6 +31,12 @@
 
 #include "../../include/_stdint.h"
 
+#ifdef HAVE_LIBUSB
+/* libusb event handling is replaced to test its error path */
+#define libusb_handle_events_completed mock_handle_events_completed
+#define libusb_cancel_transfer mock_cancel_transfer
+#endif
+
 /*
  * In order to avoid modifying sanei_usb.c to allow for unit tests
  * we include it so we can use its private variables and structures
@@ -38,6 +44,33 @@
  */
 #include "../../sanei/sanei_usb.c"
 
+#ifdef HAVE_LIBUSB
+static int mock_events_calls = 0;
+static int mock_cancel_calls = 0;
+
+/* interrupted once, then failing for good */
+int LIBUSB_CALL
+mock_handle_events_completed (libusb_context * ctx, int *completed)
+{
+  (void) ctx;
+  (void) completed;
+
+  mock_events_calls++;
+  assert (mock_events_calls < 100);
+  return mock_events_calls == 1 ? LIBUSB_ERROR_INTERRUPTED
+    : LIBUSB_ERROR_IO;
+}
+
+int LIBUSB_CALL
+mock_cancel_transfer (struct libusb_transfer *transfer)
+{
+  (void) transfer;
+
+  mock_cancel_calls++;
+  return 0;
+}
+#endif
+
 
 /** test sanei_usb_init()
  * calls sanei_usb_init
@@ -268,6 +301,149 @@ test_store_device (void)
   return 1;
 }
 
+#ifdef SANEI_USB_HOTPLUG
+/** test hotplug event queue
+ * feed synthetic departures through the hotplug queue and check
+ * the slots of open and closed devices, then overflow the queue
+ * @return 1 on success, else 0
+ */
+static int
+test_hotplug_events (void)
+{
+  device_list_type mock;
+  int enabled = hotplug_enabled;
+  int closed_dn, open_dn;
+  int i;
+
+  hotplug_enabled = 1;
+
+  create_mock_device ("libusb:001:042", &mock);
+  closed_dn = device_number;
+  store_device (mock);
+  create_mock_device ("libusb:001:043", &mock);
+  open_dn = device_number;
+  store_device (mock);
+  devices[open_dn].open = SANE_TRUE;
+
+  /* departures carry no device reference, only its location */
+  sanei_usb_hotplug_queue (NULL, LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 1, 42);
+  sanei_usb_hotplug_queue (NULL, LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 1, 43);
+  if (!libusb_hotplug_scan_devices () || hotplug_event_count != 0)
+    {
+      printf ("ERROR: hotplug events not handled!\n");
+      return 0;
+    }
+  if (devices[closed_dn].missing != 2)
+    {
+      printf ("ERROR: slot of closed device not reusable!\n");
+      return 0;
+    }
+  if (devices[open_dn].missing != 1)
+    {
+      printf ("ERROR: slot of open device not kept!\n");
+      return 0;
+    }
+
+  /* closing must free the slot, use the kernel driver method so
+   * that there's no libusb handle to close */
+  devices[open_dn].method = sanei_usb_method_scanner_driver;
+  devices[open_dn].fd = -1;
+  sanei_usb_close (open_dn);
+  if (devices[open_dn].missing != 2)
+    {
+      printf ("ERROR: slot of closed device not reusable!\n");
+      return 0;
+    }
+
+  /* too many events must ask for a full rescan and empty the queue */
+  for (i = 0; i <= MAX_HOTPLUG_EVENTS; i++)
+    sanei_usb_hotplug_queue (NULL, i & 1 ? LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT
+			     : LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, 1, i);
+  if (libusb_hotplug_scan_devices ()
+      || hotplug_event_count != 0 || hotplug_overflow)
+    {
+      printf ("ERROR: hotplug queue overflow not handled!\n");
+      return 0;
+    }
+
+  /* remove mock devices */
+  for (i = closed_dn; i <= open_dn; i++)
+    {
+      free (devices[i].devname);
+      devices[i].devname = NULL;
+    }
+  device_number = closed_dn;
+  hotplug_enabled = enabled;
+
+  return 1;
+}
+#endif
+
+#ifdef HAVE_LIBUSB
+/** test reaping a queued read when libusb can't handle events
+ * the read must fail and its transfer be cancelled instead of
+ * waiting forever
+ * @return 1 on success, else 0
+ */
+static int
+test_async_events_error (void)
+{
+  device_list_type mock;
+  struct libusb_transfer *transfer;
+  SANE_Byte buffer[64];
+  size_t size = sizeof (buffer);
+  SANE_Status status;
+  int dn;
+
+  create_mock_device ("mock-async", &mock);
+  mock.bulk_in_ep = 0x81;
+  mock.open = SANE_TRUE;
+  dn = device_number;
+  store_device (mock);
+
+  /* a read in flight, as sanei_usb_async_submit() leaves it */
+  transfer = calloc (1, sizeof (*transfer));
+  devices[dn].async_reads = calloc (SANEI_USB_MAX_ASYNC_READS,
+                                    sizeof (sanei_usb_async_read));
+  assert (transfer && devices[dn].async_reads);
+  devices[dn].async_reads[0].transfer = transfer;
+  devices[dn].async_reads[0].size = sizeof (buffer);
+  devices[dn].async_count = 1;
+
+  mock_events_calls = 0;
+  mock_cancel_calls = 0;
+  status = sanei_usb_reap_bulk_read (dn, buffer, &size);
+  if (status != SANE_STATUS_IO_ERROR || size != 0)
+    {
+      printf ("ERROR: failed event handling not reported!\n");
+      return 0;
+    }
+  if (mock_events_calls != 2 || mock_cancel_calls != 1)
+    {
+      printf ("ERROR: transfer not cancelled after %d calls!\n",
+              mock_events_calls);
+      return 0;
+    }
+  /* the transfer now frees itself once libusb completes it */
+  if (transfer->callback != sanei_usb_async_abandoned_callback
+      || devices[dn].async_count != 0)
+    {
+      printf ("ERROR: transfer not abandoned!\n");
+      return 0;
+    }
+
+  /* remove mock device */
+  free (transfer);
+  free (devices[dn].async_reads);
+  devices[dn].async_reads = NULL;
+  free (devices[dn].devname);
+  devices[dn].devname = NULL;
+  device_number = dn;
+
+  return 1;
+}
+#endif
+
 /** return count of opened devices
  * @return count of opened devices
  */
@@ -868,6 +1044,16 @@ main (int __sane_unused__ argc, char **argv)
   /* test corner cases with mock device */
   assert (test_store_device ());
 
+#ifdef HAVE_LIBUSB
+  /* test failing event handling for queued reads */
+  assert (test_async_events_error ());
+#endif
+
+#ifdef SANEI_USB_HOTPLUG
+  /* test hotplug events with mock devices */
+  assert (test_hotplug_events ());
+#endif
+
   /* get vendor/product id for all available devices devname */
   assert (test_vendor_by_devname ());
 
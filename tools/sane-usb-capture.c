@@ -0,0 +1,78 @@
+/* sane-usb-capture.c
+
+   Copyright (C) 2026 Sane Developers.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   Converts USB captures made by the sanei_usb record mode.
+ */
+
+#include "../include/sane/config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../include/sane/sane.h"
+#include "../include/sane/sanei.h"
+#include "../include/sane/sanei_usb.h"
+
+static const char *prog_name;
+
+static void
+usage (void)
+{
+  fprintf (stderr, "Usage: %s COMMAND INPUT OUTPUT\n", prog_name);
+  fprintf (stderr, "Commands:\n");
+  fprintf (stderr, "\tcompile: compile an XML capture into a replay log "
+	   "for fast replay\n");
+  fprintf (stderr, "\tto-xml: convert a streamed recording into an XML "
+	   "capture\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  SANE_Status status;
+
+  prog_name = strrchr (argv[0], '/');
+  if (prog_name)
+    ++prog_name;
+  else
+    prog_name = argv[0];
+
+  if (argc != 4)
+    {
+      usage ();
+      return 1;
+    }
+
+  if (strcmp (argv[1], "compile") == 0)
+    status = sanei_usb_testing_compile_replay_log (argv[2], argv[3]);
+  else if (strcmp (argv[1], "to-xml") == 0)
+    status = sanei_usb_testing_convert_stream_record (argv[2], argv[3]);
+  else
+    {
+      usage ();
+      return 1;
+    }
+
+  if (status != SANE_STATUS_GOOD)
+    {
+      fprintf (stderr, "%s: %s failed: %s\n", prog_name, argv[1],
+	       sane_strstatus (status));
+      return 1;
+    }
+  return 0;
+}